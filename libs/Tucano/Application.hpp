@@ -0,0 +1,398 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __APPLICATION__
+#define __APPLICATION__
+
+#include "Context.hpp"
+#include "DeletionQueue.hpp"
+#include "CameraBlock.hpp"
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace Tucano
+{
+
+/**
+ * @brief Application main loop with a fixed timestep simulation decoupled from rendering.
+ *
+ * Derived classes implement update, called at a fixed rate with a constant time step (camera movement,
+ * animation, physics), and render, called once per frame with the fraction of a step elapsed since the
+ * last update, to interpolate. Input is processed once per frame before the updates. Rendering is paced by
+ * the swap interval (vsync), an optional frame rate limit and a limit on the frames queued to the GPU,
+ * which bounds the input latency when the GPU is the bottleneck.
+ *
+ *     class Viewer : public Tucano::Application {
+ *         void update (double dt) { if (forward_key_down) flycamera.moveForward(); }
+ *         void render (double alpha) { ... }
+ *     };
+ *     Viewer viewer (context);
+ *     viewer.run();
+ *
+ * Camera movements that step by a fixed amount per call (ex. Flycamera::moveForward) then move at the same
+ * speed whatever the frame rate.
+ */
+class Application {
+
+public:
+
+    /// Frame time statistics, in milliseconds.
+    struct FrameStats
+    {
+        /// Frames measured.
+        unsigned long frames;
+        /// Frame to frame times over the history.
+        double average_ms, min_ms, max_ms, p99_ms;
+        /// Average frames per second over the history.
+        double fps;
+        /// Total fixed updates.
+        unsigned long updates;
+        /// Updates skipped because the simulation could not keep up.
+        unsigned long dropped_updates;
+        /// Frames that waited for the GPU because of the frame latency limit.
+        unsigned long latency_waits;
+    };
+
+    /**
+     * @brief Constructs the application on an initialized context.
+     * @param ctx Context, current in the calling thread.
+     */
+    Application (Context& ctx) : context(ctx), timestep(1.0/60.0), max_updates(8), swap_interval(1),
+                                 max_frames_in_flight(2), min_frame_time(0.0), history_size(240),
+                                 frames(0), updates(0), dropped_updates(0), latency_waits(0), simulation_time(0.0)
+    {
+        context.setSwapInterval(swap_interval);
+    }
+
+    /**
+     * @brief Default destructor.
+     */
+    virtual ~Application (void)
+    {
+        releaseFences();
+    }
+
+    /**
+     * @brief Called once by run before the loop starts.
+     * @return False to abort.
+     */
+    virtual bool initialize (void)
+    {
+        return true;
+    }
+
+    /**
+     * @brief Called once per frame, after the window events were polled and before the updates.
+     */
+    virtual void processInput (void) {}
+
+    /**
+     * @brief Advances the simulation by a fixed time step.
+     * @param dt Time step in seconds (see setFixedTimestep).
+     */
+    virtual void update (double dt) = 0;
+
+    /**
+     * @brief Renders a frame.
+     * @param alpha Fraction of a time step elapsed since the last update, in [0,1), to interpolate states.
+     */
+    virtual void render (double alpha) = 0;
+
+    /**
+     * @brief Called once by run after the loop ends.
+     */
+    virtual void finalize (void) {}
+
+    /**
+     * @brief Runs the loop until the context should close.
+     */
+    void run (void)
+    {
+        if (!initialize())
+        {
+            return;
+        }
+        typedef std::chrono::steady_clock Clock;
+        Clock::time_point previous = Clock::now();
+        double accumulator = 0.0;
+
+        while (!context.shouldClose())
+        {
+            Clock::time_point frame_start = Clock::now();
+            double elapsed = std::chrono::duration<double>(frame_start - previous).count();
+            previous = frame_start;
+            recordFrameTime(elapsed);
+
+            context.pollEvents();
+            processInput();
+
+            accumulator += elapsed;
+            int steps = 0;
+            while (accumulator >= timestep && steps < max_updates)
+            {
+                update(timestep);
+                simulation_time += timestep;
+                accumulator -= timestep;
+                ++steps;
+                ++updates;
+            }
+            if (accumulator >= timestep)
+            {
+                // too far behind (ex. after a stall): drop the remaining steps instead of spiraling
+                unsigned long behind = (unsigned long)(accumulator / timestep);
+                dropped_updates += behind;
+                accumulator -= behind * timestep;
+            }
+
+            context.updateViewport();
+            render(accumulator / timestep);
+            context.swapBuffers();
+            limitFramesInFlight();
+            DeletionQueue::Instance().fence();
+            DeletionQueue::Instance().collect();
+            ++frames;
+
+            if (min_frame_time > 0.0)
+            {
+                Clock::time_point deadline = frame_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(min_frame_time));
+                std::this_thread::sleep_until(deadline);
+            }
+        }
+        releaseFences();
+        finalize();
+        cameraBlock.release();
+        DeletionQueue::Instance().flush();
+    }
+
+    /**
+     * @brief Sets the simulation time step.
+     * @param seconds Time step in seconds (default 1/60).
+     */
+    void setFixedTimestep (double seconds)
+    {
+        timestep = std::max(seconds, 1e-6);
+    }
+
+    /**
+     * @brief Sets the maximum number of updates per frame, further steps are dropped.
+     * @param count Maximum updates (default 8).
+     */
+    void setMaxUpdatesPerFrame (int count)
+    {
+        max_updates = std::max(count, 1);
+    }
+
+    /**
+     * @brief Sets the swap interval, 0 disables vsync.
+     * @param interval Number of vertical syncs per swap (default 1).
+     */
+    void setSwapInterval (int interval)
+    {
+        swap_interval = interval;
+        context.setSwapInterval(interval);
+    }
+
+    /**
+     * @brief Limits the number of frames queued to the GPU, waiting on a fence of an older frame after each swap.
+     * @param count Maximum frames in flight (default 2), 0 disables the limit.
+     */
+    void setMaxFramesInFlight (int count)
+    {
+        max_frames_in_flight = std::max(count, 0);
+    }
+
+    /**
+     * @brief Caps the frame rate by sleeping, ex. for headless contexts or vsync off.
+     * @param fps Maximum frames per second, 0 for no limit.
+     */
+    void setFrameRateLimit (double fps)
+    {
+        min_frame_time = fps > 0.0 ? 1.0 / fps : 0.0;
+    }
+
+    /**
+     * @brief Sets the number of frames kept for the statistics.
+     * @param count Number of frames (default 240).
+     */
+    void setStatsHistorySize (unsigned int count)
+    {
+        history_size = std::max(count, 1u);
+        while (frame_times.size() > history_size)
+        {
+            frame_times.pop_front();
+        }
+    }
+
+    /**
+     * @brief Returns the simulation time in seconds, sum of all time steps.
+     */
+    double getSimulationTime (void) const
+    {
+        return simulation_time;
+    }
+
+    /**
+     * @brief Returns the frame statistics over the history.
+     */
+    FrameStats getStats (void) const
+    {
+        FrameStats stats;
+        stats.frames = frames;
+        stats.updates = updates;
+        stats.dropped_updates = dropped_updates;
+        stats.latency_waits = latency_waits;
+        stats.average_ms = stats.min_ms = stats.max_ms = stats.p99_ms = stats.fps = 0.0;
+        if (frame_times.empty())
+        {
+            return stats;
+        }
+        std::vector<double> sorted (frame_times.begin(), frame_times.end());
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (unsigned int i = 0; i < sorted.size(); ++i)
+        {
+            sum += sorted[i];
+        }
+        stats.average_ms = 1000.0 * sum / sorted.size();
+        stats.min_ms = 1000.0 * sorted.front();
+        stats.max_ms = 1000.0 * sorted.back();
+        stats.p99_ms = 1000.0 * sorted[std::min(sorted.size() - 1, (size_t)(0.99 * sorted.size()))];
+        stats.fps = sum > 0.0 ? sorted.size() / sum : 0.0;
+        return stats;
+    }
+
+    /**
+     * @brief Prints the frame statistics.
+     */
+    void printStats (void) const
+    {
+        FrameStats stats = getStats();
+        std::cout << "frames " << stats.frames << ", " << stats.fps << " fps, frame ms avg " << stats.average_ms
+                  << " min " << stats.min_ms << " max " << stats.max_ms << " p99 " << stats.p99_ms
+                  << ", updates " << stats.updates << " (dropped " << stats.dropped_updates << ")"
+                  << ", latency waits " << stats.latency_waits << std::endl;
+    }
+
+protected:
+
+    /// Context the application renders to.
+    Context& context;
+
+private:
+
+    ///Copy Constructor
+    Application (Application const&);
+
+    ///Assignment Operation
+    Application& operator= (Application const&);
+
+    /**
+     * @brief Adds a frame time to the history.
+     */
+    void recordFrameTime (double seconds)
+    {
+        if (frames == 0)
+        {
+            return;
+        }
+        frame_times.push_back(seconds);
+        if (frame_times.size() > history_size)
+        {
+            frame_times.pop_front();
+        }
+    }
+
+    /**
+     * @brief Fences the frame just submitted and waits for the oldest one when too many are in flight.
+     */
+    void limitFramesInFlight (void)
+    {
+        if (max_frames_in_flight == 0)
+        {
+            releaseFences();
+            return;
+        }
+        fences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        while ((int)fences.size() > max_frames_in_flight)
+        {
+            GLsync oldest = fences.front();
+            fences.pop_front();
+            if (glClientWaitSync(oldest, 0, 0) == GL_TIMEOUT_EXPIRED)
+            {
+                ++latency_waits;
+                while (glClientWaitSync(oldest, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+            }
+            glDeleteSync(oldest);
+        }
+    }
+
+    /**
+     * @brief Deletes the frame fences.
+     */
+    void releaseFences (void)
+    {
+        for (unsigned int i = 0; i < fences.size(); ++i)
+        {
+            glDeleteSync(fences[i]);
+        }
+        fences.clear();
+    }
+
+    /// Simulation time step in seconds.
+    double timestep;
+
+    /// Maximum updates per frame.
+    int max_updates;
+
+    /// Swap interval.
+    int swap_interval;
+
+    /// Maximum frames queued to the GPU, 0 for no limit.
+    int max_frames_in_flight;
+
+    /// Minimum frame time for the frame rate limit, 0 for no limit.
+    double min_frame_time;
+
+    /// Number of frame times kept.
+    unsigned int history_size;
+
+    /// Recent frame times in seconds.
+    std::deque<double> frame_times;
+
+    /// Fences of the frames in flight, oldest first.
+    std::deque<GLsync> fences;
+
+    /// Counters.
+    unsigned long frames, updates, dropped_updates, latency_waits;
+
+    /// Sum of the time steps.
+    double simulation_time;
+};
+
+}
+
+#endif
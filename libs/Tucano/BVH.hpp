@@ -0,0 +1,806 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BVH__
+#define __BVH__
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <Eigen/Dense>
+
+#include "BoundingBox3.hpp"
+#include "Frustum.hpp"
+
+namespace Tucano
+{
+
+/**
+ * @brief Bounding volume hierarchy over object bounding boxes, for picking and culling on the CPU.
+ *
+ * Built top-down with the surface area heuristic (binned on the box centroids), and stored as a flat
+ * array of 32 byte nodes in depth-first order: the left child of a node follows it in memory and only
+ * the right child index is stored. Objects are referred to by their index in the box vector given to build.
+ *
+ * Moving objects are handled by refitting the node boxes (refit for all objects, update for one),
+ * which keeps the tree valid; rebuild when the objects moved far enough that queries slow down.
+ *
+ * Rays for picking are generated with Camera::getRay, from mouse coordinates normalized with
+ * Camera::normalizeScreenPosition or Trackball::normalizePosition.
+ */
+class BVH {
+
+public:
+
+    /// Result of a ray query.
+    struct Hit
+    {
+        /// Object index, -1 if nothing was hit.
+        int object;
+        /// Ray parameter of the hit (distance along the ray, if its direction is normalized).
+        float t;
+    };
+
+    /**
+     * @brief Default constructor, an empty hierarchy.
+     */
+    BVH (void) : max_leaf_size(4) {}
+
+    /**
+     * @brief Builds the hierarchy.
+     * @param boxes Bounding box of each object.
+     * @param leaf_size Maximum number of objects in a leaf.
+     */
+    void build (const std::vector< BoundingBox3<float> >& boxes, int leaf_size = 4)
+    {
+        max_leaf_size = std::max(1, leaf_size);
+        nodes.clear();
+        parents.clear();
+        object_boxes.resize(boxes.size());
+        indices.resize(boxes.size());
+        object_leaf.assign(boxes.size(), -1);
+        std::vector<Eigen::Vector3f> centroids (boxes.size());
+        for (unsigned int i = 0; i < boxes.size(); ++i)
+        {
+            object_boxes[i].set(boxes[i].Min(), boxes[i].Max());
+            centroids[i] = boxes[i].center();
+            indices[i] = i;
+        }
+        if (boxes.empty())
+        {
+            return;
+        }
+        nodes.reserve(2 * boxes.size());
+        nodes.push_back(Node());
+        parents.push_back(-1);
+        buildNode(0, 0, boxes.size(), 0, centroids);
+    }
+
+    /**
+     * @brief Updates all object boxes and refits the node boxes, without changing the tree.
+     * @param boxes New bounding box of each object, same objects as in build.
+     */
+    void refit (const std::vector< BoundingBox3<float> >& boxes)
+    {
+        for (unsigned int i = 0; i < boxes.size() && i < object_boxes.size(); ++i)
+        {
+            object_boxes[i].set(boxes[i].Min(), boxes[i].Max());
+        }
+        // children are always after their parent in the array
+        for (int n = (int)nodes.size() - 1; n >= 0; --n)
+        {
+            refitNode(n);
+        }
+    }
+
+    /**
+     * @brief Updates the box of one object and refits its ancestors.
+     * @param object Object index.
+     * @param box New bounding box.
+     */
+    void update (int object, const BoundingBox3<float>& box)
+    {
+        object_boxes[object].set(box.Min(), box.Max());
+        for (int n = object_leaf[object]; n != -1; n = parents[n])
+        {
+            Box previous = nodes[n].box;
+            refitNode(n);
+            if (previous == nodes[n].box)
+            {
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief Finds the closest object box hit by a ray.
+     * @param origin Ray origin.
+     * @param direction Ray direction.
+     * @param max_t Maximum ray parameter.
+     * @return Closest hit, object -1 if none.
+     */
+    Hit raycast (const Eigen::Vector3f& origin, const Eigen::Vector3f& direction, float max_t = std::numeric_limits<float>::max()) const
+    {
+        return raycast(origin, direction, BoxHit(), max_t);
+    }
+
+    /**
+     * @brief Finds the closest hit of a ray, with an exact test per object (ex. against its triangles).
+     *
+     * The test is only called for objects whose box is hit closer than the best hit so far.
+     * @param origin Ray origin.
+     * @param direction Ray direction.
+     * @param test Callable as float test (int object, float t_box), returns the hit parameter or a negative value.
+     * @param max_t Maximum ray parameter.
+     * @return Closest hit, object -1 if none.
+     */
+    template <class ObjectTest>
+    Hit raycast (const Eigen::Vector3f& origin, const Eigen::Vector3f& direction, ObjectTest test, float max_t = std::numeric_limits<float>::max()) const
+    {
+        Hit hit;
+        hit.object = -1;
+        hit.t = max_t;
+        if (nodes.empty())
+        {
+            return hit;
+        }
+
+        RayData ray (origin, direction);
+        int stack[STACK_SIZE];
+        int top = 0;
+        float t_root;
+        if (!ray.intersect(nodes[0].box, hit.t, t_root))
+        {
+            return hit;
+        }
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node& node = nodes[stack[--top]];
+            float t_node;
+            if (!ray.intersect(node.box, hit.t, t_node))
+            {
+                continue;
+            }
+            if (node.count > 0)
+            {
+                for (int i = node.first; i < node.first + node.count; ++i)
+                {
+                    float t_box;
+                    int object = indices[i];
+                    if (ray.intersect(object_boxes[object], hit.t, t_box))
+                    {
+                        float t = test(object, t_box);
+                        if (t >= 0.0f && t < hit.t)
+                        {
+                            hit.t = t;
+                            hit.object = object;
+                        }
+                    }
+                }
+                continue;
+            }
+            // push the farther child first, so the nearer one is visited first
+            int left = &node - &nodes[0] + 1;
+            int right = node.first;
+            float t_left, t_right;
+            bool hit_left = ray.intersect(nodes[left].box, hit.t, t_left);
+            bool hit_right = ray.intersect(nodes[right].box, hit.t, t_right);
+            if (hit_left && hit_right)
+            {
+                if (t_left > t_right)
+                {
+                    std::swap(left, right);
+                }
+                stack[top++] = right;
+                stack[top++] = left;
+            }
+            else if (hit_left)
+            {
+                stack[top++] = left;
+            }
+            else if (hit_right)
+            {
+                stack[top++] = right;
+            }
+        }
+        return hit;
+    }
+
+    /**
+     * @brief Finds all objects whose box is hit by a ray, sorted by distance.
+     * @param origin Ray origin.
+     * @param direction Ray direction.
+     * @param hits Receives the hits.
+     */
+    void raycastAll (const Eigen::Vector3f& origin, const Eigen::Vector3f& direction, std::vector<Hit>& hits) const
+    {
+        hits.clear();
+        if (nodes.empty())
+        {
+            return;
+        }
+        RayData ray (origin, direction);
+        const float max_t = std::numeric_limits<float>::max();
+        int stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            int n = stack[--top];
+            const Node& node = nodes[n];
+            float t;
+            if (!ray.intersect(node.box, max_t, t))
+            {
+                continue;
+            }
+            if (node.count > 0)
+            {
+                for (int i = node.first; i < node.first + node.count; ++i)
+                {
+                    if (ray.intersect(object_boxes[indices[i]], max_t, t))
+                    {
+                        Hit hit = {indices[i], t};
+                        hits.push_back(hit);
+                    }
+                }
+                continue;
+            }
+            stack[top++] = node.first;
+            stack[top++] = n + 1;
+        }
+        std::sort(hits.begin(), hits.end(), closerHit);
+    }
+
+    /**
+     * @brief Finds all objects whose box intersects a given box.
+     * @param box Query box.
+     * @param objects Receives the object indices.
+     */
+    void query (const BoundingBox3<float>& box, std::vector<int>& objects) const
+    {
+        objects.clear();
+        if (nodes.empty())
+        {
+            return;
+        }
+        Box query_box;
+        query_box.set(box.Min(), box.Max());
+        int stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            int n = stack[--top];
+            const Node& node = nodes[n];
+            if (!node.box.overlaps(query_box))
+            {
+                continue;
+            }
+            if (node.count > 0)
+            {
+                for (int i = node.first; i < node.first + node.count; ++i)
+                {
+                    if (object_boxes[indices[i]].overlaps(query_box))
+                    {
+                        objects.push_back(indices[i]);
+                    }
+                }
+                continue;
+            }
+            stack[top++] = node.first;
+            stack[top++] = n + 1;
+        }
+    }
+
+    /**
+     * @brief Finds all objects whose box may be inside a frustum.
+     *
+     * Subtrees completely inside the frustum are added without testing their objects.
+     * @param frustum Frustum, in the same space as the boxes (see Camera::getFrustum).
+     * @param objects Receives the object indices.
+     */
+    void query (const Frustum& frustum, std::vector<int>& objects) const
+    {
+        objects.clear();
+        if (nodes.empty())
+        {
+            return;
+        }
+        float planes[6][4];
+        for (int p = 0; p < 6; ++p)
+        {
+            Eigen::Vector4f plane = frustum.getPlane(p);
+            for (int c = 0; c < 4; ++c)
+            {
+                planes[p][c] = plane[c];
+            }
+        }
+        int stack[STACK_SIZE];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            int n = stack[--top];
+            const Node& node = nodes[n];
+            int side = classify(planes, node.box);
+            if (side < 0)
+            {
+                continue;
+            }
+            if (side > 0)
+            {
+                collect(n, objects);
+                continue;
+            }
+            if (node.count > 0)
+            {
+                for (int i = node.first; i < node.first + node.count; ++i)
+                {
+                    if (classify(planes, object_boxes[indices[i]]) >= 0)
+                    {
+                        objects.push_back(indices[i]);
+                    }
+                }
+                continue;
+            }
+            stack[top++] = node.first;
+            stack[top++] = n + 1;
+        }
+    }
+
+    /**
+     * @brief Returns the box of all objects.
+     */
+    BoundingBox3<float> getBounds (void) const
+    {
+        if (nodes.empty())
+        {
+            return BoundingBox3<float>();
+        }
+        const Box& box = nodes[0].box;
+        return BoundingBox3<float>(box.min[0], box.min[1], box.min[2], box.max[0], box.max[1], box.max[2]);
+    }
+
+    /**
+     * @brief Returns the number of nodes.
+     */
+    int getNumNodes (void) const
+    {
+        return nodes.size();
+    }
+
+    /**
+     * @brief Returns the number of objects.
+     */
+    int getNumObjects (void) const
+    {
+        return object_boxes.size();
+    }
+
+private:
+
+    /// Traversal stack size, the traversals push at most one node per level plus the root.
+    static const int STACK_SIZE = 128;
+
+    /// Depth at which a node is made a leaf whatever its size, so traversals never overflow their stack.
+    static const int MAX_DEPTH = STACK_SIZE - 2;
+
+    /// Depth from which nodes are split at the median, which reaches single objects in 32 more levels.
+    static const int MEDIAN_DEPTH = MAX_DEPTH - 32;
+
+    /// Number of centroid bins evaluated per axis by the SAH build.
+    static const int NUM_BINS = 16;
+
+    /// Axis aligned box as plain floats.
+    struct Box
+    {
+        float min[3];
+        float max[3];
+
+        void reset (void)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                min[c] = std::numeric_limits<float>::max();
+                max[c] = -std::numeric_limits<float>::max();
+            }
+        }
+
+        void set (const Eigen::Vector3f& lo, const Eigen::Vector3f& hi)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                min[c] = lo[c];
+                max[c] = hi[c];
+            }
+        }
+
+        void grow (const Box& box)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                min[c] = std::min(min[c], box.min[c]);
+                max[c] = std::max(max[c], box.max[c]);
+            }
+        }
+
+        void grow (const Eigen::Vector3f& p)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                min[c] = std::min(min[c], p[c]);
+                max[c] = std::max(max[c], p[c]);
+            }
+        }
+
+        float area (void) const
+        {
+            float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+            if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+            {
+                return 0.0f;
+            }
+            return 2.0f * (dx*dy + dy*dz + dz*dx);
+        }
+
+        bool overlaps (const Box& box) const
+        {
+            return min[0] <= box.max[0] && max[0] >= box.min[0] &&
+                   min[1] <= box.max[1] && max[1] >= box.min[1] &&
+                   min[2] <= box.max[2] && max[2] >= box.min[2];
+        }
+
+        bool operator== (const Box& box) const
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                if (min[c] != box.min[c] || max[c] != box.max[c])
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    /// Flattened node, 32 bytes: for leaves first is the first object slot, for inner nodes the right child.
+    struct Node
+    {
+        Box box;
+        int first;
+        int count;
+    };
+
+    /// Ray with precomputed inverse direction for the slab test.
+    struct RayData
+    {
+        float origin[3];
+        float inv_dir[3];
+
+        RayData (const Eigen::Vector3f& o, const Eigen::Vector3f& d)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                origin[c] = o[c];
+                inv_dir[c] = 1.0f / d[c];
+            }
+        }
+
+        /// Returns wether the ray hits the box before max_t, and the entry parameter (0 if the origin is inside).
+        bool intersect (const Box& box, float max_t, float& t_enter) const
+        {
+            float t0 = 0.0f, t1 = max_t;
+            for (int c = 0; c < 3; ++c)
+            {
+                float near_t = (box.min[c] - origin[c]) * inv_dir[c];
+                float far_t = (box.max[c] - origin[c]) * inv_dir[c];
+                if (near_t > far_t)
+                {
+                    std::swap(near_t, far_t);
+                }
+                t0 = near_t > t0 ? near_t : t0;
+                t1 = far_t < t1 ? far_t : t1;
+                if (t0 > t1)
+                {
+                    return false;
+                }
+            }
+            t_enter = t0;
+            return true;
+        }
+    };
+
+    /// Default object test of raycast, the object box is the hit.
+    struct BoxHit
+    {
+        float operator() (int, float t_box) const
+        {
+            return t_box;
+        }
+    };
+
+    /// Order of hits by distance.
+    static bool closerHit (const Hit& a, const Hit& b)
+    {
+        return a.t < b.t;
+    }
+
+    /**
+     * @brief Classifies a box against frustum planes.
+     * @return -1 outside, 0 intersecting, 1 completely inside.
+     */
+    static int classify (const float planes[6][4], const Box& box)
+    {
+        int result = 1;
+        for (int p = 0; p < 6; ++p)
+        {
+            float center_dist = planes[p][3], radius = 0.0f;
+            for (int c = 0; c < 3; ++c)
+            {
+                center_dist += planes[p][c] * (box.min[c] + box.max[c]) * 0.5f;
+                radius += std::fabs(planes[p][c]) * (box.max[c] - box.min[c]) * 0.5f;
+            }
+            if (center_dist < -radius)
+            {
+                return -1;
+            }
+            if (center_dist < radius)
+            {
+                result = 0;
+            }
+        }
+        return result;
+    }
+
+    /**
+     * @brief Adds all objects of a subtree.
+     */
+    void collect (int n, std::vector<int>& objects) const
+    {
+        const Node& node = nodes[n];
+        if (node.count > 0)
+        {
+            objects.insert(objects.end(), indices.begin() + node.first, indices.begin() + node.first + node.count);
+            return;
+        }
+        collect(n + 1, objects);
+        collect(node.first, objects);
+    }
+
+    /**
+     * @brief Recomputes a node box from its objects or children.
+     */
+    void refitNode (int n)
+    {
+        Node& node = nodes[n];
+        node.box.reset();
+        if (node.count > 0)
+        {
+            for (int i = node.first; i < node.first + node.count; ++i)
+            {
+                node.box.grow(object_boxes[indices[i]]);
+            }
+        }
+        else
+        {
+            node.box.grow(nodes[n + 1].box);
+            node.box.grow(nodes[node.first].box);
+        }
+    }
+
+    /**
+     * @brief Makes a node a leaf with the given object slots.
+     */
+    void makeLeaf (int n, int first, int count)
+    {
+        nodes[n].first = first;
+        nodes[n].count = count;
+        for (int i = first; i < first + count; ++i)
+        {
+            object_leaf[indices[i]] = n;
+        }
+    }
+
+    /**
+     * @brief Builds the subtree of a node over the object slots [first, first + count).
+     *
+     * Binned SAH does not bound the depth (ex. with clustered objects), so deep subtrees switch to median splits.
+     * @param depth Depth of the node, 0 for the root.
+     */
+    void buildNode (int n, int first, int count, int depth, const std::vector<Eigen::Vector3f>& centroids)
+    {
+        Box bounds, centroid_bounds;
+        bounds.reset();
+        centroid_bounds.reset();
+        for (int i = first; i < first + count; ++i)
+        {
+            bounds.grow(object_boxes[indices[i]]);
+            centroid_bounds.grow(centroids[indices[i]]);
+        }
+        nodes[n].box = bounds;
+
+        if (count <= max_leaf_size || depth >= MAX_DEPTH)
+        {
+            makeLeaf(n, first, count);
+            return;
+        }
+
+        if (depth >= MEDIAN_DEPTH)
+        {
+            // split at the median centroid along the largest extent
+            int axis = 0;
+            for (int c = 1; c < 3; ++c)
+            {
+                if (centroid_bounds.max[c] - centroid_bounds.min[c] > centroid_bounds.max[axis] - centroid_bounds.min[axis])
+                {
+                    axis = c;
+                }
+            }
+            int* begin = &indices[0] + first;
+            std::nth_element(begin, begin + count / 2, begin + count, MedianTest(centroids, axis));
+            splitNode(n, first, first + count / 2, count, depth, centroids);
+            return;
+        }
+
+        // binned SAH over the three axes
+        int best_axis = -1;
+        int best_split = 0;
+        float best_cost = std::numeric_limits<float>::max();
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+            if (extent <= 0.0f)
+            {
+                continue;
+            }
+            Box bin_boxes[NUM_BINS];
+            int bin_counts[NUM_BINS] = {0};
+            for (int b = 0; b < NUM_BINS; ++b)
+            {
+                bin_boxes[b].reset();
+            }
+            float scale = NUM_BINS / extent;
+            for (int i = first; i < first + count; ++i)
+            {
+                int b = std::min(NUM_BINS - 1, (int)((centroids[indices[i]][axis] - centroid_bounds.min[axis]) * scale));
+                bin_counts[b]++;
+                bin_boxes[b].grow(object_boxes[indices[i]]);
+            }
+            // sweep from the right to get the area and count of every right side
+            float right_area[NUM_BINS];
+            int right_count[NUM_BINS];
+            Box right;
+            right.reset();
+            int total = 0;
+            for (int b = NUM_BINS - 1; b > 0; --b)
+            {
+                right.grow(bin_boxes[b]);
+                total += bin_counts[b];
+                right_area[b] = right.area();
+                right_count[b] = total;
+            }
+            Box left;
+            left.reset();
+            total = 0;
+            for (int b = 0; b < NUM_BINS - 1; ++b)
+            {
+                left.grow(bin_boxes[b]);
+                total += bin_counts[b];
+                float cost = left.area() * total + right_area[b + 1] * right_count[b + 1];
+                if (total > 0 && right_count[b + 1] > 0 && cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = b + 1;
+                }
+            }
+        }
+
+        int mid = first + count / 2;
+        float leaf_cost = bounds.area() * count;
+        if (best_axis != -1)
+        {
+            if (best_cost >= leaf_cost && count <= 4 * max_leaf_size)
+            {
+                makeLeaf(n, first, count);
+                return;
+            }
+            float extent = centroid_bounds.max[best_axis] - centroid_bounds.min[best_axis];
+            float split = centroid_bounds.min[best_axis] + extent * best_split / NUM_BINS;
+            int* begin = &indices[0] + first;
+            int* middle = std::partition(begin, begin + count, SplitTest(centroids, best_axis, split));
+            mid = middle - &indices[0];
+        }
+        if (mid == first || mid == first + count)
+        {
+            // all centroids in the same place, split in half
+            mid = first + count / 2;
+        }
+        splitNode(n, first, mid, count, depth, centroids);
+    }
+
+    /**
+     * @brief Creates the two children of a node, over the object slots [first, mid) and [mid, first + count).
+     */
+    void splitNode (int n, int first, int mid, int count, int depth, const std::vector<Eigen::Vector3f>& centroids)
+    {
+        int left = nodes.size();
+        nodes.push_back(Node());
+        parents.push_back(n);
+        nodes[n].count = 0;
+        buildNode(left, first, mid - first, depth + 1, centroids);
+        int right = nodes.size();
+        nodes.push_back(Node());
+        parents.push_back(n);
+        nodes[n].first = right;
+        buildNode(right, mid, first + count - mid, depth + 1, centroids);
+    }
+
+    /// Partition predicate of the build, true for objects left of the split plane.
+    struct SplitTest
+    {
+        const std::vector<Eigen::Vector3f>& centroids;
+        int axis;
+        float split;
+        SplitTest (const std::vector<Eigen::Vector3f>& c, int a, float s) : centroids(c), axis(a), split(s) {}
+        bool operator() (int object) const
+        {
+            return centroids[object][axis] < split;
+        }
+    };
+
+    /// Ordering of the median split, by centroid along an axis.
+    struct MedianTest
+    {
+        const std::vector<Eigen::Vector3f>& centroids;
+        int axis;
+        MedianTest (const std::vector<Eigen::Vector3f>& c, int a) : centroids(c), axis(a) {}
+        bool operator() (int a, int b) const
+        {
+            return centroids[a][axis] < centroids[b][axis];
+        }
+    };
+
+    /// Flattened nodes in depth-first order.
+    std::vector<Node> nodes;
+
+    /// Parent of each node, -1 for the root.
+    std::vector<int> parents;
+
+    /// Object indices, each leaf refers to a contiguous range.
+    std::vector<int> indices;
+
+    /// Box of each object.
+    std::vector<Box> object_boxes;
+
+    /// Leaf holding each object.
+    std::vector<int> object_leaf;
+
+    /// Maximum number of objects per leaf.
+    int max_leaf_size;
+};
+
+}
+
+#endif
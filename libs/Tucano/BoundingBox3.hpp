@@ -4,12 +4,171 @@
 // from Standard Library
 #include <vector>
 #include <limits>
+#include <algorithm>
+#include <thread>
+#include <cmath>
+#include <cstddef>
 
 #include <Eigen/Dense>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 namespace Tucano
 {
 
+	/*!
+	 *@brief Vector min/max kernels used by BoundingBox3::fromPointCloud on contiguous buffers.
+	 *@details Points are read in blocks of (stride x lanes) values, one register per stride, so lane k of the
+	 * block always holds coordinate k % stride and no shuffle is needed inside the loop. NaN coordinates are skipped.
+	 */
+	namespace BoundsKernels
+	{
+
+#if defined(__AVX__)
+		struct FloatLanes
+		{
+			typedef __m256 Reg;
+			static const size_t width = 8;
+			static Reg set ( float v ) { return _mm256_set1_ps ( v ); }
+			static Reg load ( const float* p ) { return _mm256_loadu_ps ( p ); }
+			static void store ( float* p , Reg v ) { _mm256_storeu_ps ( p , v ); }
+			static Reg min ( Reg v , Reg acc ) { return _mm256_min_ps ( v , acc ); }
+			static Reg max ( Reg v , Reg acc ) { return _mm256_max_ps ( v , acc ); }
+		};
+
+		struct DoubleLanes
+		{
+			typedef __m256d Reg;
+			static const size_t width = 4;
+			static Reg set ( double v ) { return _mm256_set1_pd ( v ); }
+			static Reg load ( const double* p ) { return _mm256_loadu_pd ( p ); }
+			static void store ( double* p , Reg v ) { _mm256_storeu_pd ( p , v ); }
+			static Reg min ( Reg v , Reg acc ) { return _mm256_min_pd ( v , acc ); }
+			static Reg max ( Reg v , Reg acc ) { return _mm256_max_pd ( v , acc ); }
+		};
+#elif defined(__SSE2__)
+		struct FloatLanes
+		{
+			typedef __m128 Reg;
+			static const size_t width = 4;
+			static Reg set ( float v ) { return _mm_set1_ps ( v ); }
+			static Reg load ( const float* p ) { return _mm_loadu_ps ( p ); }
+			static void store ( float* p , Reg v ) { _mm_storeu_ps ( p , v ); }
+			static Reg min ( Reg v , Reg acc ) { return _mm_min_ps ( v , acc ); }
+			static Reg max ( Reg v , Reg acc ) { return _mm_max_ps ( v , acc ); }
+		};
+
+		struct DoubleLanes
+		{
+			typedef __m128d Reg;
+			static const size_t width = 2;
+			static Reg set ( double v ) { return _mm_set1_pd ( v ); }
+			static Reg load ( const double* p ) { return _mm_loadu_pd ( p ); }
+			static void store ( double* p , Reg v ) { _mm_storeu_pd ( p , v ); }
+			static Reg min ( Reg v , Reg acc ) { return _mm_min_pd ( v , acc ); }
+			static Reg max ( Reg v , Reg acc ) { return _mm_max_pd ( v , acc ); }
+		};
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+		struct FloatLanes
+		{
+			typedef float32x4_t Reg;
+			static const size_t width = 4;
+			static Reg set ( float v ) { return vdupq_n_f32 ( v ); }
+			static Reg load ( const float* p ) { return vld1q_f32 ( p ); }
+			static void store ( float* p , Reg v ) { vst1q_f32 ( p , v ); }
+			static Reg min ( Reg v , Reg acc ) { return vminnmq_f32 ( v , acc ); }
+			static Reg max ( Reg v , Reg acc ) { return vmaxnmq_f32 ( v , acc ); }
+		};
+
+		struct DoubleLanes
+		{
+			typedef float64x2_t Reg;
+			static const size_t width = 2;
+			static Reg set ( double v ) { return vdupq_n_f64 ( v ); }
+			static Reg load ( const double* p ) { return vld1q_f64 ( p ); }
+			static void store ( double* p , Reg v ) { vst1q_f64 ( p , v ); }
+			static Reg min ( Reg v , Reg acc ) { return vminnmq_f64 ( v , acc ); }
+			static Reg max ( Reg v , Reg acc ) { return vmaxnmq_f64 ( v , acc ); }
+		};
+#endif
+
+		/*!
+		 *@brief Extends lo/hi (3 values each) with the points of a buffer, using vector lanes.
+		 *@return Number of points processed, the remaining ones are left to the scalar loop.
+		 */
+		template < class Lanes , class Real >
+		size_t minMaxLanes ( const Real* points , size_t count , size_t stride , Real* lo , Real* hi )
+		{
+			const size_t width = Lanes::width;
+			const size_t max_stride = 8;
+			size_t blocks = count / width;
+			if ( stride < 3 or stride > max_stride or blocks == 0 )
+			{
+				return 0;
+			}
+
+			typename Lanes::Reg vlo[max_stride] , vhi[max_stride];
+			for ( size_t r = 0; r < stride; ++r )
+			{
+				vlo[r] = Lanes::set (  std::numeric_limits<Real>::max() );
+				vhi[r] = Lanes::set ( -std::numeric_limits<Real>::max() );
+			}
+			for ( size_t b = 0; b < blocks; ++b )
+			{
+				const Real* block = points + b * width * stride;
+				for ( size_t r = 0; r < stride; ++r )
+				{
+					typename Lanes::Reg v = Lanes::load ( block + r * width );
+					vlo[r] = Lanes::min ( v , vlo[r] );
+					vhi[r] = Lanes::max ( v , vhi[r] );
+				}
+			}
+
+			Real block_lo[max_stride * width] , block_hi[max_stride * width];
+			for ( size_t r = 0; r < stride; ++r )
+			{
+				Lanes::store ( block_lo + r * width , vlo[r] );
+				Lanes::store ( block_hi + r * width , vhi[r] );
+			}
+			for ( size_t k = 0; k < stride * width; ++k )
+			{
+				size_t c = k % stride;
+				if ( c < 3 )
+				{
+					lo[c] = (std::min) ( lo[c] , block_lo[k] );
+					hi[c] = (std::max) ( hi[c] , block_hi[k] );
+				}
+			}
+			return blocks * width;
+		}
+
+		/// No vector kernel for this type, everything is left to the scalar loop.
+		template < class Real >
+		inline size_t minMax ( const Real* , size_t , size_t , Real* , Real* )
+		{
+			return 0;
+		}
+
+#if defined(__AVX__) || defined(__SSE2__) || ( defined(__ARM_NEON) && defined(__aarch64__) )
+		inline size_t minMax ( const float* points , size_t count , size_t stride , float* lo , float* hi )
+		{
+			return minMaxLanes<FloatLanes> ( points , count , stride , lo , hi );
+		}
+
+		inline size_t minMax ( const double* points , size_t count , size_t stride , double* lo , double* hi )
+		{
+			return minMaxLanes<DoubleLanes> ( points , count , stride , lo , hi );
+		}
+#endif
+
+	}
+
 	/*!
 	 *@class BoundingBox3.
 	 *@brief Class that represent a Box in 3D.
@@ -86,21 +245,10 @@ namespace Tucano
 			{
 				this->reset();
 
-				for ( typename std::vector<Vector3 >::const_iterator new_point = new_point_begin; new_point != new_point_end; new_point++)
+				// Eigen fixed size vectors are stored contiguously, without padding
+				if ( new_point_begin != new_point_end )
 				{
-
-					 BoundingBox3<Real> box( (std::min) ( min_.x() , new_point->x() ) ,
-								 (std::min) ( min_.y() , new_point->y() ) ,
-								 (std::min) ( min_.z() , new_point->z() ) ,
-								 (std::max) ( max_.x() , new_point->x() ) ,
-								 (std::max) ( max_.y() , new_point->y() ) ,
-								 (std::max) ( max_.z() , new_point->z() ) );
-
-//						std::cout << min( );
-//						std::cout << max( );
-//						std::cout << " new_point " << *new_point;
-
-					 *this = *this + box;
+					this->accumulate ( new_point_begin->data ( ) , new_point_end - new_point_begin , 3 );
 				}
 
 			}
@@ -109,21 +257,9 @@ namespace Tucano
 			{
 				this->reset();
 
-				for ( typename std::vector<Vector4>::const_iterator new_point = new_point_begin; new_point != new_point_end; new_point++)
+				if ( new_point_begin != new_point_end )
 				{
-
-					 BoundingBox3<Real> box( (std::min) ( min_.x() , new_point->x() ) ,
-								 (std::min) ( min_.y() , new_point->y() ) ,
-								 (std::min) ( min_.z() , new_point->z() ) ,
-								 (std::max) ( max_.x() , new_point->x() ) ,
-								 (std::max) ( max_.y() , new_point->y() ) ,
-								 (std::max) ( max_.z() , new_point->z() ) );
-
-//						std::cout << min( );
-//						std::cout << max( );
-//						std::cout << " new_point " << *new_point;
-
-					 *this = *this + box;
+					this->accumulate ( new_point_begin->data ( ) , new_point_end - new_point_begin , 4 );
 				}
 
 			}
@@ -146,21 +282,9 @@ namespace Tucano
 				basis_[2] = third_basis;
 
 
-				for ( typename std::vector<Vector4>::const_iterator new_point = points.begin(); new_point != points.end(); new_point++)
+				if ( !points.empty ( ) )
 				{
-
-					 BoundingBox3<Real> box( (std::min) ( min_.x() , new_point->x() ) ,
-								 (std::min) ( min_.y() , new_point->y() ) ,
-								 (std::min) ( min_.z() , new_point->z() ) ,
-								 (std::max) ( max_.x() , new_point->x() ) ,
-								 (std::max) ( max_.y() , new_point->y() ) ,
-								 (std::max) ( max_.z() , new_point->z() ) );
-
-//						std::cout << min( );
-//						std::cout << max( );
-//						std::cout << " new_point " << *new_point;
-
-					 *this = *this + box;
+					this->accumulate ( points[0].data ( ) , points.size ( ) , 4 );
 				}
 
 				Vector3 diff = points[0].toVector3() - this->center();
@@ -196,6 +320,87 @@ namespace Tucano
 			}
 
 
+			/*!
+			 *@brief Computes the box of points stored in a contiguous buffer (ex. a vertex array or a mapped file).
+			 *@details Large buffers are split in chunks reduced in parallel, each with vector min/max lanes
+			 * (AVX, SSE2 or NEON), and the chunk boxes are merged with operator+.
+			 *@param points Pointer to the first coordinate (x of the first point).
+			 *@param count Number of points.
+			 *@param stride Number of values from one point to the next (3 for xyz, 4 for xyzw, ...).
+			 *@param num_threads Number of threads, 0 to decide from the number of points and cores.
+			 */
+			void fromPointCloud ( const Real* points , size_t count , size_t stride = 3 , int num_threads = 0 )
+			{
+				this->reset();
+				this->accumulate ( points , count , stride , num_threads );
+			}
+
+			/*!
+			 *@brief Extends the box with the points of a contiguous buffer (see fromPointCloud).
+			 */
+			void accumulate ( const Real* points , size_t count , size_t stride = 3 , int num_threads = 0 )
+			{
+				// below this many points per thread, spawning threads costs more than it saves
+				const size_t min_points_per_thread = 1 << 18;
+
+				if ( count == 0 )
+				{
+					return;
+				}
+				if ( num_threads <= 0 )
+				{
+					num_threads = (std::max) ( 1u , std::thread::hardware_concurrency ( ) );
+				}
+				size_t threads = (std::min) ( (size_t)num_threads , (std::max) ( (size_t)1 , count / min_points_per_thread ) );
+
+				if ( threads == 1 )
+				{
+					*this = *this + chunkBounds ( points , count , stride );
+					return;
+				}
+
+				std::vector< BoundingBox3<Real> > chunks ( threads );
+				std::vector< std::thread > workers;
+				size_t chunk_size = ( count + threads - 1 ) / threads;
+				for ( size_t t = 1; t < threads; ++t )
+				{
+					size_t first = t * chunk_size;
+					size_t n = ( first < count ) ? (std::min) ( chunk_size , count - first ) : 0;
+					workers.push_back ( std::thread ( [=, &chunks] ( ) { chunks[t] = chunkBounds ( points + first * stride , n , stride ); } ) );
+				}
+				chunks[0] = chunkBounds ( points , (std::min) ( chunk_size , count ) , stride );
+				for ( size_t t = 0; t < workers.size ( ); ++t )
+				{
+					workers[t].join ( );
+				}
+				for ( size_t t = 0; t < threads; ++t )
+				{
+					*this = *this + chunks[t];
+				}
+			}
+
+			/*!
+			 *@brief Computes the box of one chunk of a contiguous buffer, with vector lanes and a scalar tail.
+			 */
+			static BoundingBox3<Real> chunkBounds ( const Real* points , size_t count , size_t stride )
+			{
+				Real lo[3] = {  std::numeric_limits<Real>::max() ,  std::numeric_limits<Real>::max() ,  std::numeric_limits<Real>::max() };
+				Real hi[3] = { -std::numeric_limits<Real>::max() , -std::numeric_limits<Real>::max() , -std::numeric_limits<Real>::max() };
+
+				size_t done = BoundsKernels::minMax ( points , count , stride , lo , hi );
+				for ( size_t i = done; i < count; ++i )
+				{
+					const Real* p = points + i * stride;
+					for ( int c = 0; c < 3; ++c )
+					{
+						// comparisons are false for NaN, so they are skipped as in the vector kernels
+						lo[c] = ( p[c] < lo[c] ) ? p[c] : lo[c];
+						hi[c] = ( p[c] > hi[c] ) ? p[c] : hi[c];
+					}
+				}
+				return BoundingBox3<Real> ( lo[0] , lo[1] , lo[2] , hi[0] , hi[1] , hi[2] );
+			}
+
 			Real diagonal ( ) const
 			{
 
@@ -0,0 +1,216 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BOUNDSREDUCER__
+#define __BOUNDSREDUCER__
+
+#include "Shader.hpp"
+#include "Buffer.hpp"
+#include "BoundingBox3.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+namespace Tucano
+{
+
+/**
+ * @brief Computes the bounding box of points already in a GPU buffer with a compute shader reduction.
+ *
+ * Each work group reduces its points in shared memory and merges the result with atomic min/max on
+ * order preserving integer encodings of the floats, so a single dispatch gives the final box.
+ * The result stays in a small buffer (six uints: encoded min xyz, max xyz) that other shaders can read,
+ * or is read back with read, which waits for the GPU. Requires OpenGL 4.3.
+ */
+class BoundsReducer {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    BoundsReducer (void) : shader("boundsReducer"), num_points(0) {}
+
+    /**
+     * @brief Compiles the reduction shader and creates the result buffer.
+     */
+    void initialize (void)
+    {
+        shader.initializeComputeFromString(source());
+        result.create(6*sizeof(GLuint));
+    }
+
+    /**
+     * @brief Dispatches the reduction, without waiting for it.
+     * @param points Buffer with the float coordinates.
+     * @param count Number of points.
+     * @param stride Number of floats from one point to the next (3 for xyz, 4 for xyzw, ...).
+     * @param first Index of the first point.
+     */
+    void dispatch (Buffer& points, GLuint count, GLuint stride = 3, GLuint first = 0)
+    {
+        // identities of min and max in the encoded order
+        const GLuint reset[6] = {0xFFFFFFFFu, 0xFFFFFFFFu, 0xFFFFFFFFu, 0u, 0u, 0u};
+        result.update(reset, sizeof(reset));
+        num_points = count;
+        if (count == 0)
+        {
+            return;
+        }
+
+        shader.bind();
+        points.bindBase(0);
+        result.bindBase(1);
+        shader.setUniform("count", (GLint)count);
+        shader.setUniform("stride", (GLint)stride);
+        shader.setUniform("first", (GLint)first);
+        // each invocation loops over several points, a few thousand groups are enough to fill the GPU
+        GLuint groups = std::min((count + GROUP_SIZE - 1) / GROUP_SIZE, (GLuint)4096);
+        shader.dispatch(groups, 1, 1, GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        shader.unbind();
+    }
+
+    /**
+     * @brief Reads back the box of the last dispatch. Waits for the GPU.
+     * @return Bounding box, empty (reset) if there were no points.
+     */
+    BoundingBox3<float> read (void)
+    {
+        BoundingBox3<float> box;
+        if (num_points == 0)
+        {
+            return box;
+        }
+        glState.flushBarriers();
+        GLuint encoded[6];
+        result.read(encoded, sizeof(encoded));
+        return BoundingBox3<float>(decode(encoded[0]), decode(encoded[1]), decode(encoded[2]),
+                                   decode(encoded[3]), decode(encoded[4]), decode(encoded[5]));
+    }
+
+    /**
+     * @brief Dispatches the reduction and reads back the result.
+     * @param points Buffer with the float coordinates.
+     * @param count Number of points.
+     * @param stride Number of floats from one point to the next.
+     * @return Bounding box of the points.
+     */
+    BoundingBox3<float> compute (Buffer& points, GLuint count, GLuint stride = 3)
+    {
+        dispatch(points, count, stride);
+        return read();
+    }
+
+    /**
+     * @brief Returns the buffer with the encoded result, to be read by other shaders.
+     *
+     * Decode in GLSL with: uint u = v; float f = uintBitsToFloat((u & 0x80000000u) != 0u ? u & 0x7FFFFFFFu : ~u);
+     */
+    Buffer* getResultBuffer (void)
+    {
+        return &result;
+    }
+
+private:
+
+    /// Number of invocations per work group.
+    static const GLuint GROUP_SIZE = 256;
+
+    ///Copy Constructor
+    BoundsReducer (BoundsReducer const&);
+
+    ///Assignment Operation
+    BoundsReducer& operator= (BoundsReducer const&);
+
+    /**
+     * @brief Decodes a float from its order preserving encoding.
+     */
+    static float decode (GLuint u)
+    {
+        GLuint bits = (u & 0x80000000u) ? (u & 0x7FFFFFFFu) : ~u;
+        float f;
+        memcpy(&f, &bits, sizeof(float));
+        return f;
+    }
+
+    /**
+     * @brief Returns the reduction compute shader code.
+     */
+    static string source (void)
+    {
+        return
+            "#version 430\n"
+            "layout(local_size_x = 256) in;\n"
+            "layout(std430, binding = 0) readonly buffer Points { float points[]; };\n"
+            "layout(std430, binding = 1) buffer Bounds { uint bounds[6]; };\n"
+            "uniform int count;\n"
+            "uniform int stride;\n"
+            "uniform int first;\n"
+            "shared vec3 group_lo[256];\n"
+            "shared vec3 group_hi[256];\n"
+            "uint encode (float f) {\n"
+            "    uint u = floatBitsToUint(f);\n"
+            "    return (u & 0x80000000u) != 0u ? ~u : (u | 0x80000000u);\n"
+            "}\n"
+            "void main () {\n"
+            "    vec3 lo = vec3(3.402823e38);\n"
+            "    vec3 hi = vec3(-3.402823e38);\n"
+            "    uint num_threads = gl_NumWorkGroups.x * gl_WorkGroupSize.x;\n"
+            "    for (uint i = gl_GlobalInvocationID.x; i < uint(count); i += num_threads) {\n"
+            "        uint base = (uint(first) + i) * uint(stride);\n"
+            "        vec3 p = vec3(points[base], points[base + 1u], points[base + 2u]);\n"
+            "        lo = min(lo, p);\n"
+            "        hi = max(hi, p);\n"
+            "    }\n"
+            "    uint l = gl_LocalInvocationIndex;\n"
+            "    group_lo[l] = lo;\n"
+            "    group_hi[l] = hi;\n"
+            "    barrier();\n"
+            "    for (uint s = gl_WorkGroupSize.x / 2u; s > 0u; s >>= 1u) {\n"
+            "        if (l < s) {\n"
+            "            group_lo[l] = min(group_lo[l], group_lo[l + s]);\n"
+            "            group_hi[l] = max(group_hi[l], group_hi[l + s]);\n"
+            "        }\n"
+            "        barrier();\n"
+            "    }\n"
+            "    if (l == 0u) {\n"
+            "        for (int c = 0; c < 3; ++c) {\n"
+            "            atomicMin(bounds[c], encode(group_lo[0][c]));\n"
+            "            atomicMax(bounds[3 + c], encode(group_hi[0][c]));\n"
+            "        }\n"
+            "    }\n"
+            "}\n";
+    }
+
+    /// Reduction compute shader.
+    Shader shader;
+
+    /// Encoded result.
+    Buffer result;
+
+    /// Number of points of the last dispatch.
+    GLuint num_points;
+};
+
+}
+
+#endif
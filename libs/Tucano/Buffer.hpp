@@ -0,0 +1,307 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BUFFER__
+#define __BUFFER__
+
+#include <iostream>
+#include <utility>
+#include <GL/glew.h>
+
+#include "DeletionQueue.hpp"
+#include "GLState.hpp"
+
+namespace Tucano
+{
+
+/**
+ * @brief A generic GL buffer object, usually a shader storage buffer.
+ *
+ * Storage is immutable when buffer storage (GL 4.4) is available, and can be persistently mapped so
+ * the CPU writes (or reads) it directly. The same buffer can be bound to indexed targets
+ * (shader storage, uniform, atomic counter, transform feedback) or used as vertex or indirect buffer.
+ */
+class Buffer {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    Buffer (void) : buffer_id(0), buffer_size(0), mapped(NULL), storage_flags(0) {}
+
+    /**
+     * @brief Default destructor, deletes the buffer.
+     */
+    ~Buffer (void)
+    {
+        destroy();
+    }
+
+    /**
+     * @brief Move constructor, takes the buffer (and its mapping) of another buffer, leaving it empty.
+     * @param other Buffer to move from.
+     */
+    Buffer (Buffer&& other) noexcept : buffer_id(other.buffer_id), buffer_size(other.buffer_size),
+                                       mapped(other.mapped), storage_flags(other.storage_flags)
+    {
+        other.buffer_id = 0;
+        other.buffer_size = 0;
+        other.mapped = NULL;
+        other.storage_flags = 0;
+    }
+
+    /**
+     * @brief Move assignment, deletes the current buffer and takes the one of another buffer.
+     * @param other Buffer to move from.
+     * @return Reference to this buffer.
+     */
+    Buffer& operator= (Buffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            std::swap(buffer_id, other.buffer_id);
+            std::swap(buffer_size, other.buffer_size);
+            std::swap(mapped, other.mapped);
+            std::swap(storage_flags, other.storage_flags);
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Creates the buffer storage.
+     *
+     * Without buffer storage support a mutable buffer is created with glBufferData, and mapping flags are ignored.
+     * @param size Size in bytes.
+     * @param data Initial data, or NULL.
+     * @param flags Storage flags (default lets the buffer be updated with update).
+     * @return True if created.
+     */
+    bool create (GLsizeiptr size, const GLvoid* data = NULL, GLbitfield flags = GL_DYNAMIC_STORAGE_BIT)
+    {
+        destroy();
+        buffer_size = size;
+        storage_flags = flags;
+        glGenBuffers(1, &buffer_id);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+        if (isStorageSupported())
+        {
+            glBufferStorage(GL_COPY_WRITE_BUFFER, size, data, flags);
+        }
+        else
+        {
+            storage_flags = 0;
+            glBufferData(GL_COPY_WRITE_BUFFER, size, data, GL_DYNAMIC_DRAW);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return buffer_id != 0;
+    }
+
+    /**
+     * @brief Creates the buffer and maps it persistently and coherently.
+     *
+     * The CPU must not write a region the GPU may still be reading, fence the accesses when reusing regions.
+     * @param size Size in bytes.
+     * @param data Initial data, or NULL.
+     * @param read If true the mapping can also be read (ex. to read compute results).
+     * @return Pointer to the mapped memory, or NULL if persistent mapping is not supported.
+     */
+    GLvoid* createMapped (GLsizeiptr size, const GLvoid* data = NULL, bool read = false)
+    {
+        if (!isStorageSupported())
+        {
+            std::cerr << "Warning: persistent buffer mapping requires OpenGL 4.4!" << std::endl;
+            return NULL;
+        }
+        GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT | (read ? GL_MAP_READ_BIT : 0);
+        create(size, data, access | GL_DYNAMIC_STORAGE_BIT);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+        mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, access);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (!mapped)
+        {
+            std::cerr << "Error: could not map buffer" << std::endl;
+        }
+        return mapped;
+    }
+
+    /**
+     * @brief Unmaps and deletes the buffer.
+     */
+    void destroy (void)
+    {
+        if (buffer_id != 0)
+        {
+            if (mapped)
+            {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            }
+            DeletionQueue::Instance().retire(DeletionQueue::BUFFER, buffer_id);
+        }
+        buffer_id = 0;
+        buffer_size = 0;
+        mapped = NULL;
+        storage_flags = 0;
+    }
+
+    /**
+     * @brief Updates a range of the buffer.
+     * @param data Pointer to the data.
+     * @param size Number of bytes.
+     * @param offset Offset in bytes.
+     */
+    void update (const GLvoid* data, GLsizeiptr size, GLintptr offset = 0)
+    {
+        glState.flushBarriers();
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    /**
+     * @brief Reads a range of the buffer back to the CPU. Waits for the GPU.
+     *
+     * If the buffer was written by a shader, GL_BUFFER_UPDATE_BARRIER_BIT must have been recorded, the recorded
+     * barriers are issued before reading.
+     * @param data Pointer to receive the data.
+     * @param size Number of bytes.
+     * @param offset Offset in bytes.
+     */
+    void read (GLvoid* data, GLsizeiptr size, GLintptr offset = 0)
+    {
+        glState.flushBarriers();
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer_id);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, offset, size, data);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    /**
+     * @brief Fills the buffer with zeros.
+     */
+    void clear (void)
+    {
+        glState.flushBarriers();
+        GLuint zero = 0;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_id);
+        glClearBufferData(GL_COPY_WRITE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    /**
+     * @brief Binds the buffer to an indexed binding point.
+     * @param index Binding point (ex. the binding of a GLSL buffer block).
+     * @param target GL_SHADER_STORAGE_BUFFER (default), GL_UNIFORM_BUFFER, GL_ATOMIC_COUNTER_BUFFER or GL_TRANSFORM_FEEDBACK_BUFFER.
+     */
+    void bindBase (GLuint index, GLenum target = GL_SHADER_STORAGE_BUFFER)
+    {
+        glBindBufferBase(target, index, buffer_id);
+    }
+
+    /**
+     * @brief Binds a range of the buffer to an indexed binding point.
+     * @param index Binding point.
+     * @param offset Offset in bytes, must respect the target offset alignment.
+     * @param size Size of the range in bytes.
+     * @param target Indexed target.
+     */
+    void bindRange (GLuint index, GLintptr offset, GLsizeiptr size, GLenum target = GL_SHADER_STORAGE_BUFFER)
+    {
+        glBindBufferRange(target, index, buffer_id, offset, size);
+    }
+
+    /**
+     * @brief Binds the buffer to a non-indexed target (ex. GL_ARRAY_BUFFER or GL_DISPATCH_INDIRECT_BUFFER).
+     * @param target Buffer target.
+     */
+    void bind (GLenum target)
+    {
+        glBindBuffer(target, buffer_id);
+    }
+
+    /**
+     * @brief Unbinds any buffer from a non-indexed target.
+     * @param target Buffer target.
+     */
+    void unbind (GLenum target)
+    {
+        glBindBuffer(target, 0);
+    }
+
+    /**
+     * @brief Returns the persistently mapped memory, or NULL if not mapped.
+     */
+    GLvoid* getMappedPointer (void) const
+    {
+        return mapped;
+    }
+
+    /**
+     * @brief Returns the buffer handle.
+     */
+    GLuint bufferID (void) const
+    {
+        return buffer_id;
+    }
+
+    /**
+     * @brief Returns the buffer size in bytes.
+     */
+    GLsizeiptr getSize (void) const
+    {
+        return buffer_size;
+    }
+
+    /**
+     * @brief Returns wether immutable buffer storage (GL 4.4 or ARB_buffer_storage) is supported.
+     */
+    static bool isStorageSupported (void)
+    {
+        return GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    }
+
+private:
+
+    ///Copy Constructor
+    Buffer (Buffer const&);
+
+    ///Assignment Operation
+    Buffer& operator= (Buffer const&);
+
+    /// Buffer handle.
+    GLuint buffer_id;
+
+    /// Size in bytes.
+    GLsizeiptr buffer_size;
+
+    /// Persistently mapped memory.
+    GLvoid* mapped;
+
+    /// Storage flags used at creation.
+    GLbitfield storage_flags;
+};
+
+}
+
+#endif
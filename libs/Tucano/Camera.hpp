@@ -23,8 +23,11 @@
 #define __CAMERA__
 
 #include "Misc.hpp"
+#include "UniformBuffer.hpp"
+#include "Frustum.hpp"
 #include <Eigen/Dense>
 #include <cmath>  
+#include <limits>
 
 namespace Tucano
 {
@@ -80,6 +83,21 @@ protected:
     /// Flag to indicate if using a perspective or othograpic projection.
     bool use_perspective;
 
+    /// Cached projection times view matrix (see getViewProjectionMatrix).
+    mutable Eigen::Matrix4f view_projection;
+
+    /// Projection matrix used to compute the cached view projection.
+    mutable Eigen::Matrix4f cached_projection;
+
+    /// View matrix used to compute the cached view projection.
+    mutable Eigen::Matrix4f cached_view;
+
+    /// Cached inverse of the view projection (see getInverseViewProjectionMatrix).
+    mutable Eigen::Matrix4f inverse_view_projection;
+
+    /// Flag to indicate the cached inverse matches the cached view projection.
+    mutable bool inverse_valid;
+
 public:
 
     /**
@@ -157,7 +175,7 @@ public:
     inline Eigen::Vector3f projectPoint (const Eigen::Vector4f& pt, Eigen::Vector4f& viewport)
     {
         Eigen::Vector3f screen_pt = Eigen::Vector3f::Zero();
-        Eigen::Vector4f proj = projection_matrix * view_matrix * pt;
+        Eigen::Vector4f proj = getViewProjectionMatrix() * pt;
         if (proj[3] == 0.0)
             return screen_pt;
 
@@ -170,6 +188,176 @@ public:
     }
 
 
+    /**
+     * @brief Projects many points (w = 1) to screen space, stored as structure of arrays.
+     *
+     * Same result as projectPoint for each point, points with clip w equal to zero are set to zero.
+     * Uses AVX or NEON when the code is compiled for them (ex. -mavx or -march=native).
+     * @param x Points x coordinates.
+     * @param y Points y coordinates.
+     * @param z Points z coordinates.
+     * @param count Number of points.
+     * @param viewport Viewport [minX, minY, width, height].
+     * @param sx Receives the screen x coordinates.
+     * @param sy Receives the screen y coordinates.
+     * @param sz Receives the depths, in [0, 1] inside the frustum.
+     */
+    void projectPoints (const float* x, const float* y, const float* z, size_t count, const Eigen::Vector4f& viewport,
+                        float* sx, float* sy, float* sz) const
+    {
+        const Eigen::Matrix4f& m = getViewProjectionMatrix();
+        const float half_w = 0.5f * viewport[2], half_h = 0.5f * viewport[3];
+        const float offset_x = viewport[0] + half_w, offset_y = viewport[1] + half_h;
+        size_t i = 0;
+
+#if defined(__AVX__)
+        __m256 m00 = _mm256_set1_ps(m(0,0)), m01 = _mm256_set1_ps(m(0,1)), m02 = _mm256_set1_ps(m(0,2)), m03 = _mm256_set1_ps(m(0,3));
+        __m256 m10 = _mm256_set1_ps(m(1,0)), m11 = _mm256_set1_ps(m(1,1)), m12 = _mm256_set1_ps(m(1,2)), m13 = _mm256_set1_ps(m(1,3));
+        __m256 m20 = _mm256_set1_ps(m(2,0)), m21 = _mm256_set1_ps(m(2,1)), m22 = _mm256_set1_ps(m(2,2)), m23 = _mm256_set1_ps(m(2,3));
+        __m256 m30 = _mm256_set1_ps(m(3,0)), m31 = _mm256_set1_ps(m(3,1)), m32 = _mm256_set1_ps(m(3,2)), m33 = _mm256_set1_ps(m(3,3));
+        __m256 scale_x = _mm256_set1_ps(half_w), scale_y = _mm256_set1_ps(half_h), half = _mm256_set1_ps(0.5f);
+        __m256 add_x = _mm256_set1_ps(offset_x), add_y = _mm256_set1_ps(offset_y), one = _mm256_set1_ps(1.0f), zero = _mm256_setzero_ps();
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 px = _mm256_loadu_ps(x + i), py = _mm256_loadu_ps(y + i), pz = _mm256_loadu_ps(z + i);
+            __m256 cx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, px), _mm256_mul_ps(m01, py)), _mm256_add_ps(_mm256_mul_ps(m02, pz), m03));
+            __m256 cy = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m10, px), _mm256_mul_ps(m11, py)), _mm256_add_ps(_mm256_mul_ps(m12, pz), m13));
+            __m256 cz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m20, px), _mm256_mul_ps(m21, py)), _mm256_add_ps(_mm256_mul_ps(m22, pz), m23));
+            __m256 cw = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m30, px), _mm256_mul_ps(m31, py)), _mm256_add_ps(_mm256_mul_ps(m32, pz), m33));
+            __m256 valid = _mm256_cmp_ps(cw, zero, _CMP_NEQ_OQ);
+            __m256 inv_w = _mm256_div_ps(one, cw);
+            __m256 rx = _mm256_add_ps(add_x, _mm256_mul_ps(scale_x, _mm256_mul_ps(cx, inv_w)));
+            __m256 ry = _mm256_add_ps(add_y, _mm256_mul_ps(scale_y, _mm256_mul_ps(cy, inv_w)));
+            __m256 rz = _mm256_add_ps(half, _mm256_mul_ps(half, _mm256_mul_ps(cz, inv_w)));
+            _mm256_storeu_ps(sx + i, _mm256_and_ps(rx, valid));
+            _mm256_storeu_ps(sy + i, _mm256_and_ps(ry, valid));
+            _mm256_storeu_ps(sz + i, _mm256_and_ps(rz, valid));
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        float32x4_t zero = vdupq_n_f32(0.0f);
+        for (; i + 4 <= count; i += 4)
+        {
+            float32x4_t px = vld1q_f32(x + i), py = vld1q_f32(y + i), pz = vld1q_f32(z + i);
+            float32x4_t clip[4];
+            for (int r = 0; r < 4; ++r)
+            {
+                clip[r] = vdupq_n_f32(m(r,3));
+                clip[r] = vmlaq_n_f32(clip[r], px, m(r,0));
+                clip[r] = vmlaq_n_f32(clip[r], py, m(r,1));
+                clip[r] = vmlaq_n_f32(clip[r], pz, m(r,2));
+            }
+            uint32x4_t invalid = vceqq_f32(clip[3], zero);
+            float32x4_t inv_w = vdivq_f32(vdupq_n_f32(1.0f), clip[3]);
+            float32x4_t rx = vmlaq_n_f32(vdupq_n_f32(offset_x), vmulq_f32(clip[0], inv_w), half_w);
+            float32x4_t ry = vmlaq_n_f32(vdupq_n_f32(offset_y), vmulq_f32(clip[1], inv_w), half_h);
+            float32x4_t rz = vmlaq_n_f32(vdupq_n_f32(0.5f), vmulq_f32(clip[2], inv_w), 0.5f);
+            vst1q_f32(sx + i, vbslq_f32(invalid, zero, rx));
+            vst1q_f32(sy + i, vbslq_f32(invalid, zero, ry));
+            vst1q_f32(sz + i, vbslq_f32(invalid, zero, rz));
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            float cx = m(0,0)*x[i] + m(0,1)*y[i] + m(0,2)*z[i] + m(0,3);
+            float cy = m(1,0)*x[i] + m(1,1)*y[i] + m(1,2)*z[i] + m(1,3);
+            float cz = m(2,0)*x[i] + m(2,1)*y[i] + m(2,2)*z[i] + m(2,3);
+            float cw = m(3,0)*x[i] + m(3,1)*y[i] + m(3,2)*z[i] + m(3,3);
+            if (cw == 0.0f)
+            {
+                sx[i] = sy[i] = sz[i] = 0.0f;
+                continue;
+            }
+            float inv_w = 1.0f / cw;
+            sx[i] = offset_x + half_w * cx * inv_w;
+            sy[i] = offset_y + half_h * cy * inv_w;
+            sz[i] = 0.5f + 0.5f * cz * inv_w;
+        }
+    }
+
+    /**
+     * @brief Returns the projection matrix times the view matrix.
+     *
+     * The product is cached and only recomputed when one of the matrices changed, even through the
+     * viewMatrix and projectionMatrix pointers.
+     * @return View projection matrix.
+     */
+    const Eigen::Matrix4f& getViewProjectionMatrix (void) const
+    {
+        if (cached_projection != projection_matrix || cached_view != view_matrix.matrix())
+        {
+            cached_projection = projection_matrix;
+            cached_view = view_matrix.matrix();
+            view_projection = cached_projection * cached_view;
+            inverse_valid = false;
+        }
+        return view_projection;
+    }
+
+    /**
+     * @brief Returns the inverse of the view projection matrix, cached as the view projection itself.
+     * @return Inverse view projection matrix.
+     */
+    const Eigen::Matrix4f& getInverseViewProjectionMatrix (void) const
+    {
+        const Eigen::Matrix4f& m = getViewProjectionMatrix();
+        if (!inverse_valid)
+        {
+            inverse_view_projection = m.inverse();
+            inverse_valid = true;
+        }
+        return inverse_view_projection;
+    }
+
+    /**
+     * @brief Returns the view frustum in world space.
+     * @return Frustum planes of the view projection matrix.
+     */
+    Frustum getFrustum (void) const
+    {
+        return Frustum(getViewProjectionMatrix());
+    }
+
+    /**
+     * @brief Returns the view frustum in the object space of a model.
+     * @param model_matrix Model matrix of the object.
+     * @return Frustum planes, to be tested against the object space bounding boxes.
+     */
+    Frustum getFrustum (const Eigen::Affine3f& model_matrix) const
+    {
+        return Frustum(getViewProjectionMatrix() * model_matrix.matrix());
+    }
+
+    /**
+     * @brief Normalizes a screen position (ex. mouse coordinates, origin at top left) to range [-1,1].
+     *
+     * Same convention as Trackball::normalizePosition, with the y axis pointing up.
+     * @param pos Screen position in pixels.
+     * @return Position in normalized device coordinates.
+     */
+    Eigen::Vector2f normalizeScreenPosition (const Eigen::Vector2f& pos) const
+    {
+        return Eigen::Vector2f (2.0f * (pos[0] - viewport[0]) / viewport[2] - 1.0f,
+                                1.0f - 2.0f * (pos[1] - viewport[1]) / viewport[3]);
+    }
+
+    /**
+     * @brief Computes the world space ray through a point of the screen, for picking.
+     *
+     * The ray starts at the near plane and its direction is normalized, so hit parameters are distances.
+     * @param ndc_pos Position in normalized device coordinates (see normalizeScreenPosition).
+     * @param origin Receives the ray origin.
+     * @param direction Receives the ray direction.
+     */
+    void getRay (const Eigen::Vector2f& ndc_pos, Eigen::Vector3f& origin, Eigen::Vector3f& direction) const
+    {
+        const Eigen::Matrix4f& inverse = getInverseViewProjectionMatrix();
+        Eigen::Vector4f near_pt = inverse * Eigen::Vector4f(ndc_pos[0], ndc_pos[1], -1.0f, 1.0f);
+        Eigen::Vector4f far_pt = inverse * Eigen::Vector4f(ndc_pos[0], ndc_pos[1], 1.0f, 1.0f);
+        origin = near_pt.head<3>() / near_pt[3];
+        direction = (far_pt.head<3>() / far_pt[3] - origin).normalized();
+    }
+
     /**
      * @brief Returns the view matrix as an Affine 3x3 matrix
      * @return View Matrix.
@@ -324,6 +512,22 @@ public:
         return far_plane;
     }
 
+    /**
+     * @brief Writes the camera values in the layout of the shared camera block (see CameraBlock).
+     * @param writer Std140 writer to append the block to.
+     */
+    void fillCameraBlock (Std140Writer& writer) const
+    {
+        Eigen::Matrix4f view = view_matrix.matrix();
+        writer.add(projection_matrix);
+        writer.add(view);
+        writer.add(getViewProjectionMatrix());
+        writer.add(Eigen::Matrix4f(view.inverse()));
+        writer.add(viewport);
+        writer.add(Eigen::Vector4f(getCenter()[0], getCenter()[1], getCenter()[2], 1.0f));
+        writer.add(Eigen::Vector4f(near_plane, far_plane, fovy, aspect_ratio));
+    }
+
     /**
      * @brief Default destructor.
      */
@@ -355,8 +559,12 @@ public:
         near_plane = 0.1f;
         far_plane = 100.0f;
         fovy = 60.0f;
+        aspect_ratio = 1.0f;
 
         default_view = Eigen::Affine3f::Identity();
+        cached_view.setConstant(std::numeric_limits<float>::quiet_NaN());
+        cached_projection = cached_view;
+        inverse_valid = false;
         reset();
     }
 
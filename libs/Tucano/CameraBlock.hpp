@@ -0,0 +1,135 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CAMERABLOCK__
+#define __CAMERABLOCK__
+
+/// Defines our unique instance of this singleton class.
+#define cameraBlock CameraBlock::Instance()
+
+#include "Camera.hpp"
+#include "UniformBuffer.hpp"
+
+namespace Tucano
+{
+
+/**
+ * @brief Singleton holding the camera uniform block shared by all programs.
+ *
+ * Call update once per frame with the active camera. Every program declaring the block below
+ * is assigned to its binding point when linked, so no camera uniform has to be set per program:
+ *
+ *     layout(std140) uniform CameraBlock {
+ *         mat4 projectionMatrix;
+ *         mat4 viewMatrix;
+ *         mat4 viewProjectionMatrix;
+ *         mat4 inverseViewMatrix;
+ *         vec4 viewport;        // [minX, minY, width, height]
+ *         vec4 cameraPosition;  // world space, w = 1
+ *         vec4 cameraParams;    // near, far, fovy, aspect ratio
+ *     };
+ *
+ * The instance outlives the context and the per thread DeletionQueue, so its buffer must be deleted
+ * with release before the context is destroyed. Application does it when its loop ends.
+ */
+class CameraBlock {
+
+public:
+
+    /**
+     * @brief Returns the unique instance. If no instace exists, it will create one (only once).
+     */
+    static CameraBlock &Instance (void)
+    {
+        static CameraBlock _instance;
+        return _instance;
+    }
+
+    /**
+     * @brief Uploads the camera matrices and binds the block.
+     * @param camera Camera to read from.
+     */
+    void update (const Camera& camera)
+    {
+        writer.clear();
+        camera.fillCameraBlock(writer);
+        buffer.update(writer);
+        buffer.bindBase(TUCANO_CAMERA_BLOCK_BINDING);
+    }
+
+    /**
+     * @brief Returns the GLSL declaration of the block, to be pasted in shaders.
+     */
+    static const char* declaration (void)
+    {
+        return "layout(std140) uniform CameraBlock {\n"
+               "    mat4 projectionMatrix;\n"
+               "    mat4 viewMatrix;\n"
+               "    mat4 viewProjectionMatrix;\n"
+               "    mat4 inverseViewMatrix;\n"
+               "    vec4 viewport;\n"
+               "    vec4 cameraPosition;\n"
+               "    vec4 cameraParams;\n"
+               "};\n";
+    }
+
+    /**
+     * @brief Returns the uniform buffer holding the block.
+     */
+    UniformBuffer* getBuffer (void)
+    {
+        return &buffer;
+    }
+
+    /**
+     * @brief Deletes the uniform buffer, with the context that updated the block current.
+     *
+     * The buffer is created again by the next update.
+     */
+    void release (void)
+    {
+        buffer.destroy();
+    }
+
+    ~CameraBlock () {}
+
+private:
+
+    ///Default Constructor
+    CameraBlock (void) {}
+
+    ///Copy Constructor
+    CameraBlock (CameraBlock const&);
+
+    ///Assignment Operation
+    CameraBlock& operator= (CameraBlock const&);
+
+    /// Uniform buffer holding the block.
+    UniformBuffer buffer;
+
+    /// Writer reused every frame.
+    Std140Writer writer;
+};
+
+}
+
+#endif
@@ -0,0 +1,410 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __COMMANDLIST__
+#define __COMMANDLIST__
+
+#include "Shader.hpp"
+#include "GLTexture.hpp"
+#include "FrameBuffer.hpp"
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <algorithm>
+
+namespace Tucano
+{
+
+/**
+ * @brief A list of GL commands recorded by any thread and executed later by the thread owning the context.
+ *
+ * Commands are stored in a linear arena of large blocks: recording is a bump allocation and a copy, and
+ * reset keeps the blocks for the next frame, so a list reused every frame does not allocate.
+ * Each worker thread records into its own list, the render thread executes the lists in submission order
+ * (see RenderThread). Recording never calls OpenGL.
+ *
+ * Common commands have helpers taking Tucano objects, which are called on the render thread (ex. bind
+ * calls Shader::bind), so the objects must live until the list is executed. Anything else, including the
+ * methods of the existing classes, is recorded with call:
+ *
+ *     list.bind(shader);
+ *     list.setUniform(shader, "modelMatrix", model.getModelMatrix());
+ *     list.call([&mesh, &shader] () { mesh.render(shader); });
+ *
+ * Uniform names are copied into the arena and values are captured at recording time.
+ */
+class CommandList {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     * @param block Size in bytes of each arena block, commands larger than a block get their own block.
+     */
+    CommandList (size_t block = 64 * 1024) : block_size(block), current_block(0), block_offset(0),
+                                             first(NULL), last(NULL), num_commands(0) {}
+
+    /**
+     * @brief Default destructor, destroys the recorded commands and frees the arena.
+     */
+    ~CommandList (void)
+    {
+        reset();
+        for (unsigned int i = 0; i < blocks.size(); ++i)
+        {
+            delete [] blocks[i].storage;
+        }
+    }
+
+    /**
+     * @brief Records any callable, executed with no arguments on the render thread.
+     * @param function Callable (ex. a lambda), copied into the arena.
+     */
+    template <class Function>
+    void call (const Function& function)
+    {
+        static_assert(alignof(Command<Function>) <= BLOCK_ALIGNMENT, "command alignment is larger than the arena blocks alignment");
+        void* memory = allocate(sizeof(Command<Function>), alignof(Command<Function>));
+        Command<Function>* command = new (memory) Command<Function>(function);
+        if (last)
+        {
+            last->next = command;
+        }
+        else
+        {
+            first = command;
+        }
+        last = command;
+        ++num_commands;
+    }
+
+    /**
+     * @brief Executes all commands in recording order. Must be called by the thread with the current context.
+     */
+    void execute (void) const
+    {
+        for (CommandBase* command = first; command; command = command->next)
+        {
+            command->execute();
+        }
+    }
+
+    /**
+     * @brief Destroys the recorded commands, keeping the arena memory for the next recording.
+     */
+    void reset (void)
+    {
+        CommandBase* command = first;
+        while (command)
+        {
+            CommandBase* next = command->next;
+            command->~CommandBase();
+            command = next;
+        }
+        first = last = NULL;
+        num_commands = 0;
+        current_block = 0;
+        block_offset = 0;
+    }
+
+    /**
+     * @brief Records a Shader::bind.
+     * @param shader Shader, must be alive when the list executes.
+     */
+    void bind (Shader& shader)
+    {
+        Shader* s = &shader;
+        call([s] () { s->bind(); });
+    }
+
+    /**
+     * @brief Records a Shader::unbind.
+     * @param shader Shader.
+     */
+    void unbind (Shader& shader)
+    {
+        Shader* s = &shader;
+        call([s] () { s->unbind(); });
+    }
+
+    /**
+     * @brief Records a Framebuffer::bind.
+     * @param fbo Framebuffer, must be alive when the list executes.
+     */
+    void bind (Framebuffer& fbo)
+    {
+        Framebuffer* f = &fbo;
+        call([f] () { f->bind(); });
+    }
+
+    /**
+     * @brief Records a Framebuffer::unbindFBO, binding the default framebuffer.
+     * @param fbo Framebuffer.
+     */
+    void unbind (Framebuffer& fbo)
+    {
+        Framebuffer* f = &fbo;
+        call([f] () { f->unbindFBO(); });
+    }
+
+    /**
+     * @brief Records a Texture::bind to a given unit.
+     * @param texture Texture, must be alive when the list executes.
+     * @param unit Texture unit.
+     */
+    void bind (Texture& texture, int unit)
+    {
+        Texture* t = &texture;
+        call([t, unit] () { t->bind(unit); });
+    }
+
+    /**
+     * @brief Records a Texture::unbind.
+     * @param texture Texture.
+     */
+    void unbind (Texture& texture)
+    {
+        Texture* t = &texture;
+        call([t] () { t->unbind(); });
+    }
+
+    /**
+     * @brief Records a Shader::setUniform of any type the shader accepts.
+     * @param shader Shader.
+     * @param name Uniform name, copied.
+     * @param value Uniform value, copied.
+     */
+    template <class T>
+    void setUniform (Shader& shader, const GLchar* name, const T& value)
+    {
+        Shader* s = &shader;
+        const GLchar* n = copyString(name);
+        call([s, n, value] () { s->setUniform(n, value); });
+    }
+
+    /**
+     * @brief Records a glViewport.
+     */
+    void viewport (GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        call([x, y, width, height] () { glViewport(x, y, width, height); });
+    }
+
+    /**
+     * @brief Records a glClearColor and glClear.
+     * @param mask Buffers to clear (ex. GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT).
+     * @param color Clear color.
+     */
+    void clear (GLbitfield mask, const Eigen::Vector4f& color = Eigen::Vector4f(0.0, 0.0, 0.0, 0.0))
+    {
+        float r = color[0], g = color[1], b = color[2], a = color[3];
+        call([mask, r, g, b, a] () { glClearColor(r, g, b, a); glClear(mask); });
+    }
+
+    /**
+     * @brief Records a glDrawArraysInstanced.
+     */
+    void drawArrays (GLenum mode, GLint first_vertex, GLsizei count, GLsizei instances = 1)
+    {
+        call([mode, first_vertex, count, instances] ()
+        {
+            glState.flushBarriers();
+            glDrawArraysInstanced(mode, first_vertex, count, instances);
+        });
+    }
+
+    /**
+     * @brief Records a glDrawElementsInstancedBaseVertex, with the element buffer of the vertex array bound at execution.
+     * @param offset Offset of the first index in bytes.
+     */
+    void drawElements (GLenum mode, GLsizei count, GLenum type, GLintptr offset = 0, GLsizei instances = 1, GLint base_vertex = 0)
+    {
+        call([mode, count, type, offset, instances, base_vertex] ()
+        {
+            glState.flushBarriers();
+            glDrawElementsInstancedBaseVertex(mode, count, type, (const GLvoid*)offset, instances, base_vertex);
+        });
+    }
+
+    /**
+     * @brief Records a glBindVertexArray.
+     */
+    void bindVertexArray (GLuint vao)
+    {
+        call([vao] () { glBindVertexArray(vao); });
+    }
+
+    /**
+     * @brief Records a compute dispatch (see Shader::dispatch), the shader must be bound.
+     */
+    void dispatch (Shader& shader, GLuint x, GLuint y = 1, GLuint z = 1, GLbitfield barriers = GL_SHADER_STORAGE_BARRIER_BIT)
+    {
+        Shader* s = &shader;
+        call([s, x, y, z, barriers] () { s->dispatch(x, y, z, barriers); });
+    }
+
+    /**
+     * @brief Returns the number of recorded commands.
+     */
+    unsigned int getNumCommands (void) const
+    {
+        return num_commands;
+    }
+
+    /**
+     * @brief Returns wether no command was recorded.
+     */
+    bool empty (void) const
+    {
+        return num_commands == 0;
+    }
+
+    /**
+     * @brief Returns the arena memory in bytes, used and reserved.
+     */
+    size_t getArenaSize (void) const
+    {
+        size_t total = 0;
+        for (unsigned int i = 0; i < blocks.size(); ++i)
+        {
+            total += blocks[i].size;
+        }
+        return total;
+    }
+
+private:
+
+    /// Recorded command, linked in recording order.
+    struct CommandBase
+    {
+        CommandBase (void) : next(NULL) {}
+        virtual ~CommandBase (void) {}
+        virtual void execute (void) const = 0;
+        CommandBase* next;
+    };
+
+    /// Command holding a copy of a callable.
+    template <class Function>
+    struct Command : public CommandBase
+    {
+        Command (const Function& f) : function(f) {}
+        virtual void execute (void) const
+        {
+            function();
+        }
+        Function function;
+    };
+
+    /// Alignment of the arena blocks, enough for the fixed size Eigen types captured by commands (ex. with AVX).
+#if defined(EIGEN_MAX_ALIGN_BYTES) && EIGEN_MAX_ALIGN_BYTES > 16
+    enum { BLOCK_ALIGNMENT = EIGEN_MAX_ALIGN_BYTES };
+#else
+    enum { BLOCK_ALIGNMENT = 16 };
+#endif
+
+    /// Arena memory block.
+    struct Block
+    {
+        char* storage;
+        char* data;
+        size_t size;
+    };
+
+    ///Copy Constructor
+    CommandList (CommandList const&);
+
+    ///Assignment Operation
+    CommandList& operator= (CommandList const&);
+
+    /**
+     * @brief Allocates memory from the arena.
+     * @param size Number of bytes.
+     * @param alignment Alignment in bytes, a power of two up to BLOCK_ALIGNMENT.
+     */
+    void* allocate (size_t size, size_t alignment)
+    {
+        while (current_block < blocks.size() && alignOffset(block_offset, alignment) + size > blocks[current_block].size)
+        {
+            ++current_block;
+            block_offset = 0;
+        }
+        if (current_block == blocks.size())
+        {
+            // new[] only guarantees the alignment of fundamental types, the block start is aligned by hand
+            Block block;
+            block.size = std::max(block_size, size);
+            block.storage = new char[block.size + BLOCK_ALIGNMENT - 1];
+            size_t address = reinterpret_cast<size_t>(block.storage);
+            block.data = block.storage + (alignOffset(address, BLOCK_ALIGNMENT) - address);
+            blocks.push_back(block);
+            block_offset = 0;
+        }
+        block_offset = alignOffset(block_offset, alignment);
+        void* memory = blocks[current_block].data + block_offset;
+        block_offset += size;
+        return memory;
+    }
+
+    /**
+     * @brief Rounds an offset up to a multiple of an alignment.
+     */
+    static size_t alignOffset (size_t offset, size_t alignment)
+    {
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+
+    /**
+     * @brief Copies a string into the arena.
+     */
+    const GLchar* copyString (const GLchar* text)
+    {
+        size_t length = strlen(text) + 1;
+        GLchar* copy = (GLchar*)allocate(length, 1);
+        memcpy(copy, text, length);
+        return copy;
+    }
+
+    /// Size of each new block.
+    size_t block_size;
+
+    /// Arena blocks.
+    std::vector<Block> blocks;
+
+    /// Block being filled.
+    size_t current_block;
+
+    /// First free byte in the current block.
+    size_t block_offset;
+
+    /// First and last recorded commands.
+    CommandBase* first;
+    CommandBase* last;
+
+    /// Number of recorded commands.
+    unsigned int num_commands;
+};
+
+}
+
+#endif
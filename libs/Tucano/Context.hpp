@@ -0,0 +1,200 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CONTEXT__
+#define __CONTEXT__
+
+#include "Misc.hpp"
+
+#include <string>
+#include <Eigen/Dense>
+
+namespace Tucano
+{
+
+/**
+ * @brief Interface of an OpenGL context provider.
+ *
+ * Implemented by WindowContext (GLFW window) and HeadlessContext (EGL, no display needed), so the same
+ * application code can run interactively or as a batch job rendering into framebuffers.
+ * Each implementation is in its own header, include only the one whose library is linked.
+ */
+class Context {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    Context (void) : size(Eigen::Vector2i(0, 0)), close_requested(false) {}
+
+    /**
+     * @brief Default destructor.
+     */
+    virtual ~Context (void) {}
+
+    /**
+     * @brief Creates the context (and window or surface), without making it current.
+     * @param width Width of the window or surface.
+     * @param height Height of the window or surface.
+     * @param title Window title, ignored by headless contexts.
+     * @param major OpenGL major version (core profile).
+     * @param minor OpenGL minor version.
+     * @param debug If true a debug context is requested.
+     * @return True if the context was created.
+     */
+    virtual bool create (int width, int height, const std::string& title = "Tucano", int major = 4, int minor = 5, bool debug = false) = 0;
+
+    /**
+     * @brief Destroys the context.
+     */
+    virtual void destroy (void) = 0;
+
+    /**
+     * @brief Makes the context current in the calling thread.
+     */
+    virtual void makeCurrent (void) = 0;
+
+    /**
+     * @brief Releases the context from the calling thread, so another thread can make it current.
+     */
+    virtual void doneCurrent (void) = 0;
+
+    /**
+     * @brief Creates a context sharing objects (buffers, textures, programs) with this one, for another thread.
+     *
+     * Used to create resources asynchronously (see ResourceThread). The shared context has no default
+     * framebuffer to present and is not made current. Call from the thread that created this context.
+     * @return New context to be deleted by the caller, or NULL if sharing is not supported.
+     */
+    virtual Context* createShared (void)
+    {
+        return NULL;
+    }
+
+    /**
+     * @brief Presents the default framebuffer, nothing for headless contexts.
+     */
+    virtual void swapBuffers (void) = 0;
+
+    /**
+     * @brief Processes window events, nothing for headless contexts.
+     */
+    virtual void pollEvents (void) {}
+
+    /**
+     * @brief Applies a pending resize of the default framebuffer to the viewport, nothing for headless contexts.
+     *
+     * Window events are processed by the thread calling pollEvents, which may not be the rendering one, so
+     * the viewport is set by the thread the context is current in, before rendering a frame. Application
+     * and RenderThread call it once per frame.
+     */
+    virtual void updateViewport (void) {}
+
+    /**
+     * @brief Sets the number of vertical syncs to wait for on swapBuffers (0 disables vsync).
+     * @param interval Swap interval.
+     */
+    virtual void setSwapInterval (int interval) = 0;
+
+    /**
+     * @brief Returns wether the application should stop, because the window was closed or requestClose was called.
+     */
+    virtual bool shouldClose (void)
+    {
+        return close_requested;
+    }
+
+    /**
+     * @brief Asks the application loop to stop.
+     */
+    void requestClose (void)
+    {
+        close_requested = true;
+    }
+
+    /**
+     * @brief Returns wether the context has no window.
+     */
+    virtual bool isHeadless (void) const = 0;
+
+    /**
+     * @brief Returns wether rendering to framebuffer 0 is possible, otherwise all rendering must go to a Framebuffer.
+     */
+    virtual bool hasDefaultFramebuffer (void) const = 0;
+
+    /**
+     * @brief Returns the size of the window or surface in pixels.
+     */
+    Eigen::Vector2i getSize (void) const
+    {
+        return size;
+    }
+
+    /**
+     * @brief Creates the context, makes it current and initializes GLEW.
+     *
+     * With debug set the debug output callback is also installed (see Misc::enableDebugOutput).
+     * @param width Width of the window or surface.
+     * @param height Height of the window or surface.
+     * @param title Window title.
+     * @param major OpenGL major version.
+     * @param minor OpenGL minor version.
+     * @param debug If true a debug context is requested.
+     * @return True if the context is ready.
+     */
+    bool initialize (int width, int height, const std::string& title = "Tucano", int major = 4, int minor = 5, bool debug = false)
+    {
+        if (!create(width, height, title, major, minor, debug))
+        {
+            return false;
+        }
+        makeCurrent();
+        Misc::initializeGLEW();
+        glViewport(0, 0, size[0], size[1]);
+        if (debug)
+        {
+            Misc::enableDebugOutput();
+        }
+        return true;
+    }
+
+protected:
+
+    /// Window or surface size in pixels.
+    Eigen::Vector2i size;
+
+    /// Flag set by requestClose.
+    bool close_requested;
+
+private:
+
+    ///Copy Constructor
+    Context (Context const&);
+
+    ///Assignment Operation
+    Context& operator= (Context const&);
+};
+
+}
+
+#endif
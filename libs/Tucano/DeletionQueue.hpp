@@ -0,0 +1,261 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DELETIONQUEUE__
+#define __DELETIONQUEUE__
+
+#include <vector>
+#include <deque>
+#include <GL/glew.h>
+
+namespace Tucano
+{
+
+/**
+ * @brief Singleton queue that deletes GL objects once the GPU is done with the frames that used them.
+ *
+ * Texture, Framebuffer, Shader, Buffer and the classes built on them release their GL names through retire. By default the names are
+ * deleted immediately, as before. With deferred deletion enabled they are kept until the end of the frame,
+ * when fence closes the batch of names retired during the frame, and collect deletes the batches whose fence
+ * signaled. A name is then never reused by the driver while frames in flight still reference it, and
+ * destroying objects in the middle of a frame (ex. when trimming a pool) does not stall.
+ *
+ * Application and RenderThread call fence and collect after each swap, and flush at the end of the loop.
+ * Otherwise the owner of the context calls them:
+ *
+ *     DeletionQueue::Instance().setDeferred(true);
+ *     ...
+ *     context.swapBuffers();
+ *     DeletionQueue::Instance().fence();
+ *     DeletionQueue::Instance().collect();
+ *     ...
+ *     DeletionQueue::Instance().flush(); // before the context is destroyed
+ *
+ * As the GL state shadow, there is one queue per thread, holding names of the context current in the thread.
+ */
+class DeletionQueue {
+
+public:
+
+    /// Kinds of GL objects the queue deletes.
+    enum ObjectType
+    {
+        TEXTURE,
+        BUFFER,
+        FRAMEBUFFER,
+        RENDERBUFFER,
+        VERTEX_ARRAY,
+        TRANSFORM_FEEDBACK,
+        QUERY,
+        SHADER,
+        PROGRAM
+    };
+
+    /**
+     * @brief Returns the instance of the calling thread.
+     */
+    static DeletionQueue& Instance (void)
+    {
+        static thread_local DeletionQueue instance;
+        return instance;
+    }
+
+    /**
+     * @brief Enables or disables deferred deletion. Disabling it deletes all queued names.
+     * @param flag If true names are deleted after the fence of the frame that retired them signals.
+     */
+    void setDeferred (bool flag)
+    {
+        if (!flag && deferred)
+        {
+            flush();
+        }
+        deferred = flag;
+    }
+
+    /**
+     * @brief Returns wether deletion is deferred.
+     */
+    bool isDeferred (void) const
+    {
+        return deferred;
+    }
+
+    /**
+     * @brief Releases a GL name, deleting it now or queueing it until the end of the frame.
+     * @param type Object type.
+     * @param name GL name, 0 is ignored.
+     */
+    void retire (ObjectType type, GLuint name)
+    {
+        if (name == 0)
+        {
+            return;
+        }
+        if (!deferred)
+        {
+            deleteObject(type, name);
+            return;
+        }
+        pending.push_back(Object(type, name));
+    }
+
+    /**
+     * @brief Closes the batch of names retired since the last call, with a fence after the commands issued so far.
+     *
+     * Called once per frame, after the last command that may use the retired objects.
+     */
+    void fence (void)
+    {
+        if (pending.empty())
+        {
+            return;
+        }
+        batches.push_back(Batch());
+        batches.back().objects.swap(pending);
+        batches.back().fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    /**
+     * @brief Deletes the names of the batches whose fence signaled, without waiting.
+     * @return Number of deleted names.
+     */
+    unsigned int collect (void)
+    {
+        unsigned int count = 0;
+        while (!batches.empty())
+        {
+            GLenum status = glClientWaitSync(batches.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+            {
+                break;
+            }
+            count += deleteBatch(batches.front());
+            batches.pop_front();
+        }
+        return count;
+    }
+
+    /**
+     * @brief Waits for all batches and deletes every queued name, including the ones not fenced yet.
+     *
+     * Must be called before the context is destroyed, the queue does not delete anything on destruction.
+     */
+    void flush (void)
+    {
+        fence();
+        while (!batches.empty())
+        {
+            glClientWaitSync(batches.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            deleteBatch(batches.front());
+            batches.pop_front();
+        }
+    }
+
+    /**
+     * @brief Returns the number of names waiting to be deleted.
+     */
+    unsigned int getNumPending (void) const
+    {
+        unsigned int count = pending.size();
+        for (unsigned int i = 0; i < batches.size(); ++i)
+        {
+            count += batches[i].objects.size();
+        }
+        return count;
+    }
+
+private:
+
+    /// A retired name.
+    struct Object
+    {
+        ObjectType type;
+        GLuint name;
+        Object (ObjectType t, GLuint n) : type(t), name(n) {}
+    };
+
+    /// Names retired during one frame and the fence after their last use.
+    struct Batch
+    {
+        std::vector<Object> objects;
+        GLsync fence;
+        Batch (void) : fence(0) {}
+    };
+
+    /**
+     * @brief Default Constructor, deletion is immediate.
+     */
+    DeletionQueue (void) : deferred(false) {}
+
+    ///Copy Constructor
+    DeletionQueue (DeletionQueue const&);
+
+    ///Assignment Operation
+    DeletionQueue& operator= (DeletionQueue const&);
+
+    /**
+     * @brief Deletes the names of a batch and its fence.
+     * @return Number of deleted names.
+     */
+    unsigned int deleteBatch (Batch& batch)
+    {
+        for (unsigned int i = 0; i < batch.objects.size(); ++i)
+        {
+            deleteObject(batch.objects[i].type, batch.objects[i].name);
+        }
+        glDeleteSync(batch.fence);
+        return batch.objects.size();
+    }
+
+    /**
+     * @brief Deletes one GL name.
+     */
+    static void deleteObject (ObjectType type, GLuint name)
+    {
+        switch (type)
+        {
+            case TEXTURE: glDeleteTextures(1, &name); break;
+            case BUFFER: glDeleteBuffers(1, &name); break;
+            case FRAMEBUFFER: glDeleteFramebuffers(1, &name); break;
+            case RENDERBUFFER: glDeleteRenderbuffers(1, &name); break;
+            case VERTEX_ARRAY: glDeleteVertexArrays(1, &name); break;
+            case TRANSFORM_FEEDBACK: glDeleteTransformFeedbacks(1, &name); break;
+            case QUERY: glDeleteQueries(1, &name); break;
+            case SHADER: glDeleteShader(name); break;
+            case PROGRAM: glDeleteProgram(name); break;
+        }
+    }
+
+    /// Flag to indicate deletion is deferred to the end of the frame.
+    bool deferred;
+
+    /// Names retired since the last fence.
+    std::vector<Object> pending;
+
+    /// Fenced batches, oldest first.
+    std::deque<Batch> batches;
+};
+
+}
+
+#endif
@@ -0,0 +1,289 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FEEDBACKPIPELINE__
+#define __FEEDBACKPIPELINE__
+
+#include <iostream>
+#include <GL/glew.h>
+
+#include "Shader.hpp"
+#include "Buffer.hpp"
+
+namespace Tucano
+{
+
+/**
+ * @brief Double buffered transform feedback pipeline, for GPU simulations such as particle systems.
+ *
+ * Holds two vertex buffers, each captured by its own transform feedback object. Every step reads the
+ * current buffer and writes the other one with an update shader (initialized with Shader::initializeTF,
+ * interleaved varyings), then swaps them. The number of vertices written is kept by the transform feedback
+ * object and consumed by glDrawTransformFeedback, so the CPU never reads primitive counts and several
+ * steps can be issued per frame without synchronization.
+ *
+ * The same vertex layout is used for input and output, set with setAttribute before the first step.
+ * Requires OpenGL 4.0.
+ */
+class FeedbackPipeline {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    FeedbackPipeline (void) : current(0), initial_vertices(0), primed(false), query(0), last_written(0)
+    {
+        tf[0] = tf[1] = 0;
+        vao[0] = vao[1] = 0;
+    }
+
+    /**
+     * @brief Default destructor.
+     */
+    ~FeedbackPipeline (void)
+    {
+        destroy();
+    }
+
+    /**
+     * @brief Creates both buffers and the transform feedback objects.
+     * @param bytes Size of each buffer, the largest output of one step.
+     * @param data Initial vertices, or NULL.
+     * @param num_vertices Number of initial vertices, drawn by the first step.
+     */
+    void initialize (GLsizeiptr bytes, const GLvoid* data, GLsizei num_vertices)
+    {
+        destroy();
+
+        buffers[0].create(bytes, data, 0);
+        buffers[1].create(bytes, NULL, 0);
+        initial_vertices = num_vertices;
+        primed = false;
+        current = 0;
+
+        glGenTransformFeedbacks(2, tf);
+        glGenVertexArrays(2, vao);
+        for (int i = 0; i < 2; ++i)
+        {
+            glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, tf[i]);
+            buffers[i].bindBase(0, GL_TRANSFORM_FEEDBACK_BUFFER);
+        }
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+        glGenQueries(1, &query);
+    }
+
+    /**
+     * @brief Deletes the buffers and transform feedback objects.
+     */
+    void destroy (void)
+    {
+        if (tf[0] != 0)
+        {
+            DeletionQueue& queue = DeletionQueue::Instance();
+            for (int i = 0; i < 2; ++i)
+            {
+                queue.retire(DeletionQueue::TRANSFORM_FEEDBACK, tf[i]);
+                queue.retire(DeletionQueue::VERTEX_ARRAY, vao[i]);
+            }
+            queue.retire(DeletionQueue::QUERY, query);
+        }
+        tf[0] = tf[1] = 0;
+        vao[0] = vao[1] = 0;
+        query = 0;
+        buffers[0].destroy();
+        buffers[1].destroy();
+    }
+
+    /**
+     * @brief Describes one vertex attribute of the buffers, for both the update and render passes.
+     * @param location Attribute location.
+     * @param components Number of components (1 to 4).
+     * @param stride Size of one vertex in bytes.
+     * @param offset Offset of the attribute in bytes.
+     * @param type Component type (default is GL_FLOAT), integer types are read as integers.
+     */
+    void setAttribute (GLuint location, GLint components, GLsizei stride, GLintptr offset, GLenum type = GL_FLOAT)
+    {
+        for (int i = 0; i < 2; ++i)
+        {
+            glBindVertexArray(vao[i]);
+            buffers[i].bind(GL_ARRAY_BUFFER);
+            if (type == GL_FLOAT || type == GL_HALF_FLOAT || type == GL_DOUBLE)
+            {
+                glVertexAttribPointer(location, components, type, GL_FALSE, stride, (const GLvoid*)offset);
+            }
+            else
+            {
+                glVertexAttribIPointer(location, components, type, stride, (const GLvoid*)offset);
+            }
+            glEnableVertexAttribArray(location);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    /**
+     * @brief Runs one simulation step and swaps the buffers.
+     *
+     * Rasterization is disabled during the step. The shader uniforms must be set before calling.
+     * @param update_shader Shader with the transform feedback varyings, taking points as input.
+     * @param count_primitives If true the number of vertices written is queried (see getVerticesWritten).
+     */
+    void step (Shader& update_shader, bool count_primitives = false)
+    {
+        int next = 1 - current;
+
+        update_shader.bind();
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(vao[current]);
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, tf[next]);
+        if (count_primitives)
+        {
+            glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query);
+        }
+        glBeginTransformFeedback(GL_POINTS);
+        glState.flushBarriers();
+        if (!primed)
+        {
+            glDrawArrays(GL_POINTS, 0, initial_vertices);
+            primed = true;
+        }
+        else
+        {
+            glDrawTransformFeedback(GL_POINTS, tf[current]);
+        }
+        glEndTransformFeedback();
+        if (count_primitives)
+        {
+            glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        }
+        glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+        glBindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+
+        current = next;
+    }
+
+    /**
+     * @brief Runs several simulation steps without any CPU synchronization.
+     * @param update_shader Shader with the transform feedback varyings.
+     * @param num_steps Number of steps.
+     */
+    void steps (Shader& update_shader, int num_steps)
+    {
+        for (int i = 0; i < num_steps; ++i)
+        {
+            step(update_shader);
+        }
+    }
+
+    /**
+     * @brief Draws the vertices written by the last step.
+     *
+     * The render shader must be bound and its uniforms set.
+     * @param mode Primitive mode (default is GL_POINTS).
+     */
+    void draw (GLenum mode = GL_POINTS)
+    {
+        glBindVertexArray(vao[current]);
+        glState.flushBarriers();
+        if (!primed)
+        {
+            glDrawArrays(mode, 0, initial_vertices);
+        }
+        else
+        {
+            glDrawTransformFeedback(mode, tf[current]);
+        }
+        glBindVertexArray(0);
+    }
+
+    /**
+     * @brief Returns the number of vertices written by the last counted step, without waiting.
+     *
+     * The value is updated only when the query result is available, so it may be a few frames old.
+     * @return Number of vertices (points) written.
+     */
+    GLuint getVerticesWritten (void)
+    {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT, &last_written);
+        }
+        return last_written;
+    }
+
+    /**
+     * @brief Returns the buffer holding the output of the last step.
+     */
+    Buffer* getCurrentBuffer (void)
+    {
+        return &buffers[current];
+    }
+
+    /**
+     * @brief Returns the vertex array reading the output of the last step, to draw with custom calls.
+     */
+    GLuint getCurrentVertexArray (void) const
+    {
+        return vao[current];
+    }
+
+private:
+
+    ///Copy Constructor
+    FeedbackPipeline (FeedbackPipeline const&);
+
+    ///Assignment Operation
+    FeedbackPipeline& operator= (FeedbackPipeline const&);
+
+    /// Vertex buffers, alternately read and written.
+    Buffer buffers[2];
+
+    /// Transform feedback objects, each one captures into the buffer with the same index.
+    GLuint tf[2];
+
+    /// Vertex arrays, each one reads from the buffer with the same index.
+    GLuint vao[2];
+
+    /// Index of the buffer with the latest output.
+    int current;
+
+    /// Number of vertices in the initial data.
+    GLsizei initial_vertices;
+
+    /// Flag to indicate at least one step was run, so draws use the feedback counts.
+    bool primed;
+
+    /// Primitives written query.
+    GLuint query;
+
+    /// Last available primitives written result.
+    GLuint last_written;
+};
+
+}
+
+#endif
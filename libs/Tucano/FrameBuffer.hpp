@@ -27,12 +27,16 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <limits>
+#include <algorithm>
 
 #include <GL/glew.h>
 
 #include "GLTexture.hpp"
 #include "Shader.hpp"
+#include "ImageWriter.hpp"
+#include "Profiler.hpp"
 
 namespace Tucano
 {
@@ -42,17 +46,45 @@ namespace Tucano
  *
  * The Framebuffer class is responsible for framebuffer generation and storage.
  * It holds many shortcut methods to bind, draw to buffer, read buffer for debug, etc...
+ *
+ * A framebuffer owns its GL objects and attachments: it can be moved but not copied. Framebuffers sharing
+ * the depth attachment of another one keep a pointer to it, so a framebuffer whose depth is shared must not
+ * be moved.
  */
 class Framebuffer {
 
+public:
+
+    /**
+     * @brief Describes how the depth (and stencil) attachment of a framebuffer is created.
+     */
+    struct DepthAttachment
+    {
+        /// Sized depth format (GL_DEPTH_COMPONENT16/24/32F, GL_DEPTH24_STENCIL8, GL_DEPTH32F_STENCIL8), or GL_NONE for no depth.
+        GLenum format;
+        /// If true the depth is a texture that can be sampled, otherwise a renderbuffer.
+        bool texture;
+        /// If not NULL the depth attachment of this framebuffer is used instead of creating one.
+        Framebuffer* shared;
+
+        DepthAttachment (GLenum fmt = GL_DEPTH_COMPONENT24, bool as_texture = false, Framebuffer* share = NULL) :
+            format(fmt), texture(as_texture), shared(share) {}
+    };
+
 protected:
 
     /// The Framebuffer Object.
     GLuint fbo_id;
 
-    /// The Depthbuffer Object.
+    /// The Depthbuffer Object, when the depth attachment is an owned renderbuffer.
     GLuint depthbuffer;
 
+    /// The depth texture, when the depth attachment is an owned texture.
+    Texture depth_texture;
+
+    /// Description of the depth attachment.
+    DepthAttachment depth_desc;
+
     /// Array of textures attachments.
     std::vector<Texture> fboTextures;
 
@@ -71,6 +103,12 @@ protected:
     /// Format as defined by OpenGL (ex. GL_RGBA, GL_RGBA_INTEGER ...)
     GLenum format;
 
+    /// Number of samples per pixel of the attachments, 0 for single-sample.
+    int samples;
+
+    /// Debug label of the framebuffer, also used to name its profiler pass.
+    string label;
+
     /**
      * @brief Flag to indicate if buffer is binded or not
      *
@@ -80,6 +118,28 @@ protected:
      */
     bool is_binded;
 
+    /// One buffer of the asynchronous readback ring.
+    struct ReadbackSlot
+    {
+        /// Pixel pack buffer.
+        GLuint pbo;
+        /// Persistently mapped memory of the buffer.
+        GLvoid* mapped;
+        /// Allocated size in bytes.
+        GLsizeiptr capacity;
+        /// Size in bytes of the pending or completed read.
+        GLsizeiptr bytes;
+        /// Fence signaled when the read is complete, 0 if slot is free.
+        GLsync fence;
+        ReadbackSlot (void) : pbo(0), mapped(NULL), capacity(0), bytes(0), fence(0) {}
+    };
+
+    /// Pixel pack buffers used by the asynchronous reads, each slot index is a readback ticket.
+    std::vector<ReadbackSlot> readback_slots;
+
+    /// Maximum number of asynchronous reads in flight.
+    int readback_ring_size;
+
 public:
 
     /**
@@ -93,12 +153,15 @@ public:
      * @param int_frm Internal format (default is GL_RGBA32F)
      * @param frm Format (default is GL_RGBA)
      * @param pix_type Texture pixel type (default is GL_FLOAT)
+     * @param num_samples Number of samples per pixel, 0 (default) for a single-sample framebuffer
      */
-    Framebuffer (int w, int h, int num_buffers = 1, GLenum textype = GL_TEXTURE_2D, GLenum int_frm = GL_RGBA32F, GLenum frm = GL_RGBA, GLenum pix_type = GL_UNSIGNED_BYTE  ) :
-        texture_type(textype), internal_format(int_frm), pixel_type(pix_type), format(frm)
+    Framebuffer (int w, int h, int num_buffers = 1, GLenum textype = GL_TEXTURE_2D, GLenum int_frm = GL_RGBA32F, GLenum frm = GL_RGBA, GLenum pix_type = GL_UNSIGNED_BYTE, int num_samples = 0) :
+        texture_type(textype), internal_format(int_frm), pixel_type(pix_type), format(frm), samples(num_samples)
     {
         fbo_id = 0;
+        depthbuffer = 0;
         is_binded = false;
+        readback_ring_size = 3;
         fboTextures.clear();
         create(w, h, num_buffers);
     }
@@ -106,10 +169,12 @@ public:
     /**
      * @brief Framebuffer default empty constructor
      */
-    Framebuffer (void) : texture_type(GL_TEXTURE_2D), internal_format(GL_RGBA32F), pixel_type(GL_UNSIGNED_BYTE), format(GL_RGBA)
+    Framebuffer (void) : texture_type(GL_TEXTURE_2D), internal_format(GL_RGBA32F), pixel_type(GL_UNSIGNED_BYTE), format(GL_RGBA), samples(0)
     {
         fbo_id = 0;
+        depthbuffer = 0;
         is_binded = false;
+        readback_ring_size = 3;
         size = Eigen::Vector2i(0,0);
     }
 
@@ -122,6 +187,30 @@ public:
         destroy();
     }
 
+    /**
+     * @brief Move constructor, takes the GL objects of another framebuffer, leaving it empty.
+     * @param other Framebuffer to move from.
+     */
+    Framebuffer (Framebuffer&& other) noexcept : Framebuffer()
+    {
+        moveFrom(other);
+    }
+
+    /**
+     * @brief Move assignment, destroys the current framebuffer and takes the one of another framebuffer.
+     * @param other Framebuffer to move from.
+     * @return Reference to this framebuffer.
+     */
+    Framebuffer& operator= (Framebuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
     /**
      * @brief Creates the framebuffer with specified parameters.
      * @param w Width of FBO.
@@ -158,15 +247,41 @@ public:
 
         if(fbo_id)
         {
-            glDeleteFramebuffers(1, &fbo_id);
+            glState.forgetFramebuffer(fbo_id);
+            DeletionQueue::Instance().retire(DeletionQueue::FRAMEBUFFER, fbo_id);
+            fbo_id = 0;
         }
 
         if(depthbuffer)
         {
-            glDeleteRenderbuffers(1, &depthbuffer);
+            DeletionQueue::Instance().retire(DeletionQueue::RENDERBUFFER, depthbuffer);
+            depthbuffer = 0;
         }
+        depth_texture.destroy();
 
         fboTextures.clear();
+
+        destroyReadbackSlots();
+    }
+
+    /**
+     * @brief Names the framebuffer and its attachments for debug messages, GPU debuggers and the profiler.
+     *
+     * Attachments are named "label color i" and "label depth", labels are applied again when the framebuffer is recreated.
+     * @param name Framebuffer label.
+     */
+    void setLabel (const string& name)
+    {
+        label = name;
+        applyLabels();
+    }
+
+    /**
+     * @brief Returns the framebuffer label.
+     */
+    const string& getLabel (void) const
+    {
+        return label;
     }
 
     /**
@@ -222,13 +337,18 @@ public:
 
     /**
      * @brief Binds framebuffer object.
+     *
+     * The bind is filtered by the GL state shadow, so it is only sent to the driver
+     * if another framebuffer is currently bound. When profiling, a pass zone is opened
+     * for this framebuffer (see Profiler).
      */
     virtual void bind (void)
     {
-        if (!is_binded)
+        if (gpuProfiler.isEnabled())
         {
-            glBindFramebuffer(GL_FRAMEBUFFER, fbo_id);
+            gpuProfiler.framebufferBound(fbo_id, label);
         }
+        glState.bindFramebuffer(GL_FRAMEBUFFER, fbo_id);
         is_binded = true;
     }
 
@@ -379,7 +499,11 @@ public:
      */
     virtual void unbindFBO (void)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (gpuProfiler.isEnabled())
+        {
+            gpuProfiler.framebufferBound(0);
+        }
+        glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
         is_binded = false;
     }
 
@@ -440,13 +564,13 @@ public:
     }
 
     /**
-     * @brief Clears the FBO depthbuffer.
+     * @brief Clears the FBO depthbuffer, and the stencil if the depth format has one.
      */
     void clearDepth (void)
     {
         bool was_binded = is_binded;
         bind();
-        glClear(GL_DEPTH_BUFFER_BIT);
+        glClear(hasStencil() ? (GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT) : GL_DEPTH_BUFFER_BIT);
         if (!was_binded)
         {
             unbindFBO();
@@ -483,6 +607,85 @@ public:
         {
             fboTextures[i].unbind();
         }
+        if (depth_texture.texID() != 0)
+        {
+            depth_texture.unbind();
+        }
+    }
+
+    /**
+     * @brief Sets how the depth attachment is created, takes effect on the next create.
+     *
+     * When sharing, the framebuffer that owns the depth must be created first and have the same size
+     * and number of samples. If the owner is recreated (ex. resized) the framebuffers sharing its depth
+     * must be recreated as well.
+     * @param desc Depth attachment description.
+     */
+    void setDepthAttachment (const DepthAttachment& desc)
+    {
+        depth_desc = desc;
+    }
+
+    /**
+     * @brief Returns the description of the depth attachment.
+     * @return Depth attachment description.
+     */
+    const DepthAttachment& getDepthAttachment (void) const
+    {
+        return depth_desc;
+    }
+
+    /**
+     * @brief Returns the depth texture, which may belong to the framebuffer the depth is shared with.
+     * @return Pointer to the depth texture, or NULL if the depth is a renderbuffer or there is no depth.
+     */
+    Texture* getDepthTexture (void)
+    {
+        Framebuffer* owner = depthOwner();
+        if (owner->depth_texture.texID() == 0)
+        {
+            return NULL;
+        }
+        return &owner->depth_texture;
+    }
+
+    /**
+     * @brief Binds the depth texture to a given texture unit.
+     * @param texture_unit Number of unit to bind texture.
+     */
+    void bindDepthTexture (int texture_unit)
+    {
+        Texture* tex = getDepthTexture();
+        if (!tex)
+        {
+            cerr << "Warning: framebuffer has no depth texture" << endl;
+            return;
+        }
+        tex->bind(texture_unit);
+    }
+
+    /**
+     * @brief Binds the depth texture to the first free unit.
+     * @return Number of unit attached, or -1 if no unit available or no depth texture.
+     */
+    int bindDepthTexture (void)
+    {
+        Texture* tex = getDepthTexture();
+        if (!tex)
+        {
+            cerr << "Warning: framebuffer has no depth texture" << endl;
+            return -1;
+        }
+        return tex->bind();
+    }
+
+    /**
+     * @brief Returns wether the depth attachment has a stencil component.
+     * @return True if the depth format has stencil, false otherwise.
+     */
+    bool hasStencil (void)
+    {
+        return isStencilFormat(depthOwner()->depth_desc.format);
     }
 
     /**
@@ -529,6 +732,95 @@ public:
         texture_type = tex_type;
     }
 
+    /**
+     * @brief Sets the number of samples per pixel, takes effect on the next create.
+     *
+     * With more than zero samples the color attachments are GL_TEXTURE_2D_MULTISAMPLE textures
+     * and the depth buffer is a multisample renderbuffer. Multisample attachments cannot be read
+     * back directly, they must first be resolved to a single-sample framebuffer.
+     * The internal format should be a sized format (ex. GL_RGBA8).
+     * @param num_samples Number of samples, 0 for single-sample.
+     */
+    void setSamples (int num_samples)
+    {
+        samples = num_samples;
+    }
+
+    /**
+     * @brief Returns the number of samples per pixel.
+     * @return Number of samples, 0 if single-sample.
+     */
+    int getSamples (void) const
+    {
+        return samples;
+    }
+
+    /**
+     * @brief Returns wether the attachments are multisampled.
+     * @return True if multisampled, false otherwise.
+     */
+    bool isMultisample (void) const
+    {
+        return samples > 0;
+    }
+
+    /**
+     * @brief Resolves the attachments into a single-sample framebuffer.
+     *
+     * Each color attachment is blitted to the attachment with the same index in the target,
+     * up to the number of attachments of the smallest one. Both framebuffers must have the same size.
+     * Can also be used to copy between single-sample framebuffers.
+     * @param target Destination framebuffer.
+     * @param resolve_depth If true the depth buffer (and stencil, if both have it) is also copied, the depth formats must match.
+     */
+    void resolve (Framebuffer& target, bool resolve_depth = false)
+    {
+        int num_attachs = std::min(getNumAttachments(), target.getNumAttachments());
+        for (int i = 0; i < num_attachs; ++i)
+        {
+            blitTo(target.fbo_id, GL_COLOR_ATTACHMENT0+i, GL_COLOR_ATTACHMENT0+i, target.size, GL_COLOR_BUFFER_BIT);
+        }
+        if (resolve_depth)
+        {
+            GLbitfield mask = GL_DEPTH_BUFFER_BIT;
+            if (hasStencil() && target.hasStencil())
+            {
+                mask |= GL_STENCIL_BUFFER_BIT;
+            }
+            blitTo(target.fbo_id, GL_NONE, GL_NONE, target.size, mask);
+        }
+        unbindFBO();
+        target.is_binded = false;
+    }
+
+    /**
+     * @brief Resolves one color attachment into an attachment of a single-sample framebuffer.
+     * @param attach Source attachment.
+     * @param target Destination framebuffer, must have the same size.
+     * @param target_attach Destination attachment.
+     */
+    void resolve (int attach, Framebuffer& target, int target_attach)
+    {
+        blitTo(target.fbo_id, GL_COLOR_ATTACHMENT0+attach, GL_COLOR_ATTACHMENT0+target_attach, target.size, GL_COLOR_BUFFER_BIT);
+        unbindFBO();
+        target.is_binded = false;
+    }
+
+    /**
+     * @brief Resolves one color attachment directly into the back buffer of the default framebuffer.
+     *
+     * The window must have the same size as the FBO. Avoids an intermediate single-sample
+     * framebuffer when the anti-aliased image is only displayed.
+     * @param attach Source attachment.
+     */
+    void resolveToScreen (int attach = 0)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        blitTo(0, GL_COLOR_ATTACHMENT0+attach, GL_BACK, Eigen::Vector2i(viewport[2], viewport[3]), GL_COLOR_BUFFER_BIT);
+        unbindFBO();
+    }
+
     /**
      * @brief Reads a pixel from a buffer and returns it as an Eigen vector.
      *
@@ -543,6 +835,7 @@ public:
         bind();
         glReadBuffer(GL_COLOR_ATTACHMENT0+attach);
         GLfloat pixel[4];
+        glState.flushBarriers();
         glReadPixels(pos[0], pos[1], 1, 1, GL_RGBA, GL_FLOAT, &pixel[0]);
         if (!was_binded)
         {
@@ -569,6 +862,7 @@ public:
         pixels = new GLfloat[(int)(size[0] * size[1] * 4)];
         bind();
         glReadBuffer(GL_COLOR_ATTACHMENT0+attach_id);
+        glState.flushBarriers();
         glReadPixels(0, 0, size[0], size[1], GL_RGBA, GL_FLOAT, pixels);
         if (!was_binded)
         {
@@ -594,6 +888,7 @@ public:
         pixels = new GLbyte[(int)(size[0]*size[1]*4)];
         bind();
         glReadBuffer(GL_COLOR_ATTACHMENT0+attach_id);
+        glState.flushBarriers();
         glReadPixels(0, 0, size[0], size[1], GL_RGBA, GL_UNSIGNED_BYTE, pixels);
         if (!was_binded)
         {
@@ -619,6 +914,7 @@ public:
         pixels = new unsigned char[(int)(size[0]*size[1]*4)];
         bind();
         glReadBuffer(GL_COLOR_ATTACHMENT0+attach_id);
+        glState.flushBarriers();
         glReadPixels(0, 0, size[0], size[1], GL_RGBA, GL_UNSIGNED_BYTE, pixels);
         if (!was_binded)
         {
@@ -641,6 +937,7 @@ public:
         pixels.resize((int)(size[0]*size[1]*4));
         bind();
         glReadBuffer(GL_COLOR_ATTACHMENT0+attach_id);
+        glState.flushBarriers();
         glReadPixels(0, 0, size[0], size[1], GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
         if (!was_binded)
         {
@@ -664,6 +961,7 @@ public:
         glFinish();
         glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
         glReadBuffer(GL_COLOR_ATTACHMENT0+attach_id);
+        glState.flushBarriers();
         glReadPixels(0, 0, size[0], size[1], GL_RGBA, GL_FLOAT, &pixels[0]);
         if (!was_binded)
         {
@@ -672,58 +970,284 @@ public:
     }
 
     /**
-     * @brief Reads the depth buffer and stores it in a CPU vector of float.
-     * @param depth_values Vector of float pixels to receive depth values.
+     * @brief Sets the maximum number of asynchronous reads that can be in flight at once.
+     * @param n Number of readback buffers (default is 3).
      */
-    void readDepthBuffer (vector<float> & depth_values)
+    void setReadbackRingSize (int n)
     {
-        depth_values.clear();
-        depth_values.resize((int)(size[0]*size[1]));
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-        glBindRenderbuffer(GL_RENDERBUFFER, depthbuffer);
-        glReadPixels(0, 0, size[0], size[1], GL_DEPTH_COMPONENT, GL_FLOAT, &depth_values[0]);
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    }
-
-	/**
-	 * @brief Saves the buffer to a PPM image
-	 * @param filename Output ppm filename
-	 * @param attach FBO attachment to save as image (default is 0)
-	 */
-	void saveAsPPM (string filename, int attach = 0)
-	{
-		ofstream out_stream;
-		out_stream.open(filename.c_str());
-		out_stream << "P3\n";
-		out_stream << size[0] << " " << size[1] << "\n";
-		out_stream << "255\n";
+        readback_ring_size = n;
+    }
 
-        bool was_binded = is_binded;
+    /**
+     * @brief Starts an asynchronous read of a whole attachment, without stalling the pipeline.
+     *
+     * The pixels are read into a pixel pack buffer and a fence is inserted. The data can be accessed
+     * with getReadbackData a frame or two later, once isReadbackReady returns true.
+     * The ticket must be released with releaseReadback after the data is consumed.
+     * @param attach_id Buffer to be read, the id of the attachment.
+     * @param fmt Format of the read pixels (default is GL_RGBA).
+     * @param type Type of each read channel (default is GL_UNSIGNED_BYTE).
+     * @return Readback ticket, or -1 if all readback buffers are in use.
+     */
+    int readBufferAsync (int attach_id, GLenum fmt = GL_RGBA, GLenum type = GL_UNSIGNED_BYTE)
+    {
+        return readRegionAsync(attach_id, 0, 0, size[0], size[1], fmt, type);
+    }
 
-        GLfloat * pixels = new GLfloat[(int)(size[0]*size[1]*4)];
+    /**
+     * @brief Starts an asynchronous read of a single pixel, usually for picking.
+     *
+     * The pixel is read as four GLfloat elements, use getReadbackPixel to retrieve it.
+     * @param attach Buffer to be read, the id of the attachment.
+     * @param pos Pixel position to be read.
+     * @return Readback ticket, or -1 if all readback buffers are in use.
+     */
+    int readPixelAsync (int attach, Eigen::Vector2i pos)
+    {
+        return readRegionAsync(attach, pos[0], pos[1], 1, 1, GL_RGBA, GL_FLOAT);
+    }
+
+    /**
+     * @brief Starts an asynchronous read of a rectangle of an attachment.
+     * @param attach_id Buffer to be read, the id of the attachment.
+     * @param x Left coordinate of the rectangle.
+     * @param y Bottom coordinate of the rectangle.
+     * @param w Width of the rectangle.
+     * @param h Height of the rectangle.
+     * @param fmt Format of the read pixels.
+     * @param type Type of each read channel.
+     * @return Readback ticket, or -1 if all readback buffers are in use.
+     */
+    int readRegionAsync (int attach_id, int x, int y, int w, int h, GLenum fmt, GLenum type)
+    {
+        if (!Texture::isDSASupported())
+        {
+            cerr << "Warning: asynchronous readback requires OpenGL 4.5!" << endl;
+            return -1;
+        }
+
+        GLsizeiptr bytes = (GLsizeiptr)w * h * bytesPerPixel(fmt, type);
+        int ticket = acquireReadbackSlot(bytes);
+        if (ticket == -1)
+        {
+            cerr << "Warning: no free readback buffer!" << endl;
+            return -1;
+        }
+        ReadbackSlot& slot = readback_slots[ticket];
+
+        bool was_binded = is_binded;
         bind();
-        glReadBuffer(GL_COLOR_ATTACHMENT0+attach);
-        glReadPixels(0, 0, size[0], size[1], GL_RGBA, GL_FLOAT, pixels);
+        GLint alignment;
+        glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadBuffer(GL_COLOR_ATTACHMENT0+attach_id);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        glState.flushBarriers();
+        glReadPixels(x, y, w, h, fmt, type, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.bytes = bytes;
+        if (!was_binded)
+        {
+            unbindFBO();
+        }
+        return ticket;
+    }
 
-		int pos;
-	    for (int j = size[1]-1; j >= 0; --j)
+    /**
+     * @brief Returns wether an asynchronous read has completed, never waits.
+     * @param ticket Readback ticket.
+     * @return True if the data can be accessed without stalling.
+     */
+    bool isReadbackReady (int ticket)
+    {
+        if (ticket < 0 || ticket >= (int)readback_slots.size() || !readback_slots[ticket].fence)
         {
-            for (int i = 0 ; i < size[0]; ++i)
+            return false;
+        }
+        GLenum status = glClientWaitSync(readback_slots[ticket].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        return (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED);
+    }
+
+    /**
+     * @brief Returns the data of an asynchronous read.
+     *
+     * The pointer remains valid until the ticket is released.
+     * @param ticket Readback ticket.
+     * @param wait If true waits for the read to complete (this may stall), otherwise returns NULL if not ready.
+     * @return Pointer to the read pixels, tightly packed, or NULL if not ready.
+     */
+    const GLvoid* getReadbackData (int ticket, bool wait = false)
+    {
+        if (ticket < 0 || ticket >= (int)readback_slots.size() || !readback_slots[ticket].fence)
+        {
+            return NULL;
+        }
+        if (!isReadbackReady(ticket))
+        {
+            if (!wait)
             {
-                pos = (i + size[0]*j)*4;
-				out_stream << (int)(255*pixels[pos+0]) << " " << (int)(255*pixels[pos+1]) << " " << (int)(255*pixels[pos+2]) << " ";
-			}
-			out_stream << "\n";
-		}
-		out_stream.close();
+                return NULL;
+            }
+            glClientWaitSync(readback_slots[ticket].fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        }
+        return readback_slots[ticket].mapped;
+    }
+
+    /**
+     * @brief Returns the size in bytes of the data of an asynchronous read.
+     * @param ticket Readback ticket.
+     * @return Size in bytes.
+     */
+    GLsizeiptr getReadbackSize (int ticket) const
+    {
+        return readback_slots[ticket].bytes;
+    }
+
+    /**
+     * @brief Returns the pixel of an asynchronous single pixel read, waiting for it if necessary.
+     *
+     * Also releases the ticket.
+     * @param ticket Ticket returned by readPixelAsync.
+     * @return Read pixel as a vector of four floats.
+     */
+    Eigen::Vector4f getReadbackPixel (int ticket)
+    {
+        const GLfloat* pixel = (const GLfloat*)getReadbackData(ticket, true);
+        Eigen::Vector4f result = Eigen::Vector4f::Zero();
+        if (pixel)
+        {
+            result << pixel[0], pixel[1], pixel[2], pixel[3];
+        }
+        releaseReadback(ticket);
+        return result;
+    }
+
+    /**
+     * @brief Releases a readback ticket so its buffer can be reused.
+     * @param ticket Readback ticket.
+     */
+    void releaseReadback (int ticket)
+    {
+        if (ticket < 0 || ticket >= (int)readback_slots.size())
+        {
+            return;
+        }
+        if (readback_slots[ticket].fence)
+        {
+            glDeleteSync(readback_slots[ticket].fence);
+        }
+        readback_slots[ticket].fence = 0;
+        readback_slots[ticket].bytes = 0;
+    }
 
-	    if (!was_binded)
+    /**
+     * @brief Returns the size in bytes of one pixel for a given format and type.
+     * @param fmt Pixel format (ex. GL_RGBA, GL_RED, GL_DEPTH_COMPONENT).
+     * @param type Channel type (ex. GL_UNSIGNED_BYTE, GL_FLOAT).
+     * @return Bytes per pixel.
+     */
+    static int bytesPerPixel (GLenum fmt, GLenum type)
+    {
+        int channels = 4;
+        switch (fmt)
+        {
+            case GL_RED: case GL_GREEN: case GL_BLUE: case GL_RED_INTEGER:
+            case GL_DEPTH_COMPONENT: case GL_STENCIL_INDEX:
+                channels = 1; break;
+            case GL_RG: case GL_RG_INTEGER: case GL_DEPTH_STENCIL:
+                channels = 2; break;
+            case GL_RGB: case GL_BGR: case GL_RGB_INTEGER:
+                channels = 3; break;
+            default:
+                channels = 4;
+        }
+        switch (type)
+        {
+            case GL_UNSIGNED_BYTE: case GL_BYTE:
+                return channels;
+            case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT:
+                return channels * 2;
+            case GL_UNSIGNED_INT_24_8:
+                return 4;
+            case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+                return 8;
+            default:
+                return channels * 4;
+        }
+    }
+
+    /**
+     * @brief Reads the depth buffer and stores it in a CPU vector of float.
+     *
+     * When the depth is a texture it is usually better to sample it directly in a shader.
+     * @param depth_values Vector of float pixels to receive depth values.
+     */
+    void readDepthBuffer (vector<float> & depth_values)
+    {
+        bool was_binded = is_binded;
+        depth_values.clear();
+        depth_values.resize((int)(size[0]*size[1]));
+        bind();
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glState.flushBarriers();
+        glReadPixels(0, 0, size[0], size[1], GL_DEPTH_COMPONENT, GL_FLOAT, &depth_values[0]);
+        if (!was_binded)
         {
             unbindFBO();
         }
-		delete [] pixels;
+    }
+
+    /**
+     * @brief Saves the buffer to a binary PPM (P6) image.
+     *
+     * The attachment is read directly as 8 bit RGB (conversion is done by the driver during the read),
+     * flipped in place and written with a single call.
+     * @param filename Output ppm filename
+     * @param attach FBO attachment to save as image (default is 0)
+     * @param writer If given, the file is written by the writer thread and this method returns after the read.
+     */
+    void saveAsPPM (string filename, int attach = 0, ImageWriter* writer = NULL)
+    {
+        std::ostringstream header;
+        header << "P6\n" << size[0] << " " << size[1] << "\n255\n";
+        vector<unsigned char> data;
+        readForExport(attach, GL_RGB, GL_UNSIGNED_BYTE, header.str(), true, data);
+        writeExport(filename, data, writer);
+    }
 
-	}
+    /**
+     * @brief Saves the buffer to a PFM (portable float map) image, RGB 32 bit float.
+     *
+     * PFM stores rows bottom to top, the same order as OpenGL, so no flip is needed.
+     * @param filename Output pfm filename
+     * @param attach FBO attachment to save as image (default is 0)
+     * @param writer If given, the file is written by the writer thread and this method returns after the read.
+     */
+    void saveAsPFM (string filename, int attach = 0, ImageWriter* writer = NULL)
+    {
+        std::ostringstream header;
+        // negative scale means little endian
+        header << "PF\n" << size[0] << " " << size[1] << "\n" << (isLittleEndian() ? "-1.0" : "1.0") << "\n";
+        vector<unsigned char> data;
+        readForExport(attach, GL_RGB, GL_FLOAT, header.str(), false, data);
+        writeExport(filename, data, writer);
+    }
+
+    /**
+     * @brief Saves the buffer as raw RGBA pixels, without header, rows from top to bottom.
+     * @param filename Output filename
+     * @param attach FBO attachment to save (default is 0)
+     * @param type Channel type, GL_UNSIGNED_BYTE for RGBA8 or GL_HALF_FLOAT for RGBA16F (default is GL_UNSIGNED_BYTE)
+     * @param writer If given, the file is written by the writer thread and this method returns after the read.
+     */
+    void saveAsRaw (string filename, int attach = 0, GLenum type = GL_UNSIGNED_BYTE, ImageWriter* writer = NULL)
+    {
+        vector<unsigned char> data;
+        readForExport(attach, GL_RGBA, type, "", true, data);
+        writeExport(filename, data, writer);
+    }
 
     /**
      * @brief Prints the content of a GPU. Usually used for debugging.
@@ -739,6 +1263,7 @@ public:
         GLfloat * pixels = new GLfloat[(int)(size[0]*size[1]*4)];
         bind();
         glReadBuffer(GL_COLOR_ATTACHMENT0+attach);
+        glState.flushBarriers();
         glReadPixels(0, 0, size[0], size[1], GL_RGBA, GL_FLOAT, pixels);
 
         int count = 0;
@@ -832,6 +1357,40 @@ public:
 
 protected:
 
+    ///Copy Constructor
+    Framebuffer (Framebuffer const&);
+
+    ///Assignment Operation
+    Framebuffer& operator= (Framebuffer const&);
+
+    /**
+     * @brief Takes the GL objects, attachments and parameters of another framebuffer, which must be destroyed.
+     * @param other Framebuffer to move from.
+     */
+    void moveFrom (Framebuffer& other)
+    {
+        fbo_id = other.fbo_id;
+        depthbuffer = other.depthbuffer;
+        depth_texture = std::move(other.depth_texture);
+        depth_desc = other.depth_desc;
+        fboTextures.swap(other.fboTextures);
+        texture_type = other.texture_type;
+        size = other.size;
+        internal_format = other.internal_format;
+        pixel_type = other.pixel_type;
+        format = other.format;
+        samples = other.samples;
+        label.swap(other.label);
+        is_binded = other.is_binded;
+        readback_slots.swap(other.readback_slots);
+        readback_ring_size = other.readback_ring_size;
+
+        other.fbo_id = 0;
+        other.depthbuffer = 0;
+        other.is_binded = false;
+        other.size = Eigen::Vector2i(0, 0);
+    }
+
     /**
      * @brief Creates the framebuffer and the depthbuffer.
      *
@@ -849,7 +1408,8 @@ protected:
 
         //Creating Framebuffer:
         if(fbo_id) {
-            glDeleteFramebuffers(1, &fbo_id);
+            glState.forgetFramebuffer(fbo_id);
+            DeletionQueue::Instance().retire(DeletionQueue::FRAMEBUFFER, fbo_id);
         }
         glGenFramebuffers(1, &fbo_id);
         bind();
@@ -857,6 +1417,17 @@ protected:
         // clearing textures that already exist
         fboTextures.clear();
 
+        if (samples > 0)
+        {
+            GLint max_samples = 0;
+            glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+            if (samples > max_samples)
+            {
+                cerr << "Warning: " << samples << " samples requested, max samples is " << max_samples << endl;
+                samples = max_samples;
+            }
+        }
+
         //Creating texture:
         fboTextures.resize( numberOfTextures );
         for (int i = 0; i < numberOfTextures; ++i)
@@ -865,14 +1436,9 @@ protected:
         }
 
         //Depth Buffer Generation:
-        if(depthbuffer)
-        {
-            glDeleteRenderbuffers(1,&depthbuffer);
-        }
-        glGenRenderbuffers(1, &depthbuffer);
-        glBindRenderbuffer(GL_RENDERBUFFER, depthbuffer);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, size[0], size[1]);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthbuffer);
+        createDepthAttachment();
+
+        applyLabels();
 
         GLint status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
         if (status != GL_FRAMEBUFFER_COMPLETE)
@@ -885,17 +1451,337 @@ protected:
         //errorCheckFunc(__FILE__, __LINE__);
     }
 
+    /**
+     * @brief Reads an attachment into an export buffer, preceded by a file header.
+     * @param attach Attachment to read.
+     * @param fmt Read format.
+     * @param type Read channel type.
+     * @param header File header to place before the pixels.
+     * @param flip If true rows are stored from top to bottom.
+     * @param data Output buffer with header and pixels.
+     */
+    void readForExport (int attach, GLenum fmt, GLenum type, const string& header, bool flip, vector<unsigned char>& data)
+    {
+        size_t row_bytes = (size_t)size[0] * bytesPerPixel(fmt, type);
+        data.resize(header.size() + row_bytes * size[1]);
+        std::copy(header.begin(), header.end(), data.begin());
+        unsigned char* pixels = &data[0] + header.size();
+
+        bool was_binded = is_binded;
+        bind();
+        GLint alignment;
+        glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadBuffer(GL_COLOR_ATTACHMENT0+attach);
+        glState.flushBarriers();
+        glReadPixels(0, 0, size[0], size[1], fmt, type, pixels);
+        glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+        if (!was_binded)
+        {
+            unbindFBO();
+        }
+
+        if (flip)
+        {
+            for (int j = 0; j < size[1]/2; ++j)
+            {
+                std::swap_ranges(pixels + j*row_bytes, pixels + (j+1)*row_bytes, pixels + (size[1]-1-j)*row_bytes);
+            }
+        }
+    }
+
+    /**
+     * @brief Writes an export buffer to file, in the background if a writer is given.
+     * @param filename Output filename.
+     * @param data Complete file contents, may be consumed.
+     * @param writer Background writer, or NULL to write immediately.
+     */
+    void writeExport (const string& filename, vector<unsigned char>& data, ImageWriter* writer)
+    {
+        if (writer)
+        {
+            writer->write(filename, data);
+        }
+        else
+        {
+            ImageWriter::writeFile(filename, data);
+        }
+    }
+
+    /**
+     * @brief Returns wether the host is little endian.
+     */
+    static bool isLittleEndian (void)
+    {
+        unsigned int one = 1;
+        return *((unsigned char*)&one) == 1;
+    }
+
+    /**
+     * @brief Finds a free readback buffer with at least the given size, allocating it if necessary.
+     * @param bytes Required size in bytes.
+     * @return Slot index, or -1 if all slots of the ring are in use.
+     */
+    int acquireReadbackSlot (GLsizeiptr bytes)
+    {
+        int free_slot = -1;
+        for (unsigned int i = 0; i < readback_slots.size(); ++i)
+        {
+            if (!readback_slots[i].fence)
+            {
+                free_slot = i;
+                break;
+            }
+        }
+        if (free_slot == -1)
+        {
+            if ((int)readback_slots.size() >= readback_ring_size)
+            {
+                return -1;
+            }
+            readback_slots.push_back(ReadbackSlot());
+            free_slot = readback_slots.size()-1;
+        }
+
+        ReadbackSlot& slot = readback_slots[free_slot];
+        if (slot.capacity < bytes)
+        {
+            if (slot.pbo)
+            {
+                glUnmapNamedBuffer(slot.pbo);
+                DeletionQueue::Instance().retire(DeletionQueue::BUFFER, slot.pbo);
+            }
+            GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glCreateBuffers(1, &slot.pbo);
+            glNamedBufferStorage(slot.pbo, bytes, NULL, flags | GL_CLIENT_STORAGE_BIT);
+            slot.mapped = glMapNamedBufferRange(slot.pbo, 0, bytes, flags);
+            slot.capacity = bytes;
+        }
+        return free_slot;
+    }
+
+    /**
+     * @brief Deletes all readback buffers and fences.
+     */
+    void destroyReadbackSlots (void)
+    {
+        for (unsigned int i = 0; i < readback_slots.size(); ++i)
+        {
+            if (readback_slots[i].fence)
+            {
+                glDeleteSync(readback_slots[i].fence);
+            }
+            if (readback_slots[i].pbo)
+            {
+                glUnmapNamedBuffer(readback_slots[i].pbo);
+                DeletionQueue::Instance().retire(DeletionQueue::BUFFER, readback_slots[i].pbo);
+            }
+        }
+        readback_slots.clear();
+    }
+
+    /**
+     * @brief Applies the debug label to the framebuffer and its owned attachments.
+     */
+    void applyLabels (void)
+    {
+        if (label.empty() || fbo_id == 0 || !Misc::isDebugOutputSupported())
+        {
+            return;
+        }
+        Misc::setObjectLabel(GL_FRAMEBUFFER, fbo_id, label);
+        for (unsigned int i = 0; i < fboTextures.size(); ++i)
+        {
+            std::ostringstream name;
+            name << label << " color " << i;
+            fboTextures[i].setLabel(name.str());
+        }
+        if (depth_texture.texID() != 0)
+        {
+            depth_texture.setLabel(label + " depth");
+        }
+        Misc::setObjectLabel(GL_RENDERBUFFER, depthbuffer, label + " depth");
+    }
+
     /**
      * @brief Generate the ith FBO texture as the ith color attachment.
      * @param attach_id Attachment holding the texture.
      */
     virtual void createTexture (int attach_id)
     {
+        if (samples > 0)
+        {
+            fboTextures[attach_id].createMultisample(internal_format, size[0], size[1], samples);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0+attach_id, GL_TEXTURE_2D_MULTISAMPLE, fboTextures[attach_id].texID(), 0);
+            return;
+        }
+
         fboTextures[attach_id].create(texture_type, internal_format, size[0], size[1], format, pixel_type);
 
-        glBindTexture(texture_type, fboTextures[attach_id].texID());
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0+attach_id, texture_type, fboTextures[attach_id].texID() , 0);
-        glBindTexture(texture_type, 0);
+    }
+
+    /**
+     * @brief Creates (or attaches the shared) depth attachment as described by depth_desc.
+     *
+     * The framebuffer must be bound.
+     */
+    virtual void createDepthAttachment (void)
+    {
+        if (depthbuffer)
+        {
+            DeletionQueue::Instance().retire(DeletionQueue::RENDERBUFFER, depthbuffer);
+            depthbuffer = 0;
+        }
+        depth_texture.destroy();
+
+        if (depth_desc.shared)
+        {
+            Framebuffer* owner = depthOwner();
+            if (owner->size != size || owner->samples != samples)
+            {
+                cerr << "Warning: shared depth attachment has different size or number of samples" << endl;
+            }
+            GLenum attachment = depthAttachmentPoint(owner->depth_desc.format);
+            if (owner->depth_texture.texID() != 0)
+            {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, owner->depth_texture.getTextureType(), owner->depth_texture.texID(), 0);
+            }
+            else if (owner->depthbuffer)
+            {
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, owner->depthbuffer);
+            }
+            else
+            {
+                cerr << "Warning: shared framebuffer has no depth attachment" << endl;
+            }
+            return;
+        }
+
+        if (depth_desc.format == GL_NONE)
+        {
+            return;
+        }
+
+        GLenum attachment = depthAttachmentPoint(depth_desc.format);
+        if (depth_desc.texture)
+        {
+            if (samples > 0)
+            {
+                depth_texture.createMultisample(depth_desc.format, size[0], size[1], samples);
+            }
+            else if (isStencilFormat(depth_desc.format))
+            {
+                GLenum type = (depth_desc.format == GL_DEPTH32F_STENCIL8) ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV : GL_UNSIGNED_INT_24_8;
+                depth_texture.createImmutable(GL_TEXTURE_2D, depth_desc.format, size[0], size[1], GL_DEPTH_STENCIL, type);
+            }
+            else
+            {
+                depth_texture.createImmutable(GL_TEXTURE_2D, depth_desc.format, size[0], size[1], GL_DEPTH_COMPONENT, GL_FLOAT);
+            }
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, depth_texture.getTextureType(), depth_texture.texID(), 0);
+        }
+        else
+        {
+            glGenRenderbuffers(1, &depthbuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, depthbuffer);
+            if (samples > 0)
+            {
+                glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, depth_desc.format, size[0], size[1]);
+            }
+            else
+            {
+                glRenderbufferStorage(GL_RENDERBUFFER, depth_desc.format, size[0], size[1]);
+            }
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, depthbuffer);
+        }
+    }
+
+    /**
+     * @brief Returns the framebuffer that owns the depth attachment, following shared descriptions.
+     * @return Owner of the depth attachment (this if not shared).
+     */
+    Framebuffer* depthOwner (void)
+    {
+        Framebuffer* owner = this;
+        while (owner->depth_desc.shared && owner->depth_desc.shared != owner)
+        {
+            owner = owner->depth_desc.shared;
+        }
+        return owner;
+    }
+
+    /**
+     * @brief Returns wether a depth format has a stencil component.
+     * @param fmt Depth format.
+     * @return True if fmt is a depth stencil format.
+     */
+    static bool isStencilFormat (GLenum fmt)
+    {
+        return fmt == GL_DEPTH24_STENCIL8 || fmt == GL_DEPTH32F_STENCIL8 || fmt == GL_DEPTH_STENCIL;
+    }
+
+    /**
+     * @brief Returns the framebuffer attachment point for a depth format.
+     * @param fmt Depth format.
+     * @return GL_DEPTH_STENCIL_ATTACHMENT for depth stencil formats, GL_DEPTH_ATTACHMENT otherwise.
+     */
+    static GLenum depthAttachmentPoint (GLenum fmt)
+    {
+        return isStencilFormat(fmt) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+    }
+
+    /**
+     * @brief Blits this framebuffer into another one, resolving samples if multisampled.
+     *
+     * Leaves both framebuffers bound (read and draw targets), callers unbind afterwards. The read and draw buffers
+     * are only selected during the blit, so the draw buffers of a multiple render target destination are kept.
+     * @param draw_fbo Destination framebuffer handle (0 for the default framebuffer).
+     * @param read_buffer Source color buffer (ignored for depth).
+     * @param draw_buffer Destination color buffer (ignored for depth).
+     * @param dst_size Destination size, must be equal to the FBO size when resolving.
+     * @param mask GL_COLOR_BUFFER_BIT or GL_DEPTH_BUFFER_BIT.
+     */
+    void blitTo (GLuint draw_fbo, GLenum read_buffer, GLenum draw_buffer, const Eigen::Vector2i& dst_size, GLbitfield mask)
+    {
+        if (samples > 0 && dst_size != size)
+        {
+            cerr << "Warning: resolve target size (" << dst_size.transpose() << ") differs from FBO size (" << size.transpose() << ")" << endl;
+        }
+        glState.bindFramebuffer(GL_READ_FRAMEBUFFER, fbo_id);
+        glState.bindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_fbo);
+        if (!(mask & GL_COLOR_BUFFER_BIT))
+        {
+            glBlitFramebuffer(0, 0, size[0], size[1], 0, 0, dst_size[0], dst_size[1], mask, GL_NEAREST);
+            return;
+        }
+
+        GLint saved_read, max_draw_buffers;
+        glGetIntegerv(GL_READ_BUFFER, &saved_read);
+        glGetIntegerv(GL_MAX_DRAW_BUFFERS, &max_draw_buffers);
+        vector<GLenum> saved_draw (draw_fbo == 0 ? 1 : max_draw_buffers);
+        for (unsigned int i = 0; i < saved_draw.size(); ++i)
+        {
+            GLint buffer;
+            glGetIntegerv(GL_DRAW_BUFFER0 + i, &buffer);
+            saved_draw[i] = buffer;
+        }
+
+        glReadBuffer(read_buffer);
+        glDrawBuffer(draw_buffer);
+        glBlitFramebuffer(0, 0, size[0], size[1], 0, 0, dst_size[0], dst_size[1], mask, GL_NEAREST);
+
+        glReadBuffer(saved_read);
+        if (draw_fbo == 0)
+        {
+            // the default framebuffer may use GL_BACK, which glDrawBuffers does not accept
+            glDrawBuffer(saved_draw[0]);
+        }
+        else
+        {
+            glDrawBuffers(saved_draw.size(), &saved_draw[0]);
+        }
     }
 
 
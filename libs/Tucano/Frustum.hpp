@@ -0,0 +1,290 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FRUSTUM__
+#define __FRUSTUM__
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <Eigen/Dense>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "BoundingBox3.hpp"
+
+namespace Tucano
+{
+
+/**
+ * @brief View frustum as six planes, extracted from a view-projection matrix.
+ *
+ * Planes point inwards, a point p is inside plane i when dot(plane_i.xyz, p) + plane_i.w >= 0.
+ * Box tests are conservative: boxes reported visible may still be outside near a frustum corner,
+ * boxes reported culled are always outside.
+ *
+ * The batch test works on boxes stored as structure of arrays (centers and half extents), eight boxes at a
+ * time with AVX or four with NEON when the code is compiled for them (ex. -mavx or -march=native).
+ */
+class Frustum {
+
+public:
+
+    /// Plane indices.
+    enum Plane {LEFT = 0, RIGHT, BOTTOM, TOP, NEAR_PLANE, FAR_PLANE};
+
+    /**
+     * @brief Default constructor, a frustum containing everything.
+     */
+    Frustum (void)
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            planes[i][0] = planes[i][1] = planes[i][2] = 0.0f;
+            planes[i][3] = 1.0f;
+        }
+    }
+
+    /**
+     * @brief Constructs the frustum of a view-projection matrix.
+     * @param view_projection Projection matrix times view matrix (and model matrix for object space planes).
+     */
+    explicit Frustum (const Eigen::Matrix4f& view_projection)
+    {
+        extract(view_projection);
+    }
+
+    /**
+     * @brief Extracts and normalizes the planes of a view-projection matrix (OpenGL clip space, -w <= z <= w).
+     * @param m Projection matrix times view matrix.
+     */
+    void extract (const Eigen::Matrix4f& m)
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            int axis = i / 2;
+            float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+            Eigen::Vector4f plane = m.row(3).transpose() + sign * m.row(axis).transpose();
+            float length = plane.head<3>().norm();
+            if (length > 0.0f)
+            {
+                plane /= length;
+            }
+            for (int c = 0; c < 4; ++c)
+            {
+                planes[i][c] = plane[c];
+            }
+        }
+    }
+
+    /**
+     * @brief Returns one plane as (normal, distance).
+     * @param index Plane index (see Plane).
+     */
+    Eigen::Vector4f getPlane (int index) const
+    {
+        return Eigen::Vector4f(planes[index][0], planes[index][1], planes[index][2], planes[index][3]);
+    }
+
+    /**
+     * @brief Returns wether a point is inside the frustum.
+     * @param p Point.
+     */
+    bool contains (const Eigen::Vector3f& p) const
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            if (planes[i][0]*p[0] + planes[i][1]*p[1] + planes[i][2]*p[2] + planes[i][3] < 0.0f)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Returns wether a sphere may intersect the frustum.
+     * @param center Sphere center.
+     * @param radius Sphere radius.
+     */
+    bool intersectSphere (const Eigen::Vector3f& center, float radius) const
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            if (planes[i][0]*center[0] + planes[i][1]*center[1] + planes[i][2]*center[2] + planes[i][3] < -radius)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Returns wether a box given by center and half extents may intersect the frustum.
+     * @param center Box center.
+     * @param extent Box half extents.
+     */
+    bool intersect (const Eigen::Vector3f& center, const Eigen::Vector3f& extent) const
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            float distance = planes[i][0]*center[0] + planes[i][1]*center[1] + planes[i][2]*center[2] + planes[i][3];
+            float radius = std::fabs(planes[i][0])*extent[0] + std::fabs(planes[i][1])*extent[1] + std::fabs(planes[i][2])*extent[2];
+            if (distance < -radius)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Returns wether a bounding box may intersect the frustum.
+     * @param box Axis aligned box.
+     */
+    bool intersect (const BoundingBox3<float>& box) const
+    {
+        return intersect(box.center(), (box.Max() - box.Min()) * 0.5f);
+    }
+
+    /**
+     * @brief Tests many boxes stored as structure of arrays.
+     * @param cx Box centers x coordinates.
+     * @param cy Box centers y coordinates.
+     * @param cz Box centers z coordinates.
+     * @param ex Box half extents in x.
+     * @param ey Box half extents in y.
+     * @param ez Box half extents in z.
+     * @param count Number of boxes.
+     * @param visible Receives 1 for each box that may be visible, 0 for culled boxes.
+     * @return Number of visible boxes.
+     */
+    size_t cullBoxes (const float* cx, const float* cy, const float* cz, const float* ex, const float* ey, const float* ez,
+                      size_t count, unsigned char* visible) const
+    {
+        size_t i = 0;
+        size_t num_visible = 0;
+
+#if defined(__AVX__)
+        __m256 zero = _mm256_setzero_ps();
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(cx + i), y = _mm256_loadu_ps(cy + i), z = _mm256_loadu_ps(cz + i);
+            __m256 hx = _mm256_loadu_ps(ex + i), hy = _mm256_loadu_ps(ey + i), hz = _mm256_loadu_ps(ez + i);
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p][0]), x),
+                                                              _mm256_mul_ps(_mm256_set1_ps(planes[p][1]), y)),
+                                                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p][2]), z),
+                                                              _mm256_set1_ps(planes[p][3])));
+                __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::fabs(planes[p][0])), hx),
+                                                            _mm256_mul_ps(_mm256_set1_ps(std::fabs(planes[p][1])), hy)),
+                                              _mm256_mul_ps(_mm256_set1_ps(std::fabs(planes[p][2])), hz));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+            }
+            int bits = _mm256_movemask_ps(inside);
+            for (int k = 0; k < 8; ++k)
+            {
+                visible[i + k] = (bits >> k) & 1;
+                num_visible += visible[i + k];
+            }
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        float32x4_t zero = vdupq_n_f32(0.0f);
+        for (; i + 4 <= count; i += 4)
+        {
+            float32x4_t x = vld1q_f32(cx + i), y = vld1q_f32(cy + i), z = vld1q_f32(cz + i);
+            float32x4_t hx = vld1q_f32(ex + i), hy = vld1q_f32(ey + i), hz = vld1q_f32(ez + i);
+            uint32x4_t inside = vdupq_n_u32(0xFFFFFFFFu);
+            for (int p = 0; p < 6; ++p)
+            {
+                float32x4_t distance = vdupq_n_f32(planes[p][3]);
+                distance = vmlaq_n_f32(distance, x, planes[p][0]);
+                distance = vmlaq_n_f32(distance, y, planes[p][1]);
+                distance = vmlaq_n_f32(distance, z, planes[p][2]);
+                distance = vmlaq_n_f32(distance, hx, std::fabs(planes[p][0]));
+                distance = vmlaq_n_f32(distance, hy, std::fabs(planes[p][1]));
+                distance = vmlaq_n_f32(distance, hz, std::fabs(planes[p][2]));
+                inside = vandq_u32(inside, vcgeq_f32(distance, zero));
+            }
+            uint32_t lanes[4];
+            vst1q_u32(lanes, inside);
+            for (int k = 0; k < 4; ++k)
+            {
+                visible[i + k] = lanes[k] ? 1 : 0;
+                num_visible += visible[i + k];
+            }
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            visible[i] = intersect(Eigen::Vector3f(cx[i], cy[i], cz[i]), Eigen::Vector3f(ex[i], ey[i], ez[i])) ? 1 : 0;
+            num_visible += visible[i];
+        }
+        return num_visible;
+    }
+
+    /**
+     * @brief Tests many bounding boxes, converted in blocks to the structure of arrays layout.
+     * @param boxes Axis aligned boxes.
+     * @param visible Receives 1 for each box that may be visible, 0 for culled boxes.
+     * @return Number of visible boxes.
+     */
+    size_t cullBoxes (const std::vector< BoundingBox3<float> >& boxes, std::vector<unsigned char>& visible) const
+    {
+        const size_t block = 256;
+        float soa[6][block];
+        size_t num_visible = 0;
+        visible.resize(boxes.size());
+        for (size_t first = 0; first < boxes.size(); first += block)
+        {
+            size_t n = std::min(block, boxes.size() - first);
+            for (size_t i = 0; i < n; ++i)
+            {
+                const BoundingBox3<float>& box = boxes[first + i];
+                for (int c = 0; c < 3; ++c)
+                {
+                    soa[c][i] = (box.Max()[c] + box.Min()[c]) * 0.5f;
+                    soa[3 + c][i] = (box.Max()[c] - box.Min()[c]) * 0.5f;
+                }
+            }
+            num_visible += cullBoxes(soa[0], soa[1], soa[2], soa[3], soa[4], soa[5], n, &visible[first]);
+        }
+        return num_visible;
+    }
+
+private:
+
+    /// Planes as (nx, ny, nz, d), normals pointing inwards.
+    float planes[6][4];
+};
+
+}
+
+#endif
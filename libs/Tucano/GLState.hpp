@@ -0,0 +1,409 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GLSTATE__
+#define __GLSTATE__
+
+/// Defines our unique instance of this singleton class.
+#define glState GLState::Instance()
+
+#include <vector>
+#include <GL/glew.h>
+
+namespace Tucano
+{
+
+/**
+ * @brief Singleton class that shadows the OpenGL binding state.
+ *
+ * Program, framebuffer and texture unit bindings made through Tucano are recorded here,
+ * and a bind is only sent to the driver if it changes the current state.
+ * A value of -1 in the shadow means the state is unknown, and the next bind is always issued.
+ *
+ * If the application changes any of these bindings with raw OpenGL calls, it must call
+ * invalidate() afterwards (or disable filtering with setFilteringEnabled(false)).
+ */
+class GLState {
+
+public:
+
+    /**
+     * @brief Returns the instance of the calling thread. If no instace exists, it will create one (only once).
+     *
+     * Each thread has its own instance, since it shadows the state of the context current in that thread
+     * (ex. the render thread and a resource thread with a shared context, see RenderThread).
+     */
+    static GLState &Instance (void)
+    {
+        static thread_local GLState _instance;
+        return _instance;
+    }
+
+    /**
+     * @brief Makes a program current, if it is not already.
+     * @param program Program handle.
+     */
+    void useProgram (GLuint program)
+    {
+        if (filtering && current_program == (GLint)program)
+        {
+            ++skipped;
+            return;
+        }
+        glUseProgram(program);
+        current_program = program;
+        ++issued;
+    }
+
+    /**
+     * @brief Binds a framebuffer to a target, if it is not already bound.
+     *
+     * GL_FRAMEBUFFER sets both draw and read targets.
+     * @param target GL_FRAMEBUFFER, GL_DRAW_FRAMEBUFFER or GL_READ_FRAMEBUFFER.
+     * @param fbo Framebuffer handle.
+     */
+    void bindFramebuffer (GLenum target, GLuint fbo)
+    {
+        bool draw = (target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER);
+        bool read = (target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER);
+        if (filtering && (!draw || draw_framebuffer == (GLint)fbo) && (!read || read_framebuffer == (GLint)fbo))
+        {
+            ++skipped;
+            return;
+        }
+        glBindFramebuffer(target, fbo);
+        if (draw)
+            draw_framebuffer = fbo;
+        if (read)
+            read_framebuffer = fbo;
+        ++issued;
+    }
+
+    /**
+     * @brief Binds a texture to a given texture unit, if it is not already bound.
+     * @param texture_unit Texture unit (zero based, not GL_TEXTURE0 based).
+     * @param tex_type Texture target (ex. GL_TEXTURE_2D).
+     * @param tex_id Texture handle.
+     */
+    void bindTexture (int texture_unit, GLenum tex_type, GLuint tex_id)
+    {
+        if (texture_unit >= (int)units.size())
+        {
+            units.resize(texture_unit+1, TextureBinding());
+        }
+        TextureBinding& binding = units[texture_unit];
+        if (filtering && binding.tex_type == tex_type && binding.tex_id == (GLint)tex_id)
+        {
+            ++skipped;
+            return;
+        }
+        activeTexture(texture_unit);
+        glBindTexture(tex_type, tex_id);
+        binding.tex_type = tex_type;
+        binding.tex_id = tex_id;
+        ++issued;
+    }
+
+    /**
+     * @brief Binds a texture to the currently active texture unit.
+     *
+     * Used when a texture has to be bound only to edit it, without caring for which unit.
+     * @param tex_type Texture target (ex. GL_TEXTURE_2D).
+     * @param tex_id Texture handle.
+     */
+    void bindTexture (GLenum tex_type, GLuint tex_id)
+    {
+        if (active_unit == -1)
+        {
+            activeTexture(0);
+        }
+        bindTexture(active_unit, tex_type, tex_id);
+    }
+
+    /**
+     * @brief Marks a texture as deleted, the units that hold it are marked as unknown.
+     *
+     * Must be called when a texture is deleted, since GL unbinds it and may recycle its name. The units are not
+     * assumed unbound, since with deferred deletion (see DeletionQueue) the texture stays bound until collected.
+     * @param tex_id Texture handle.
+     */
+    void forgetTexture (GLuint tex_id)
+    {
+        for (unsigned int i = 0; i < units.size(); ++i)
+        {
+            if (units[i].tex_id == (GLint)tex_id)
+            {
+                units[i].tex_id = -1;
+            }
+        }
+    }
+
+    /**
+     * @brief Marks a program as deleted.
+     * @param program Program handle.
+     */
+    void forgetProgram (GLuint program)
+    {
+        if (current_program == (GLint)program)
+        {
+            current_program = -1;
+        }
+    }
+
+    /**
+     * @brief Marks a framebuffer as deleted, the targets that hold it are marked as unknown.
+     *
+     * GL reverts the bindings to the default framebuffer only when the name is actually deleted, which with
+     * deferred deletion happens later, so the next bind is always issued.
+     * @param fbo Framebuffer handle.
+     */
+    void forgetFramebuffer (GLuint fbo)
+    {
+        if (draw_framebuffer == (GLint)fbo)
+            draw_framebuffer = -1;
+        if (read_framebuffer == (GLint)fbo)
+            read_framebuffer = -1;
+    }
+
+    /**
+     * @brief Records memory barrier bits needed by the consumers of a shader write (ex. a compute dispatch).
+     *
+     * The barrier is not issued immediately, all recorded bits are issued in a single glMemoryBarrier by
+     * flushBarriers at the consumer points: draws, indirect dispatches, the CPU side reads and updates of Buffer,
+     * Texture and Framebuffer, and the bind of a program other than the one that recorded them
+     * (see flushBarriersForProgram). Consecutive dispatches of a program thus share a single barrier.
+     * @param barriers Barrier bits (ex. GL_SHADER_STORAGE_BARRIER_BIT).
+     * @param producer Program whose dispatch needs the barrier, -1 if unknown.
+     */
+    void addBarrier (GLbitfield barriers, GLint producer = -1)
+    {
+        if (pending_barriers == 0)
+        {
+            barrier_producer = producer;
+        }
+        else if (barrier_producer != producer)
+        {
+            barrier_producer = -1;
+        }
+        pending_barriers |= barriers;
+    }
+
+    /**
+     * @brief Issues the recorded memory barriers before a program is used, unless they were all recorded by it.
+     * @param program Program about to be used.
+     */
+    void flushBarriersForProgram (GLuint program)
+    {
+        if (pending_barriers != 0 && (barrier_producer == -1 || barrier_producer != (GLint)program))
+        {
+            flushBarriers();
+        }
+    }
+
+    /**
+     * @brief Issues the recorded memory barriers, if any.
+     */
+    void flushBarriers (void)
+    {
+        if (pending_barriers != 0)
+        {
+            glMemoryBarrier(pending_barriers);
+            pending_barriers = 0;
+            ++issued;
+        }
+    }
+
+    /**
+     * @brief Returns the recorded and not yet issued barrier bits.
+     */
+    GLbitfield getPendingBarriers (void) const
+    {
+        return pending_barriers;
+    }
+
+    /**
+     * @brief Forgets all the shadowed state.
+     *
+     * Escape hatch for code that changes bindings with raw OpenGL calls,
+     * the next bind of each kind will always be sent to the driver.
+     */
+    void invalidate (void)
+    {
+        current_program = -1;
+        draw_framebuffer = -1;
+        read_framebuffer = -1;
+        active_unit = -1;
+        units.assign(units.size(), TextureBinding());
+    }
+
+    /**
+     * @brief Enables or disables the redundant bind filtering.
+     *
+     * When disabled every bind is sent to the driver, but the state is still recorded.
+     * @param flag True to enable filtering, false to disable.
+     */
+    void setFilteringEnabled (bool flag)
+    {
+        filtering = flag;
+    }
+
+    /**
+     * @brief Starts counting binds for a new frame.
+     *
+     * The counters of the frame being closed are kept and can be read with getLastFrameIssued and getLastFrameSkipped.
+     */
+    void newFrame (void)
+    {
+        last_issued = issued;
+        last_skipped = skipped;
+        issued = 0;
+        skipped = 0;
+    }
+
+    /**
+     * @brief Returns the number of binds sent to the driver in the current frame.
+     */
+    unsigned int getIssued (void) const
+    {
+        return issued;
+    }
+
+    /**
+     * @brief Returns the number of redundant binds skipped in the current frame.
+     */
+    unsigned int getSkipped (void) const
+    {
+        return skipped;
+    }
+
+    /**
+     * @brief Returns the number of binds sent to the driver in the last complete frame.
+     */
+    unsigned int getLastFrameIssued (void) const
+    {
+        return last_issued;
+    }
+
+    /**
+     * @brief Returns the number of redundant binds skipped in the last complete frame.
+     */
+    unsigned int getLastFrameSkipped (void) const
+    {
+        return last_skipped;
+    }
+
+    /**
+     * @brief Returns the currently bound program, or -1 if unknown.
+     */
+    GLint currentProgram (void) const
+    {
+        return current_program;
+    }
+
+    /**
+     * @brief Returns the currently bound draw framebuffer, or -1 if unknown.
+     */
+    GLint currentDrawFramebuffer (void) const
+    {
+        return draw_framebuffer;
+    }
+
+    ~GLState () {}
+
+private:
+
+    /// Texture bound to one unit.
+    struct TextureBinding
+    {
+        GLenum tex_type;
+        GLint tex_id;
+        TextureBinding (void) : tex_type(0), tex_id(-1) {}
+    };
+
+    ///Default Constructor
+    GLState (void) : current_program(-1), draw_framebuffer(-1), read_framebuffer(-1), active_unit(-1),
+        filtering(true), issued(0), skipped(0), last_issued(0), last_skipped(0), pending_barriers(0), barrier_producer(-1)
+    {
+        GLint max_units = 0;
+        glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &max_units);
+        units.resize(max_units > 0 ? max_units : 0, TextureBinding());
+    }
+
+    ///Copy Constructor
+    GLState (GLState const&);
+
+    ///Assignment Operation
+    GLState& operator= (GLState const&);
+
+    /**
+     * @brief Sets the active texture unit, if it is not already.
+     * @param texture_unit Texture unit (zero based).
+     */
+    void activeTexture (int texture_unit)
+    {
+        if (!filtering || active_unit != texture_unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + texture_unit);
+            active_unit = texture_unit;
+        }
+    }
+
+    /// Current program.
+    GLint current_program;
+
+    /// Current draw framebuffer.
+    GLint draw_framebuffer;
+
+    /// Current read framebuffer.
+    GLint read_framebuffer;
+
+    /// Current active texture unit.
+    GLint active_unit;
+
+    /// Texture bound to each unit.
+    std::vector<TextureBinding> units;
+
+    /// Flag to skip redundant binds.
+    bool filtering;
+
+    /// Binds sent to the driver in the current frame.
+    unsigned int issued;
+
+    /// Binds skipped in the current frame.
+    unsigned int skipped;
+
+    /// Binds sent to the driver in the last frame.
+    unsigned int last_issued;
+
+    /// Binds skipped in the last frame.
+    unsigned int last_skipped;
+
+    /// Memory barrier bits recorded and not yet issued.
+    GLbitfield pending_barriers;
+
+    /// Program that recorded all the pending barriers, -1 if unknown or several.
+    GLint barrier_producer;
+};
+
+}
+
+#endif
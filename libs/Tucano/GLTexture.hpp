@@ -24,9 +24,13 @@
 #define __TEXTURE__
 
 #include <iostream>
+#include <algorithm>
 #include <GL/glew.h>
+#include <Eigen/Dense>
 
 #include "TextureManager.hpp"
+#include "DeletionQueue.hpp"
+#include "Misc.hpp"
 
 using namespace std;
 
@@ -36,6 +40,9 @@ namespace Tucano
 /**
  * @brief An OpenGL texture.
  * It can be a simple texture or an FBO texture.
+ *
+ * A texture owns its GL name: it can be moved (ex. stored in a vector) but not copied, and the name is
+ * released when the texture is destroyed, through the DeletionQueue.
  */
 class Texture {
 private:
@@ -70,6 +77,76 @@ private:
     /// Texture unit this texture is occupying (if any).
     int unit;
 
+    /// Bindless texture handle (ARB_bindless_texture), 0 if no handle was requested.
+    GLuint64 bindless_handle;
+
+    /// Flag to indicate if the texture was created with immutable storage (glTextureStorage).
+    bool immutable;
+
+    /// Number of mipmap levels allocated with immutable storage.
+    int storage_levels;
+
+    /// Number of samples for multisample textures, 0 for regular textures.
+    int samples;
+
+    /// Debug label of the texture (see setLabel).
+    std::string label;
+
+    /**
+     * @brief Sets one integer texture parameter.
+     *
+     * Uses direct state access if available, otherwise the texture must be bound to its target.
+     * @param pname Parameter name.
+     * @param value Parameter value.
+     */
+    void setParameter (GLenum pname, GLint value)
+    {
+        if (isDSASupported())
+        {
+            glTextureParameteri(tex_id, pname, value);
+        }
+        else
+        {
+            glTexParameteri(tex_type, pname, value);
+        }
+    }
+
+    ///Copy Constructor
+    Texture (Texture const&);
+
+    ///Assignment Operation
+    Texture& operator= (Texture const&);
+
+    /**
+     * @brief Takes the GL texture and the description of another texture, leaving it empty.
+     * @param other Texture to move from.
+     */
+    void moveFrom (Texture& other)
+    {
+        tex_id = other.tex_id;
+        tex_type = other.tex_type;
+        internal_format = other.internal_format;
+        width = other.width;
+        height = other.height;
+        depth = other.depth;
+        format = other.format;
+        pixel_type = other.pixel_type;
+        lod = other.lod;
+        unit = other.unit;
+        bindless_handle = other.bindless_handle;
+        immutable = other.immutable;
+        storage_levels = other.storage_levels;
+        samples = other.samples;
+        label.swap(other.label);
+
+        other.tex_id = 0;
+        other.unit = -1;
+        other.bindless_handle = 0;
+        other.immutable = false;
+        other.storage_levels = 1;
+        other.samples = 0;
+    }
+
 public:
 
     /**
@@ -78,6 +155,11 @@ public:
     Texture (void)
     {
         tex_id = 0;
+        unit = -1;
+        bindless_handle = 0;
+        immutable = false;
+        storage_levels = 1;
+        samples = 0;
     }
 
     /**
@@ -89,6 +171,30 @@ public:
         destroy();
     }
 
+    /**
+     * @brief Move constructor, takes the GL texture of another texture, leaving it empty.
+     * @param other Texture to move from.
+     */
+    Texture (Texture&& other) noexcept
+    {
+        moveFrom(other);
+    }
+
+    /**
+     * @brief Move assignment, deletes the current texture and takes the one of another texture.
+     * @param other Texture to move from.
+     * @return Reference to this texture.
+     */
+    Texture& operator= (Texture&& other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
 
     /**
     * @brief Returns the texture width
@@ -108,6 +214,24 @@ public:
         return height;
     }
 
+    /**
+    * @brief Returns the texture depth
+    * @return texture depth in pixels (or number of layers), only meaningful for 3D and array textures
+    */
+    int getDepth (void)
+    {
+        return depth;
+    }
+
+    /**
+    * @brief Returns the texture type
+    * @return texture type (ex. GL_TEXTURE_2D)
+    */
+    GLenum getTextureType (void) const
+    {
+        return tex_type;
+    }
+
     /**
     * @brief Returns the texture dimensions
     * @return Texture dimensions as an int vector
@@ -139,13 +263,15 @@ public:
         pixel_type = pix_type;
         lod = 0;
         depth = dpt;
+        immutable = false;
+        storage_levels = 1;
+        samples = 0;
 
-        if (tex_id != 0)
-            glDeleteTextures(1, &tex_id);
+        destroy();
 
         glGenTextures(1, &tex_id);        
 
-        glBindTexture(tex_type, tex_id);
+        glState.bindTexture(tex_type, tex_id);
         if(tex_type == GL_TEXTURE_2D || tex_type == GL_TEXTURE_RECTANGLE)
         {            
             glTexImage2D(tex_type, lod, internal_format, width, height, 0, format, pixel_type, data);           
@@ -162,7 +288,7 @@ public:
         // default parameters
         setTexParameters();
 
-        glBindTexture(tex_type, 0);
+        glState.bindTexture(tex_type, 0);
         return tex_id;
     }
 
@@ -180,6 +306,372 @@ public:
         return create (GL_TEXTURE_2D, GL_RGBA32F, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data, 0);
     }
 
+    /**
+     * @brief Creates a texture with immutable storage using direct state access and returns its handler.
+     *
+     * Storage is allocated once with glTextureStorage*, so the driver does not need to revalidate the texture,
+     * and no bind is necessary to create, fill or change parameters.
+     * The internal format must be a sized format (ex. GL_RGBA8, GL_RGBA32F).
+     * Falls back to create if direct state access (GL 4.5) is not available.
+     * @param type Type of GL texture (GL_TEXTURE_1D, GL_TEXTURE_2D, GL_TEXTURE_RECTANGLE, GL_TEXTURE_2D_ARRAY or GL_TEXTURE_3D)
+     * @param int_format Sized format of texel (ex. GL_RGBA8 or GL_RGBA32F)
+     * @param w Width of texture
+     * @param h Height of texture
+     * @param fmt Format of texel channels (usually GL_RGBA)
+     * @param pix_type Type of one channel of a texel (usually GL_FLOAT or GL_USIGNED_BYTE)
+     * @param data Pointer to data to fill the first level of the texture
+     * @param dpt Depth of texture (number of layers for arrays)
+     * @param levels Number of mipmap levels to allocate
+     * @return Texture ID (handler for OpenGL)
+     */
+    GLuint createImmutable (GLenum type, GLenum int_format, int w, int h, GLenum fmt, GLenum pix_type, const GLvoid* data = NULL, int dpt = 1, int levels = 1)
+    {
+        if (!isDSASupported())
+        {
+            cerr << "Warning: direct state access not supported, creating mutable texture" << endl;
+            return create(type, int_format, w, h, fmt, pix_type, data, dpt);
+        }
+
+        tex_type = type;
+        internal_format = int_format;
+        width = w;
+        height = h;
+        format = fmt;
+        pixel_type = pix_type;
+        lod = 0;
+        depth = dpt;
+        immutable = true;
+        storage_levels = levels;
+        samples = 0;
+
+        destroy();
+
+        glCreateTextures(tex_type, 1, &tex_id);
+
+        if (tex_type == GL_TEXTURE_2D || tex_type == GL_TEXTURE_RECTANGLE)
+        {
+            glTextureStorage2D(tex_id, storage_levels, internal_format, width, height);
+        }
+        else if (tex_type == GL_TEXTURE_3D || tex_type == GL_TEXTURE_2D_ARRAY)
+        {
+            glTextureStorage3D(tex_id, storage_levels, internal_format, width, height, depth);
+        }
+        else if (tex_type == GL_TEXTURE_1D)
+        {
+            glTextureStorage1D(tex_id, storage_levels, internal_format, width);
+        }
+
+        if (data)
+        {
+            update(data);
+        }
+
+        // default parameters, GL_CLAMP is not accepted by core profiles
+        setTexParameters(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+
+        return tex_id;
+    }
+
+    /**
+     * @brief Creates a multisample texture (GL_TEXTURE_2D_MULTISAMPLE) and returns its handler.
+     *
+     * Multisample textures can only be rendered to, fetched with texelFetch, or resolved with a blit,
+     * so no data or sampling parameters are set. Immutable storage is used if direct state access is available.
+     * The number of samples is clamped to GL_MAX_SAMPLES.
+     * @param int_format Sized format of texel (ex. GL_RGBA8 or GL_RGBA32F)
+     * @param w Width of texture
+     * @param h Height of texture
+     * @param num_samples Number of samples per texel
+     * @param fixed_locations If true all texels use the same sample locations, required to mix with renderbuffers
+     * @return Texture ID (handler for OpenGL)
+     */
+    GLuint createMultisample (GLenum int_format, int w, int h, int num_samples, bool fixed_locations = true)
+    {
+        GLint max_samples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+        if (num_samples > max_samples)
+        {
+            cerr << "Warning: " << num_samples << " samples requested, max samples is " << max_samples << endl;
+            num_samples = max_samples;
+        }
+
+        tex_type = GL_TEXTURE_2D_MULTISAMPLE;
+        internal_format = int_format;
+        width = w;
+        height = h;
+        lod = 0;
+        depth = 1;
+        storage_levels = 1;
+        samples = num_samples;
+
+        destroy();
+
+        if (isDSASupported())
+        {
+            immutable = true;
+            glCreateTextures(tex_type, 1, &tex_id);
+            glTextureStorage2DMultisample(tex_id, samples, internal_format, width, height, fixed_locations);
+        }
+        else
+        {
+            immutable = false;
+            glGenTextures(1, &tex_id);
+            glState.bindTexture(tex_type, tex_id);
+            glTexImage2DMultisample(tex_type, samples, internal_format, width, height, fixed_locations);
+            glState.bindTexture(tex_type, 0);
+        }
+
+        return tex_id;
+    }
+
+    /**
+     * @brief Creates a texture with storage for all levels of a compressed format (BC1-BC7, ASTC) and returns its handler.
+     *
+     * No data is uploaded, each level is filled with updateCompressed (see TextureFile for loading files with precomputed mipmaps).
+     * Storage is immutable if direct state access is available, otherwise each level is allocated with glCompressedTexImage*.
+     * Sampling parameters are set for trilinear filtering over the allocated levels.
+     * @param type Type of GL texture (GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP)
+     * @param int_format Compressed internal format (ex. GL_COMPRESSED_RGBA_BPTC_UNORM)
+     * @param w Width of the first level
+     * @param h Height of the first level
+     * @param levels Number of mipmap levels to allocate
+     * @param dpt Number of layers for array textures
+     * @return Texture ID (handler for OpenGL), 0 if the format is not a known compressed format
+     */
+    GLuint createCompressed (GLenum type, GLenum int_format, int w, int h, int levels, int dpt = 1)
+    {
+        int block_width, block_height, block_bytes;
+        if (!getCompressedBlock(int_format, block_width, block_height, block_bytes))
+        {
+            cerr << "Warning: not a compressed texture format: " << int_format << endl;
+            return 0;
+        }
+        if (!isCompressedFormatSupported(int_format))
+        {
+            cerr << "Warning: compressed texture format not supported by the driver: " << int_format << endl;
+        }
+
+        tex_type = type;
+        internal_format = int_format;
+        width = w;
+        height = h;
+        format = GL_NONE;
+        pixel_type = GL_NONE;
+        lod = 0;
+        depth = (type == GL_TEXTURE_2D_ARRAY) ? dpt : 1;
+        storage_levels = std::max(levels, 1);
+        samples = 0;
+
+        destroy();
+
+        if (isDSASupported())
+        {
+            immutable = true;
+            glCreateTextures(tex_type, 1, &tex_id);
+            if (tex_type == GL_TEXTURE_2D_ARRAY)
+            {
+                glTextureStorage3D(tex_id, storage_levels, internal_format, width, height, depth);
+            }
+            else
+            {
+                glTextureStorage2D(tex_id, storage_levels, internal_format, width, height);
+            }
+        }
+        else
+        {
+            immutable = false;
+            glGenTextures(1, &tex_id);
+            glState.bindTexture(tex_type, tex_id);
+            for (int level = 0; level < storage_levels; ++level)
+            {
+                int lw = std::max(width >> level, 1), lh = std::max(height >> level, 1);
+                GLsizei bytes = getCompressedSize(internal_format, lw, lh);
+                if (tex_type == GL_TEXTURE_2D_ARRAY)
+                {
+                    glCompressedTexImage3D(tex_type, level, internal_format, lw, lh, depth, 0, bytes * depth, NULL);
+                }
+                else if (tex_type == GL_TEXTURE_CUBE_MAP)
+                {
+                    for (int face = 0; face < 6; ++face)
+                    {
+                        glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, internal_format, lw, lh, 0, bytes, NULL);
+                    }
+                }
+                else
+                {
+                    glCompressedTexImage2D(tex_type, level, internal_format, lw, lh, 0, bytes, NULL);
+                }
+            }
+        }
+
+        setTexParametersMipMap(storage_levels - 1, 0, GL_REPEAT, GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, false);
+
+        if (!isDSASupported())
+        {
+            glState.bindTexture(tex_type, 0);
+        }
+        return tex_id;
+    }
+
+    /**
+     * @brief Returns the number of samples per texel.
+     * @return Number of samples, or 0 if it is not a multisample texture.
+     */
+    int getSamples (void) const
+    {
+        return samples;
+    }
+
+    /**
+     * @brief Returns wether direct state access (GL 4.5 or ARB_direct_state_access) is supported.
+     * @return True if supported, false otherwise.
+     */
+    static bool isDSASupported (void)
+    {
+        return GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access;
+    }
+
+    /**
+     * @brief Returns the block dimensions of a compressed format.
+     * @param int_format Internal format.
+     * @param block_width Returns the block width in texels.
+     * @param block_height Returns the block height in texels.
+     * @param block_bytes Returns the size of a block in bytes.
+     * @return True if int_format is a BC (S3TC, RGTC, BPTC) or ASTC format, false otherwise.
+     */
+    static bool getCompressedBlock (GLenum int_format, int& block_width, int& block_height, int& block_bytes)
+    {
+        block_width = block_height = 4;
+        switch (int_format)
+        {
+            case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+            case GL_COMPRESSED_RED_RGTC1:
+            case GL_COMPRESSED_SIGNED_RED_RGTC1:
+                block_bytes = 8;
+                return true;
+            case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+            case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+            case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+            case GL_COMPRESSED_RG_RGTC2:
+            case GL_COMPRESSED_SIGNED_RG_RGTC2:
+            case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+            case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+            case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+                block_bytes = 16;
+                return true;
+            default:
+                break;
+        }
+        // ASTC linear and sRGB formats share the same ordering of block sizes
+        static const int astc_blocks[14][2] = {{4,4}, {5,4}, {5,5}, {6,5}, {6,6}, {8,5}, {8,6}, {8,8},
+                                               {10,5}, {10,6}, {10,8}, {10,10}, {12,10}, {12,12}};
+        int astc = -1;
+        if (int_format >= GL_COMPRESSED_RGBA_ASTC_4x4_KHR && int_format <= GL_COMPRESSED_RGBA_ASTC_12x12_KHR)
+        {
+            astc = int_format - GL_COMPRESSED_RGBA_ASTC_4x4_KHR;
+        }
+        else if (int_format >= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR && int_format <= GL_COMPRESSED_SRGB8_ALPHA8_ASTC_12x12_KHR)
+        {
+            astc = int_format - GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR;
+        }
+        if (astc < 0)
+        {
+            return false;
+        }
+        block_width = astc_blocks[astc][0];
+        block_height = astc_blocks[astc][1];
+        block_bytes = 16;
+        return true;
+    }
+
+    /**
+     * @brief Returns the size in bytes of an image in a compressed format.
+     * @param int_format Compressed internal format.
+     * @param w Image width.
+     * @param h Image height.
+     * @param d Image depth or number of layers.
+     * @return Size in bytes, 0 if int_format is not a known compressed format.
+     */
+    static GLsizei getCompressedSize (GLenum int_format, int w, int h, int d = 1)
+    {
+        int block_width, block_height, block_bytes;
+        if (!getCompressedBlock(int_format, block_width, block_height, block_bytes))
+        {
+            return 0;
+        }
+        return ((w + block_width - 1) / block_width) * ((h + block_height - 1) / block_height) * block_bytes * d;
+    }
+
+    /**
+     * @brief Returns wether the driver supports a compressed format.
+     *
+     * RGTC is core since GL 3.0, S3TC needs EXT_texture_compression_s3tc, BPTC GL 4.2 or ARB_texture_compression_bptc,
+     * and ASTC KHR_texture_compression_astc_ldr (usually only on mobile and integrated GPUs).
+     * @param int_format Compressed internal format.
+     * @return True if supported, false otherwise.
+     */
+    static bool isCompressedFormatSupported (GLenum int_format)
+    {
+        int block_width, block_height, block_bytes;
+        if (!getCompressedBlock(int_format, block_width, block_height, block_bytes))
+        {
+            return false;
+        }
+        switch (int_format)
+        {
+            case GL_COMPRESSED_RED_RGTC1:
+            case GL_COMPRESSED_SIGNED_RED_RGTC1:
+            case GL_COMPRESSED_RG_RGTC2:
+            case GL_COMPRESSED_SIGNED_RG_RGTC2:
+                return true;
+            case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM:
+            case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT:
+            case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT:
+                return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+            default:
+                break;
+        }
+        if (int_format >= GL_COMPRESSED_RGBA_ASTC_4x4_KHR)
+        {
+            return GLEW_KHR_texture_compression_astc_ldr;
+        }
+        return GLEW_EXT_texture_compression_s3tc;
+    }
+
+    /**
+     * @brief Returns wether the texture has a compressed internal format.
+     * @return True if compressed, false otherwise.
+     */
+    bool isCompressed (void) const
+    {
+        int block_width, block_height, block_bytes;
+        return getCompressedBlock(internal_format, block_width, block_height, block_bytes);
+    }
+
+    /**
+     * @brief Returns the number of allocated mipmap levels (see createImmutable and createCompressed).
+     * @return Number of levels.
+     */
+    int getLevels (void) const
+    {
+        return storage_levels;
+    }
+
+    /**
+     * @brief Returns wether the texture was created with immutable storage.
+     * @return True if immutable, false otherwise.
+     */
+    bool isImmutable (void) const
+    {
+        return immutable;
+    }
+
 
     /**
      * @brief Deletes the texture.
@@ -187,11 +679,22 @@ public:
     void destroy (void)
     {
         if (tex_id != 0) {
-            glDeleteTextures(1, &tex_id);
+            releaseHandle();
+            glState.forgetTexture(tex_id);
+            DeletionQueue::Instance().retire(DeletionQueue::TEXTURE, tex_id);
         }
         tex_id = 0;
     }
 
+    /**
+     * @brief Makes the bindless handle non resident and forgets it, before the texture is deleted.
+     */
+    void releaseHandle (void)
+    {
+        makeNonResident();
+        bindless_handle = 0;
+    }
+
     /**
      * @brief Sets texture parameters.
      * Sets the Wrap S and T, and Min and Mag filter parameters.
@@ -202,33 +705,46 @@ public:
      */
     void setTexParameters (GLenum wraps = GL_CLAMP, GLenum wrapt = GL_CLAMP, GLenum magfilter = GL_NEAREST, GLenum minfilter = GL_NEAREST)
     {
-        glTexParameteri(tex_type, GL_TEXTURE_WRAP_S, wraps);
-        glTexParameteri(tex_type, GL_TEXTURE_WRAP_T, wrapt);
-        glTexParameteri(tex_type, GL_TEXTURE_MAG_FILTER, magfilter);
-        glTexParameteri(tex_type, GL_TEXTURE_MIN_FILTER, minfilter);
+        setParameter(GL_TEXTURE_WRAP_S, wraps);
+        setParameter(GL_TEXTURE_WRAP_T, wrapt);
+        setParameter(GL_TEXTURE_MAG_FILTER, magfilter);
+        setParameter(GL_TEXTURE_MIN_FILTER, minfilter);
     }
 
     /**
      * @brief Sets texture parameters.
      * Sets the Wrap S and T, Min and Mag filter, and MipMap parameters.
-     * Also generates the MipMap at the end.
+     * Also generates the MipMap at the end, unless generate_mipmap is false.
      * @param maxlevel Max Mipmap level
      * @param baselevel Mipmap Base Level
      * @param wraps Wrap S
      * @param wrapt Wrap T
      * @param magfilter Mag Filter
      * @param minfilter Min Filter
+     * @param generate_mipmap If false the levels are left as uploaded (ex. precomputed in a file)
      */
-    void setTexParametersMipMap (int maxlevel, int baselevel = 0, GLenum wraps = GL_CLAMP, GLenum wrapt = GL_CLAMP, GLenum magfilter = GL_NEAREST, GLenum minfilter = GL_NEAREST_MIPMAP_NEAREST)
+    void setTexParametersMipMap (int maxlevel, int baselevel = 0, GLenum wraps = GL_CLAMP, GLenum wrapt = GL_CLAMP, GLenum magfilter = GL_NEAREST, GLenum minfilter = GL_NEAREST_MIPMAP_NEAREST, bool generate_mipmap = true)
     {
-        glTexParameteri(tex_type, GL_TEXTURE_MIN_FILTER, minfilter);
-        glTexParameteri(tex_type, GL_TEXTURE_MAG_FILTER, magfilter);
-        glTexParameteri(tex_type, GL_TEXTURE_WRAP_S, wraps);
-        glTexParameteri(tex_type, GL_TEXTURE_WRAP_T, wrapt);
-        glTexParameteri(tex_type, GL_TEXTURE_BASE_LEVEL, baselevel );
-        glTexParameteri(tex_type, GL_TEXTURE_MAX_LEVEL, maxlevel );
+        setParameter(GL_TEXTURE_MIN_FILTER, minfilter);
+        setParameter(GL_TEXTURE_MAG_FILTER, magfilter);
+        setParameter(GL_TEXTURE_WRAP_S, wraps);
+        setParameter(GL_TEXTURE_WRAP_T, wrapt);
+        setParameter(GL_TEXTURE_BASE_LEVEL, baselevel );
+        setParameter(GL_TEXTURE_MAX_LEVEL, maxlevel );
 
-        glGenerateMipmap(tex_type);
+        // precomputed (ex. compressed) mipmaps must not be overwritten
+        if (!generate_mipmap)
+        {
+            return;
+        }
+        if (isDSASupported())
+        {
+            glGenerateTextureMipmap(tex_id);
+        }
+        else
+        {
+            glGenerateMipmap(tex_type);
+        }
     }
 
 
@@ -240,18 +756,166 @@ public:
     **/
     void update (const GLvoid* data)
     {
-        glBindTexture(tex_type, tex_id);
-        if(tex_type == GL_TEXTURE_2D || tex_type == GL_TEXTURE_RECTANGLE) {
-            glTexSubImage2D(tex_type, lod, 0, 0, width, height, format, pixel_type, data);
+        if (tex_type == GL_TEXTURE_1D)
+        {
+            update(0, width, data);
+        }
+        else if (tex_type == GL_TEXTURE_3D || tex_type == GL_TEXTURE_2D_ARRAY)
+        {
+            update(0, 0, 0, width, height, depth, data);
+        }
+        else
+        {
+            update(0, 0, width, height, data);
+        }
+    }
+
+    /**
+     * @brief Updates a segment of a 1D texture.
+     * @param x First texel to update.
+     * @param w Number of texels to update.
+     * @param data Pointer to the w texels.
+     */
+    void update (int x, int w, const GLvoid* data)
+    {
+        glState.flushBarriers();
+        if (isDSASupported())
+        {
+            glTextureSubImage1D(tex_id, lod, x, w, format, pixel_type, data);
+            return;
+        }
+        glState.bindTexture(tex_type, tex_id);
+        glTexSubImage1D(tex_type, lod, x, w, format, pixel_type, data);
+        glState.bindTexture(tex_type, 0);
+    }
+
+    /**
+     * @brief Updates a rectangle of a 2D texture, useful for streaming tiles.
+     *
+     * The data must hold only the w x h texels of the rectangle, respecting the current GL_UNPACK_ALIGNMENT.
+     * @param x Left coordinate of the rectangle.
+     * @param y Bottom coordinate of the rectangle.
+     * @param w Width of the rectangle.
+     * @param h Height of the rectangle.
+     * @param data Pointer to the rectangle texels.
+     */
+    void update (int x, int y, int w, int h, const GLvoid* data)
+    {
+        glState.flushBarriers();
+        if (isDSASupported())
+        {
+            glTextureSubImage2D(tex_id, lod, x, y, w, h, format, pixel_type, data);
+            return;
+        }
+        glState.bindTexture(tex_type, tex_id);
+        glTexSubImage2D(tex_type, lod, x, y, w, h, format, pixel_type, data);
+        glState.bindTexture(tex_type, 0);
+    }
+
+    /**
+     * @brief Updates a sub-volume of a 3D texture (or a range of layers of a 2D array texture).
+     * @param x First texel in x.
+     * @param y First texel in y.
+     * @param z First texel in z (or first layer).
+     * @param w Width of the sub-volume.
+     * @param h Height of the sub-volume.
+     * @param d Depth of the sub-volume (or number of layers).
+     * @param data Pointer to the sub-volume texels.
+     */
+    void update (int x, int y, int z, int w, int h, int d, const GLvoid* data)
+    {
+        glState.flushBarriers();
+        if (isDSASupported())
+        {
+            glTextureSubImage3D(tex_id, lod, x, y, z, w, h, d, format, pixel_type, data);
+            return;
+        }
+        glState.bindTexture(tex_type, tex_id);
+        glTexSubImage3D(tex_type, lod, x, y, z, w, h, d, format, pixel_type, data);
+        glState.bindTexture(tex_type, 0);
+    }
+
+    /**
+     * @brief Updates a rectangle of one level of a compressed 2D texture.
+     *
+     * The rectangle must be aligned to the compression blocks, or reach the border of the level.
+     * @param level Mipmap level.
+     * @param x Left coordinate of the rectangle.
+     * @param y Bottom coordinate of the rectangle.
+     * @param w Width of the rectangle.
+     * @param h Height of the rectangle.
+     * @param data Pointer to the compressed blocks.
+     * @param bytes Size of the data in bytes.
+     */
+    void updateCompressed (int level, int x, int y, int w, int h, const GLvoid* data, GLsizei bytes)
+    {
+        glState.flushBarriers();
+        if (isDSASupported())
+        {
+            glCompressedTextureSubImage2D(tex_id, level, x, y, w, h, internal_format, bytes, data);
+            return;
+        }
+        glState.bindTexture(tex_type, tex_id);
+        glCompressedTexSubImage2D(tex_type, level, x, y, w, h, internal_format, bytes, data);
+        glState.bindTexture(tex_type, 0);
+    }
+
+    /**
+     * @brief Updates a region of one level of a compressed array or cube map texture.
+     * @param level Mipmap level.
+     * @param x Left coordinate of the region.
+     * @param y Bottom coordinate of the region.
+     * @param z First layer, or first face of a cube map (in the GL_TEXTURE_CUBE_MAP_POSITIVE_X order).
+     * @param w Width of the region.
+     * @param h Height of the region.
+     * @param d Number of layers (or faces).
+     * @param data Pointer to the compressed blocks, layer after layer.
+     * @param bytes Size of the data in bytes.
+     */
+    void updateCompressed (int level, int x, int y, int z, int w, int h, int d, const GLvoid* data, GLsizei bytes)
+    {
+        glState.flushBarriers();
+        if (isDSASupported())
+        {
+            glCompressedTextureSubImage3D(tex_id, level, x, y, z, w, h, d, internal_format, bytes, data);
+            return;
         }
-        else if (tex_type == GL_TEXTURE_3D) {
-            glTexSubImage3D(tex_type, lod, 0, 0, 0, width, height, depth, format, pixel_type, data);
+        glState.bindTexture(tex_type, tex_id);
+        if (tex_type == GL_TEXTURE_CUBE_MAP)
+        {
+            GLsizei face_bytes = bytes / d;
+            for (int face = 0; face < d; ++face)
+            {
+                glCompressedTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + z + face, level, x, y, w, h, internal_format,
+                                          face_bytes, (const GLubyte*)data + face * face_bytes);
+            }
         }
-        else if (tex_type == GL_TEXTURE_1D) {
-            glTexSubImage1D(tex_type, lod, 0, width, format, pixel_type, data);
+        else
+        {
+            glCompressedTexSubImage3D(tex_type, level, x, y, z, w, h, d, internal_format, bytes, data);
         }
-        glBindTexture(tex_type,0);
+        glState.bindTexture(tex_type, 0);
+    }
 
+    /**
+     * @brief Restricts sampling to a range of levels, ex. the levels loaded so far when streaming.
+     *
+     * Levels below base_level are never accessed, and do not need to hold data.
+     * @param base_level Finest level sampled (GL_TEXTURE_BASE_LEVEL).
+     * @param max_level Coarsest level sampled (GL_TEXTURE_MAX_LEVEL), -1 for the last allocated level.
+     */
+    void setLevelRange (int base_level, int max_level = -1)
+    {
+        if (!isDSASupported())
+        {
+            glState.bindTexture(tex_type, tex_id);
+        }
+        setParameter(GL_TEXTURE_BASE_LEVEL, base_level);
+        setParameter(GL_TEXTURE_MAX_LEVEL, max_level < 0 ? storage_levels - 1 : max_level);
+        if (!isDSASupported())
+        {
+            glState.bindTexture(tex_type, 0);
+        }
     }
 
     /**
@@ -348,6 +1012,61 @@ public:
         unit = -1;
     }
 
+    /**
+     * @brief Returns wether bindless textures (ARB_bindless_texture) are supported.
+     * @return True if supported, false otherwise.
+     */
+    static bool isBindlessSupported (void)
+    {
+        return GLEW_ARB_bindless_texture;
+    }
+
+    /**
+     * @brief Returns a resident bindless handle for this texture.
+     *
+     * The handle is created on the first call and made resident through the texture manager.
+     * A resident texture can be sampled in shaders without being bound to a unit, pass the handle
+     * with Shader::setUniformHandle or write it into a uniform or storage buffer.
+     * Note that after a handle is created the texture parameters and storage can no longer be changed.
+     * @return Bindless texture handle, or 0 if bindless textures are not supported.
+     */
+    GLuint64 makeResident (void)
+    {
+        if (!isBindlessSupported())
+        {
+            cerr << "Warning: ARB_bindless_texture not supported!" << endl;
+            return 0;
+        }
+        if (bindless_handle == 0)
+        {
+            bindless_handle = glGetTextureHandleARB(tex_id);
+        }
+        texManager.makeHandleResident(bindless_handle);
+        return bindless_handle;
+    }
+
+    /**
+     * @brief Makes the bindless handle of this texture non resident.
+     *
+     * The handle remains valid and can be made resident again.
+     */
+    void makeNonResident (void)
+    {
+        if (bindless_handle != 0)
+        {
+            texManager.makeHandleNonResident(bindless_handle);
+        }
+    }
+
+    /**
+     * @brief Returns the bindless handle of this texture.
+     * @return Bindless texture handle, or 0 if no handle was created.
+     */
+    GLuint64 getBindlessHandle (void) const
+    {
+        return bindless_handle;
+    }
+
     /**
      * @brief Returns the texture handle (texture ID).
      * @return Texture ID.
@@ -357,6 +1076,26 @@ public:
         return tex_id;
     }
 
+    /**
+     * @brief Names the texture for debug messages and GPU debuggers.
+     *
+     * The label is applied to the current texture object, set it again if the texture is recreated.
+     * @param name Texture label.
+     */
+    void setLabel (const std::string& name)
+    {
+        label = name;
+        Misc::setObjectLabel(GL_TEXTURE, tex_id, label);
+    }
+
+    /**
+     * @brief Returns the texture label.
+     */
+    const std::string& getLabel (void) const
+    {
+        return label;
+    }
+
     /**
      * @brief Returns the texture unit this texture is bound to.
      * @return The bound texture unit.
@@ -0,0 +1,728 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEOMETRYARENA__
+#define __GEOMETRYARENA__
+
+#include "Shader.hpp"
+#include "Buffer.hpp"
+
+#include <vector>
+#include <map>
+#include <string>
+#include <cstring>
+#include <iostream>
+
+namespace Tucano
+{
+
+/**
+ * @brief One draw of glMultiDrawElementsIndirect, as laid out in the indirect buffer.
+ */
+struct DrawElementsIndirectCommand
+{
+    /// Number of indices.
+    GLuint count;
+    /// Number of instances.
+    GLuint instance_count;
+    /// First index in the index buffer.
+    GLuint first_index;
+    /// Value added to each index.
+    GLint base_vertex;
+    /// First instance, offsets the per-instance attributes.
+    GLuint base_instance;
+};
+
+/**
+ * @brief Many meshes stored in a few large buffers and drawn with a single multi draw indirect call.
+ *
+ * The vertex layout is declared once as named float attributes, each stored in its own immutable buffer,
+ * followed by the per-instance attributes, which are interleaved. Meshes are suballocated out of the
+ * vertex and index buffers and referred to by an id.
+ *
+ * Per frame, instance data and draw commands are written to a persistently mapped ring of three regions,
+ * each guarded by a fence, so the CPU writes one frame while the GPU still reads the previous ones:
+ *
+ *     arena.beginFrame();
+ *     float* instance = arena.addDraw(mesh_id); // write the instance attributes of this draw
+ *     ...
+ *     arena.submit(shader);
+ *
+ * Vertex arrays are created per shader from the shader attribute locations, attributes not found in the
+ * shader are skipped. Requires OpenGL 4.3 (4.4 for persistent mapping, otherwise the ring is updated with copies).
+ */
+class GeometryArena {
+
+public:
+
+    /// Handle of a mesh in the arena.
+    typedef int MeshID;
+
+    /// Suballocated ranges of a mesh.
+    struct MeshRange
+    {
+        /// First vertex in the vertex buffers.
+        GLuint base_vertex;
+        /// Number of vertices.
+        GLuint vertex_count;
+        /// First index in the index buffer.
+        GLuint first_index;
+        /// Number of indices.
+        GLuint index_count;
+    };
+
+    /**
+     * @brief Default constructor.
+     */
+    GeometryArena (void) : max_vertices(0), max_indices(0), max_instances(0), max_draws(0), instance_stride(0),
+                           region_size(0), ring_data(NULL), frame(0), region(0), num_instances(0),
+                           vertex_allocator(0), index_allocator(0)
+    {
+        for (int i = 0; i < NUM_REGIONS; ++i)
+        {
+            fences[i] = 0;
+        }
+    }
+
+    /**
+     * @brief Default destructor.
+     */
+    ~GeometryArena (void)
+    {
+        destroy();
+    }
+
+    /**
+     * @brief Declares a vertex attribute, before initialize.
+     * @param name Attribute name in the shaders (ex. "in_Position").
+     * @param components Number of floats (1 to 4).
+     */
+    void addAttribute (const string& name, int components)
+    {
+        Attribute attribute = {name, components, 0};
+        attributes.push_back(attribute);
+    }
+
+    /**
+     * @brief Declares a per-instance attribute, before initialize.
+     *
+     * Attributes larger than four floats (ex. a mat4) use consecutive locations, as in GLSL.
+     * @param name Attribute name in the shaders (ex. "in_ModelMatrix").
+     * @param components Number of floats (1 to 4, or 16 for a mat4).
+     */
+    void addInstanceAttribute (const string& name, int components)
+    {
+        Attribute attribute = {name, components, instance_stride};
+        instance_attributes.push_back(attribute);
+        instance_stride += components * sizeof(GLfloat);
+    }
+
+    /**
+     * @brief Creates the buffers.
+     * @param vertices Capacity in vertices.
+     * @param indices Capacity in indices.
+     * @param instances Maximum number of instances per frame.
+     * @param draws Maximum number of draws per frame.
+     */
+    void initialize (GLuint vertices, GLuint indices, GLuint instances, GLuint draws)
+    {
+        destroy();
+        max_vertices = vertices;
+        max_indices = indices;
+        max_instances = instances;
+        max_draws = draws;
+
+        vertex_buffers.resize(attributes.size());
+        for (unsigned int i = 0; i < attributes.size(); ++i)
+        {
+            vertex_buffers[i].create(vertices * attributes[i].components * sizeof(GLfloat));
+        }
+        index_buffer.create(indices * sizeof(GLuint));
+        vertex_allocator = RangeAllocator(vertices);
+        index_allocator = RangeAllocator(indices);
+
+        // each region is instance data followed by the draw commands
+        region_size = align(align(instances * instance_stride) + draws * sizeof(DrawElementsIndirectCommand));
+        ring_data = (char*)ring.createMapped(NUM_REGIONS * region_size);
+        if (!ring_data)
+        {
+            ring.create(NUM_REGIONS * region_size);
+            staging.resize(region_size);
+        }
+        frame = 0;
+        region = 0;
+        num_instances = 0;
+        draws_in_frame.clear();
+    }
+
+    /**
+     * @brief Deletes the buffers, vertex arrays and fences, releasing all meshes.
+     */
+    void destroy (void)
+    {
+        vertex_buffers.clear();
+        for (map<vector<GLint>, GLuint>::iterator it = vaos.begin(); it != vaos.end(); ++it)
+        {
+            DeletionQueue::Instance().retire(DeletionQueue::VERTEX_ARRAY, it->second);
+        }
+        vaos.clear();
+        for (int i = 0; i < NUM_REGIONS; ++i)
+        {
+            if (fences[i])
+            {
+                glDeleteSync(fences[i]);
+            }
+            fences[i] = 0;
+        }
+        index_buffer.destroy();
+        ring.destroy();
+        ring_data = NULL;
+        meshes.clear();
+        free_ids.clear();
+    }
+
+    /**
+     * @brief Adds a mesh to the arena.
+     * @param vertex_data One array per attribute, in declaration order, with vertex_count elements each.
+     * @param vertex_count Number of vertices.
+     * @param indices Triangle indices, relative to the mesh first vertex.
+     * @param index_count Number of indices.
+     * @return Mesh id, or -1 if the arena is full.
+     */
+    MeshID addMesh (const vector<const GLfloat*>& vertex_data, GLuint vertex_count, const GLuint* indices, GLuint index_count)
+    {
+        if (vertex_data.size() != attributes.size())
+        {
+            std::cerr << "Warning: mesh has " << vertex_data.size() << " attributes, arena expects " << attributes.size() << std::endl;
+            return -1;
+        }
+        MeshRange range;
+        range.vertex_count = vertex_count;
+        range.index_count = index_count;
+        if (!vertex_allocator.allocate(vertex_count, range.base_vertex))
+        {
+            std::cerr << "Warning: geometry arena is out of vertex space" << std::endl;
+            return -1;
+        }
+        if (!index_allocator.allocate(index_count, range.first_index))
+        {
+            vertex_allocator.release(range.base_vertex, vertex_count);
+            std::cerr << "Warning: geometry arena is out of index space" << std::endl;
+            return -1;
+        }
+
+        for (unsigned int i = 0; i < attributes.size(); ++i)
+        {
+            GLsizeiptr element = attributes[i].components * sizeof(GLfloat);
+            vertex_buffers[i].update(vertex_data[i], vertex_count * element, range.base_vertex * element);
+        }
+        index_buffer.update(indices, index_count * sizeof(GLuint), range.first_index * sizeof(GLuint));
+
+        MeshID id;
+        if (!free_ids.empty())
+        {
+            id = free_ids.back();
+            free_ids.pop_back();
+            meshes[id] = range;
+        }
+        else
+        {
+            id = meshes.size();
+            meshes.push_back(range);
+        }
+        return id;
+    }
+
+    /**
+     * @brief Removes a mesh, its space is reused by the next meshes.
+     *
+     * The mesh must not be drawn after removal, draws already submitted are not affected
+     * until a new mesh overwrites the space, so remove meshes at the start of a frame.
+     * @param id Mesh id.
+     */
+    void removeMesh (MeshID id)
+    {
+        if (id < 0 || id >= (int)meshes.size() || meshes[id].vertex_count == 0)
+        {
+            return;
+        }
+        vertex_allocator.release(meshes[id].base_vertex, meshes[id].vertex_count);
+        index_allocator.release(meshes[id].first_index, meshes[id].index_count);
+        meshes[id].vertex_count = 0;
+        meshes[id].index_count = 0;
+        free_ids.push_back(id);
+    }
+
+    /**
+     * @brief Returns the ranges of a mesh, to build draw commands (ex. on the GPU).
+     * @param id Mesh id.
+     */
+    const MeshRange& getMesh (MeshID id) const
+    {
+        return meshes[id];
+    }
+
+    /**
+     * @brief Starts recording the draws of a frame.
+     *
+     * Waits for the GPU to finish reading the ring region used three frames ago, which normally has already happened.
+     */
+    void beginFrame (void)
+    {
+        region = frame % NUM_REGIONS;
+        if (fences[region])
+        {
+            GLenum status = glClientWaitSync(fences[region], 0, 0);
+            while (status == GL_TIMEOUT_EXPIRED)
+            {
+                status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            }
+            glDeleteSync(fences[region]);
+            fences[region] = 0;
+        }
+        num_instances = 0;
+        draws_in_frame.clear();
+    }
+
+    /**
+     * @brief Adds a draw of a mesh to the current frame.
+     * @param id Mesh id.
+     * @param instance_count Number of instances.
+     * @return Pointer where the instance attributes of the draw must be written (instance_count times the
+     *         instance stride, attributes interleaved), or NULL if the frame is full.
+     */
+    GLfloat* addDraw (MeshID id, GLuint instance_count = 1)
+    {
+        if (num_instances + instance_count > max_instances || draws_in_frame.size() >= max_draws)
+        {
+            std::cerr << "Warning: geometry arena frame is full, draw skipped" << std::endl;
+            return NULL;
+        }
+        const MeshRange& mesh = meshes[id];
+        DrawElementsIndirectCommand command;
+        command.count = mesh.index_count;
+        command.instance_count = instance_count;
+        command.first_index = mesh.first_index;
+        command.base_vertex = mesh.base_vertex;
+        // instance attributes are sourced from the start of the ring, so the region offset goes in base_instance
+        command.base_instance = getFrameBaseInstance() + num_instances;
+        draws_in_frame.push_back(command);
+
+        GLfloat* instance = (GLfloat*)(frameData() + num_instances * instance_stride);
+        num_instances += instance_count;
+        return instance;
+    }
+
+    /**
+     * @brief Reserves instance data in the current frame without adding a draw, for commands written on the GPU.
+     * @param instance_count Number of instances.
+     * @param first Receives the first instance, relative to getFrameBaseInstance.
+     * @return Pointer where the instance attributes must be written, or NULL if the frame is full.
+     */
+    GLfloat* allocateInstances (GLuint instance_count, GLuint& first)
+    {
+        if (num_instances + instance_count > max_instances)
+        {
+            std::cerr << "Warning: geometry arena frame is full, instances not allocated" << std::endl;
+            return NULL;
+        }
+        first = num_instances;
+        GLfloat* instance = (GLfloat*)(frameData() + num_instances * instance_stride);
+        num_instances += instance_count;
+        return instance;
+    }
+
+    /**
+     * @brief Draws all the draws of the frame with a single glMultiDrawElementsIndirect and fences the region.
+     * @param shader Shader to draw with, bound here.
+     */
+    void submit (Shader& shader)
+    {
+        if (draws_in_frame.empty())
+        {
+            endFrame();
+            return;
+        }
+        GLintptr commands_offset = align(max_instances * instance_stride);
+        memcpy(frameData() + commands_offset, &draws_in_frame[0], draws_in_frame.size() * sizeof(DrawElementsIndirectCommand));
+        if (!ring_data)
+        {
+            ring.update(&staging[0], region_size, region * region_size);
+        }
+
+        shader.bind();
+        bindVertexArray(shader);
+        ring.bind(GL_DRAW_INDIRECT_BUFFER);
+        glState.flushBarriers();
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                    (const GLvoid*)(region * region_size + commands_offset), draws_in_frame.size(), 0);
+        ring.unbind(GL_DRAW_INDIRECT_BUFFER);
+        glBindVertexArray(0);
+        endFrame();
+    }
+
+    /**
+     * @brief Draws with commands from another buffer (ex. written by a compute shader), instance data from this frame.
+     *
+     * If the commands were written by a shader, the dispatch must have recorded GL_COMMAND_BARRIER_BIT.
+     * With a count buffer (GL 4.6 or ARB_indirect_parameters) the number of draws is read from it on the GPU.
+     * @param shader Shader to draw with, bound here.
+     * @param commands Buffer with DrawElementsIndirectCommands.
+     * @param max_count Number of commands, or maximum number of commands with a count buffer.
+     * @param offset Offset of the first command in bytes.
+     * @param count_buffer Buffer with the number of draws as a GLuint, or NULL.
+     * @param count_offset Offset of the count in bytes.
+     */
+    void drawIndirect (Shader& shader, Buffer& commands, GLsizei max_count, GLintptr offset = 0,
+                       Buffer* count_buffer = NULL, GLintptr count_offset = 0)
+    {
+        if (!ring_data && num_instances > 0)
+        {
+            ring.update(&staging[0], region_size, region * region_size);
+        }
+        shader.bind();
+        bindVertexArray(shader);
+        commands.bind(GL_DRAW_INDIRECT_BUFFER);
+        glState.flushBarriers();
+        if (count_buffer && isIndirectCountSupported())
+        {
+            count_buffer->bind(GL_PARAMETER_BUFFER_ARB);
+            glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)offset, count_offset, max_count, 0);
+            count_buffer->unbind(GL_PARAMETER_BUFFER_ARB);
+        }
+        else
+        {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)offset, max_count, 0);
+        }
+        commands.unbind(GL_DRAW_INDIRECT_BUFFER);
+        glBindVertexArray(0);
+    }
+
+    /**
+     * @brief Fences the ring region of the frame and moves to the next one. Called by submit.
+     *
+     * Call it directly when the frame is drawn only with drawIndirect.
+     */
+    void endFrame (void)
+    {
+        if (fences[region])
+        {
+            glDeleteSync(fences[region]);
+        }
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        ++frame;
+    }
+
+    /**
+     * @brief Returns the first instance of the current frame, to be added to instance indices written on the GPU.
+     */
+    GLuint getFrameBaseInstance (void) const
+    {
+        return region * (region_size / std::max(instance_stride, (GLuint)1));
+    }
+
+    /**
+     * @brief Returns the instance data size of one instance in bytes.
+     */
+    GLuint getInstanceStride (void) const
+    {
+        return instance_stride;
+    }
+
+    /**
+     * @brief Returns the number of draws added in the current frame.
+     */
+    GLuint getNumDraws (void) const
+    {
+        return draws_in_frame.size();
+    }
+
+    /**
+     * @brief Returns the index buffer.
+     */
+    Buffer& getIndexBuffer (void)
+    {
+        return index_buffer;
+    }
+
+    /**
+     * @brief Returns the buffer of a vertex attribute, in declaration order.
+     * @param attribute Attribute index.
+     */
+    Buffer& getVertexBuffer (int attribute)
+    {
+        return vertex_buffers[attribute];
+    }
+
+    /**
+     * @brief Returns wether glMultiDrawElementsIndirectCount is available.
+     */
+    static bool isIndirectCountSupported (void)
+    {
+        return GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters;
+    }
+
+private:
+
+    /// Number of ring regions, frames in flight.
+    static const int NUM_REGIONS = 3;
+
+    /// Named float attribute.
+    struct Attribute
+    {
+        string name;
+        int components;
+        GLuint offset;
+    };
+
+    /**
+     * @brief First fit allocator of element ranges, merging freed neighbours.
+     */
+    struct RangeAllocator
+    {
+        /// Free ranges, first element to size.
+        map<GLuint, GLuint> free_ranges;
+
+        RangeAllocator (GLuint capacity)
+        {
+            if (capacity > 0)
+            {
+                free_ranges[0] = capacity;
+            }
+        }
+
+        bool allocate (GLuint size, GLuint& first)
+        {
+            for (map<GLuint, GLuint>::iterator it = free_ranges.begin(); it != free_ranges.end(); ++it)
+            {
+                if (it->second >= size)
+                {
+                    first = it->first;
+                    GLuint remaining = it->second - size;
+                    free_ranges.erase(it);
+                    if (remaining > 0)
+                    {
+                        free_ranges[first + size] = remaining;
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void release (GLuint first, GLuint size)
+        {
+            if (size == 0)
+            {
+                return;
+            }
+            map<GLuint, GLuint>::iterator next = free_ranges.lower_bound(first);
+            if (next != free_ranges.end() && first + size == next->first)
+            {
+                size += next->second;
+                free_ranges.erase(next++);
+            }
+            if (next != free_ranges.begin())
+            {
+                map<GLuint, GLuint>::iterator prev = next;
+                --prev;
+                if (prev->first + prev->second == first)
+                {
+                    prev->second += size;
+                    return;
+                }
+            }
+            free_ranges[first] = size;
+        }
+    };
+
+    ///Copy Constructor
+    GeometryArena (GeometryArena const&);
+
+    ///Assignment Operation
+    GeometryArena& operator= (GeometryArena const&);
+
+    /**
+     * @brief Rounds a size up to a multiple of the command and instance alignment.
+     */
+    GLuint align (GLuint size) const
+    {
+        // multiple of the instance stride, so regions start at a whole instance, and of 16 bytes for the commands
+        GLuint unit = 16;
+        while (instance_stride > 0 && unit % instance_stride != 0)
+        {
+            unit += 16;
+        }
+        return ((size + unit - 1) / unit) * unit;
+    }
+
+    /**
+     * @brief Returns where the CPU writes the data of the current frame.
+     */
+    char* frameData (void)
+    {
+        return ring_data ? ring_data + region * region_size : &staging[0];
+    }
+
+    /**
+     * @brief Binds the vertex array matching the shader attribute locations, creating it the first time.
+     *
+     * Vertex arrays are shared by all shaders with the same locations, so a reloaded shader or a recycled
+     * program name never picks up a vertex array built for another layout.
+     */
+    void bindVertexArray (Shader& shader)
+    {
+        vector<GLint> locations;
+        locations.reserve(attributes.size() + instance_attributes.size());
+        for (unsigned int i = 0; i < attributes.size(); ++i)
+        {
+            locations.push_back(shader.getAttributeLocation(attributes[i].name.c_str()));
+        }
+        for (unsigned int i = 0; i < instance_attributes.size(); ++i)
+        {
+            locations.push_back(shader.getAttributeLocation(instance_attributes[i].name.c_str()));
+        }
+        map<vector<GLint>, GLuint>::iterator it = vaos.find(locations);
+        if (it != vaos.end())
+        {
+            glBindVertexArray(it->second);
+            return;
+        }
+
+        GLuint vao;
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        vaos[locations] = vao;
+
+        vector<string> active;
+        shader.getActiveAttributes(active);
+        int matched = 0;
+
+        for (unsigned int i = 0; i < attributes.size(); ++i)
+        {
+            GLint location = locations[i];
+            if (location < 0)
+            {
+                continue;
+            }
+            ++matched;
+            glEnableVertexAttribArray(location);
+            glVertexAttribFormat(location, attributes[i].components, GL_FLOAT, GL_FALSE, 0);
+            glVertexAttribBinding(location, i);
+            glBindVertexBuffer(i, vertex_buffers[i].bufferID(), 0, attributes[i].components * sizeof(GLfloat));
+        }
+
+        // all instance attributes come from the ring, in one interleaved binding
+        GLuint instance_binding = attributes.size();
+        for (unsigned int i = 0; i < instance_attributes.size(); ++i)
+        {
+            GLint location = locations[attributes.size() + i];
+            if (location < 0)
+            {
+                continue;
+            }
+            ++matched;
+            int columns = (instance_attributes[i].components + 3) / 4;
+            for (int c = 0; c < columns; ++c)
+            {
+                int components = std::min(4, instance_attributes[i].components - 4*c);
+                glEnableVertexAttribArray(location + c);
+                glVertexAttribFormat(location + c, components, GL_FLOAT, GL_FALSE, instance_attributes[i].offset + 4*c*sizeof(GLfloat));
+                glVertexAttribBinding(location + c, instance_binding);
+            }
+        }
+        if (instance_stride > 0)
+        {
+            glBindVertexBuffer(instance_binding, ring.bufferID(), 0, instance_stride);
+            glVertexBindingDivisor(instance_binding, 1);
+        }
+
+        index_buffer.bind(GL_ELEMENT_ARRAY_BUFFER);
+
+        if (matched < (int)active.size())
+        {
+            std::cerr << "Warning: shader " << shader.getShaderName() << " has " << active.size() - matched
+                      << " active attributes not provided by the geometry arena" << std::endl;
+        }
+    }
+
+    /// Vertex attributes.
+    vector<Attribute> attributes;
+
+    /// Per-instance attributes, interleaved.
+    vector<Attribute> instance_attributes;
+
+    /// One buffer per vertex attribute.
+    vector<Buffer> vertex_buffers;
+
+    /// Index buffer of all meshes.
+    Buffer index_buffer;
+
+    /// Ring of per-frame instance data and draw commands.
+    Buffer ring;
+
+    /// Suballocated meshes, by id.
+    vector<MeshRange> meshes;
+
+    /// Ids of removed meshes, reused first.
+    vector<MeshID> free_ids;
+
+    /// Vertex array of each set of attribute locations (vertex then instance attributes, -1 if unused).
+    map<vector<GLint>, GLuint> vaos;
+
+    /// Capacities.
+    GLuint max_vertices, max_indices, max_instances, max_draws;
+
+    /// Bytes per instance.
+    GLuint instance_stride;
+
+    /// Bytes per ring region.
+    GLuint region_size;
+
+    /// Persistently mapped ring, NULL when mapping is not supported.
+    char* ring_data;
+
+    /// CPU copy of the frame region when the ring is not mapped.
+    vector<char> staging;
+
+    /// Fence of the last frame that used each region.
+    GLsync fences[NUM_REGIONS];
+
+    /// Frame counter.
+    unsigned int frame;
+
+    /// Ring region of the current frame.
+    GLuint region;
+
+    /// Instances written in the current frame.
+    GLuint num_instances;
+
+    /// Draw commands of the current frame.
+    vector<DrawElementsIndirectCommand> draws_in_frame;
+
+    /// Allocators of the vertex and index buffers.
+    RangeAllocator vertex_allocator, index_allocator;
+};
+
+}
+
+#endif
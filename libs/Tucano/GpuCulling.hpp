@@ -0,0 +1,444 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GPUCULLING__
+#define __GPUCULLING__
+
+#include "Shader.hpp"
+#include "Buffer.hpp"
+#include "Camera.hpp"
+#include "FrameBuffer.hpp"
+#include "GeometryArena.hpp"
+#include "BoundingBox3.hpp"
+
+#include <vector>
+#include <algorithm>
+
+/// Directory of the Tucano shaders, defined by the library CMakeLists.
+#ifndef TUCANO_SHADERS_DIR
+#define TUCANO_SHADERS_DIR "shaders/"
+#endif
+
+namespace Tucano
+{
+
+/**
+ * @brief One object tested by GpuCulling, with its box and draw, laid out as the std430 struct of the shader.
+ */
+struct CullObject
+{
+    /// Box minimum corner, in the space of the culling frustum (usually world space).
+    GLfloat box_min[3];
+    /// Number of indices of the mesh.
+    GLuint index_count;
+    /// Box maximum corner.
+    GLfloat box_max[3];
+    /// First index of the mesh.
+    GLuint first_index;
+    /// First vertex of the mesh.
+    GLint base_vertex;
+    /// First instance, the culling pass adds the frame offset given to cull.
+    GLuint base_instance;
+    /// Number of instances, zero to hide the object.
+    GLuint instance_count;
+    /// Padding to the std430 struct size.
+    GLuint padding;
+};
+
+/**
+ * @brief GPU driven culling: a compute pass tests object boxes and writes the indirect draw commands.
+ *
+ * Each object has a bounding box and a draw of a GeometryArena mesh. The pass tests the boxes against the
+ * camera frustum and optionally against a hierarchical depth pyramid (the farthest depth of each texel
+ * region, built from a Framebuffer depth texture), and writes the commands of the visible objects.
+ * The CPU cost is a single dispatch and a single draw, whatever the number of objects:
+ *
+ *     culling.cull(camera, arena.getFrameBaseInstance());
+ *     culling.draw(arena, shader);
+ *     arena.endFrame();
+ *
+ * With GL 4.6 or ARB_indirect_parameters the visible commands are compacted and their count is read by
+ * the draw on the GPU, otherwise culled commands get zero instances. Occlusion uses the depth of a previous
+ * frame, so it is tested with the view-projection matrix of that frame. Requires OpenGL 4.3.
+ *
+ * The shaders gpuCulling.comp and depthPyramid.comp are loaded with Shader::load from the Tucano shaders directory.
+ */
+class GpuCulling {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    GpuCulling (void) : cull_shader("gpuCulling"), pyramid_shader("depthPyramid"), max_objects(0), num_objects(0),
+                        pyramid_width(0), pyramid_height(0), pyramid_levels(0), occlusion(false) {}
+
+    /**
+     * @brief Default destructor.
+     */
+    ~GpuCulling (void)
+    {
+        destroy();
+    }
+
+    /**
+     * @brief Loads the shaders and creates the buffers.
+     * @param capacity Maximum number of objects.
+     * @param shader_dir Directory of gpuCulling.comp and depthPyramid.comp.
+     */
+    void initialize (GLuint capacity, string shader_dir = TUCANO_SHADERS_DIR)
+    {
+        cull_shader.load("gpuCulling", shader_dir);
+        cull_shader.initialize();
+        pyramid_shader.load("depthPyramid", shader_dir);
+        pyramid_shader.initialize();
+
+        max_objects = capacity;
+        num_objects = 0;
+        objects.create(std::max(capacity, (GLuint)1) * sizeof(CullObject));
+        commands.create(std::max(capacity, (GLuint)1) * sizeof(DrawElementsIndirectCommand));
+        draw_count.create(sizeof(GLuint));
+    }
+
+    /**
+     * @brief Deletes the depth pyramid.
+     */
+    void destroy (void)
+    {
+        pyramid.destroy();
+        pyramid_width = pyramid_height = pyramid_levels = 0;
+        occlusion = false;
+    }
+
+    /**
+     * @brief Fills an object from a mesh of a GeometryArena and a box.
+     * @param mesh Mesh ranges (see GeometryArena::getMesh).
+     * @param box Object bounding box.
+     * @param base_instance First instance of the object.
+     * @param instance_count Number of instances.
+     * @return Object to be given to setObjects or updateObject.
+     */
+    static CullObject makeObject (const GeometryArena::MeshRange& mesh, const BoundingBox3<float>& box, GLuint base_instance, GLuint instance_count = 1)
+    {
+        CullObject object;
+        for (int c = 0; c < 3; ++c)
+        {
+            object.box_min[c] = box.Min()[c];
+            object.box_max[c] = box.Max()[c];
+        }
+        object.index_count = mesh.index_count;
+        object.first_index = mesh.first_index;
+        object.base_vertex = mesh.base_vertex;
+        object.base_instance = base_instance;
+        object.instance_count = instance_count;
+        object.padding = 0;
+        return object;
+    }
+
+    /**
+     * @brief Uploads all the objects.
+     * @param list Objects, at most the capacity given to initialize.
+     */
+    void setObjects (const vector<CullObject>& list)
+    {
+        num_objects = std::min((GLuint)list.size(), max_objects);
+        if (list.size() > max_objects)
+        {
+            cerr << "Warning: " << list.size() - max_objects << " objects over the culling capacity were ignored" << endl;
+        }
+        if (num_objects > 0)
+        {
+            objects.update(&list[0], num_objects * sizeof(CullObject));
+        }
+    }
+
+    /**
+     * @brief Uploads one object, ex. after it moved.
+     * @param index Object index.
+     * @param object New object data.
+     */
+    void updateObject (GLuint index, const CullObject& object)
+    {
+        if (index < num_objects)
+        {
+            objects.update(&object, sizeof(CullObject), index * sizeof(CullObject));
+        }
+    }
+
+    /**
+     * @brief Builds the depth pyramid from the depth texture of a framebuffer and enables occlusion culling.
+     *
+     * Usually called after the depth of a frame is rendered, and used to cull the next frame.
+     * @param fbo Framebuffer with a depth texture (see Framebuffer::DepthAttachment).
+     * @param view_projection View-projection matrix the depth was rendered with.
+     */
+    void buildDepthPyramid (Framebuffer& fbo, const Eigen::Matrix4f& view_projection)
+    {
+        Texture* depth = fbo.getDepthTexture();
+        if (!depth)
+        {
+            cerr << "Warning: occlusion culling needs a framebuffer with a depth texture" << endl;
+            occlusion = false;
+            return;
+        }
+        createPyramid(depth->getWidth(), depth->getHeight());
+        occlusion_matrix = view_projection;
+
+        pyramid_shader.bind();
+        GLint location = pyramid_shader.getUniformLocation("source");
+        int width = pyramid_width, height = pyramid_height;
+        for (int level = 0; level < pyramid_levels; ++level)
+        {
+            // level 0 copies the depth, each next level reduces the previous one
+            GLuint source = (level == 0) ? depth->texID() : pyramid.texID();
+            int unit = texManager.bindTexture(GL_TEXTURE_2D, source);
+            pyramid_shader.setUniform(location, unit);
+            pyramid_shader.setUniform("source_level", std::max(level - 1, 0));
+            pyramid_shader.setUniform("source_size", Eigen::Vector2i(width, height));
+            pyramid_shader.setUniform("reduce", level == 0 ? 0 : 1);
+            if (level > 0)
+            {
+                width = std::max(width / 2, 1);
+                height = std::max(height / 2, 1);
+            }
+            glBindImageTexture(0, pyramid.texID(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            pyramid_shader.dispatch((width + 7) / 8, (height + 7) / 8, 1, GL_TEXTURE_FETCH_BARRIER_BIT);
+            texManager.unbindTexture(GL_TEXTURE_2D, unit, source);
+            // the next level samples this one
+            glState.flushBarriers();
+        }
+        pyramid_shader.unbind();
+        occlusion = true;
+    }
+
+    /**
+     * @brief Enables or disables occlusion culling, which is enabled by buildDepthPyramid.
+     * @param flag True to test the boxes against the depth pyramid.
+     */
+    void setOcclusionEnabled (bool flag)
+    {
+        occlusion = flag && pyramid.texID() != 0;
+    }
+
+    /**
+     * @brief Culls the objects against the camera frustum and writes the draw commands.
+     * @param camera Camera, boxes are in world space.
+     * @param base_instance_offset Added to every base instance (ex. GeometryArena::getFrameBaseInstance).
+     */
+    void cull (const Camera& camera, GLuint base_instance_offset = 0)
+    {
+        cull(camera.getFrustum(), base_instance_offset);
+    }
+
+    /**
+     * @brief Culls the objects against a frustum and writes the draw commands.
+     * @param frustum Frustum in the space of the object boxes.
+     * @param base_instance_offset Added to every base instance.
+     */
+    void cull (const Frustum& frustum, GLuint base_instance_offset = 0)
+    {
+        GLfloat planes[6][4];
+        for (int p = 0; p < 6; ++p)
+        {
+            Eigen::Vector4f plane = frustum.getPlane(p);
+            for (int c = 0; c < 4; ++c)
+            {
+                planes[p][c] = plane[c];
+            }
+        }
+
+        draw_count.clear();
+        if (num_objects == 0)
+        {
+            return;
+        }
+
+        cull_shader.bind();
+        objects.bindBase(0);
+        commands.bindBase(1);
+        draw_count.bindBase(2);
+        cull_shader.setUniform("num_objects", (GLint)num_objects);
+        cull_shader.setUniform("base_instance_offset", (GLint)base_instance_offset);
+        cull_shader.setUniform("compact", isCompacting() ? 1 : 0);
+        cull_shader.setUniform("planes", &planes[0][0], 4, 6);
+        cull_shader.setUniform("occlusion", occlusion ? 1 : 0);
+        int unit = -1;
+        if (occlusion)
+        {
+            unit = texManager.bindTexture(GL_TEXTURE_2D, pyramid.texID());
+            cull_shader.setUniform("depth_pyramid", unit);
+            cull_shader.setUniform("occlusion_view_projection", occlusion_matrix);
+            cull_shader.setUniform("pyramid_size", Eigen::Vector2f(pyramid_width, pyramid_height));
+            cull_shader.setUniform("pyramid_levels", pyramid_levels);
+        }
+        cull_shader.dispatch((num_objects + 63) / 64, 1, 1, GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+        if (unit != -1)
+        {
+            texManager.unbindTexture(GL_TEXTURE_2D, unit, pyramid.texID());
+        }
+        cull_shader.unbind();
+    }
+
+    /**
+     * @brief Draws the commands written by the last cull.
+     * @param arena Arena with the meshes of the objects.
+     * @param shader Shader to draw with.
+     */
+    void draw (GeometryArena& arena, Shader& shader)
+    {
+        if (num_objects == 0)
+        {
+            return;
+        }
+        arena.drawIndirect(shader, commands, num_objects, 0, isCompacting() ? &draw_count : NULL);
+    }
+
+    /**
+     * @brief Reads back the number of visible objects of the last cull. Waits for the GPU, for debugging and statistics.
+     * @return Number of visible objects, or the number of objects when commands are not compacted.
+     */
+    GLuint readVisibleCount (void)
+    {
+        if (!isCompacting())
+        {
+            return num_objects;
+        }
+        glState.flushBarriers();
+        GLuint count = 0;
+        draw_count.read(&count, sizeof(GLuint));
+        return count;
+    }
+
+    /**
+     * @brief Returns the buffer with the draw commands.
+     */
+    Buffer& getCommandBuffer (void)
+    {
+        return commands;
+    }
+
+    /**
+     * @brief Returns the buffer with the number of visible commands, when compacting.
+     */
+    Buffer& getCountBuffer (void)
+    {
+        return draw_count;
+    }
+
+    /**
+     * @brief Returns the number of objects.
+     */
+    GLuint getNumObjects (void) const
+    {
+        return num_objects;
+    }
+
+    /**
+     * @brief Returns wether the visible commands are compacted, which needs glMultiDrawElementsIndirectCount.
+     */
+    static bool isCompacting (void)
+    {
+        return GeometryArena::isIndirectCountSupported();
+    }
+
+private:
+
+    ///Copy Constructor
+    GpuCulling (GpuCulling const&);
+
+    ///Assignment Operation
+    GpuCulling& operator= (GpuCulling const&);
+
+    /**
+     * @brief Creates the pyramid texture, with all mip levels, if the depth size changed.
+     */
+    void createPyramid (int width, int height)
+    {
+        if (pyramid.texID() != 0 && width == pyramid_width && height == pyramid_height)
+        {
+            return;
+        }
+        destroy();
+        pyramid_width = width;
+        pyramid_height = height;
+        pyramid_levels = 1;
+        for (int size = std::max(width, height); size > 1; size /= 2)
+        {
+            ++pyramid_levels;
+        }
+        pyramid.createImmutable(GL_TEXTURE_2D, GL_R32F, width, height, GL_RED, GL_FLOAT, NULL, 1, pyramid_levels);
+        glState.bindTexture(GL_TEXTURE_2D, pyramid.texID());
+        if (!pyramid.isImmutable())
+        {
+            // without direct state access only level 0 was allocated
+            for (int level = 1, w = width, h = height; level < pyramid_levels; ++level)
+            {
+                w = std::max(w / 2, 1);
+                h = std::max(h / 2, 1);
+                glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, w, h, 0, GL_RED, GL_FLOAT, NULL);
+            }
+        }
+        pyramid.setTexParametersMipMap(pyramid_levels - 1, 0, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST_MIPMAP_NEAREST, false);
+        glState.bindTexture(GL_TEXTURE_2D, 0);
+        pyramid.setLabel("gpuCulling depth pyramid");
+    }
+
+    /// Culling compute shader.
+    Shader cull_shader;
+
+    /// Depth pyramid reduction compute shader.
+    Shader pyramid_shader;
+
+    /// Objects, boxes and draws.
+    Buffer objects;
+
+    /// Draw commands written by the culling pass.
+    Buffer commands;
+
+    /// Number of visible commands, when compacting.
+    Buffer draw_count;
+
+    /// Capacity in objects.
+    GLuint max_objects;
+
+    /// Number of objects.
+    GLuint num_objects;
+
+    /// Depth pyramid texture (GL_R32F, immutable storage with all mip levels).
+    Texture pyramid;
+
+    /// Depth pyramid level 0 size.
+    int pyramid_width, pyramid_height;
+
+    /// Number of pyramid levels.
+    int pyramid_levels;
+
+    /// View-projection matrix of the depth in the pyramid.
+    Eigen::Matrix4f occlusion_matrix;
+
+    /// Wether boxes are tested against the depth pyramid.
+    bool occlusion;
+};
+
+}
+
+#endif
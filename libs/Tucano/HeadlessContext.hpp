@@ -0,0 +1,333 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __HEADLESSCONTEXT__
+#define __HEADLESSCONTEXT__
+
+#include "Context.hpp"
+
+// keep the X11 headers (and their macros) out, no display is used
+#ifndef EGL_NO_X11
+#define EGL_NO_X11
+#endif
+#ifndef MESA_EGL_NO_X11_HEADERS
+#define MESA_EGL_NO_X11_HEADERS
+#endif
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+namespace Tucano
+{
+
+/**
+ * @brief OpenGL context without any window system, created with EGL.
+ *
+ * The display is opened directly on a GPU (EGL_EXT_platform_device) when available, so no X server or
+ * compositor is needed, otherwise the default display is used. The context is made current without a
+ * surface when EGL_KHR_surfaceless_context is supported, in which case there is no default framebuffer
+ * and all rendering must go to Framebuffers, otherwise a pbuffer surface of the given size is used.
+ * There is no swap, so frames are only limited by the GPU. Requires linking libEGL.
+ */
+class HeadlessContext : public Context {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     * @param device Index of the GPU to use, when several are available.
+     */
+    HeadlessContext (int device = 0) : device_index(device), display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT), surface(EGL_NO_SURFACE),
+                                       config(NULL), context_major(4), context_minor(5), context_debug(false), owns_display(true) {}
+
+    /**
+     * @brief Default destructor.
+     */
+    virtual ~HeadlessContext (void)
+    {
+        destroy();
+    }
+
+    virtual bool create (int width, int height, const std::string& title = "Tucano", int major = 4, int minor = 5, bool debug = false)
+    {
+        (void)title;
+        destroy();
+
+        display = openDisplay();
+        EGLint egl_major = 0, egl_minor = 0;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &egl_major, &egl_minor))
+        {
+            std::cerr << "Error: could not initialize an EGL display" << std::endl;
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API))
+        {
+            std::cerr << "Error: EGL display does not support desktop OpenGL" << std::endl;
+            destroy();
+            return false;
+        }
+
+        const EGLint config_attribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+            EGL_DEPTH_SIZE, 24,
+            EGL_NONE
+        };
+        EGLint num_configs = 0;
+        if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0)
+        {
+            std::cerr << "Error: no EGL config for OpenGL rendering" << std::endl;
+            destroy();
+            return false;
+        }
+
+        context_major = major;
+        context_minor = minor;
+        context_debug = debug;
+        if (!createContext(EGL_NO_CONTEXT, width, height))
+        {
+            destroy();
+            return false;
+        }
+
+        #ifdef TUCANODEBUG
+        std::cout << "EGL " << egl_major << "." << egl_minor << ", " << eglQueryString(display, EGL_VENDOR)
+                  << (surface == EGL_NO_SURFACE ? ", surfaceless" : ", pbuffer") << std::endl;
+        #endif
+
+        size << width, height;
+        close_requested = false;
+        return true;
+    }
+
+    virtual void destroy (void)
+    {
+        if (display != EGL_NO_DISPLAY)
+        {
+            // only release the context if current here, another context of the thread must stay current
+            if (context != EGL_NO_CONTEXT)
+            {
+                doneCurrent();
+            }
+            if (surface != EGL_NO_SURFACE)
+            {
+                eglDestroySurface(display, surface);
+            }
+            if (context != EGL_NO_CONTEXT)
+            {
+                eglDestroyContext(display, context);
+            }
+            if (owns_display)
+            {
+                eglTerminate(display);
+            }
+        }
+        display = EGL_NO_DISPLAY;
+        context = EGL_NO_CONTEXT;
+        surface = EGL_NO_SURFACE;
+    }
+
+    virtual void makeCurrent (void)
+    {
+        if (!eglMakeCurrent(display, surface, surface, context))
+        {
+            std::cerr << "Error: could not make EGL context current" << std::endl;
+        }
+    }
+
+    virtual void doneCurrent (void)
+    {
+        if (eglGetCurrentContext() == context)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        }
+    }
+
+    /**
+     * @brief Creates a context on the same display sharing objects with this one.
+     */
+    virtual Context* createShared (void)
+    {
+        if (context == EGL_NO_CONTEXT)
+        {
+            return NULL;
+        }
+        HeadlessContext* shared = new HeadlessContext(device_index);
+        shared->display = display;
+        shared->config = config;
+        shared->owns_display = false;
+        shared->context_major = context_major;
+        shared->context_minor = context_minor;
+        shared->context_debug = context_debug;
+        if (!shared->createContext(context, 1, 1))
+        {
+            delete shared;
+            return NULL;
+        }
+        shared->size << 1, 1;
+        return shared;
+    }
+
+    virtual void swapBuffers (void) {}
+
+    virtual void setSwapInterval (int interval)
+    {
+        if (surface != EGL_NO_SURFACE)
+        {
+            eglSwapInterval(display, interval);
+        }
+    }
+
+    virtual bool isHeadless (void) const
+    {
+        return true;
+    }
+
+    virtual bool hasDefaultFramebuffer (void) const
+    {
+        return surface != EGL_NO_SURFACE;
+    }
+
+    /**
+     * @brief Returns the EGL display.
+     */
+    EGLDisplay getDisplay (void) const
+    {
+        return display;
+    }
+
+private:
+
+    /**
+     * @brief Creates the EGL context, and a pbuffer surface when surfaceless contexts are not supported.
+     * @param share Context to share objects with, or EGL_NO_CONTEXT.
+     * @param width Pbuffer width.
+     * @param height Pbuffer height.
+     * @return True if created.
+     */
+    bool createContext (EGLContext share, int width, int height)
+    {
+        const EGLint context_attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION_KHR, context_major,
+            EGL_CONTEXT_MINOR_VERSION_KHR, context_minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+            EGL_CONTEXT_FLAGS_KHR, context_debug ? EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR : 0,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, share, context_attribs);
+        if (context == EGL_NO_CONTEXT)
+        {
+            std::cerr << "Error: could not create EGL context for OpenGL " << context_major << "." << context_minor << std::endl;
+            return false;
+        }
+
+        if (!hasExtension("EGL_KHR_surfaceless_context"))
+        {
+            const EGLint pbuffer_attribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+            surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+            if (surface == EGL_NO_SURFACE)
+            {
+                std::cerr << "Error: could not create EGL pbuffer surface" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Opens a display on a GPU device if possible, or the default display.
+     */
+    EGLDisplay openDisplay (void)
+    {
+        PFNEGLQUERYDEVICESEXTPROC queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (queryDevices && getPlatformDisplay)
+        {
+            const EGLint max_devices = 16;
+            EGLDeviceEXT devices[max_devices];
+            EGLint num_devices = 0;
+            if (queryDevices(max_devices, devices, &num_devices) && num_devices > 0)
+            {
+                int index = std::min(std::max(device_index, 0), num_devices - 1);
+                EGLDisplay device_display = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, devices[index], NULL);
+                if (device_display != EGL_NO_DISPLAY)
+                {
+                    return device_display;
+                }
+            }
+        }
+        return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    /**
+     * @brief Returns wether the display supports an extension.
+     * @param name Extension name.
+     */
+    bool hasExtension (const char* name) const
+    {
+        const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!extensions)
+        {
+            return false;
+        }
+        size_t length = strlen(name);
+        for (const char* p = strstr(extensions, name); p; p = strstr(p + length, name))
+        {
+            if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0'))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// Index of the GPU device.
+    int device_index;
+
+    /// EGL display.
+    EGLDisplay display;
+
+    /// EGL context.
+    EGLContext context;
+
+    /// Pbuffer surface, EGL_NO_SURFACE when surfaceless.
+    EGLSurface surface;
+
+    /// Framebuffer configuration of the context.
+    EGLConfig config;
+
+    /// Requested OpenGL version and debug flag, reused by shared contexts.
+    int context_major, context_minor;
+    bool context_debug;
+
+    /// If true destroy also terminates the display, false for shared contexts.
+    bool owns_display;
+};
+
+}
+
+#endif
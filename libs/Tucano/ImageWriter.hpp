@@ -0,0 +1,183 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __IMAGEWRITER__
+#define __IMAGEWRITER__
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace Tucano
+{
+
+/**
+ * @brief Writes encoded image files from a background thread.
+ *
+ * Each file is handed over as a complete buffer (header and pixels) and written with a single fwrite,
+ * so the render loop only pays for the readback. Used by the Framebuffer export methods.
+ */
+class ImageWriter {
+
+public:
+
+    /**
+     * @brief Default constructor, starts the writer thread.
+     */
+    ImageWriter (void) : stop(false), writing(false)
+    {
+        worker = std::thread(&ImageWriter::run, this);
+    }
+
+    /**
+     * @brief Default destructor, writes all queued files and stops the thread.
+     */
+    ~ImageWriter (void)
+    {
+        {
+            std::lock_guard<std::mutex> lock (queue_mutex);
+            stop = true;
+        }
+        queue_changed.notify_all();
+        worker.join();
+    }
+
+    /**
+     * @brief Queues a file to be written.
+     *
+     * The buffer contents are taken (the given vector is left empty), no copy is made.
+     * @param filename Output filename.
+     * @param data Complete file contents.
+     */
+    void write (const std::string& filename, std::vector<unsigned char>& data)
+    {
+        {
+            std::lock_guard<std::mutex> lock (queue_mutex);
+            queue.push_back(std::make_pair(filename, std::vector<unsigned char>()));
+            queue.back().second.swap(data);
+        }
+        queue_changed.notify_all();
+    }
+
+    /**
+     * @brief Blocks until all queued files are written.
+     */
+    void wait (void)
+    {
+        std::unique_lock<std::mutex> lock (queue_mutex);
+        while (!queue.empty() || writing)
+        {
+            queue_changed.wait(lock);
+        }
+    }
+
+    /**
+     * @brief Writes a buffer to a file with a single call.
+     * @param filename Output filename.
+     * @param data Complete file contents.
+     * @return True if the whole buffer was written.
+     */
+    static bool writeFile (const std::string& filename, const std::vector<unsigned char>& data)
+    {
+        FILE* file = fopen(filename.c_str(), "wb");
+        if (!file)
+        {
+            std::cerr << "Error: could not open file " << filename << std::endl;
+            return false;
+        }
+        size_t written = data.empty() ? 0 : fwrite(&data[0], 1, data.size(), file);
+        fclose(file);
+        if (written != data.size())
+        {
+            std::cerr << "Error: could not write file " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+private:
+
+    /**
+     * @brief Writer thread loop.
+     */
+    void run (void)
+    {
+        std::unique_lock<std::mutex> lock (queue_mutex);
+        while (true)
+        {
+            while (queue.empty() && !stop)
+            {
+                queue_changed.wait(lock);
+            }
+            if (queue.empty())
+            {
+                return;
+            }
+            std::pair<std::string, std::vector<unsigned char> > item;
+            item.first.swap(queue.front().first);
+            item.second.swap(queue.front().second);
+            queue.pop_front();
+            writing = true;
+
+            lock.unlock();
+            writeFile(item.first, item.second);
+            lock.lock();
+
+            writing = false;
+            queue_changed.notify_all();
+        }
+    }
+
+    ///Copy Constructor
+    ImageWriter (ImageWriter const&);
+
+    ///Assignment Operation
+    ImageWriter& operator= (ImageWriter const&);
+
+    /// Files waiting to be written.
+    std::deque<std::pair<std::string, std::vector<unsigned char> > > queue;
+
+    /// Guards the queue and flags.
+    std::mutex queue_mutex;
+
+    /// Signaled when a file is queued or written.
+    std::condition_variable queue_changed;
+
+    /// Flag to stop the thread once the queue is empty.
+    bool stop;
+
+    /// Flag to indicate a file is being written.
+    bool writing;
+
+    /// Writer thread, declared last so it starts after all members are initialized.
+    std::thread worker;
+};
+
+}
+
+#endif
@@ -39,18 +39,35 @@ namespace Tucano
 
         namespace Misc
         {
+                /**
+                 * @brief Flag to indicate the debug message callback is installed (see enableDebugOutput).
+                 *
+                 * Not static, so all translation units share the same flag.
+                 */
+                inline bool& debugOutputEnabled ( void )
+                {
+                        static bool enabled = false;
+                        return enabled;
+                }
+
                 /**
                  * @brief GL error check method.
                  *
                  * This is a method to check for OpenGL erros. Note this will catch the last OpenGL error,
                  * independently form where it was thrown. This should be used more for debug purposes.
                  * Usually the macros __FILE__ and __LINE__ are passed as parameters, with and optional custom message.
+                 * When debug output is enabled errors are reported by the callback, and this check does nothing,
+                 * avoiding the synchronous glGetError.
                  * @param file File from where method was called.
                  * @param line Line in file.
                  * @param message A custom message to be exhibited.
                  */
                 static inline void errorCheckFunc ( std::string file , int line , std::string message = "" )
                 {
+                        if ( debugOutputEnabled ( ) )
+                        {
+                                return;
+                        }
                         //OpenGL Error Handling Function:
                         GLenum ErrorCheckValue = glGetError ( );
                         if ( ErrorCheckValue != GL_NO_ERROR )
@@ -62,12 +79,24 @@ namespace Tucano
                 }
                 /**
                  * @brief Initialize Glew
+                 *
+                 * Works with window (GLFW) and headless (EGL) contexts, the context must be current.
+                 * A GLEW built for GLX reports a missing GLX display under EGL after the GL entry points were
+                 * already loaded, so that error is ignored.
                  */
                 static inline void initializeGLEW ( void )
                 {
 
                         glewExperimental = true;
                         GLenum glewInitResult = glewInit ( );
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+                        if ( glewInitResult == GLEW_ERROR_NO_GLX_DISPLAY )
+                        {
+                                glewInitResult = GLEW_OK;
+                        }
+#endif
+                        // glewExperimental may leave an invalid enum error in core profiles
+                        glGetError ( );
                         if ( GLEW_OK != glewInitResult )
                         {
                                 std::cerr << "Error: " << glewGetErrorString ( glewInitResult ) << std::endl;
@@ -81,6 +110,126 @@ namespace Tucano
 
                 }
 
+                /**
+                 * @brief Returns wether debug output (GL 4.3 or KHR_debug) is supported.
+                 */
+                static inline bool isDebugOutputSupported ( void )
+                {
+                        return GLEW_VERSION_4_3 || GLEW_KHR_debug;
+                }
+
+                /**
+                 * @brief Debug message callback, prints the messages sent by the driver.
+                 */
+                static void GLAPIENTRY debugMessageCallback ( GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* user_param )
+                {
+                        (void)source; (void)length; (void)user_param;
+                        const char* type_name = "other";
+                        switch ( type )
+                        {
+                                case GL_DEBUG_TYPE_ERROR: type_name = "error"; break;
+                                case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: type_name = "deprecated"; break;
+                                case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: type_name = "undefined behavior"; break;
+                                case GL_DEBUG_TYPE_PORTABILITY: type_name = "portability"; break;
+                                case GL_DEBUG_TYPE_PERFORMANCE: type_name = "performance"; break;
+                                case GL_DEBUG_TYPE_PUSH_GROUP: case GL_DEBUG_TYPE_POP_GROUP: return;
+                                default: break;
+                        }
+                        const char* severity_name = "notification";
+                        switch ( severity )
+                        {
+                                case GL_DEBUG_SEVERITY_HIGH: severity_name = "high"; break;
+                                case GL_DEBUG_SEVERITY_MEDIUM: severity_name = "medium"; break;
+                                case GL_DEBUG_SEVERITY_LOW: severity_name = "low"; break;
+                                default: break;
+                        }
+                        std::ostream& out = ( type == GL_DEBUG_TYPE_ERROR ) ? std::cerr : std::cout;
+                        out << "GL " << type_name << " (" << severity_name << ", id " << id << ") : " << message << std::endl;
+                }
+
+                /**
+                 * @brief Installs the debug message callback, replacing the glGetError polling.
+                 *
+                 * Errors and driver warnings (ex. shader recompiles, buffer stalls) are reported as they happen.
+                 * Some drivers only send messages to debug contexts (ex. GLFW_OPENGL_DEBUG_CONTEXT hint).
+                 * @param synchronous If true messages are sent from the offending call, so it shows in the stack trace (slower).
+                 * @param notifications If true messages of notification severity are also reported.
+                 * @return True if debug output is supported.
+                 */
+                static inline bool enableDebugOutput ( bool synchronous = false, bool notifications = false )
+                {
+                        if ( !isDebugOutputSupported ( ) )
+                        {
+                                std::cerr << "Warning: debug output requires OpenGL 4.3 or KHR_debug" << std::endl;
+                                return false;
+                        }
+                        glEnable ( GL_DEBUG_OUTPUT );
+                        if ( synchronous )
+                                glEnable ( GL_DEBUG_OUTPUT_SYNCHRONOUS );
+                        else
+                                glDisable ( GL_DEBUG_OUTPUT_SYNCHRONOUS );
+                        glDebugMessageCallback ( debugMessageCallback, NULL );
+                        glDebugMessageControl ( GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE );
+                        if ( !notifications )
+                        {
+                                glDebugMessageControl ( GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE );
+                        }
+                        debugOutputEnabled ( ) = true;
+                        return true;
+                }
+
+                /**
+                 * @brief Removes the debug message callback, errorCheckFunc polls glGetError again.
+                 */
+                static inline void disableDebugOutput ( void )
+                {
+                        if ( debugOutputEnabled ( ) )
+                        {
+                                glDebugMessageCallback ( NULL, NULL );
+                                glDisable ( GL_DEBUG_OUTPUT );
+                                debugOutputEnabled ( ) = false;
+                        }
+                }
+
+                /**
+                 * @brief Names a GL object, the name is used in debug messages and by external GPU debuggers and profilers.
+                 *
+                 * The object must have been bound or created with direct state access. Ignored without debug output support.
+                 * @param identifier Object type (ex. GL_TEXTURE, GL_FRAMEBUFFER, GL_PROGRAM, GL_SHADER, GL_BUFFER).
+                 * @param name Object handle.
+                 * @param label Object name.
+                 */
+                static inline void setObjectLabel ( GLenum identifier, GLuint name, const std::string& label )
+                {
+                        if ( name != 0 && !label.empty ( ) && isDebugOutputSupported ( ) )
+                        {
+                                glObjectLabel ( identifier, name, -1, label.c_str ( ) );
+                        }
+                }
+
+                /**
+                 * @brief Opens a named debug group, shown as a nested region by GPU debuggers and profilers.
+                 * @param name Group name.
+                 */
+                static inline void pushDebugGroup ( const std::string& name )
+                {
+                        if ( isDebugOutputSupported ( ) )
+                        {
+                                glPushDebugGroup ( GL_DEBUG_SOURCE_APPLICATION, 0, -1, name.c_str ( ) );
+                        }
+                }
+
+                /**
+                 * @brief Closes the last debug group.
+                 */
+                static inline void popDebugGroup ( void )
+                {
+                        if ( isDebugOutputSupported ( ) )
+                        {
+                                glPopDebugGroup ( );
+                        }
+                }
+
                 static inline void OpenGLInformation ( void)
                 {
                         std::cout  << " GLEW INFO: OpenGL Vendor String   : "  << glGetString(GL_VENDOR) << std::endl;
@@ -0,0 +1,712 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __PROFILER__
+#define __PROFILER__
+
+/// Defines our unique instance of this singleton class.
+#define gpuProfiler Profiler::Instance()
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <chrono>
+#include <GL/glew.h>
+
+#include "Misc.hpp"
+
+namespace Tucano
+{
+
+/**
+ * @brief Singleton frame profiler measuring CPU and GPU time per zone.
+ *
+ * GPU times are measured with GL_TIMESTAMP queries kept in a ring of frames, and read back a few frames later
+ * only if already available, so profiling never stalls the pipeline (frames whose results are late are dropped).
+ *
+ * Zones can be opened by hand (beginZone/endZone or ProfileZone), and when automatic zones are enabled,
+ * Framebuffer::bind opens a zone for each render target (pass) and Shader::bind a nested zone for each program.
+ * Statistics (min, average and 99th percentile) are kept per zone name over the last samples, and the zones of
+ * captured frames can be exported in the Chrome trace format (chrome://tracing or Perfetto).
+ *
+ * With debug groups enabled every zone is also pushed as a KHR_debug group, so passes and programs show up by name
+ * in external GPU debuggers and profilers. Groups can be used without timing (setEnabled(false)).
+ *
+ * Must be used from the GL thread. Disabled by default, in which case every call returns immediately.
+ */
+class Profiler {
+
+public:
+
+    /// Statistics of one zone, times in milliseconds.
+    struct ZoneStats
+    {
+        std::string name;
+        int samples;
+        double cpu_min, cpu_avg, cpu_p99;
+        double gpu_min, gpu_avg, gpu_p99;
+    };
+
+    /**
+     * @brief Returns the unique instance. If no instace exists, it will create one (only once).
+     */
+    static Profiler &Instance (void)
+    {
+        static Profiler _instance;
+        return _instance;
+    }
+
+    /**
+     * @brief Enables or disables profiling, takes effect on the next beginFrame.
+     * @param flag True to enable.
+     */
+    void setEnabled (bool flag)
+    {
+        requested = flag;
+    }
+
+    /**
+     * @brief Returns wether zones are recorded in the current frame (timing or debug groups).
+     */
+    bool isEnabled (void) const
+    {
+        return enabled;
+    }
+
+    /**
+     * @brief Enables or disables pushing a debug group for each zone, takes effect on the next beginFrame.
+     * @param flag True to push debug groups.
+     */
+    void setDebugGroups (bool flag)
+    {
+        requested_groups = flag;
+    }
+
+    /**
+     * @brief Enables or disables the automatic zones opened by Framebuffer and Shader binds.
+     * @param flag True to enable (default).
+     */
+    void setAutoZones (bool flag)
+    {
+        auto_zones = flag;
+    }
+
+    /**
+     * @brief Sets the number of samples kept per zone to compute the statistics.
+     * @param samples Number of samples (default is 240).
+     */
+    void setHistorySize (int samples)
+    {
+        history_size = samples;
+    }
+
+    /**
+     * @brief Starts a new frame. Reads back the results of the oldest frame in the ring, if available.
+     */
+    void beginFrame (void)
+    {
+        if (requested && !GLEW_VERSION_3_3 && !GLEW_ARB_timer_query)
+        {
+            std::cerr << "Warning: timer queries not supported, profiling disabled" << std::endl;
+            requested = false;
+        }
+        if (requested_groups && !Misc::isDebugOutputSupported())
+        {
+            std::cerr << "Warning: debug groups require OpenGL 4.3 or KHR_debug" << std::endl;
+            requested_groups = false;
+        }
+        timing = requested;
+        debug_groups = requested_groups;
+        enabled = timing || debug_groups;
+        if (!enabled)
+        {
+            return;
+        }
+
+        FrameSlot& slot = frames[frame_index % NUM_FRAMES];
+        if (slot.pending)
+        {
+            collect(slot);
+        }
+        slot.events.clear();
+        slot.used_queries = 0;
+        slot.cpu_begin = now();
+        slot.query_begin = timing ? timestamp(slot) : -1;
+        in_frame = true;
+    }
+
+    /**
+     * @brief Ends the current frame, closing any zone still open.
+     */
+    void endFrame (void)
+    {
+        if (!enabled || !in_frame)
+        {
+            return;
+        }
+        closeAutoZones();
+        if (!zone_stack.empty())
+        {
+            std::cerr << "Warning: profiler zone " << currentSlot().events[zone_stack.back()].name << " not closed" << std::endl;
+            while (!zone_stack.empty())
+            {
+                endZone();
+            }
+        }
+        currentSlot().pending = timing;
+        in_frame = false;
+        ++frame_index;
+    }
+
+    /**
+     * @brief Opens a zone, zones can be nested.
+     * @param name Zone name, zones with the same name are aggregated.
+     * @param gpu If true the GPU time is measured as well.
+     */
+    void beginZone (const std::string& name, bool gpu = true)
+    {
+        if (!enabled || !in_frame)
+        {
+            return;
+        }
+        zone_stack.push_back(openEvent(name, gpu));
+    }
+
+    /**
+     * @brief Closes the last opened zone.
+     */
+    void endZone (void)
+    {
+        if (!enabled || !in_frame || zone_stack.empty())
+        {
+            return;
+        }
+        closeEvent(zone_stack.back());
+        zone_stack.pop_back();
+    }
+
+    /**
+     * @brief Automatic zone hook, called when a framebuffer is bound (0 for the default framebuffer).
+     * @param fbo Framebuffer handle.
+     * @param name Framebuffer name, empty to use the handle.
+     */
+    void framebufferBound (GLuint fbo, const std::string& name = "")
+    {
+        if (!enabled || !in_frame || !auto_zones || (auto_pass != -1 && auto_pass_fbo == fbo))
+        {
+            return;
+        }
+        closeAutoZones();
+        std::string pass_name = name;
+        if (pass_name.empty())
+        {
+            std::ostringstream label;
+            if (fbo == 0)
+                label << "default framebuffer";
+            else
+                label << "framebuffer " << fbo;
+            pass_name = label.str();
+        }
+        auto_pass = openEvent(pass_name, true);
+        auto_pass_fbo = fbo;
+    }
+
+    /**
+     * @brief Automatic zone hook, called when a program is bound.
+     * @param program Program handle.
+     * @param name Shader name.
+     */
+    void programBound (GLuint program, const std::string& name)
+    {
+        if (!enabled || !in_frame || !auto_zones || (auto_shader != -1 && auto_shader_program == program))
+        {
+            return;
+        }
+        if (auto_shader != -1)
+        {
+            closeEvent(auto_shader);
+        }
+        auto_shader = openEvent(name.empty() ? "unnamed shader" : name, true);
+        auto_shader_program = program;
+    }
+
+    /**
+     * @brief Returns the statistics of all zones.
+     * @param stats Vector to receive one entry per zone name.
+     */
+    void getStats (std::vector<ZoneStats>& stats) const
+    {
+        stats.clear();
+        for (std::map<std::string, History>::const_iterator it = history.begin(); it != history.end(); ++it)
+        {
+            ZoneStats zone;
+            zone.name = it->first;
+            zone.samples = it->second.cpu.size();
+            summarize(it->second.cpu, zone.cpu_min, zone.cpu_avg, zone.cpu_p99);
+            summarize(it->second.gpu, zone.gpu_min, zone.gpu_avg, zone.gpu_p99);
+            stats.push_back(zone);
+        }
+    }
+
+    /**
+     * @brief Prints the statistics of all zones.
+     * @param out Output stream (default is cout).
+     */
+    void printStats (std::ostream& out = std::cout) const
+    {
+        std::vector<ZoneStats> stats;
+        getStats(stats);
+        out << "zone : cpu min / avg / p99 | gpu min / avg / p99 (ms)" << std::endl;
+        for (unsigned int i = 0; i < stats.size(); ++i)
+        {
+            out << stats[i].name << " : " << stats[i].cpu_min << " / " << stats[i].cpu_avg << " / " << stats[i].cpu_p99
+                << " | " << stats[i].gpu_min << " / " << stats[i].gpu_avg << " / " << stats[i].gpu_p99 << std::endl;
+        }
+        if (dropped_frames > 0)
+        {
+            out << dropped_frames << " frames dropped (results not ready in time)" << std::endl;
+        }
+    }
+
+    /**
+     * @brief Clears the statistics.
+     */
+    void resetStats (void)
+    {
+        history.clear();
+        dropped_frames = 0;
+    }
+
+    /**
+     * @brief Starts or stops keeping the zones of each frame for the trace export.
+     * @param flag True to capture.
+     */
+    void setCapture (bool flag)
+    {
+        capturing = flag;
+    }
+
+    /**
+     * @brief Writes the captured zones in the Chrome trace event format and clears them.
+     *
+     * CPU zones are in thread 1 and GPU zones in thread 2, GPU times are aligned to the beginning of each frame.
+     * @param filename Output json filename.
+     * @return True if the file was written.
+     */
+    bool exportChromeTrace (const std::string& filename)
+    {
+        std::ofstream file (filename.c_str());
+        if (!file.is_open())
+        {
+            std::cerr << "Error: could not open file " << filename << std::endl;
+            return false;
+        }
+        file << "{\"traceEvents\":[" << std::endl;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}}," << std::endl;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}";
+        for (unsigned int i = 0; i < trace.size(); ++i)
+        {
+            const TraceEvent& event = trace[i];
+            std::string name = event.name;
+            for (size_t p = name.find_first_of("\"\\"); p != std::string::npos; p = name.find_first_of("\"\\", p + 2))
+            {
+                name.insert(p, "\\");
+            }
+            file << "," << std::endl << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (event.gpu ? 2 : 1)
+                 << ",\"ts\":" << event.begin << ",\"dur\":" << event.duration << "}";
+        }
+        file << std::endl << "]}" << std::endl;
+        trace.clear();
+        return true;
+    }
+
+    ~Profiler () {}
+
+private:
+
+    /// Number of frames in flight in the query ring.
+    static const int NUM_FRAMES = 4;
+
+    /// One zone of one frame.
+    struct Event
+    {
+        std::string name;
+        double cpu_begin, cpu_end;
+        int query_begin, query_end;
+    };
+
+    /// Queries and zones of one frame of the ring.
+    struct FrameSlot
+    {
+        std::vector<GLuint> queries;
+        int used_queries;
+        std::vector<Event> events;
+        double cpu_begin;
+        int query_begin;
+        bool pending;
+        FrameSlot (void) : used_queries(0), cpu_begin(0), query_begin(-1), pending(false) {}
+    };
+
+    /// Recent durations of one zone name, in milliseconds.
+    struct History
+    {
+        std::vector<float> cpu;
+        std::vector<float> gpu;
+        unsigned int next;
+        History (void) : next(0) {}
+    };
+
+    /// One zone of the trace export, times in microseconds.
+    struct TraceEvent
+    {
+        std::string name;
+        double begin, duration;
+        bool gpu;
+    };
+
+    ///Default Constructor
+    Profiler (void) : requested(false), requested_groups(false), enabled(false), timing(false), debug_groups(false), auto_zones(true), in_frame(false), capturing(false),
+        frame_index(0), history_size(240), dropped_frames(0), auto_pass(-1), auto_pass_fbo(0), auto_shader(-1), auto_shader_program(0),
+        start(std::chrono::steady_clock::now())
+    {}
+
+    ///Copy Constructor
+    Profiler (Profiler const&);
+
+    ///Assignment Operation
+    Profiler& operator= (Profiler const&);
+
+    /**
+     * @brief Returns the CPU time since the profiler was created, in microseconds.
+     */
+    double now (void) const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * @brief Returns the ring slot of the current frame.
+     */
+    FrameSlot& currentSlot (void)
+    {
+        return frames[frame_index % NUM_FRAMES];
+    }
+
+    /**
+     * @brief Issues a timestamp query in a slot.
+     * @return Query index in the slot.
+     */
+    int timestamp (FrameSlot& slot)
+    {
+        if (slot.used_queries == (int)slot.queries.size())
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            slot.queries.push_back(query);
+        }
+        glQueryCounter(slot.queries[slot.used_queries], GL_TIMESTAMP);
+        return slot.used_queries++;
+    }
+
+    /**
+     * @brief Opens a zone in the current frame.
+     * @return Index of the zone.
+     */
+    int openEvent (const std::string& name, bool gpu)
+    {
+        FrameSlot& slot = currentSlot();
+        Event event;
+        event.name = name;
+        event.cpu_begin = now();
+        event.cpu_end = event.cpu_begin;
+        event.query_begin = (gpu && timing) ? timestamp(slot) : -1;
+        event.query_end = -1;
+        slot.events.push_back(event);
+        int index = slot.events.size() - 1;
+        if (debug_groups)
+        {
+            Misc::pushDebugGroup(name);
+            group_stack.push_back(index);
+        }
+        return index;
+    }
+
+    /**
+     * @brief Closes a zone of the current frame.
+     * @param index Index of the zone.
+     */
+    void closeEvent (int index)
+    {
+        FrameSlot& slot = currentSlot();
+        Event& event = slot.events[index];
+        event.cpu_end = now();
+        if (event.query_begin != -1)
+        {
+            event.query_end = timestamp(slot);
+        }
+        if (debug_groups)
+        {
+            popGroup(index);
+        }
+    }
+
+    /**
+     * @brief Pops the debug group of a zone.
+     *
+     * Automatic zones do not nest with manual zones, so groups opened after this one are popped and pushed again
+     * to keep the GL group stack consistent.
+     * @param index Index of the zone.
+     */
+    void popGroup (int index)
+    {
+        std::vector<int>::iterator it = std::find(group_stack.begin(), group_stack.end(), index);
+        if (it == group_stack.end())
+        {
+            return;
+        }
+        std::vector<int> reopen (it + 1, group_stack.end());
+        for (unsigned int i = 0; i < reopen.size() + 1; ++i)
+        {
+            Misc::popDebugGroup();
+        }
+        group_stack.erase(it, group_stack.end());
+        for (unsigned int i = 0; i < reopen.size(); ++i)
+        {
+            Misc::pushDebugGroup(currentSlot().events[reopen[i]].name);
+            group_stack.push_back(reopen[i]);
+        }
+    }
+
+    /**
+     * @brief Closes the automatic pass and shader zones.
+     */
+    void closeAutoZones (void)
+    {
+        if (auto_shader != -1)
+        {
+            closeEvent(auto_shader);
+            auto_shader = -1;
+        }
+        if (auto_pass != -1)
+        {
+            closeEvent(auto_pass);
+            auto_pass = -1;
+        }
+    }
+
+    /**
+     * @brief Reads the query results of a finished frame and accumulates its zones, if the results are available.
+     * @param slot Frame slot.
+     */
+    void collect (FrameSlot& slot)
+    {
+        slot.pending = false;
+        if (slot.used_queries == 0)
+        {
+            return;
+        }
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(slot.queries[slot.used_queries-1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            ++dropped_frames;
+            return;
+        }
+
+        std::vector<GLuint64> times (slot.used_queries);
+        for (int i = 0; i < slot.used_queries; ++i)
+        {
+            glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &times[i]);
+        }
+
+        for (unsigned int i = 0; i < slot.events.size(); ++i)
+        {
+            const Event& event = slot.events[i];
+            double cpu_us = event.cpu_end - event.cpu_begin;
+            double gpu_us = 0.0;
+            bool gpu = event.query_begin != -1 && event.query_end != -1;
+            if (gpu)
+            {
+                gpu_us = (times[event.query_end] - times[event.query_begin]) / 1000.0;
+            }
+            addSample(event.name, cpu_us / 1000.0, gpu_us / 1000.0);
+
+            if (capturing)
+            {
+                TraceEvent cpu_event = {event.name, event.cpu_begin, cpu_us, false};
+                trace.push_back(cpu_event);
+                if (gpu)
+                {
+                    double gpu_begin = slot.cpu_begin + (times[event.query_begin] - times[slot.query_begin]) / 1000.0;
+                    TraceEvent gpu_event = {event.name, gpu_begin, gpu_us, true};
+                    trace.push_back(gpu_event);
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Adds one sample to the history of a zone.
+     */
+    void addSample (const std::string& name, double cpu_ms, double gpu_ms)
+    {
+        History& zone = history[name];
+        if ((int)zone.cpu.size() < history_size)
+        {
+            zone.cpu.push_back(cpu_ms);
+            zone.gpu.push_back(gpu_ms);
+        }
+        else
+        {
+            zone.cpu[zone.next] = cpu_ms;
+            zone.gpu[zone.next] = gpu_ms;
+            zone.next = (zone.next + 1) % zone.cpu.size();
+        }
+    }
+
+    /**
+     * @brief Computes min, average and 99th percentile of a set of samples.
+     */
+    static void summarize (std::vector<float> samples, double& min, double& avg, double& p99)
+    {
+        min = avg = p99 = 0.0;
+        if (samples.empty())
+        {
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        double sum = 0.0;
+        for (unsigned int i = 0; i < samples.size(); ++i)
+        {
+            sum += samples[i];
+        }
+        min = samples.front();
+        avg = sum / samples.size();
+        p99 = samples[std::min(samples.size() - 1, (size_t)(samples.size() * 0.99))];
+    }
+
+    /// Timing state requested for the next frame.
+    bool requested;
+
+    /// Debug groups state requested for the next frame.
+    bool requested_groups;
+
+    /// Flag to indicate zones are recorded in the current frame.
+    bool enabled;
+
+    /// Flag to indicate zones are timed in the current frame.
+    bool timing;
+
+    /// Flag to indicate zones push debug groups in the current frame.
+    bool debug_groups;
+
+    /// Flag to enable the zones opened by Framebuffer and Shader binds.
+    bool auto_zones;
+
+    /// Flag to indicate a frame is open.
+    bool in_frame;
+
+    /// Flag to keep zones for the trace export.
+    bool capturing;
+
+    /// Current frame number.
+    unsigned int frame_index;
+
+    /// Number of samples kept per zone.
+    int history_size;
+
+    /// Number of frames whose results were not available in time.
+    unsigned int dropped_frames;
+
+    /// Ring of frames in flight.
+    FrameSlot frames[NUM_FRAMES];
+
+    /// Open manual zones of the current frame.
+    std::vector<int> zone_stack;
+
+    /// Zones with an open debug group, in push order.
+    std::vector<int> group_stack;
+
+    /// Open automatic pass zone, -1 if none.
+    int auto_pass;
+
+    /// Framebuffer of the automatic pass zone.
+    GLuint auto_pass_fbo;
+
+    /// Open automatic shader zone, -1 if none.
+    int auto_shader;
+
+    /// Program of the automatic shader zone.
+    GLuint auto_shader_program;
+
+    /// Sample history per zone name.
+    std::map<std::string, History> history;
+
+    /// Captured zones for the trace export.
+    std::vector<TraceEvent> trace;
+
+    /// CPU time origin.
+    std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * @brief Scoped profiler zone, opened on construction and closed on destruction.
+ */
+class ProfileZone {
+
+public:
+
+    /**
+     * @brief Opens the zone.
+     * @param name Zone name.
+     * @param gpu If true the GPU time is measured as well.
+     */
+    ProfileZone (const std::string& name, bool gpu = true)
+    {
+        gpuProfiler.beginZone(name, gpu);
+    }
+
+    /**
+     * @brief Closes the zone.
+     */
+    ~ProfileZone (void)
+    {
+        gpuProfiler.endZone();
+    }
+
+private:
+
+    ///Copy Constructor
+    ProfileZone (ProfileZone const&);
+
+    ///Assignment Operation
+    ProfileZone& operator= (ProfileZone const&);
+};
+
+}
+
+#endif
@@ -0,0 +1,276 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RENDERTARGETPOOL__
+#define __RENDERTARGETPOOL__
+
+#include <iostream>
+#include <vector>
+#include <GL/glew.h>
+
+#include "FrameBuffer.hpp"
+
+namespace Tucano
+{
+
+/**
+ * @brief Pool of framebuffers shared between render passes.
+ *
+ * A pass acquires a framebuffer matching a description (size, formats, number of attachments, samples
+ * and depth attachment), renders to it, and releases it as soon as its result has been consumed.
+ * A released framebuffer can be handed to any later pass with the same description, in the same frame
+ * or in the following ones, so passes whose lifetimes do not overlap share the same memory.
+ *
+ * Framebuffers that are not used for a number of frames are deleted by newFrame, so after a window
+ * resize the targets with the old size are reclaimed without the passes having to track them.
+ */
+class RenderTargetPool {
+
+public:
+
+    /**
+     * @brief Description of a render target, framebuffers are only shared between equal descriptions.
+     */
+    struct Desc
+    {
+        /// Width in pixels.
+        int width;
+        /// Height in pixels.
+        int height;
+        /// Number of color attachments.
+        int num_attachs;
+        /// Internal format of the color attachments.
+        GLenum internal_format;
+        /// Format of the color attachments.
+        GLenum format;
+        /// Pixel type of the color attachments.
+        GLenum pixel_type;
+        /// Number of samples, 0 for single-sample.
+        int samples;
+        /// Depth format, GL_NONE for no depth.
+        GLenum depth_format;
+        /// If true depth is a texture, otherwise a renderbuffer.
+        bool depth_texture;
+
+        Desc (int w = 0, int h = 0, int n = 1, GLenum int_frm = GL_RGBA8, GLenum frm = GL_RGBA, GLenum pix_type = GL_UNSIGNED_BYTE,
+              int num_samples = 0, GLenum depth_frm = GL_DEPTH_COMPONENT24, bool depth_tex = false) :
+            width(w), height(h), num_attachs(n), internal_format(int_frm), format(frm), pixel_type(pix_type),
+            samples(num_samples), depth_format(depth_frm), depth_texture(depth_tex) {}
+
+        bool operator== (const Desc& other) const
+        {
+            return width == other.width && height == other.height && num_attachs == other.num_attachs &&
+                   internal_format == other.internal_format && format == other.format && pixel_type == other.pixel_type &&
+                   samples == other.samples && depth_format == other.depth_format && depth_texture == other.depth_texture;
+        }
+    };
+
+    /**
+     * @brief Default constructor.
+     * @param idle_frames Number of frames a released framebuffer is kept before being deleted.
+     */
+    RenderTargetPool (int idle_frames = 3) : frame(0), max_idle_frames(idle_frames), num_created(0) {}
+
+    /**
+     * @brief Default destructor, deletes all framebuffers.
+     */
+    ~RenderTargetPool (void)
+    {
+        clear();
+    }
+
+    /**
+     * @brief Returns a framebuffer matching the description, reusing a released one if possible.
+     *
+     * The framebuffer contents are undefined, the pass should clear it.
+     * @param desc Render target description.
+     * @return Pointer to the framebuffer, owned by the pool until release.
+     */
+    Framebuffer* acquire (const Desc& desc)
+    {
+        for (unsigned int i = 0; i < targets.size(); ++i)
+        {
+            if (!targets[i].in_use && targets[i].desc == desc)
+            {
+                targets[i].in_use = true;
+                targets[i].last_used = frame;
+                return targets[i].fbo;
+            }
+        }
+
+        Framebuffer* fbo = new Framebuffer();
+        fbo->setInternalFormat(desc.internal_format);
+        fbo->setInputFormat(desc.format);
+        fbo->setInputType(desc.pixel_type);
+        fbo->setSamples(desc.samples);
+        fbo->setDepthAttachment(Framebuffer::DepthAttachment(desc.depth_format, desc.depth_texture));
+        fbo->create(desc.width, desc.height, desc.num_attachs);
+        ++num_created;
+
+        #ifdef TUCANODEBUG
+        std::cout << "render target pool: created " << desc.width << "x" << desc.height << " target, total " << targets.size()+1 << std::endl;
+        #endif
+
+        targets.push_back(Target(fbo, desc, frame));
+        return fbo;
+    }
+
+    /**
+     * @brief Overload of acquire with a size and the default formats.
+     * @param w Width.
+     * @param h Height.
+     * @param num_attachs Number of color attachments.
+     * @return Pointer to the framebuffer.
+     */
+    Framebuffer* acquire (int w, int h, int num_attachs = 1)
+    {
+        return acquire(Desc(w, h, num_attachs));
+    }
+
+    /**
+     * @brief Returns a framebuffer to the pool, so later passes can reuse it.
+     *
+     * The pointer must not be used after release.
+     * @param fbo Framebuffer returned by acquire.
+     */
+    void release (Framebuffer* fbo)
+    {
+        for (unsigned int i = 0; i < targets.size(); ++i)
+        {
+            if (targets[i].fbo == fbo)
+            {
+                targets[i].in_use = false;
+                targets[i].last_used = frame;
+                return;
+            }
+        }
+        std::cerr << "Warning: releasing a framebuffer that does not belong to the pool" << std::endl;
+    }
+
+    /**
+     * @brief Advances the frame counter and deletes the framebuffers idle for too long.
+     *
+     * Should be called once per frame.
+     */
+    void newFrame (void)
+    {
+        ++frame;
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < targets.size(); ++i)
+        {
+            if (!targets[i].in_use && frame - targets[i].last_used > (unsigned int)max_idle_frames)
+            {
+                delete targets[i].fbo;
+                continue;
+            }
+            targets[kept++] = targets[i];
+        }
+        targets.erase(targets.begin() + kept, targets.end());
+    }
+
+    /**
+     * @brief Sets the number of frames a released framebuffer is kept before being deleted.
+     * @param idle_frames Number of frames.
+     */
+    void setMaxIdleFrames (int idle_frames)
+    {
+        max_idle_frames = idle_frames;
+    }
+
+    /**
+     * @brief Deletes all framebuffers, including the ones in use.
+     */
+    void clear (void)
+    {
+        for (unsigned int i = 0; i < targets.size(); ++i)
+        {
+            delete targets[i].fbo;
+        }
+        targets.clear();
+    }
+
+    /**
+     * @brief Returns the number of framebuffers held by the pool.
+     */
+    int getNumTargets (void) const
+    {
+        return targets.size();
+    }
+
+    /**
+     * @brief Returns the number of framebuffers currently acquired.
+     */
+    int getNumInUse (void) const
+    {
+        int count = 0;
+        for (unsigned int i = 0; i < targets.size(); ++i)
+        {
+            if (targets[i].in_use)
+                ++count;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Returns the number of framebuffers created since the pool was constructed.
+     *
+     * If it keeps growing in steady state the passes are not releasing their targets.
+     */
+    unsigned int getNumCreated (void) const
+    {
+        return num_created;
+    }
+
+private:
+
+    /// One framebuffer of the pool.
+    struct Target
+    {
+        Framebuffer* fbo;
+        Desc desc;
+        bool in_use;
+        unsigned int last_used;
+        Target (Framebuffer* f, const Desc& d, unsigned int used) : fbo(f), desc(d), in_use(true), last_used(used) {}
+    };
+
+    ///Copy Constructor
+    RenderTargetPool (RenderTargetPool const&);
+
+    ///Assignment Operation
+    RenderTargetPool& operator= (RenderTargetPool const&);
+
+    /// Framebuffers in the pool.
+    std::vector<Target> targets;
+
+    /// Current frame.
+    unsigned int frame;
+
+    /// Frames a released framebuffer is kept.
+    int max_idle_frames;
+
+    /// Number of framebuffers created.
+    unsigned int num_created;
+};
+
+}
+
+#endif
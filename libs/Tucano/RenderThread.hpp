@@ -0,0 +1,493 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RENDERTHREAD__
+#define __RENDERTHREAD__
+
+#include "Context.hpp"
+#include "CommandList.hpp"
+#include "DeletionQueue.hpp"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace Tucano
+{
+
+/**
+ * @brief Thread owning an OpenGL context and executing command lists in submission order.
+ *
+ * The application threads record CommandLists in parallel and submit them per frame, the render thread
+ * executes each frame's lists in the given order and presents it. A list must not be reset or recorded
+ * again until its frame was executed, waitForFrame (or double buffered lists) guarantees that:
+ *
+ *     unsigned long frame = render_thread.submitFrame(lists);
+ *     ... record the next frame into the other set of lists ...
+ *     render_thread.waitForFrame(frame);
+ *
+ * The context is released from the calling thread in start and made current in the render thread.
+ * GLState and TextureManager are per thread, so the render thread keeps its own shadow state.
+ * If the lists update the shared CameraBlock, the last submitted list releases it (cameraBlock.release()).
+ */
+class RenderThread {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    RenderThread (void) : context(NULL), running(false), submitted(0), executed(0) {}
+
+    /**
+     * @brief Default destructor, stops the thread.
+     */
+    ~RenderThread (void)
+    {
+        stop();
+    }
+
+    /**
+     * @brief Starts the render thread with a context.
+     * @param ctx Context, current in the calling thread or in none.
+     */
+    void start (Context* ctx)
+    {
+        stop();
+        context = ctx;
+        context->doneCurrent();
+        running = true;
+        thread = std::thread(&RenderThread::run, this);
+    }
+
+    /**
+     * @brief Executes the frames already submitted and stops the thread.
+     *
+     * The context is released by the render thread, so the caller can make it current again.
+     */
+    void stop (void)
+    {
+        if (!thread.joinable())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            running = false;
+        }
+        work_available.notify_one();
+        thread.join();
+    }
+
+    /**
+     * @brief Submits the lists of a frame, executed in the given order after the previous frames.
+     * @param lists Command lists.
+     * @param present If true the context buffers are swapped after the lists.
+     * @return Frame number, to be given to waitForFrame.
+     */
+    unsigned long submitFrame (const std::vector<CommandList*>& lists, bool present = true)
+    {
+        Frame frame;
+        frame.lists = lists;
+        frame.present = present;
+        unsigned long number;
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            number = ++submitted;
+            frame.number = number;
+            queue.push_back(frame);
+        }
+        work_available.notify_one();
+        return number;
+    }
+
+    /**
+     * @brief Submits a single list, not presented.
+     * @param list Command list.
+     * @return Frame number.
+     */
+    unsigned long submit (CommandList& list)
+    {
+        return submitFrame(std::vector<CommandList*>(1, &list), false);
+    }
+
+    /**
+     * @brief Waits until a frame was executed by the render thread, its lists can then be reset.
+     *
+     * Execution means the GL calls were issued, not that the GPU finished them.
+     * @param frame Frame number returned by submitFrame.
+     */
+    void waitForFrame (unsigned long frame)
+    {
+        std::unique_lock<std::mutex> lock (mutex);
+        frame_done.wait(lock, [this, frame] () { return executed >= frame || !running; });
+    }
+
+    /**
+     * @brief Waits until all submitted frames were executed.
+     */
+    void waitIdle (void)
+    {
+        unsigned long last;
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            last = submitted;
+        }
+        waitForFrame(last);
+    }
+
+    /**
+     * @brief Returns the number of frames submitted and not yet executed.
+     */
+    unsigned long getQueuedFrames (void)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        return submitted - executed;
+    }
+
+    /**
+     * @brief Returns wether the thread is running.
+     */
+    bool isRunning (void) const
+    {
+        return thread.joinable();
+    }
+
+private:
+
+    /// Lists of a submitted frame.
+    struct Frame
+    {
+        std::vector<CommandList*> lists;
+        bool present;
+        unsigned long number;
+    };
+
+    ///Copy Constructor
+    RenderThread (RenderThread const&);
+
+    ///Assignment Operation
+    RenderThread& operator= (RenderThread const&);
+
+    /**
+     * @brief Render thread loop.
+     */
+    void run (void)
+    {
+        context->makeCurrent();
+        while (true)
+        {
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock (mutex);
+                work_available.wait(lock, [this] () { return !queue.empty() || !running; });
+                if (queue.empty())
+                {
+                    break;
+                }
+                frame = queue.front();
+                queue.pop_front();
+            }
+            context->updateViewport();
+            for (unsigned int i = 0; i < frame.lists.size(); ++i)
+            {
+                frame.lists[i]->execute();
+            }
+            if (frame.present)
+            {
+                context->swapBuffers();
+            }
+            DeletionQueue::Instance().fence();
+            DeletionQueue::Instance().collect();
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                executed = frame.number;
+            }
+            frame_done.notify_all();
+        }
+        DeletionQueue::Instance().flush();
+        context->doneCurrent();
+        frame_done.notify_all();
+    }
+
+    /// Context current in the render thread.
+    Context* context;
+
+    /// Render thread.
+    std::thread thread;
+
+    /// Guards the queue and counters.
+    std::mutex mutex;
+
+    /// Signaled when a frame is submitted or the thread must stop.
+    std::condition_variable work_available;
+
+    /// Signaled when a frame was executed.
+    std::condition_variable frame_done;
+
+    /// Submitted frames not yet executed.
+    std::deque<Frame> queue;
+
+    /// False when the thread must stop.
+    bool running;
+
+    /// Number of the last submitted and last executed frames.
+    unsigned long submitted, executed;
+};
+
+/**
+ * @brief Thread creating resources (buffers, textures, shaders) asynchronously in a shared context.
+ *
+ * Each job runs in the thread's own context, which shares objects with the main one (see Context::createShared),
+ * and is followed by a fence. A resource can be used by other contexts once isReady returns true for its ticket:
+ *
+ *     unsigned long ticket = loader.enqueue([&texture, data] () { texture.create(GL_TEXTURE_2D, GL_RGBA8, w, h, GL_RGBA, GL_UNSIGNED_BYTE, data); });
+ *     ...
+ *     if (loader.isReady(ticket)) { ... use texture ... }
+ *
+ * The objects must not be used by the main context before they are ready, and container objects
+ * (vertex arrays, framebuffers) are not shared between contexts and must be created where they are used.
+ */
+class ResourceThread {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    ResourceThread (void) : context(NULL), running(false), enqueued(0), completed(0) {}
+
+    /**
+     * @brief Default destructor, stops the thread and deletes the shared context.
+     */
+    ~ResourceThread (void)
+    {
+        stop();
+    }
+
+    /**
+     * @brief Creates a context shared with the given one and starts the thread.
+     * @param main_context Context to share objects with, call from the thread that created it.
+     * @return True if started, false if the context does not support sharing.
+     */
+    bool start (Context& main_context)
+    {
+        stop();
+        context = main_context.createShared();
+        if (!context)
+        {
+            std::cerr << "Warning: context sharing not supported, resources can not be created asynchronously" << std::endl;
+            return false;
+        }
+        running = true;
+        thread = std::thread(&ResourceThread::run, this);
+        return true;
+    }
+
+    /**
+     * @brief Finishes the queued jobs and stops the thread.
+     */
+    void stop (void)
+    {
+        if (thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                running = false;
+            }
+            work_available.notify_one();
+            thread.join();
+        }
+        // the fences belong to the share group and can be deleted from any of its contexts
+        for (std::map<unsigned long, GLsync>::iterator it = fences.begin(); it != fences.end(); ++it)
+        {
+            glDeleteSync(it->second);
+        }
+        fences.clear();
+        delete context;
+        context = NULL;
+    }
+
+    /**
+     * @brief Queues a job creating or uploading resources.
+     * @param job Function called in the resource thread, with the shared context current.
+     * @return Ticket of the job.
+     */
+    unsigned long enqueue (const std::function<void()>& job)
+    {
+        unsigned long ticket;
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            ticket = ++enqueued;
+            jobs.push_back(std::make_pair(ticket, job));
+        }
+        work_available.notify_one();
+        return ticket;
+    }
+
+    /**
+     * @brief Returns wether the resources of a job are complete on the GPU and can be used. Does not block.
+     *
+     * Must be called from a thread with a context of the share group (usually the main or render thread).
+     * @param ticket Ticket returned by enqueue.
+     */
+    bool isReady (unsigned long ticket)
+    {
+        GLsync fence = 0;
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            if (ticket > completed)
+            {
+                return false;
+            }
+            std::map<unsigned long, GLsync>::iterator it = fences.find(ticket);
+            if (it == fences.end())
+            {
+                // already known to be ready
+                return true;
+            }
+            fence = it->second;
+        }
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            fences.erase(ticket);
+            glDeleteSync(fence);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Blocks until a job ran in the resource thread and makes the calling context wait for it on the GPU.
+     *
+     * Cheaper than polling isReady when the resource is needed right away: the CPU only waits for the job
+     * to be issued, the GPU of the calling context waits for the upload to complete.
+     * @param ticket Ticket returned by enqueue.
+     */
+    void wait (unsigned long ticket)
+    {
+        GLsync fence = 0;
+        {
+            std::unique_lock<std::mutex> lock (mutex);
+            job_done.wait(lock, [this, ticket] () { return completed >= ticket || !running; });
+            std::map<unsigned long, GLsync>::iterator it = fences.find(ticket);
+            if (it == fences.end())
+            {
+                return;
+            }
+            fence = it->second;
+            fences.erase(it);
+        }
+        glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+    }
+
+    /**
+     * @brief Returns the number of queued jobs not yet run.
+     */
+    unsigned long getPendingJobs (void)
+    {
+        std::lock_guard<std::mutex> lock (mutex);
+        return enqueued - completed;
+    }
+
+private:
+
+    ///Copy Constructor
+    ResourceThread (ResourceThread const&);
+
+    ///Assignment Operation
+    ResourceThread& operator= (ResourceThread const&);
+
+    /**
+     * @brief Resource thread loop.
+     */
+    void run (void)
+    {
+        context->makeCurrent();
+        while (true)
+        {
+            std::pair<unsigned long, std::function<void()> > job;
+            {
+                std::unique_lock<std::mutex> lock (mutex);
+                work_available.wait(lock, [this] () { return !jobs.empty() || !running; });
+                if (jobs.empty())
+                {
+                    break;
+                }
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            job.second();
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            // the fence must reach the GPU before other contexts wait for it
+            glFlush();
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                fences[job.first] = fence;
+                completed = job.first;
+            }
+            job_done.notify_all();
+            DeletionQueue::Instance().collect();
+        }
+        DeletionQueue::Instance().flush();
+        context->doneCurrent();
+        job_done.notify_all();
+    }
+
+    /// Shared context current in the resource thread.
+    Context* context;
+
+    /// Resource thread.
+    std::thread thread;
+
+    /// Guards the jobs, fences and counters.
+    std::mutex mutex;
+
+    /// Signaled when a job is queued or the thread must stop.
+    std::condition_variable work_available;
+
+    /// Signaled when a job ran.
+    std::condition_variable job_done;
+
+    /// Queued jobs with their tickets.
+    std::deque< std::pair<unsigned long, std::function<void()> > > jobs;
+
+    /// Fences of the jobs that ran and were not yet found ready.
+    std::map<unsigned long, GLsync> fences;
+
+    /// False when the thread must stop.
+    bool running;
+
+    /// Last queued and last completed tickets.
+    unsigned long enqueued, completed;
+};
+
+}
+
+#endif
@@ -24,9 +24,18 @@
 #define __TUCANOSHADER__
 
 #include "Misc.hpp"
+#include "GLState.hpp"
+#include "DeletionQueue.hpp"
+#include "UniformBuffer.hpp"
+#include "Buffer.hpp"
+#include "Profiler.hpp"
 
 #include <fstream>
+#include <sstream>
 #include <vector>
+#include <utility>
+#include <unordered_map>
+#include <map>
 #include <Eigen/Dense>
 
 
@@ -42,6 +51,9 @@ namespace Tucano
  * One object can store either the standard rendering pipeline shaders (vertex, geometry, fragment...) or a group of
  * compute shaders. For convenience, it also stores a user defined name, making it easier to access the shaders from within the main program.
  * The shader's name is the same as the shaders filenames, without the extensions.
+ *
+ * A shader owns its program and shader objects: it can be moved but not copied, and they are released when
+ * the shader is destroyed (or deleteShaders is called), through the DeletionQueue.
  */
 class Shader {
 
@@ -104,6 +116,26 @@ private:
     /// Debug level for outputing warnings and messages
     int debug_level;
 
+    /**
+     * @brief Cache of uniform locations indexed by name.
+     *
+     * Filled from the active uniforms list after each successful link, so that setting a uniform by name
+     * does not query the driver. Names not found in the program are also cached (as -1) on first request.
+     */
+    mutable unordered_map<string, GLint> uniform_locations;
+
+    /// Indices of the active uniform blocks indexed by name, filled after each successful link.
+    unordered_map<string, GLuint> uniform_blocks;
+
+    /// Flag to indicate the program was loaded from the binary cache, in which case there are no shader objects.
+    bool loaded_from_cache;
+
+    /// Flag to indicate the program was submitted asynchronously and its compile and link status were not checked yet.
+    bool pending_link;
+
+    /// Cache file the pending program should be stored to once linked, empty if cache is disabled.
+    string pending_cache_file;
+
 public:
 
     /**
@@ -116,6 +148,7 @@ public:
     {
         shaderName = name;
         vertexShader = 0; fragmentShader = 0; geometryShader = 0; tessellationControlShader = 0; tessellationEvaluationShader = 0; shaderProgram = 0; computeShaders = vector<GLuint>();
+        debug_level = 0; loaded_from_cache = false; pending_link = false;
     }
 
     /**
@@ -129,6 +162,7 @@ public:
         computeShaderPaths = compute_shader_paths;
 
         vertexShader = 0; fragmentShader = 0; geometryShader = 0; tessellationControlShader = 0; tessellationEvaluationShader = 0; shaderProgram = 0; computeShaders = vector<GLuint>();
+        debug_level = 0; loaded_from_cache = false; pending_link = false;
     }
 
     /**
@@ -139,6 +173,47 @@ public:
         deleteShaders();
     }
 
+    /**
+     * @brief Move constructor, takes the program, paths and name of another shader, leaving it empty.
+     * @param other Shader to move from.
+     */
+    Shader (Shader&& other) noexcept : Shader()
+    {
+        swap(other);
+    }
+
+    /**
+     * @brief Move assignment, deletes the current program and takes the one of another shader.
+     * @param other Shader to move from.
+     * @return Reference to this shader.
+     */
+    Shader& operator= (Shader&& other) noexcept
+    {
+        if (this != &other)
+        {
+            deleteShaders();
+            swap(other);
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Exchanges everything with another shader: program, shaders, file paths and name.
+     * @param other Shader to exchange with.
+     */
+    void swap (Shader& other)
+    {
+        swapProgram(other);
+        std::swap(shaderName, other.shaderName);
+        std::swap(vertexShaderPath, other.vertexShaderPath);
+        std::swap(tessellationControlShaderPath, other.tessellationControlShaderPath);
+        std::swap(tessellationEvaluationShaderPath, other.tessellationEvaluationShaderPath);
+        std::swap(geometryShaderPath, other.geometryShaderPath);
+        std::swap(fragmentShaderPath, other.fragmentShaderPath);
+        std::swap(computeShaderPaths, other.computeShaderPaths);
+        std::swap(debug_level, other.debug_level);
+    }
+
 	/**
 	* @brief Sets the shader name, very useful for debugging
 	* @param name Shader name
@@ -253,6 +328,9 @@ public:
         tessellationEvaluationShader = 0;
         shaderProgram = 0;
         computeShaders = vector<GLuint>();
+        debug_level = 0;
+        loaded_from_cache = false;
+        pending_link = false;
     }
 
 	/**
@@ -336,6 +414,9 @@ public:
         tessellationEvaluationShader = 0;
         shaderProgram = 0;
         computeShaders = vector<GLuint>();
+        debug_level = 0;
+        loaded_from_cache = false;
+        pending_link = false;
 
 	}
 
@@ -354,8 +435,9 @@ public:
 
     /**
      * @brief Link shader program and check for link errors.
+     * @return True if the program was linked, false otherwise.
      */
-    void linkProgram (void)
+    bool linkProgram (void)
     {
 
         glLinkProgram(shaderProgram);
@@ -369,6 +451,8 @@ public:
             glGetProgramInfoLog(shaderProgram, 1024, NULL, errorLog);
             fprintf(stdout, "%s", &errorLog[0]);
             cerr << endl;
+            uniform_locations.clear();
+            return false;
         }
         #ifdef TUCANODEBUG
         else
@@ -376,6 +460,128 @@ public:
             cout << " Successfully linked : " << shaderName << endl << endl;
         }
         #endif
+
+        cacheUniformLocations();
+        labelObjects();
+        return true;
+    }
+
+    /**
+     * @brief Names the program and its attached shaders after the shader name, for debug messages and GPU debuggers.
+     *
+     * Called after every successful link, ignored without debug output support.
+     */
+    void labelObjects (void)
+    {
+        if (shaderProgram == 0 || shaderName.empty() || !Misc::isDebugOutputSupported())
+        {
+            return;
+        }
+        Misc::setObjectLabel(GL_PROGRAM, shaderProgram, shaderName);
+
+        GLint num_shaders = 0;
+        glGetProgramiv(shaderProgram, GL_ATTACHED_SHADERS, &num_shaders);
+        if (num_shaders == 0)
+        {
+            return;
+        }
+        vector<GLuint> shaders (num_shaders);
+        glGetAttachedShaders(shaderProgram, num_shaders, NULL, &shaders[0]);
+        for (int i = 0; i < num_shaders; ++i)
+        {
+            GLint type = 0;
+            glGetShaderiv(shaders[i], GL_SHADER_TYPE, &type);
+            string stage = "shader";
+            switch (type)
+            {
+                case GL_VERTEX_SHADER: stage = "vertex"; break;
+                case GL_TESS_CONTROL_SHADER: stage = "tess control"; break;
+                case GL_TESS_EVALUATION_SHADER: stage = "tess evaluation"; break;
+                case GL_GEOMETRY_SHADER: stage = "geometry"; break;
+                case GL_FRAGMENT_SHADER: stage = "fragment"; break;
+                case GL_COMPUTE_SHADER: stage = "compute"; break;
+            }
+            Misc::setObjectLabel(GL_SHADER, shaders[i], shaderName + " " + stage);
+        }
+    }
+
+    /**
+     * @brief Fills the uniform location cache with all active uniforms of the linked program.
+     *
+     * Uniforms inside uniform blocks have no location and are skipped.
+     * Array uniforms are stored both as "name[0]" (as reported by GL) and as "name".
+     */
+    void cacheUniformLocations (void)
+    {
+        uniform_locations.clear();
+
+        GLint num_uniforms = 0;
+        GLint max_length = 0;
+        glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORMS, &num_uniforms);
+        glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+        if (num_uniforms <= 0 || max_length <= 0)
+        {
+            return;
+        }
+
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        char* name = new char[max_length];
+        for (GLint i = 0; i < num_uniforms; ++i)
+        {
+            glGetActiveUniform(shaderProgram, i, max_length, &length, &size, &type, name);
+            GLint location = glGetUniformLocation(shaderProgram, name);
+            if (location == -1)
+            {
+                continue;
+            }
+            string uniform_name (name, length);
+            uniform_locations[uniform_name] = location;
+
+            // arrays are reported as "name[0]", also register the base name
+            if (length > 3 && uniform_name.compare(length-3, 3, "[0]") == 0)
+            {
+                uniform_locations[uniform_name.substr(0, length-3)] = location;
+            }
+        }
+        delete [] name;
+
+        cacheUniformBlocks();
+    }
+
+    /**
+     * @brief Fills the uniform block index cache, and assigns the blocks with a global binding point (such as the camera block).
+     */
+    void cacheUniformBlocks (void)
+    {
+        uniform_blocks.clear();
+
+        GLint num_blocks = 0;
+        GLint max_length = 0;
+        glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORM_BLOCKS, &num_blocks);
+        glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_length);
+        if (num_blocks <= 0 || max_length <= 0)
+        {
+            return;
+        }
+
+        const map<string, GLuint>& global_bindings = globalBlockBindings();
+        GLsizei length = 0;
+        char* name = new char[max_length];
+        for (GLint i = 0; i < num_blocks; ++i)
+        {
+            glGetActiveUniformBlockName(shaderProgram, i, max_length, &length, name);
+            string block_name (name, length);
+            uniform_blocks[block_name] = i;
+
+            map<string, GLuint>::const_iterator it = global_bindings.find(block_name);
+            if (it != global_bindings.end())
+            {
+                glUniformBlockBinding(shaderProgram, i, it->second);
+            }
+        }
+        delete [] name;
     }
 
 
@@ -439,6 +645,22 @@ public:
      */
     void initializeFromStrings (string vertex_code, string fragment_code, string geometry_code = "", string tessellation_evaluation_code = "", string tessellation_control_code = "")
     {
+        string cache_file;
+        if (isProgramCacheEnabled())
+        {
+            vector<string> sources;
+            sources.push_back(vertex_code);
+            sources.push_back(tessellation_control_code);
+            sources.push_back(tessellation_evaluation_code);
+            sources.push_back(geometry_code);
+            sources.push_back(fragment_code);
+            cache_file = programCacheFile(sources);
+            if (loadProgramBinary(cache_file))
+            {
+                return;
+            }
+        }
+
         //Create Shader Program.
         shaderProgram = glCreateProgram();
 
@@ -479,7 +701,52 @@ public:
             setFragmentShader(fragment_code);
         }
 
-        linkProgram();
+        if (!cache_file.empty())
+        {
+            glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        if (linkProgram() && !cache_file.empty())
+        {
+            storeProgramBinary(cache_file);
+        }
+
+        #ifdef TUCANODEBUG
+        Misc::errorCheckFunc(__FILE__, __LINE__);
+        #endif
+    }
+
+    /**
+     * @brief Initializes a compute shader directly from string, no files.
+     * @param compute_code String containing the compute shader code.
+     */
+    void initializeComputeFromString (string compute_code)
+    {
+        string cache_file;
+        if (isProgramCacheEnabled())
+        {
+            // same source order as readSources, the compute shader comes after the five graphics stages
+            vector<string> sources (5);
+            sources.push_back(compute_code);
+            cache_file = programCacheFile(sources);
+            if (loadProgramBinary(cache_file))
+            {
+                return;
+            }
+        }
+
+        shaderProgram = glCreateProgram();
+        computeShaderPaths.assign(1, "");
+        computeShaders.assign(1, glCreateShader(GL_COMPUTE_SHADER));
+        setComputeShader(0, compute_code);
+
+        if (!cache_file.empty())
+        {
+            glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        if (linkProgram() && !cache_file.empty())
+        {
+            storeProgramBinary(cache_file);
+        }
 
         #ifdef TUCANODEBUG
         Misc::errorCheckFunc(__FILE__, __LINE__);
@@ -488,9 +755,18 @@ public:
 
     /**
      * @brief Calls all the functions related to the shader initialization, i.e., creates, loads the shaders from the external files and links the shader program.
+     *
+     * If the program cache is enabled (see setProgramCacheDirectory), the program binary is loaded from the cache
+     * when the sources, renderer and driver version match, and stored in the cache otherwise.
      */
     void initialize (void)
     {
+        if (isProgramCacheEnabled())
+        {
+            initializeCached();
+            return;
+        }
+
         createShaders();
 
         if(!vertexShaderPath.empty())
@@ -528,6 +804,269 @@ public:
     }
 
 
+    /**
+     * @brief Sets the directory where linked program binaries are cached, an empty string disables the cache.
+     *
+     * The directory must exist. Applies to all shaders initialized afterwards.
+     * @param dir Cache directory.
+     */
+    static void setProgramCacheDirectory (const string& dir)
+    {
+        programCacheDirectory() = dir;
+    }
+
+    /**
+     * @brief Returns the program binary cache directory, empty if the cache is disabled.
+     */
+    static const string& getProgramCacheDirectory (void)
+    {
+        return programCacheDirectory();
+    }
+
+    /**
+     * @brief Returns wether program binaries (GL 4.1 or ARB_get_program_binary) are supported with at least one format.
+     * @return True if supported, false otherwise.
+     */
+    static bool isProgramBinarySupported (void)
+    {
+        if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+        {
+            return false;
+        }
+        GLint num_formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+        return num_formats > 0;
+    }
+
+    /**
+     * @brief Returns wether the program was loaded from the binary cache instead of compiled.
+     */
+    bool isLoadedFromCache (void) const
+    {
+        return loaded_from_cache;
+    }
+
+    /**
+     * @brief Initializes the shader from the files through the program binary cache.
+     *
+     * All stage files are read and hashed. On a cache hit the binary is loaded and no shader is compiled,
+     * on a miss (or if the driver rejects the binary) the program is compiled, linked and stored in the cache.
+     */
+    void initializeCached (void)
+    {
+        vector<string> sources = readSources();
+
+        string cache_file = programCacheFile(sources);
+        if (loadProgramBinary(cache_file))
+        {
+            return;
+        }
+
+        createShaders();
+
+        if (!vertexShaderPath.empty())
+        {
+            setVertexShader(sources[0]);
+            if (!tessellationControlShaderPath.empty())
+            {
+                setTessellationControlShader(sources[1]);
+            }
+            if (!tessellationEvaluationShaderPath.empty())
+            {
+                setTessellationEvaluationShader(sources[2]);
+            }
+            if (!geometryShaderPath.empty())
+            {
+                setGeometryShader(sources[3]);
+            }
+        }
+        if (!fragmentShaderPath.empty())
+        {
+            setFragmentShader(sources[4]);
+        }
+        for (unsigned int i = 0; i < computeShaderPaths.size(); ++i)
+        {
+            setComputeShader(i, sources[5+i]);
+        }
+
+        glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        if (linkProgram())
+        {
+            storeProgramBinary(cache_file);
+        }
+
+        #ifdef TUCANODEBUG
+        Misc::errorCheckFunc(__FILE__, __LINE__);
+        #endif
+    }
+
+    /**
+     * @brief Reads the code of all stages from the files. Does not use OpenGL, so it can be called from any thread.
+     * @return Source of each stage in the order vertex, tessellation control, tessellation evaluation,
+     * geometry, fragment and compute shaders (empty for absent stages).
+     */
+    vector<string> readSources (void) const
+    {
+        vector<string> sources;
+        sources.push_back(vertexShaderPath.empty() ? "" : readShaderFile(vertexShaderPath));
+        sources.push_back(tessellationControlShaderPath.empty() ? "" : readShaderFile(tessellationControlShaderPath));
+        sources.push_back(tessellationEvaluationShaderPath.empty() ? "" : readShaderFile(tessellationEvaluationShaderPath));
+        sources.push_back(geometryShaderPath.empty() ? "" : readShaderFile(geometryShaderPath));
+        sources.push_back(fragmentShaderPath.empty() ? "" : readShaderFile(fragmentShaderPath));
+        for (unsigned int i = 0; i < computeShaderPaths.size(); ++i)
+        {
+            sources.push_back(readShaderFile(computeShaderPaths[i]));
+        }
+        return sources;
+    }
+
+    /**
+     * @brief Initializes the shader from the files without waiting for the driver to compile and link.
+     *
+     * With KHR_parallel_shader_compile the driver compiles in its own threads, so many programs can be
+     * submitted before any of them is used. Poll isReady (or call finishLink) before binding the program.
+     * Without the extension the result is the same as initialize, but errors are only reported by isReady.
+     */
+    void initializeAsync (void)
+    {
+        submitSources(readSources());
+    }
+
+    /**
+     * @brief Submits the compile and link of the given sources without checking their status.
+     *
+     * Must be called from the GL thread. Uses the program binary cache if enabled, in which case
+     * the program may already be ready when this returns.
+     * @param sources Stage sources as returned by readSources.
+     */
+    void submitSources (const vector<string>& sources)
+    {
+        pending_cache_file.clear();
+        if (isProgramCacheEnabled())
+        {
+            pending_cache_file = programCacheFile(sources);
+            if (loadProgramBinary(pending_cache_file))
+            {
+                pending_cache_file.clear();
+                return;
+            }
+        }
+
+        createShaders();
+
+        if (!vertexShaderPath.empty())
+        {
+            submitShader(vertexShader, sources[0]);
+            if (!tessellationControlShaderPath.empty())
+            {
+                submitShader(tessellationControlShader, sources[1]);
+            }
+            if (!tessellationEvaluationShaderPath.empty())
+            {
+                submitShader(tessellationEvaluationShader, sources[2]);
+            }
+            if (!geometryShaderPath.empty())
+            {
+                submitShader(geometryShader, sources[3]);
+            }
+        }
+        if (!fragmentShaderPath.empty())
+        {
+            submitShader(fragmentShader, sources[4]);
+        }
+        for (unsigned int i = 0; i < computeShaderPaths.size(); ++i)
+        {
+            submitShader(computeShaders[i], sources[5+i]);
+        }
+
+        if (!pending_cache_file.empty())
+        {
+            glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(shaderProgram);
+        pending_link = true;
+    }
+
+    /**
+     * @brief Returns wether the program can be used, without blocking if the driver is still compiling.
+     *
+     * When the driver finishes, the compile and link status are checked (and errors reported) by finishLink.
+     * Without KHR_parallel_shader_compile this always waits for the link.
+     * @return True if the program is linked (or failed to link), false if still compiling.
+     */
+    bool isReady (void)
+    {
+        if (!pending_link)
+        {
+            return true;
+        }
+        if (isParallelCompileSupported())
+        {
+            GLint completed = GL_FALSE;
+            glGetProgramiv(shaderProgram, GL_COMPLETION_STATUS_KHR, &completed);
+            if (completed != GL_TRUE)
+            {
+                return false;
+            }
+        }
+        finishLink();
+        return true;
+    }
+
+    /**
+     * @brief Waits for a pending program, checks the compile and link status and caches the uniform locations.
+     * @return True if the program was linked without errors.
+     */
+    bool finishLink (void)
+    {
+        if (!pending_link)
+        {
+            return shaderProgram != 0;
+        }
+        pending_link = false;
+
+        checkCompileStatus(vertexShader, vertexShaderPath);
+        checkCompileStatus(tessellationControlShader, tessellationControlShaderPath);
+        checkCompileStatus(tessellationEvaluationShader, tessellationEvaluationShaderPath);
+        checkCompileStatus(geometryShader, geometryShaderPath);
+        checkCompileStatus(fragmentShader, fragmentShaderPath);
+        for (unsigned int i = 0; i < computeShaders.size(); ++i)
+        {
+            checkCompileStatus(computeShaders[i], computeShaderPaths[i]);
+        }
+
+        GLint result = GL_FALSE;
+        glGetProgramiv(shaderProgram, GL_LINK_STATUS, &result);
+        if (result != GL_TRUE)
+        {
+            cerr << "Error linking program : " << shaderName << endl;
+            GLchar errorLog[1024] = {0};
+            glGetProgramInfoLog(shaderProgram, 1024, NULL, errorLog);
+            fprintf(stdout, "%s", &errorLog[0]);
+            cerr << endl;
+            uniform_locations.clear();
+            return false;
+        }
+
+        cacheUniformLocations();
+        labelObjects();
+        if (!pending_cache_file.empty())
+        {
+            storeProgramBinary(pending_cache_file);
+            pending_cache_file.clear();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Returns wether the driver can compile shaders in parallel (KHR_parallel_shader_compile).
+     * @return True if supported, false otherwise.
+     */
+    static bool isParallelCompileSupported (void)
+    {
+        return GLEW_KHR_parallel_shader_compile;
+    }
+
     /**
      * @brief Creates the GLSL shader objects, storing the identification handle for each shader.
      */
@@ -967,50 +1506,59 @@ public:
                 computeShaderStream.close();
             }
 
-            GLint result = GL_FALSE;
-            int infoLogLength;
+            setComputeShader(position, computeShaderCode);
 
-            // Compile Compute Shader
-            if (debug_level > 0)
-                //cout << "Compiling compute shader: " << *it << endl;
-                cout << "Compiling compute shader: " << *it;
-            char const * computeSourcePointer = computeShaderCode.c_str();
-            glShaderSource(computeShaders[position], 1, &computeSourcePointer , NULL);
-            glCompileShader(computeShaders[position]);
+            position++;
+        }
+    }
 
-            // Check Fragment Shader
-            glGetShaderiv(computeShaders[position], GL_COMPILE_STATUS, &result);
-            if (result != GL_TRUE)
-            {
-                cerr << "Erro compiling compute shader: " << computeShaderPaths[position] << endl;
-                glGetShaderiv(computeShaders[position], GL_INFO_LOG_LENGTH, &infoLogLength);
-                char * computeShaderErrorMessage = new char[infoLogLength];
-                glGetShaderInfoLog(computeShaders[position], infoLogLength, NULL, &computeShaderErrorMessage[0]);
-                fprintf(stdout, "\n%s", &computeShaderErrorMessage[0]);
-                delete [] computeShaderErrorMessage;
-            }
-            #ifdef TUCANODEBUG
+    /**
+     * @brief Loads the code of one compute shader into the shader program.
+     * @param position Index of the compute shader.
+     * @param computeShaderCode String containing code
+     */
+    void setComputeShader (int position, string& computeShaderCode)
+    {
+        GLint result = GL_FALSE;
+        int infoLogLength;
+
+        // Compile Compute Shader
+        if (debug_level > 0)
+            cout << "Compiling compute shader: " << computeShaderPaths[position];
+        char const * computeSourcePointer = computeShaderCode.c_str();
+        glShaderSource(computeShaders[position], 1, &computeSourcePointer , NULL);
+        glCompileShader(computeShaders[position]);
+
+        // Check Fragment Shader
+        glGetShaderiv(computeShaders[position], GL_COMPILE_STATUS, &result);
+        if (result != GL_TRUE)
+        {
+            cerr << "Erro compiling compute shader: " << computeShaderPaths[position] << endl;
+            glGetShaderiv(computeShaders[position], GL_INFO_LOG_LENGTH, &infoLogLength);
+            char * computeShaderErrorMessage = new char[infoLogLength];
+            glGetShaderInfoLog(computeShaders[position], infoLogLength, NULL, &computeShaderErrorMessage[0]);
+            fprintf(stdout, "\n%s", &computeShaderErrorMessage[0]);
+            delete [] computeShaderErrorMessage;
+        }
+        #ifdef TUCANODEBUG
+        else
+        {
+            if (computeShaderPaths[position].empty())
+            {
+                cout << "Compiled compute shader from string without errors : " << shaderName.c_str() << endl;
+            }
             else
             {
-                if (computeShaderPaths[position].empty())
-                {
-                    cout << "Compiled compute shader from string without errors : " << shaderName.c_str() << endl;
-                }
-                else
-                {
-                    cout << "Compiled compute shader without errors : " << computeShaderPaths[position] << endl;
-                }
+                cout << "Compiled compute shader without errors : " << computeShaderPaths[position] << endl;
             }
-            #endif
+        }
+        #endif
 
-            glAttachShader(shaderProgram, computeShaders[position]);
+        glAttachShader(shaderProgram, computeShaders[position]);
 
-            #ifdef TUCANODEBUG
-            Misc::errorCheckFunc(__FILE__, __LINE__, "error loading compute shader code");
-            #endif
-
-            position++;
-        }
+        #ifdef TUCANODEBUG
+        Misc::errorCheckFunc(__FILE__, __LINE__, "error loading compute shader code");
+        #endif
     }
 
 
@@ -1019,14 +1567,34 @@ public:
      *
      * This feature enables runtime editing of the shader codes.
      * After saving the text file after editing, the reload applies changes immediately.
+     * Shaders initialized from strings have no files to read, and are left unchanged.
      */
     void reloadShaders (void)
     {
+        if (!hasSourceFiles())
+        {
+            cerr << "Warning: " << shaderName << " was not loaded from files, nothing to reload" << endl;
+            return;
+        }
 
         #ifdef TUCANODEBUG
         cout << "reloading shaders" << endl;
         #endif
 
+        // locations may change after relinking, cache is filled again by linkProgram
+        uniform_locations.clear();
+
+        // a program loaded from the binary cache has no shader objects, build it again from the files
+        if (loaded_from_cache)
+        {
+            glState.forgetProgram(shaderProgram);
+            DeletionQueue::Instance().retire(DeletionQueue::PROGRAM, shaderProgram);
+            shaderProgram = 0;
+            loaded_from_cache = false;
+            initialize();
+            return;
+        }
+
         if(vertexShader != 0)
         {
             glDetachShader(shaderProgram, vertexShader);
@@ -1072,10 +1640,103 @@ public:
      * @brief Enables the shader program for usage.
      *
      * After enabling a shader any OpenGL draw call will use it for rendering.
+     * The call is skipped if the program is already in use.
+     * Memory barriers recorded by dispatches of other programs are issued here, before the program can read their results.
+     * When profiling, a zone is opened for this program inside the current pass (see Profiler).
      */
     void bind (void)
     {
-        glUseProgram(shaderProgram);
+        if (gpuProfiler.isEnabled())
+        {
+            gpuProfiler.programBound(shaderProgram, shaderName);
+        }
+        glState.flushBarriersForProgram(shaderProgram);
+        glState.useProgram(shaderProgram);
+    }
+
+    /**
+     * @brief Runs the compute shader with the given number of work groups.
+     *
+     * The given barriers are only recorded, and issued in a single call before the first consumer: a draw, an indirect
+     * dispatch, a CPU read, or the bind of another program (see GLState::addBarrier). Consecutive dispatches of this
+     * program are therefore not separated by barriers, when a dispatch reads the results of the previous one of the
+     * same program call glState.flushBarriers() between them. Use 0 when nothing reads the results.
+     * @param x Number of work groups in x.
+     * @param y Number of work groups in y.
+     * @param z Number of work groups in z.
+     * @param barriers Barrier bits needed by the consumers of this dispatch (default is GL_SHADER_STORAGE_BARRIER_BIT).
+     */
+    void dispatch (GLuint x, GLuint y = 1, GLuint z = 1, GLbitfield barriers = GL_SHADER_STORAGE_BARRIER_BIT)
+    {
+        bind();
+        glDispatchCompute(x, y, z);
+        glState.addBarrier(barriers, shaderProgram);
+    }
+
+    /**
+     * @brief Runs the compute shader with enough work groups to cover a number of invocations.
+     *
+     * The number of groups is rounded up using the local size declared in the shader, which
+     * should then discard the invocations out of range.
+     * @param nx Number of invocations in x.
+     * @param ny Number of invocations in y.
+     * @param nz Number of invocations in z.
+     * @param barriers Barrier bits needed by the consumers of this dispatch.
+     */
+    void dispatchThreads (GLuint nx, GLuint ny = 1, GLuint nz = 1, GLbitfield barriers = GL_SHADER_STORAGE_BARRIER_BIT)
+    {
+        Eigen::Vector3i local = getWorkGroupSize();
+        dispatch((nx + local[0] - 1) / local[0], (ny + local[1] - 1) / local[1], (nz + local[2] - 1) / local[2], barriers);
+    }
+
+    /**
+     * @brief Runs the compute shader with the number of work groups read from a buffer.
+     *
+     * The buffer holds three GLuint (x, y, z) at the given offset. If it was written by a shader,
+     * that dispatch must have recorded GL_COMMAND_BARRIER_BIT, all pending barriers are issued before reading it.
+     * @param buffer Buffer with the dispatch parameters.
+     * @param offset Offset in bytes, multiple of four.
+     * @param barriers Barrier bits needed by the consumers of this dispatch.
+     */
+    void dispatchIndirect (Buffer& buffer, GLintptr offset = 0, GLbitfield barriers = GL_SHADER_STORAGE_BARRIER_BIT)
+    {
+        bind();
+        glState.flushBarriers();
+        buffer.bind(GL_DISPATCH_INDIRECT_BUFFER);
+        glDispatchComputeIndirect(offset);
+        buffer.unbind(GL_DISPATCH_INDIRECT_BUFFER);
+        glState.addBarrier(barriers, shaderProgram);
+    }
+
+    /**
+     * @brief Returns the local work group size declared in the compute shader.
+     * @return Local size in x, y and z.
+     */
+    Eigen::Vector3i getWorkGroupSize (void) const
+    {
+        GLint size[3] = {1, 1, 1};
+        glGetProgramiv(shaderProgram, GL_COMPUTE_WORK_GROUP_SIZE, size);
+        return Eigen::Vector3i(size[0], size[1], size[2]);
+    }
+
+    /**
+     * @brief Assigns a binding point to a shader storage block of this program.
+     *
+     * Usually the binding is declared in the shader (layout(binding = N)), this is needed only otherwise.
+     * @param name Block name.
+     * @param binding Shader storage binding point.
+     */
+    void setStorageBlockBinding (const GLchar* name, GLuint binding)
+    {
+        GLuint index = glGetProgramResourceIndex(shaderProgram, GL_SHADER_STORAGE_BLOCK, name);
+        if (index == GL_INVALID_INDEX)
+        {
+            #ifdef TUCANODEBUG
+            cerr << "Warning: storage block " << name << " not active in shader " << shaderName << endl;
+            #endif
+            return;
+        }
+        glShaderStorageBlockBinding(shaderProgram, index, binding);
     }
 
     /**
@@ -1083,7 +1744,7 @@ public:
      */
     void unbind (void)
     {
-        glUseProgram(0);
+        glState.useProgram(0);
     }
 
     /**
@@ -1091,11 +1752,110 @@ public:
      */
     void deleteShaders (void)
     {
-        glDetachShader(shaderProgram, fragmentShader);
-        glDetachShader(shaderProgram, vertexShader);
-        glDeleteShader(fragmentShader);
-        glDeleteShader(vertexShader);
-        glDeleteProgram(shaderProgram);
+        if (shaderProgram)
+        {
+            if (fragmentShader)
+            {
+                glDetachShader(shaderProgram, fragmentShader);
+            }
+            if (vertexShader)
+            {
+                glDetachShader(shaderProgram, vertexShader);
+            }
+        }
+        DeletionQueue& queue = DeletionQueue::Instance();
+        queue.retire(DeletionQueue::SHADER, fragmentShader);
+        queue.retire(DeletionQueue::SHADER, vertexShader);
+        queue.retire(DeletionQueue::SHADER, geometryShader);
+        queue.retire(DeletionQueue::SHADER, tessellationControlShader);
+        queue.retire(DeletionQueue::SHADER, tessellationEvaluationShader);
+        for (unsigned int i = 0; i < computeShaders.size(); ++i)
+        {
+            queue.retire(DeletionQueue::SHADER, computeShaders[i]);
+        }
+        if (shaderProgram)
+        {
+            glState.forgetProgram(shaderProgram);
+            queue.retire(DeletionQueue::PROGRAM, shaderProgram);
+        }
+        // deleting twice (ex. deleteShaders then the destructor) is harmless
+        vertexShader = 0; fragmentShader = 0; geometryShader = 0; tessellationControlShader = 0; tessellationEvaluationShader = 0; shaderProgram = 0;
+        computeShaders.clear();
+        uniform_locations.clear();
+        uniform_blocks.clear();
+        pending_link = false;
+    }
+
+    /**
+     * @brief Returns the paths of all shader files of the program.
+     * @return Paths of the stages loaded from files.
+     */
+    vector<string> getSourcePaths (void) const
+    {
+        vector<string> paths;
+        const string* stage_paths[5] = {&vertexShaderPath, &tessellationControlShaderPath, &tessellationEvaluationShaderPath,
+                                        &geometryShaderPath, &fragmentShaderPath};
+        for (int i = 0; i < 5; ++i)
+        {
+            if (!stage_paths[i]->empty())
+            {
+                paths.push_back(*stage_paths[i]);
+            }
+        }
+        paths.insert(paths.end(), computeShaderPaths.begin(), computeShaderPaths.end());
+        return paths;
+    }
+
+    /**
+     * @brief Copies the shader file paths of another shader, so it can be built from the same files.
+     * @param other Shader to copy the paths from.
+     */
+    void copyPaths (const Shader& other)
+    {
+        vertexShaderPath = other.vertexShaderPath;
+        tessellationControlShaderPath = other.tessellationControlShaderPath;
+        tessellationEvaluationShaderPath = other.tessellationEvaluationShaderPath;
+        geometryShaderPath = other.geometryShaderPath;
+        fragmentShaderPath = other.fragmentShaderPath;
+        computeShaderPaths = other.computeShaderPaths;
+    }
+
+    /**
+     * @brief Exchanges the GL program (and its shaders) with another shader.
+     *
+     * Used to replace a program atomically by one built separately, the old program is
+     * deleted together with the other shader.
+     * @param other Shader to exchange programs with.
+     */
+    void swapProgram (Shader& other)
+    {
+        std::swap(vertexShader, other.vertexShader);
+        std::swap(tessellationControlShader, other.tessellationControlShader);
+        std::swap(tessellationEvaluationShader, other.tessellationEvaluationShader);
+        std::swap(geometryShader, other.geometryShader);
+        std::swap(fragmentShader, other.fragmentShader);
+        std::swap(computeShaders, other.computeShaders);
+        std::swap(shaderProgram, other.shaderProgram);
+        std::swap(uniform_locations, other.uniform_locations);
+        std::swap(uniform_blocks, other.uniform_blocks);
+        std::swap(loaded_from_cache, other.loaded_from_cache);
+        std::swap(pending_link, other.pending_link);
+        std::swap(pending_cache_file, other.pending_cache_file);
+    }
+
+    /**
+     * @brief Returns wether the program is linked. Blocks if the link is still in progress.
+     * @return True if linked without errors.
+     */
+    bool isLinked (void) const
+    {
+        if (shaderProgram == 0)
+        {
+            return false;
+        }
+        GLint result = GL_FALSE;
+        glGetProgramiv(shaderProgram, GL_LINK_STATUS, &result);
+        return result == GL_TRUE;
     }
 
 	/**
@@ -1124,12 +1884,23 @@ public:
 
     /**
      * Given the name of a uniform used inside the shader, returns it's location.
+     *
+     * Locations are read from the cache filled after linking. Only names that are not in the cache
+     * (ex. a specific array element) are queried from the driver, and the result is cached as well.
+     * For the tightest loops, query the location once and use the setUniform overloads that receive a location.
      * @param name Name of the uniform variable in shader.
-     * @return The uniform location.
+     * @return The uniform location, or -1 if the uniform is not active in the program.
      */
     GLint getUniformLocation (const GLchar* name) const
     {
-        return glGetUniformLocation(shaderProgram, name);
+        unordered_map<string, GLint>::const_iterator it = uniform_locations.find(name);
+        if (it != uniform_locations.end())
+        {
+            return it->second;
+        }
+        GLint location = glGetUniformLocation(shaderProgram, name);
+        uniform_locations[name] = location;
+        return location;
     }
 
     /**
@@ -1142,6 +1913,338 @@ public:
         return glGetAttribLocation(shaderProgram, name);
     }
 
+private:
+
+    ///Copy Constructor
+    Shader (Shader const&);
+
+    ///Assignment Operation
+    Shader& operator= (Shader const&);
+
+    /**
+     * @brief Storage of the global uniform block bindings, shared by all shaders.
+     */
+    static map<string, GLuint>& globalBlockBindings (void)
+    {
+        static map<string, GLuint> bindings = {{"CameraBlock", TUCANO_CAMERA_BLOCK_BINDING}};
+        return bindings;
+    }
+
+    /**
+     * @brief Storage of the program binary cache directory, shared by all shaders.
+     */
+    static string& programCacheDirectory (void)
+    {
+        static string dir;
+        return dir;
+    }
+
+    /**
+     * @brief Returns wether the program cache should be used.
+     */
+    static bool isProgramCacheEnabled (void)
+    {
+        return !programCacheDirectory().empty() && isProgramBinarySupported();
+    }
+
+    /**
+     * @brief Returns wether the shader was initialized from files, which reloadShaders can read again.
+     */
+    bool hasSourceFiles (void) const
+    {
+        if (!vertexShaderPath.empty() || !tessellationControlShaderPath.empty() || !tessellationEvaluationShaderPath.empty() ||
+            !geometryShaderPath.empty() || !fragmentShaderPath.empty())
+        {
+            return true;
+        }
+        for (unsigned int i = 0; i < computeShaderPaths.size(); ++i)
+        {
+            if (!computeShaderPaths[i].empty())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Reads a whole shader file into a string.
+     * @param path File path.
+     * @return File contents, empty if the file could not be opened.
+     */
+    static string readShaderFile (const string& path)
+    {
+        ifstream file(path.c_str(), std::ios::in | std::ios::binary);
+        if (!file.is_open())
+        {
+            cout << "warning: no shader file found : " << path << endl;
+            return "";
+        }
+        ostringstream code;
+        code << file.rdbuf();
+        return code.str();
+    }
+
+    /**
+     * @brief Sets the source of a shader, starts its compilation and attaches it, without checking the status.
+     * @param shader Shader handle.
+     * @param code Shader code.
+     */
+    void submitShader (GLuint shader, const string& code)
+    {
+        char const * sourcePointer = code.c_str();
+        glShaderSource(shader, 1, &sourcePointer, NULL);
+        glCompileShader(shader);
+        glAttachShader(shaderProgram, shader);
+    }
+
+    /**
+     * @brief Checks the compile status of a shader and prints its log if there are errors.
+     * @param shader Shader handle, 0 if the stage is not used.
+     * @param path Path of the shader file, used in the message.
+     * @return True if there is no shader or it compiled without errors.
+     */
+    bool checkCompileStatus (GLuint shader, const string& path)
+    {
+        if (shader == 0)
+        {
+            return true;
+        }
+        GLint result = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+        if (result != GL_TRUE)
+        {
+            cerr << "Erro compiling shader: " << path << endl;
+            int infoLogLength = 0;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+            char * errorMessage = new char[infoLogLength+1];
+            errorMessage[0] = 0;
+            glGetShaderInfoLog(shader, infoLogLength, NULL, &errorMessage[0]);
+            fprintf(stdout, "\n%s", &errorMessage[0]);
+            delete [] errorMessage;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Accumulates a string into a 64 bit FNV-1a hash.
+     * @param str String to hash.
+     * @param hash Current hash value.
+     * @return Updated hash value.
+     */
+    static unsigned long long hashString (const string& str, unsigned long long hash)
+    {
+        for (unsigned int i = 0; i < str.size(); ++i)
+        {
+            hash ^= (unsigned char)str[i];
+            hash *= 1099511628211ULL;
+        }
+        // separator, so that moving code between stages changes the hash
+        hash ^= 0xff;
+        hash *= 1099511628211ULL;
+        return hash;
+    }
+
+    /**
+     * @brief Returns the cache file for a set of stage sources on the current renderer and driver.
+     * @param sources Source of each stage (empty for absent stages).
+     * @return Path of the cache file.
+     */
+    string programCacheFile (const vector<string>& sources) const
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        hash = hashString((const char*)glGetString(GL_RENDERER), hash);
+        hash = hashString((const char*)glGetString(GL_VERSION), hash);
+        for (unsigned int i = 0; i < sources.size(); ++i)
+        {
+            hash = hashString(sources[i], hash);
+        }
+
+        ostringstream file;
+        file << programCacheDirectory() << "/" << std::hex << hash << ".bin";
+        return file.str();
+    }
+
+    /**
+     * @brief Creates the program from a cached binary.
+     * @param cache_file Path of the cache file.
+     * @return True if the binary was found and accepted by the driver, false otherwise.
+     */
+    bool loadProgramBinary (const string& cache_file)
+    {
+        ifstream file(cache_file.c_str(), std::ios::in | std::ios::binary);
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        file.seekg(0, std::ios::end);
+        std::streamoff file_size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        if (file_size <= (std::streamoff)sizeof(GLenum))
+        {
+            return false;
+        }
+
+        GLenum binary_format = 0;
+        vector<char> binary (file_size - sizeof(GLenum));
+        file.read((char*)&binary_format, sizeof(GLenum));
+        file.read(&binary[0], binary.size());
+        if (!file)
+        {
+            return false;
+        }
+
+        shaderProgram = glCreateProgram();
+        glProgramBinary(shaderProgram, binary_format, &binary[0], binary.size());
+
+        GLint result = GL_FALSE;
+        glGetProgramiv(shaderProgram, GL_LINK_STATUS, &result);
+        if (result != GL_TRUE)
+        {
+            // driver update or corrupt file, compile again and overwrite it
+            #ifdef TUCANODEBUG
+            cout << "Program binary rejected : " << cache_file << endl;
+            #endif
+            DeletionQueue::Instance().retire(DeletionQueue::PROGRAM, shaderProgram);
+            shaderProgram = 0;
+            return false;
+        }
+
+        #ifdef TUCANODEBUG
+        cout << "Loaded program binary : " << shaderName << " from " << cache_file << endl;
+        #endif
+
+        loaded_from_cache = true;
+        cacheUniformLocations();
+        labelObjects();
+        return true;
+    }
+
+    /**
+     * @brief Stores the linked program binary in the cache.
+     * @param cache_file Path of the cache file.
+     */
+    void storeProgramBinary (const string& cache_file)
+    {
+        GLint length = 0;
+        glGetProgramiv(shaderProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+        {
+            return;
+        }
+
+        GLenum binary_format = 0;
+        vector<char> binary (length);
+        glGetProgramBinary(shaderProgram, length, NULL, &binary_format, &binary[0]);
+
+        ofstream file(cache_file.c_str(), std::ios::out | std::ios::binary);
+        if (!file.is_open())
+        {
+            cerr << "Warning: could not write program cache file " << cache_file << endl;
+            return;
+        }
+        file.write((const char*)&binary_format, sizeof(GLenum));
+        file.write(&binary[0], binary.size());
+    }
+
+public:
+
+    //============================ Uniform Blocks ==========================================================
+
+    /**
+     * @brief Assigns a binding point to every program (linked afterwards) declaring a block with the given name.
+     *
+     * The shared camera block is registered by default (see CameraBlock).
+     * @param name Block name.
+     * @param binding Uniform buffer binding point.
+     */
+    static void setGlobalBlockBinding (const string& name, GLuint binding)
+    {
+        globalBlockBindings()[name] = binding;
+    }
+
+    /**
+     * @brief Returns the index of a uniform block.
+     * @param name Block name.
+     * @return Block index, or -1 if the block is not active in the program.
+     */
+    GLint getUniformBlockIndex (const string& name) const
+    {
+        unordered_map<string, GLuint>::const_iterator it = uniform_blocks.find(name);
+        if (it == uniform_blocks.end())
+        {
+            return -1;
+        }
+        return it->second;
+    }
+
+    /**
+     * @brief Returns the size of a uniform block, as laid out by the driver.
+     * @param name Block name.
+     * @return Block size in bytes, or 0 if the block is not active.
+     */
+    GLint getUniformBlockSize (const string& name) const
+    {
+        GLint index = getUniformBlockIndex(name);
+        if (index == -1)
+        {
+            return 0;
+        }
+        GLint size = 0;
+        glGetActiveUniformBlockiv(shaderProgram, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        return size;
+    }
+
+    /**
+     * @brief Returns the offset of a uniform inside its block, to write blocks not declared as std140.
+     * @param name Uniform name, as declared inside the block.
+     * @return Offset in bytes, or -1 if the uniform is not active.
+     */
+    GLint getUniformOffset (const GLchar* name) const
+    {
+        GLuint index = GL_INVALID_INDEX;
+        glGetUniformIndices(shaderProgram, 1, &name, &index);
+        if (index == GL_INVALID_INDEX)
+        {
+            return -1;
+        }
+        GLint offset = -1;
+        glGetActiveUniformsiv(shaderProgram, 1, &index, GL_UNIFORM_OFFSET, &offset);
+        return offset;
+    }
+
+    /**
+     * @brief Assigns a binding point to a uniform block of this program.
+     * @param name Block name.
+     * @param binding Uniform buffer binding point.
+     */
+    void setUniformBlockBinding (const string& name, GLuint binding)
+    {
+        GLint index = getUniformBlockIndex(name);
+        if (index == -1)
+        {
+            #ifdef TUCANODEBUG
+            cerr << "Warning: uniform block " << name << " not active in shader " << shaderName << endl;
+            #endif
+            return;
+        }
+        glUniformBlockBinding(shaderProgram, index, binding);
+    }
+
+    /**
+     * @brief Binds a uniform buffer to a block of this program through the given binding point.
+     * @param name Block name.
+     * @param buffer Uniform buffer with the block values.
+     * @param binding Uniform buffer binding point.
+     */
+    void setUniformBlock (const string& name, UniformBuffer& buffer, GLuint binding)
+    {
+        setUniformBlockBinding(name, binding);
+        buffer.bindBase(binding);
+    }
+
     //============================Uniforms Setters==========================================================
 
 
@@ -1863,6 +2966,58 @@ public:
         setUniform(location, affine_matrix);
     }
 
+    //============================ Bindless Texture Handles ==========================================================
+
+    /**
+     * @brief Sets a sampler uniform from a bindless texture handle given its location (ARB_bindless_texture).
+     *
+     * The handle must be resident, see Texture::makeResident. Named apart from setUniform so that other 64-bit
+     * integers (ex. size_t) are not silently taken as handles.
+     * @param location Location handle of uniform variable.
+     * @param handle 64-bit bindless texture handle.
+     */
+    void setUniformHandle (GLint location, GLuint64 handle)
+    {
+        glUniformHandleui64ARB(location, handle);
+    }
+
+    /**
+     * @brief Sets a sampler uniform from a bindless texture handle given its name in the shader (ARB_bindless_texture).
+     * @param name Name of uniform variable in the shader code.
+     * @param handle 64-bit bindless texture handle.
+     */
+    void setUniformHandle (const GLchar* name, GLuint64 handle)
+    {
+        GLint location = getUniformLocation(name);
+        setUniformHandle(location, handle);
+    }
+
+    /**
+     * @brief Sets an array of sampler uniforms from bindless texture handles given its location.
+     *
+     * Handles are plain 64-bit values, so they can also be written directly into UBO or SSBO arrays
+     * (as uvec2 or as sampler types with the bindless layout qualifiers).
+     * @param location Location handle of uniform variable.
+     * @param handles Array of 64-bit bindless texture handles.
+     * @param count Number of handles in the array.
+     */
+    void setUniformHandle (GLint location, const GLuint64* handles, GLsizei count)
+    {
+        glUniformHandleui64vARB(location, count, handles);
+    }
+
+    /**
+     * @brief Sets an array of sampler uniforms from bindless texture handles given its name in the shader.
+     * @param name Name of uniform variable in the shader code.
+     * @param handles Array of 64-bit bindless texture handles.
+     * @param count Number of handles in the array.
+     */
+    void setUniformHandle (const GLchar* name, const GLuint64* handles, GLsizei count)
+    {
+        GLint location = getUniformLocation(name);
+        setUniformHandle(location, handles, count);
+    }
+
 
 };
 
@@ -0,0 +1,201 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SHADERCOMPILER__
+#define __SHADERCOMPILER__
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <GL/glew.h>
+
+#include "Shader.hpp"
+
+namespace Tucano
+{
+
+/**
+ * @brief Compiles a batch of shaders without serializing the driver.
+ *
+ * Shaders are queued with add and compiled with compileAll. The shader files are read by worker threads,
+ * and each program is submitted from the GL thread as soon as its sources are read, without querying
+ * the compile status. With KHR_parallel_shader_compile the driver compiles and links in its own threads,
+ * and poll can be called every frame until all programs are ready.
+ */
+class ShaderCompiler {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     * @param threads Number of threads reading shader files, 0 to use the number of hardware threads.
+     */
+    ShaderCompiler (int threads = 0) : num_threads(threads)
+    {
+        if (num_threads <= 0)
+        {
+            num_threads = std::thread::hardware_concurrency();
+        }
+        if (num_threads <= 0)
+        {
+            num_threads = 2;
+        }
+    }
+
+    /**
+     * @brief Queues a shader to be compiled by the next compileAll.
+     *
+     * The shader files must be set (ex. with load), and the shader must outlive the compilation.
+     * @param shader Shader to compile.
+     */
+    void add (Shader* shader)
+    {
+        queued.push_back(shader);
+    }
+
+    /**
+     * @brief Reads and submits all queued shaders. Must be called from the GL thread.
+     *
+     * Returns once every program was handed to the driver, which is usually long before they are
+     * compiled. The submitted shaders are then polled by poll and waitAll.
+     */
+    void compileAll (void)
+    {
+        if (queued.empty())
+        {
+            return;
+        }
+
+        std::vector<std::vector<std::string> > sources (queued.size());
+        std::vector<bool> read (queued.size(), false);
+        std::atomic<unsigned int> next (0);
+        std::mutex read_mutex;
+        std::condition_variable read_done;
+
+        std::vector<std::thread> readers;
+        int workers = std::min(num_threads, (int)queued.size());
+        for (int t = 0; t < workers; ++t)
+        {
+            readers.push_back(std::thread([&] ()
+            {
+                unsigned int i;
+                while ((i = next++) < queued.size())
+                {
+                    std::vector<std::string> code = queued[i]->readSources();
+                    std::lock_guard<std::mutex> lock (read_mutex);
+                    sources[i].swap(code);
+                    read[i] = true;
+                    read_done.notify_all();
+                }
+            }));
+        }
+
+        // submit in order while the remaining files are being read
+        for (unsigned int i = 0; i < queued.size(); ++i)
+        {
+            {
+                std::unique_lock<std::mutex> lock (read_mutex);
+                while (!read[i])
+                {
+                    read_done.wait(lock);
+                }
+            }
+            queued[i]->submitSources(sources[i]);
+            compiling.push_back(queued[i]);
+        }
+
+        for (unsigned int t = 0; t < readers.size(); ++t)
+        {
+            readers[t].join();
+        }
+        queued.clear();
+    }
+
+    /**
+     * @brief Checks the submitted shaders without blocking, finishing the ones the driver is done with.
+     * @return Number of shaders still compiling.
+     */
+    int poll (void)
+    {
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < compiling.size(); ++i)
+        {
+            if (!compiling[i]->isReady())
+            {
+                compiling[kept++] = compiling[i];
+            }
+        }
+        compiling.resize(kept);
+        return compiling.size();
+    }
+
+    /**
+     * @brief Blocks until all submitted shaders are compiled and linked.
+     */
+    void waitAll (void)
+    {
+        for (unsigned int i = 0; i < compiling.size(); ++i)
+        {
+            compiling[i]->finishLink();
+        }
+        compiling.clear();
+    }
+
+    /**
+     * @brief Returns the number of shaders queued or still compiling.
+     */
+    int getNumPending (void) const
+    {
+        return queued.size() + compiling.size();
+    }
+
+    /**
+     * @brief Sets the number of threads the driver may use to compile shaders (KHR_parallel_shader_compile).
+     * @param count Number of threads, 0xFFFFFFFF lets the driver decide.
+     */
+    static void setMaxCompilerThreads (GLuint count)
+    {
+        if (Shader::isParallelCompileSupported())
+        {
+            glMaxShaderCompilerThreadsKHR(count);
+        }
+    }
+
+private:
+
+    /// Shaders waiting for compileAll.
+    std::vector<Shader*> queued;
+
+    /// Shaders submitted and not yet ready.
+    std::vector<Shader*> compiling;
+
+    /// Number of threads reading files.
+    int num_threads;
+};
+
+}
+
+#endif
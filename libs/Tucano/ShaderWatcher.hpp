@@ -0,0 +1,430 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SHADERWATCHER__
+#define __SHADERWATCHER__
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "Shader.hpp"
+
+namespace Tucano
+{
+
+/**
+ * @brief Watches the files of a set of shaders and reloads them when they change.
+ *
+ * A background thread waits for file changes (inotify on Linux, modification times on other systems),
+ * and reads the new sources of the modified shaders. The GL thread calls update once per frame, which
+ * submits the new program without waiting for the driver and, only once it links successfully, swaps it
+ * into the watched shader. If the new code has errors they are reported and the previous program is kept.
+ *
+ * Uniform values and transform feedback varyings are not carried over to the reloaded program.
+ */
+class ShaderWatcher {
+
+public:
+
+    /**
+     * @brief Default constructor, starts the watcher thread.
+     */
+    ShaderWatcher (void) : stop(false), notify_fd(-1)
+    {
+        #ifdef __linux__
+        notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (notify_fd < 0)
+        {
+            std::cerr << "Warning: inotify not available, polling shader files" << std::endl;
+        }
+        #endif
+        worker = std::thread(&ShaderWatcher::run, this);
+    }
+
+    /**
+     * @brief Default destructor, stops the thread and discards reloads not yet swapped.
+     */
+    ~ShaderWatcher (void)
+    {
+        {
+            std::lock_guard<std::mutex> lock (watch_mutex);
+            stop = true;
+        }
+        worker.join();
+        #ifdef __linux__
+        if (notify_fd >= 0)
+        {
+            close(notify_fd);
+        }
+        #endif
+        for (unsigned int i = 0; i < staged.size(); ++i)
+        {
+            delete staged[i].second;
+        }
+    }
+
+    /**
+     * @brief Starts watching the files of a shader.
+     *
+     * The shader must have been initialized from files and must be unwatched before it is destroyed.
+     * @param shader Shader to watch.
+     */
+    void watch (Shader* shader)
+    {
+        std::vector<std::string> paths = shader->getSourcePaths();
+        std::lock_guard<std::mutex> lock (watch_mutex);
+        for (unsigned int i = 0; i < paths.size(); ++i)
+        {
+            WatchedFile& file = files[paths[i]];
+            file.shaders.insert(shader);
+            file.mtime = modificationTime(paths[i]);
+            addDirectoryWatch(directoryOf(paths[i]));
+        }
+    }
+
+    /**
+     * @brief Stops watching a shader, pending reloads of it are discarded.
+     * @param shader Shader to stop watching.
+     */
+    void unwatch (Shader* shader)
+    {
+        {
+            // waits if the thread is reading the shader files
+            std::lock_guard<std::mutex> read_lock (read_mutex);
+            std::lock_guard<std::mutex> lock (watch_mutex);
+            for (std::map<std::string, WatchedFile>::iterator it = files.begin(); it != files.end(); )
+            {
+                it->second.shaders.erase(shader);
+                if (it->second.shaders.empty())
+                    files.erase(it++);
+                else
+                    ++it;
+            }
+            dirty.erase(shader);
+            for (unsigned int i = 0; i < reloaded.size(); )
+            {
+                if (reloaded[i].first == shader)
+                    reloaded.erase(reloaded.begin() + i);
+                else
+                    ++i;
+            }
+        }
+        for (unsigned int i = 0; i < staged.size(); )
+        {
+            if (staged[i].first == shader)
+            {
+                delete staged[i].second;
+                staged.erase(staged.begin() + i);
+            }
+            else
+                ++i;
+        }
+    }
+
+    /**
+     * @brief Submits the reloaded shaders and swaps the ones that finished linking. Must be called from the GL thread.
+     *
+     * Never waits for file reads and, with KHR_parallel_shader_compile, never waits for the driver either.
+     * @return Number of shaders replaced in this call.
+     */
+    int update (void)
+    {
+        std::vector<std::pair<Shader*, std::vector<std::string> > > to_submit;
+        {
+            std::lock_guard<std::mutex> lock (watch_mutex);
+            to_submit.swap(reloaded);
+        }
+
+        for (unsigned int i = 0; i < to_submit.size(); ++i)
+        {
+            Shader* shader = to_submit[i].first;
+            // a newer version supersedes a reload still compiling
+            for (unsigned int j = 0; j < staged.size(); ++j)
+            {
+                if (staged[j].first == shader)
+                {
+                    delete staged[j].second;
+                    staged.erase(staged.begin() + j);
+                    break;
+                }
+            }
+            Shader* staging = new Shader(shader->getShaderName());
+            staging->copyPaths(*shader);
+            staging->submitSources(to_submit[i].second);
+            staged.push_back(std::make_pair(shader, staging));
+        }
+
+        int swapped = 0;
+        for (unsigned int i = 0; i < staged.size(); )
+        {
+            Shader* staging = staged[i].second;
+            if (!staging->isReady())
+            {
+                ++i;
+                continue;
+            }
+            if (staging->isLinked())
+            {
+                staged[i].first->swapProgram(*staging);
+                ++swapped;
+                #ifdef TUCANODEBUG
+                std::cout << "reloaded shader : " << staged[i].first->getShaderName() << std::endl;
+                #endif
+            }
+            else
+            {
+                std::cerr << "Warning: keeping previous program for shader " << staged[i].first->getShaderName() << std::endl;
+            }
+            // deletes the old program, or the failed one
+            delete staging;
+            staged.erase(staged.begin() + i);
+        }
+        return swapped;
+    }
+
+private:
+
+    /// One watched file.
+    struct WatchedFile
+    {
+        /// Shaders using the file.
+        std::set<Shader*> shaders;
+        /// Last modification time, used when inotify is not available.
+        time_t mtime;
+        WatchedFile (void) : mtime(0) {}
+    };
+
+    ///Copy Constructor
+    ShaderWatcher (ShaderWatcher const&);
+
+    ///Assignment Operation
+    ShaderWatcher& operator= (ShaderWatcher const&);
+
+    /**
+     * @brief Returns the directory part of a path.
+     */
+    static std::string directoryOf (const std::string& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        if (slash == std::string::npos)
+            return ".";
+        return path.substr(0, slash);
+    }
+
+    /**
+     * @brief Returns the modification time of a file, 0 if it does not exist.
+     */
+    static time_t modificationTime (const std::string& path)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return 0;
+        return info.st_mtime;
+    }
+
+    /**
+     * @brief Watches a directory, if not watched yet. Editors usually save by replacing the file,
+     * so the directory is watched instead of the file itself. Must hold watch_mutex.
+     */
+    void addDirectoryWatch (const std::string& dir)
+    {
+        #ifdef __linux__
+        if (notify_fd < 0)
+            return;
+        for (std::map<int, std::string>::iterator it = directories.begin(); it != directories.end(); ++it)
+        {
+            if (it->second == dir)
+                return;
+        }
+        int wd = inotify_add_watch(notify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0)
+        {
+            std::cerr << "Warning: could not watch directory " << dir << std::endl;
+            return;
+        }
+        directories[wd] = dir;
+        #endif
+    }
+
+    /**
+     * @brief Marks the shaders using a file as dirty. Must hold watch_mutex.
+     */
+    void markChanged (const std::string& path)
+    {
+        std::map<std::string, WatchedFile>::iterator it = files.find(path);
+        if (it != files.end())
+        {
+            dirty.insert(it->second.shaders.begin(), it->second.shaders.end());
+        }
+    }
+
+    /**
+     * @brief Reads the events available in the inotify descriptor. Must hold watch_mutex.
+     * @return True if any event was read.
+     */
+    bool readEvents (void)
+    {
+        bool any = false;
+        #ifdef __linux__
+        char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        ssize_t length;
+        while ((length = read(notify_fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* ptr = buffer; ptr < buffer + length; )
+            {
+                const struct inotify_event* event = (const struct inotify_event*)ptr;
+                ptr += sizeof(struct inotify_event) + event->len;
+                std::map<int, std::string>::iterator dir = directories.find(event->wd);
+                if (dir == directories.end() || event->len == 0)
+                    continue;
+                std::string name (event->name);
+                markChanged(dir->second == "." ? name : dir->second + "/" + name);
+                any = true;
+            }
+        }
+        #endif
+        return any;
+    }
+
+    /**
+     * @brief Compares the modification times of all files. Must hold watch_mutex.
+     */
+    void pollFiles (void)
+    {
+        for (std::map<std::string, WatchedFile>::iterator it = files.begin(); it != files.end(); ++it)
+        {
+            time_t mtime = modificationTime(it->first);
+            if (mtime != it->second.mtime)
+            {
+                it->second.mtime = mtime;
+                dirty.insert(it->second.shaders.begin(), it->second.shaders.end());
+            }
+        }
+    }
+
+    /**
+     * @brief Watcher thread loop.
+     *
+     * Changed shaders are only read once no event arrived for one wait period, since editors
+     * usually generate several events per save.
+     */
+    void run (void)
+    {
+        while (true)
+        {
+            bool events = false;
+            #ifdef __linux__
+            if (notify_fd >= 0)
+            {
+                struct pollfd pfd;
+                pfd.fd = notify_fd;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                events = ::poll(&pfd, 1, 100) > 0;
+            }
+            else
+            #endif
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(250));
+            }
+
+            std::set<Shader*> to_read;
+            std::vector<std::pair<Shader*, std::vector<std::string> > > read_sources;
+
+            // held while reading, so a shader cannot be unwatched (and destroyed) in the meantime
+            std::lock_guard<std::mutex> read_lock (read_mutex);
+            {
+                std::lock_guard<std::mutex> lock (watch_mutex);
+                if (stop)
+                    return;
+                if (events)
+                {
+                    readEvents();
+                    continue;
+                }
+                if (notify_fd < 0)
+                {
+                    pollFiles();
+                }
+                to_read.swap(dirty);
+            }
+
+            for (std::set<Shader*>::iterator it = to_read.begin(); it != to_read.end(); ++it)
+            {
+                read_sources.push_back(std::make_pair(*it, (*it)->readSources()));
+            }
+
+            if (!read_sources.empty())
+            {
+                std::lock_guard<std::mutex> lock (watch_mutex);
+                reloaded.insert(reloaded.end(), read_sources.begin(), read_sources.end());
+            }
+        }
+    }
+
+    /// Watched files by path.
+    std::map<std::string, WatchedFile> files;
+
+    /// Watched directories by inotify watch descriptor.
+    std::map<int, std::string> directories;
+
+    /// Shaders with changed files, waiting to be read.
+    std::set<Shader*> dirty;
+
+    /// Shaders read by the thread, waiting for update.
+    std::vector<std::pair<Shader*, std::vector<std::string> > > reloaded;
+
+    /// Programs being compiled by update, paired with the shader they replace. Only used by the GL thread.
+    std::vector<std::pair<Shader*, Shader*> > staged;
+
+    /// Guards everything but staged.
+    std::mutex watch_mutex;
+
+    /// Held by the thread while it reads shader files.
+    std::mutex read_mutex;
+
+    /// Flag to stop the thread.
+    bool stop;
+
+    /// Inotify descriptor, -1 if files are polled.
+    int notify_fd;
+
+    /// Watcher thread, declared last so it starts after all members are initialized.
+    std::thread worker;
+};
+
+}
+
+#endif
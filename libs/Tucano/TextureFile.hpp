@@ -0,0 +1,792 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TEXTUREFILE__
+#define __TEXTUREFILE__
+
+#include "GLTexture.hpp"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Tucano
+{
+
+/**
+ * @brief A read-only memory mapping of a whole file.
+ *
+ * Pages are read by the OS when first accessed, so only the parts of the file that are used are loaded.
+ */
+class MappedFile {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    MappedFile (void) : data(NULL), size(0)
+    {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#endif
+    }
+
+    /**
+     * @brief Default destructor, unmaps the file.
+     */
+    ~MappedFile (void)
+    {
+        close();
+    }
+
+    /**
+     * @brief Maps a file.
+     * @param path File path.
+     * @return True if mapped.
+     */
+    bool open (const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file, &file_size);
+        size = (size_t)file_size.QuadPart;
+        mapping = size > 0 ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+        data = mapping ? (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            size = info.st_size;
+            void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            data = (mapped == MAP_FAILED) ? NULL : (const unsigned char*)mapped;
+        }
+        // the mapping stays valid after the descriptor is closed
+        ::close(fd);
+#endif
+        if (!data)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Unmaps the file.
+     */
+    void close (void)
+    {
+#ifdef _WIN32
+        if (data)
+        {
+            UnmapViewOfFile(data);
+        }
+        if (mapping)
+        {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(file);
+        }
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#else
+        if (data)
+        {
+            munmap((void*)data, size);
+        }
+#endif
+        data = NULL;
+        size = 0;
+    }
+
+    /**
+     * @brief Asks the OS to start reading a range of the file, so later accesses do not block on the disk.
+     * @param offset First byte.
+     * @param bytes Number of bytes.
+     */
+    void prefetch (size_t offset, size_t bytes) const
+    {
+#ifndef _WIN32
+        if (!data || offset >= size)
+        {
+            return;
+        }
+        // madvise needs a page aligned address
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t start = offset - offset % page;
+        madvise((void*)(data + start), std::min(size, offset + bytes) - start, MADV_WILLNEED);
+#endif
+    }
+
+    /**
+     * @brief Returns the mapped memory, NULL if no file is mapped.
+     */
+    const unsigned char* getData (void) const
+    {
+        return data;
+    }
+
+    /**
+     * @brief Returns the file size in bytes.
+     */
+    size_t getSize (void) const
+    {
+        return size;
+    }
+
+private:
+
+    ///Copy Constructor
+    MappedFile (MappedFile const&);
+
+    ///Assignment Operation
+    MappedFile& operator= (MappedFile const&);
+
+    /// Mapped memory.
+    const unsigned char* data;
+
+    /// File size in bytes.
+    size_t size;
+
+#ifdef _WIN32
+    /// File and mapping handles.
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+/**
+ * @brief A compressed texture file (KTX2 or DDS) with precomputed mipmaps.
+ *
+ * The file is memory mapped and only its header is parsed on load. Uploads pass pointers into the mapping
+ * straight to glCompressedTexSubImage*, so the texel data is never copied by the application, and only the
+ * pages of the uploaded levels are read from the disk.
+ *
+ *     Tucano::TextureFile file;
+ *     Tucano::Texture texture;
+ *     if (file.load("albedo.ktx2"))
+ *         file.upload(texture);
+ *
+ * Supported are BC1-BC7 and ASTC (LDR) formats in 2D, 2D array and cube map textures. Supercompressed KTX2
+ * files (BasisLZ, zstd, zlib) must be transcoded first (ex. with ktx transcode or ktx decode).
+ */
+class TextureFile {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    TextureFile (void) : target(GL_TEXTURE_2D), internal_format(GL_NONE), width(0), height(0), num_levels(0), num_layers(1), num_faces(1) {}
+
+    /**
+     * @brief Maps a file and parses its header. The format is detected from the file contents.
+     * @param path Path of a .ktx2 or .dds file.
+     * @return True if the file could be read and has a supported format.
+     */
+    bool load (const std::string& path)
+    {
+        close();
+        if (!file.open(path))
+        {
+            cerr << "Warning: could not open texture file " << path << endl;
+            return false;
+        }
+        static const unsigned char ktx2_identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+        bool parsed = false;
+        if (file.getSize() >= 12 && memcmp(file.getData(), ktx2_identifier, 12) == 0)
+        {
+            parsed = parseKTX2();
+        }
+        else if (file.getSize() >= 4 && memcmp(file.getData(), "DDS ", 4) == 0)
+        {
+            parsed = parseDDS();
+        }
+        else
+        {
+            cerr << "Warning: unknown texture file format" << endl;
+        }
+        if (!parsed)
+        {
+            cerr << "Warning: could not load texture file " << path << endl;
+            close();
+        }
+        return parsed;
+    }
+
+    /**
+     * @brief Unmaps the file.
+     */
+    void close (void)
+    {
+        file.close();
+        image_offsets.clear();
+        image_sizes.clear();
+        internal_format = GL_NONE;
+        width = height = num_levels = 0;
+        num_layers = num_faces = 1;
+    }
+
+    /**
+     * @brief Creates the texture storage for a range of levels and uploads them.
+     * @param texture Texture to (re)create, its first level is file level first_level.
+     * @param first_level Finest file level to upload, to skip the largest levels.
+     * @return Texture ID, 0 on failure.
+     */
+    GLuint upload (Texture& texture, int first_level = 0) const
+    {
+        if (!isLoaded())
+        {
+            return 0;
+        }
+        first_level = std::max(0, std::min(first_level, num_levels - 1));
+        GLuint id = texture.createCompressed(target, internal_format, getWidth(first_level), getHeight(first_level),
+                                             num_levels - first_level, num_layers);
+        if (id == 0)
+        {
+            return 0;
+        }
+        for (int level = first_level; level < num_levels; ++level)
+        {
+            uploadLevel(texture, level, level - first_level);
+        }
+        return id;
+    }
+
+    /**
+     * @brief Uploads all layers (or faces) of one level into an existing texture.
+     * @param texture Texture created by upload, with the same format.
+     * @param level File level.
+     * @param texture_level Texture level it is stored at.
+     */
+    void uploadLevel (Texture& texture, int level, int texture_level) const
+    {
+        int w = getWidth(level), h = getHeight(level);
+        int images = num_layers * num_faces;
+        if (target == GL_TEXTURE_2D)
+        {
+            texture.updateCompressed(texture_level, 0, 0, w, h, getImage(level, 0), image_sizes[level]);
+        }
+        else if (isContiguous(level))
+        {
+            texture.updateCompressed(texture_level, 0, 0, 0, w, h, images, getImage(level, 0), image_sizes[level] * images);
+        }
+        else
+        {
+            // DDS stores the mipmap chains one layer after the other
+            for (int i = 0; i < images; ++i)
+            {
+                texture.updateCompressed(texture_level, 0, 0, i, w, h, 1, getImage(level, i), image_sizes[level]);
+            }
+        }
+    }
+
+    /**
+     * @brief Asks the OS to start reading a level from the disk, ex. some frames before uploading it.
+     * @param level File level.
+     */
+    void prefetchLevel (int level) const
+    {
+        int images = num_layers * num_faces;
+        if (isContiguous(level))
+        {
+            file.prefetch(image_offsets[level * images], image_sizes[level] * images);
+            return;
+        }
+        for (int i = 0; i < images; ++i)
+        {
+            file.prefetch(image_offsets[level * images + i], image_sizes[level]);
+        }
+    }
+
+    /**
+     * @brief Returns a pointer to the compressed blocks of one image, inside the mapped file.
+     * @param level File level.
+     * @param image Layer, or face of a cube map.
+     */
+    const unsigned char* getImage (int level, int image) const
+    {
+        return file.getData() + image_offsets[level * num_layers * num_faces + image];
+    }
+
+    /**
+     * @brief Returns the size in bytes of one image of a level.
+     * @param level File level.
+     */
+    size_t getImageSize (int level) const
+    {
+        return image_sizes[level];
+    }
+
+    /**
+     * @brief Returns the size in bytes of a level with all its layers and faces.
+     * @param level File level.
+     */
+    size_t getLevelSize (int level) const
+    {
+        return image_sizes[level] * num_layers * num_faces;
+    }
+
+    /**
+     * @brief Returns wether a file is loaded.
+     */
+    bool isLoaded (void) const
+    {
+        return num_levels > 0;
+    }
+
+    /**
+     * @brief Returns the texture target (GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP).
+     */
+    GLenum getTarget (void) const
+    {
+        return target;
+    }
+
+    /**
+     * @brief Returns the compressed internal format.
+     */
+    GLenum getInternalFormat (void) const
+    {
+        return internal_format;
+    }
+
+    /**
+     * @brief Returns the width of a level.
+     * @param level File level.
+     */
+    int getWidth (int level = 0) const
+    {
+        return level < 31 ? std::max(width >> level, 1) : 1;
+    }
+
+    /**
+     * @brief Returns the height of a level.
+     * @param level File level.
+     */
+    int getHeight (int level = 0) const
+    {
+        return level < 31 ? std::max(height >> level, 1) : 1;
+    }
+
+    /**
+     * @brief Returns the number of levels stored in the file.
+     */
+    int getLevels (void) const
+    {
+        return num_levels;
+    }
+
+    /**
+     * @brief Returns the number of array layers, 1 for non array textures.
+     */
+    int getLayers (void) const
+    {
+        return num_layers;
+    }
+
+    /**
+     * @brief Returns the number of faces, 6 for cube maps and 1 otherwise.
+     */
+    int getFaces (void) const
+    {
+        return num_faces;
+    }
+
+private:
+
+    ///Copy Constructor
+    TextureFile (TextureFile const&);
+
+    ///Assignment Operation
+    TextureFile& operator= (TextureFile const&);
+
+    /**
+     * @brief Reads a little endian integer from the file.
+     */
+    template <class T>
+    T read (size_t offset) const
+    {
+        T value;
+        memcpy(&value, file.getData() + offset, sizeof(T));
+        return value;
+    }
+
+    /**
+     * @brief Returns wether the images of a level follow each other in the file.
+     */
+    bool isContiguous (int level) const
+    {
+        int images = num_layers * num_faces;
+        for (int i = 1; i < images; ++i)
+        {
+            if (image_offsets[level * images + i] != image_offsets[level * images + i - 1] + image_sizes[level])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Checks the format and dimensions read from a header, and computes the image sizes.
+     *
+     * The header values are not trusted: the dimensions and number of levels must be valid, and all images
+     * together must fit in the file, so a corrupted header can not make the index overflow.
+     * @return True if the texture is supported.
+     */
+    bool setDescription (GLenum format, uint32_t w, uint32_t h, uint32_t levels, uint32_t layers, uint32_t faces)
+    {
+        // largest side keeping the size of a compressed image in a GLsizei
+        const uint32_t max_size = 32768;
+        if (format == GL_NONE)
+        {
+            cerr << "Warning: texture file format is not a supported compressed format" << endl;
+            return false;
+        }
+        if (w == 0 || h == 0 || (faces != 1 && faces != 6) || (faces == 6 && layers > 1))
+        {
+            cerr << "Warning: texture file is not a 2D, 2D array or cube map texture" << endl;
+            return false;
+        }
+        if (w > max_size || h > max_size)
+        {
+            cerr << "Warning: texture file is larger than " << max_size << " texels" << endl;
+            return false;
+        }
+        uint32_t max_levels = 1;
+        while ((std::max(w, h) >> max_levels) > 0)
+        {
+            ++max_levels;
+        }
+        if (levels > max_levels)
+        {
+            cerr << "Warning: texture file has more levels than its size allows" << endl;
+            return false;
+        }
+        internal_format = format;
+        width = w;
+        height = h;
+        num_levels = std::max(levels, 1u);
+        num_faces = faces;
+        image_sizes.resize(num_levels);
+        for (int level = 0; level < num_levels; ++level)
+        {
+            image_sizes[level] = Texture::getCompressedSize(internal_format, getWidth(level), getHeight(level));
+        }
+        // a level of all layers is uploaded at once, its size must also fit in a GLsizei
+        uint64_t images = (uint64_t)std::max(layers, 1u) * faces;
+        uint64_t total = 0;
+        for (int level = 0; level < num_levels; ++level)
+        {
+            uint64_t level_size = images * image_sizes[level];
+            total += level_size;
+            if (level_size > (uint64_t)std::numeric_limits<GLsizei>::max() || total > file.getSize())
+            {
+                cerr << "Warning: texture file is truncated" << endl;
+                return false;
+            }
+        }
+        num_layers = std::max(layers, 1u);
+        target = faces == 6 ? GL_TEXTURE_CUBE_MAP : (layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D);
+        image_offsets.resize(num_levels * num_layers * num_faces);
+        return true;
+    }
+
+    /**
+     * @brief Checks that all images lie inside the file.
+     */
+    bool checkBounds (void) const
+    {
+        int images = num_layers * num_faces;
+        for (int level = 0; level < num_levels; ++level)
+        {
+            for (int i = 0; i < images; ++i)
+            {
+                size_t offset = image_offsets[level * images + i];
+                if (offset > file.getSize() || image_sizes[level] > file.getSize() - offset)
+                {
+                    cerr << "Warning: texture file is truncated" << endl;
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Parses a KTX2 header and level index.
+     *
+     * Level 0 is the largest, and each level holds its layers, each with its faces, one after the other.
+     */
+    bool parseKTX2 (void)
+    {
+        const size_t level_index = 80;
+        if (file.getSize() < level_index)
+        {
+            return false;
+        }
+        uint32_t vk_format = read<uint32_t>(12);
+        uint32_t w = read<uint32_t>(20), h = read<uint32_t>(24), d = read<uint32_t>(28);
+        uint32_t layers = read<uint32_t>(32), faces = read<uint32_t>(36), levels = read<uint32_t>(40);
+        uint32_t supercompression = read<uint32_t>(44);
+        if (supercompression != 0)
+        {
+            cerr << "Warning: supercompressed KTX2 files are not supported, transcode them first" << endl;
+            return false;
+        }
+        if (d > 0)
+        {
+            cerr << "Warning: 3D textures are not supported" << endl;
+            return false;
+        }
+        if (!setDescription(formatFromVulkan(vk_format), w, h, levels, layers, faces))
+        {
+            return false;
+        }
+        if (file.getSize() < level_index + 24 * num_levels)
+        {
+            return false;
+        }
+        int images = num_layers * num_faces;
+        for (int level = 0; level < num_levels; ++level)
+        {
+            uint64_t offset = read<uint64_t>(level_index + 24 * level);
+            uint64_t length = read<uint64_t>(level_index + 24 * level + 8);
+            if (offset > file.getSize() || length > file.getSize() - offset)
+            {
+                cerr << "Warning: texture file is truncated" << endl;
+                return false;
+            }
+            if (length < image_sizes[level] * images)
+            {
+                cerr << "Warning: KTX2 level " << level << " is smaller than expected" << endl;
+                return false;
+            }
+            for (int i = 0; i < images; ++i)
+            {
+                image_offsets[level * images + i] = offset + i * image_sizes[level];
+            }
+        }
+        return checkBounds();
+    }
+
+    /**
+     * @brief Parses a DDS header, with or without the DX10 extension.
+     *
+     * Each layer (or face) holds its full mipmap chain, one layer after the other.
+     */
+    bool parseDDS (void)
+    {
+        const size_t header = 4;
+        if (file.getSize() < header + 124 || read<uint32_t>(header) != 124)
+        {
+            return false;
+        }
+        uint32_t flags = read<uint32_t>(header + 4);
+        uint32_t h = read<uint32_t>(header + 8), w = read<uint32_t>(header + 12);
+        uint32_t levels = (flags & 0x20000) ? read<uint32_t>(header + 24) : 1;
+        uint32_t four_cc = read<uint32_t>(header + 80);
+        uint32_t caps2 = read<uint32_t>(header + 108);
+        int faces = (caps2 & 0x200) ? 6 : 1;
+        int layers = 1;
+        size_t data_offset = header + 124;
+        GLenum format = GL_NONE;
+
+        if (four_cc == fourCC("DX10"))
+        {
+            if (file.getSize() < data_offset + 20)
+            {
+                return false;
+            }
+            format = formatFromDXGI(read<uint32_t>(data_offset));
+            layers = read<uint32_t>(data_offset + 12);
+            if (read<uint32_t>(data_offset + 8) & 0x4)
+            {
+                faces = 6;
+            }
+            data_offset += 20;
+        }
+        else
+        {
+            format = formatFromFourCC(four_cc);
+        }
+        if (caps2 & 0x200000)
+        {
+            cerr << "Warning: 3D textures are not supported" << endl;
+            return false;
+        }
+        if (!setDescription(format, w, h, levels, layers, faces))
+        {
+            return false;
+        }
+        size_t offset = data_offset;
+        int images = num_layers * num_faces;
+        for (int i = 0; i < images; ++i)
+        {
+            for (int level = 0; level < num_levels; ++level)
+            {
+                image_offsets[level * images + i] = offset;
+                offset += image_sizes[level];
+            }
+        }
+        return checkBounds();
+    }
+
+    /**
+     * @brief Returns the four character code of a string.
+     */
+    static uint32_t fourCC (const char* code)
+    {
+        return (uint32_t)code[0] | ((uint32_t)code[1] << 8) | ((uint32_t)code[2] << 16) | ((uint32_t)code[3] << 24);
+    }
+
+    /**
+     * @brief Maps a legacy DDS four character code to a GL format.
+     */
+    static GLenum formatFromFourCC (uint32_t code)
+    {
+        if (code == fourCC("DXT1")) return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        if (code == fourCC("DXT2") || code == fourCC("DXT3")) return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        if (code == fourCC("DXT4") || code == fourCC("DXT5")) return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        if (code == fourCC("ATI1") || code == fourCC("BC4U")) return GL_COMPRESSED_RED_RGTC1;
+        if (code == fourCC("BC4S")) return GL_COMPRESSED_SIGNED_RED_RGTC1;
+        if (code == fourCC("ATI2") || code == fourCC("BC5U")) return GL_COMPRESSED_RG_RGTC2;
+        if (code == fourCC("BC5S")) return GL_COMPRESSED_SIGNED_RG_RGTC2;
+        return GL_NONE;
+    }
+
+    /**
+     * @brief Maps a DXGI_FORMAT of the DDS DX10 header to a GL format.
+     */
+    static GLenum formatFromDXGI (uint32_t dxgi)
+    {
+        switch (dxgi)
+        {
+            case 71: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            case 72: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+            case 74: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+            case 75: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+            case 77: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case 78: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+            case 80: return GL_COMPRESSED_RED_RGTC1;
+            case 81: return GL_COMPRESSED_SIGNED_RED_RGTC1;
+            case 83: return GL_COMPRESSED_RG_RGTC2;
+            case 84: return GL_COMPRESSED_SIGNED_RG_RGTC2;
+            case 95: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+            case 96: return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT;
+            case 98: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+            case 99: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+            default: return GL_NONE;
+        }
+    }
+
+    /**
+     * @brief Maps a VkFormat of a KTX2 header to a GL format.
+     */
+    static GLenum formatFromVulkan (uint32_t vk)
+    {
+        switch (vk)
+        {
+            case 131: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case 132: return GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+            case 133: return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            case 134: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT;
+            case 135: return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+            case 136: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT;
+            case 137: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case 138: return GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+            case 139: return GL_COMPRESSED_RED_RGTC1;
+            case 140: return GL_COMPRESSED_SIGNED_RED_RGTC1;
+            case 141: return GL_COMPRESSED_RG_RGTC2;
+            case 142: return GL_COMPRESSED_SIGNED_RG_RGTC2;
+            case 143: return GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT;
+            case 144: return GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT;
+            case 145: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+            case 146: return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+            default: break;
+        }
+        // VK_FORMAT_ASTC_4x4_UNORM_BLOCK to VK_FORMAT_ASTC_12x12_SRGB_BLOCK alternate linear and sRGB,
+        // in the same block size order as the GL formats
+        if (vk >= 157 && vk <= 184)
+        {
+            GLenum base = ((vk - 157) % 2 == 0) ? GL_COMPRESSED_RGBA_ASTC_4x4_KHR : GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4_KHR;
+            return base + (vk - 157) / 2;
+        }
+        return GL_NONE;
+    }
+
+    /// Mapped file.
+    MappedFile file;
+
+    /// Texture target.
+    GLenum target;
+
+    /// Compressed internal format.
+    GLenum internal_format;
+
+    /// Dimensions of level 0.
+    int width, height;
+
+    /// Number of levels, layers and faces.
+    int num_levels, num_layers, num_faces;
+
+    /// Offset in the file of each image, indexed by level * layers * faces + layer * faces + face.
+    std::vector<size_t> image_offsets;
+
+    /// Size in bytes of one image of each level.
+    std::vector<size_t> image_sizes;
+};
+
+}
+
+#endif
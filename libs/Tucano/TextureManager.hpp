@@ -7,8 +7,10 @@
 #include <set>
 #include <iostream>
 #include <vector>
+#include <unordered_map>
 #include <GL/glew.h>
 
+#include "GLState.hpp"
 
 using namespace std;
 
@@ -20,6 +22,11 @@ namespace Tucano
  *
  * When a texture is binded, this singleton will search for the first free slot to allocate it.
  * This removes the burden of managing texture units inside the program.
+ *
+ * Free units are kept in a linked list, and used units in a second list ordered by last use,
+ * so allocating, freeing and evicting a unit are constant time operations.
+ * A reverse map from texture ID to units makes unbinding by ID constant time as well.
+ * When all units are taken, the least recently used unit is evicted (unless eviction is disabled).
  */
 class TextureManager {
 
@@ -32,44 +39,79 @@ class TextureManager {
 	//I need to test the texturemanager in an application that uses more than one texture unit at a time.
 	public:
 
-	/** 
-     * @brief Returns the unique instance. If no instace exists, it will create one (only once).
+	/**
+     * @brief Returns the instance of the calling thread. If no instace exists, it will create one (only once).
+     *
+     * Each thread has its own instance, texture units belong to the context current in that thread.
      */
     static TextureManager &Instance (void)
     {
-      static TextureManager _instance;
+      static thread_local TextureManager _instance;
       return _instance;
     }
 
 	/**
      * @brief Binds a texture to a unit given by the user.
+     *
+     * Binding a texture to the unit it already occupies is not sent to the driver.
      */
     void bindTexture (GLenum texType, GLuint texID, int texture_unit)
     {
-        glActiveTexture(GL_TEXTURE0 + texture_unit);
-        glBindTexture(texType, texID);
-
-        if (used_units[texture_unit] != -1)
+        bool was_free = (used_units[texture_unit] == -1);
+        if (used_units[texture_unit] != -1 && used_units[texture_unit] != (GLint)texID)
         {
             cerr << "WARNING: Texture unit already used. Replacing bound texture..." << endl;
+            eraseTextureUnit(used_units[texture_unit], texture_unit);
         }
 
+        glState.bindTexture(texture_unit, texType, texID);
+
+        if (used_units[texture_unit] != (GLint)texID)
+        {
+            texture_units.insert(make_pair(texID, texture_unit));
+        }
         used_units[texture_unit] = texID;
+        touchUnit(texture_unit, was_free);
     }
 
 	/**
      * @brief Binds a texture to the first free texture unit and returns the allocated unit.
-     * @return Allocated unit, or -1 if no free unit is available.
+     *
+     * If the texture is already bound to a unit, that unit is reused.
+     * If no unit is free, the least recently used unit is evicted.
+     * @return Allocated unit, or -1 if no free unit is available and eviction is disabled.
      */
     int bindTexture (GLenum texType, GLuint texID)
     {
+        unordered_multimap<GLuint, int>::iterator it = texture_units.find(texID);
+        if (it != texture_units.end())
+        {
+            int unit = it->second;
+            glState.bindTexture(unit, texType, texID);
+            touchUnit(unit, false);
+            return unit;
+        }
+
         int free_unit = getAvailableUnit();
 
+        if (free_unit == -1 && eviction_enabled && lru_head != -1)
+        {
+            free_unit = lru_head;
+            #ifdef TUCANODEBUG
+            cerr << "Warning: no free texture unit, evicting texture " << used_units[free_unit] << " from unit " << free_unit << endl;
+            #endif
+            eraseTextureUnit(used_units[free_unit], free_unit);
+            used_units[free_unit] = -1;
+            detachUnit(free_unit, lru_head, lru_tail);
+            prependUnit(free_unit, free_head, free_tail);
+        }
+
         if (free_unit != -1)
         {
-            glActiveTexture(GL_TEXTURE0 + free_unit);
-            glBindTexture(texType, texID);
+            glState.bindTexture(free_unit, texType, texID);
             used_units[free_unit] = texID;
+            texture_units.insert(make_pair(texID, free_unit));
+            touchUnit(free_unit, true);
         }
         else
         {
@@ -84,46 +126,158 @@ class TextureManager {
      */
     int getAvailableUnit (void)
     {
-        for (int i = 0; i < max_texture_units; ++i)
+        return free_head;
+    }
+
+    /**
+     * @brief Sets one unit as unavaiable. in case something besides the texture manager has bound a texture to it.
+     *
+     * The unit is never allocated nor evicted by the manager after this call.
+     * @param unit Texture unit to reserve.
+     */
+	void setUnavailableUnit (int unit)
+    {
+        if (reserved_units[unit])
         {
-          if (used_units[i] == -1)
-          {
-            return i;
-          }
+            return;
         }
-        return -1;
+        if (used_units[unit] == -1)
+        {
+            detachUnit(unit, free_head, free_tail);
+        }
+        else
+        {
+            detachUnit(unit, lru_head, lru_tail);
+            eraseTextureUnit(used_units[unit], unit);
+            used_units[unit] = -1;
+        }
+        reserved_units[unit] = true;
+        // whoever reserved the unit binds to it without the shadow knowing
+        glState.invalidate();
     }
 
     /**
-     * @brief Sets one unit as unavaiable. in case something besides the texture manager has bound a texture to it.
+     * @brief Enables or disables evicting the least recently used unit when no unit is free.
+     * @param flag True to enable eviction (default), false to return -1 when no unit is free.
      */
-	void setUnavailableUnit(int unit);
+    void setEvictionEnabled (bool flag)
+    {
+        eviction_enabled = flag;
+    }
 
-	///Unbinds the texture from the specific texture unit.
+    /**
+     * @brief Unbinds whatever texture is bound to the specific texture unit.
+     *
+     * A unit returned by bindTexture becomes invalid when it is evicted, and may then hold another texture,
+     * prefer unbindTexture with the texture ID, or unbindTextureID, to unbind a given texture.
+     * @param texType Texture type
+     * @param texture_unit Texture unit
+     */
     void unbindTexture(GLenum texType, int texture_unit)
     {
-        glActiveTexture(GL_TEXTURE0 + texture_unit);
-        glBindTexture(texType, 0);
-        used_units[texture_unit] = -1;
+        glState.bindTexture(texture_unit, texType, 0);
+        if (used_units[texture_unit] != -1)
+        {
+            eraseTextureUnit(used_units[texture_unit], texture_unit);
+            releaseUnit(texture_unit);
+        }
+    }
+
+    /**
+     * @brief Unbinds a texture from the unit bindTexture returned, if it still holds that texture.
+     *
+     * If the unit was evicted and reused meanwhile, the texture now bound to it is left untouched.
+     * @param texType Texture type
+     * @param texture_unit Texture unit
+     * @param texID The ID handler of the texture bound to the unit
+     * @return True if the texture was unbound, false if the unit no longer holds it.
+     */
+    bool unbindTexture(GLenum texType, int texture_unit, GLuint texID)
+    {
+        if (texture_unit < 0 || texture_unit >= (int)used_units.size() || used_units[texture_unit] != (int)texID)
+        {
+            return false;
+        }
+        unbindTexture(texType, texture_unit);
+        return true;
     }
 
     /**
      * @brief Unbinds a texture with given ID
-     * Searches texture unit vector for the texture and frees unit
+     * Looks up the units holding the texture in the reverse map and frees them
      * @param texType Texture type
      * @param texID The ID handler to given texture
      */
     void unbindTextureID(GLenum texType, GLuint texID)
     {
-       for (int i = 0; i < max_texture_units; ++i) {
-         if (used_units[i] == (GLint)texID) {
-             glActiveTexture(GL_TEXTURE0 + i);
-             glBindTexture(texType, 0);
-             used_units[i] = -1;
-         }
-       }
+        pair<unordered_multimap<GLuint, int>::iterator, unordered_multimap<GLuint, int>::iterator> range = texture_units.equal_range(texID);
+        for (unordered_multimap<GLuint, int>::iterator it = range.first; it != range.second; ++it)
+        {
+            glState.bindTexture(it->second, texType, 0);
+            releaseUnit(it->second);
+        }
+        texture_units.erase(range.first, range.second);
    }
 
+    /**
+     * @brief Returns the unit a texture is bound to.
+     * @param texID The ID handler to given texture
+     * @return Texture unit, or -1 if texture is not bound by the manager.
+     */
+    int getTextureUnit (GLuint texID) const
+    {
+        unordered_multimap<GLuint, int>::const_iterator it = texture_units.find(texID);
+        if (it == texture_units.end())
+        {
+            return -1;
+        }
+        return it->second;
+    }
+
+    /**
+     * @brief Makes a bindless texture handle resident (ARB_bindless_texture).
+     *
+     * Resident handles are tracked, so making the same handle resident twice is not sent to the driver.
+     * @param handle 64-bit bindless texture handle.
+     */
+    void makeHandleResident (GLuint64 handle)
+    {
+        if (resident_handles.insert(handle).second)
+        {
+            glMakeTextureHandleResidentARB(handle);
+        }
+    }
+
+    /**
+     * @brief Makes a bindless texture handle non resident.
+     * @param handle 64-bit bindless texture handle.
+     */
+    void makeHandleNonResident (GLuint64 handle)
+    {
+        if (resident_handles.erase(handle) > 0)
+        {
+            glMakeTextureHandleNonResidentARB(handle);
+        }
+    }
+
+    /**
+     * @brief Returns wether a bindless texture handle is resident.
+     * @param handle 64-bit bindless texture handle.
+     * @return True if resident, false otherwise.
+     */
+    bool isHandleResident (GLuint64 handle) const
+    {
+        return resident_handles.find(handle) != resident_handles.end();
+    }
+
+    /**
+     * @brief Returns the number of resident bindless handles.
+     */
+    int getNumResidentHandles (void) const
+    {
+        return resident_handles.size();
+    }
+
 	//THAT'S SOMETHING IMPORTANT. SHOULDN'T REALLY I DELETE THE INSTANCE? WON'T THERE BE A MEMORY LEAKING THERE?
 	~TextureManager() {};
 
@@ -139,6 +293,20 @@ private:
 		for (int i = 0; i < max_texture_units; ++i) {
 			used_units.push_back(-1);
 		}
+
+        // all units start in the free list, in increasing order
+        unit_prev.resize(max_texture_units);
+        unit_next.resize(max_texture_units);
+        reserved_units.resize(max_texture_units, false);
+        for (int i = 0; i < max_texture_units; ++i) {
+            unit_prev[i] = i-1;
+            unit_next[i] = (i+1 < max_texture_units) ? i+1 : -1;
+        }
+        free_head = (max_texture_units > 0) ? 0 : -1;
+        free_tail = max_texture_units-1;
+        lru_head = -1;
+        lru_tail = -1;
+        eviction_enabled = true;
 	}
 
 	///Copy Constructor
@@ -147,6 +315,121 @@ private:
 	///Assignment Operation
 	TextureManager& operator=(TextureManager const&);
 
+    /**
+     * @brief Marks a unit as the most recently used one.
+     * @param unit Texture unit.
+     * @param was_free True if the unit was in the free list, false if it was already in use.
+     */
+    void touchUnit (int unit, bool was_free)
+    {
+        if (reserved_units[unit])
+        {
+            return;
+        }
+        if (was_free)
+        {
+            detachUnit(unit, free_head, free_tail);
+        }
+        else if (lru_tail == unit)
+        {
+            return;
+        }
+        else
+        {
+            detachUnit(unit, lru_head, lru_tail);
+        }
+        appendUnit(unit, lru_head, lru_tail);
+    }
+
+    /**
+     * @brief Moves a used unit back to the free list.
+     * @param unit Texture unit.
+     */
+    void releaseUnit (int unit)
+    {
+        used_units[unit] = -1;
+        if (reserved_units[unit])
+        {
+            return;
+        }
+        detachUnit(unit, lru_head, lru_tail);
+        prependUnit(unit, free_head, free_tail);
+    }
+
+    /**
+     * @brief Removes one (texture, unit) pair from the reverse map.
+     * @param texID Texture ID.
+     * @param unit Texture unit.
+     */
+    void eraseTextureUnit (GLuint texID, int unit)
+    {
+        pair<unordered_multimap<GLuint, int>::iterator, unordered_multimap<GLuint, int>::iterator> range = texture_units.equal_range(texID);
+        for (unordered_multimap<GLuint, int>::iterator it = range.first; it != range.second; ++it)
+        {
+            if (it->second == unit)
+            {
+                texture_units.erase(it);
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief Removes a unit from a list.
+     * @param unit Texture unit.
+     * @param head First unit of the list.
+     * @param tail Last unit of the list.
+     */
+    void detachUnit (int unit, int& head, int& tail)
+    {
+        if (unit_prev[unit] != -1)
+            unit_next[unit_prev[unit]] = unit_next[unit];
+        else
+            head = unit_next[unit];
+
+        if (unit_next[unit] != -1)
+            unit_prev[unit_next[unit]] = unit_prev[unit];
+        else
+            tail = unit_prev[unit];
+
+        unit_prev[unit] = -1;
+        unit_next[unit] = -1;
+    }
+
+    /**
+     * @brief Inserts a unit at the end of a list.
+     * @param unit Texture unit.
+     * @param head First unit of the list.
+     * @param tail Last unit of the list.
+     */
+    void appendUnit (int unit, int& head, int& tail)
+    {
+        unit_prev[unit] = tail;
+        unit_next[unit] = -1;
+        if (tail != -1)
+            unit_next[tail] = unit;
+        else
+            head = unit;
+        tail = unit;
+    }
+
+    /**
+     * @brief Inserts a unit at the beginning of a list.
+     * @param unit Texture unit.
+     * @param head First unit of the list.
+     * @param tail Last unit of the list.
+     */
+    void prependUnit (int unit, int& head, int& tail)
+    {
+        unit_next[unit] = head;
+        unit_prev[unit] = -1;
+        if (head != -1)
+            unit_prev[head] = unit;
+        else
+            tail = unit;
+        head = unit;
+    }
+
 	///Pointer to the instance of the Texture Manager object.
     static TextureManager* pInstance;
 
@@ -156,6 +439,36 @@ private:
 	/// Texture units in use. each slot holds the texture id or -1 if free
 	std::vector<int> used_units;
 
+    /// Reverse map from texture id to the units it is bound to.
+    unordered_multimap<GLuint, int> texture_units;
+
+    /// Previous unit in the list (free or used) each unit belongs to, -1 if first.
+    std::vector<int> unit_prev;
+
+    /// Next unit in the list (free or used) each unit belongs to, -1 if last.
+    std::vector<int> unit_next;
+
+    /// Units reserved with setUnavailableUnit, they are in no list.
+    std::vector<bool> reserved_units;
+
+    /// First free unit, -1 if none.
+    int free_head;
+
+    /// Last free unit.
+    int free_tail;
+
+    /// Least recently used unit, next one to be evicted.
+    int lru_head;
+
+    /// Most recently used unit.
+    int lru_tail;
+
+    /// Flag to evict the least recently used unit when no unit is free.
+    bool eviction_enabled;
+
+    /// Bindless texture handles currently resident.
+    std::set<GLuint64> resident_handles;
+
 };
 
 //Not sure why it is here.
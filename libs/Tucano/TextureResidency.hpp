@@ -0,0 +1,454 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TEXTURERESIDENCY__
+#define __TEXTURERESIDENCY__
+
+#include "TextureFile.hpp"
+#include "Camera.hpp"
+#include "BoundingBox3.hpp"
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+namespace Tucano
+{
+
+/**
+ * @brief Streams the mipmap levels of compressed textures in and out of GPU memory, as needed on screen.
+ *
+ * Each texture is a memory mapped TextureFile. Only its coarsest levels are uploaded when added, and every
+ * frame the user reports how large each texture appears on screen (request). update then chooses the
+ * finest level each texture needs, and:
+ *
+ * - streams missing levels in, coarse to fine, one level at a time within a per frame upload budget. The
+ *   storage is allocated down to the needed level, and GL_TEXTURE_BASE_LEVEL is clamped to the finest level
+ *   holding data, so the texture can be sampled while it is refined;
+ * - when the allocated memory exceeds the budget, evicts the levels the textures with most surplus do not need,
+ *   by recreating their storage without them.
+ *
+ *     Tucano::TextureResidency residency (256 << 20);
+ *     int albedo = residency.add("albedo.ktx2");
+ *     ...
+ *     residency.request(albedo, camera, mesh_bounds, viewport);
+ *     residency.update();
+ *     residency.getTexture(albedo).bind(0);
+ *
+ * Changing the allocated levels recreates the GL texture, so the texture must be bound (and its bindless handle
+ * queried) after update, and the sampling parameters are the ones given to add.
+ */
+class TextureResidency {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     * @param budget GPU memory budget in bytes for all textures.
+     * @param upload_budget Maximum bytes uploaded per frame.
+     */
+    TextureResidency (size_t budget = 512u << 20, size_t upload_budget = 16u << 20) :
+        memory_budget(budget), frame_upload_budget(upload_budget), min_size(64), lod_bias(0.0f), allocated_bytes(0) {}
+
+    /**
+     * @brief Adds a texture file and uploads its coarsest levels.
+     * @param path Path of a .ktx2 or .dds file.
+     * @param wrap Wrap mode for S and T.
+     * @param magfilter Mag Filter.
+     * @param minfilter Min Filter.
+     * @return Texture handle, -1 if the file could not be loaded.
+     */
+    int add (const std::string& path, GLenum wrap = GL_REPEAT, GLenum magfilter = GL_LINEAR, GLenum minfilter = GL_LINEAR_MIPMAP_LINEAR)
+    {
+        entries.emplace_back();
+        Entry& entry = entries.back();
+        if (!entry.file.load(path))
+        {
+            entries.pop_back();
+            return -1;
+        }
+        entry.wrap = wrap;
+        entry.magfilter = magfilter;
+        entry.minfilter = minfilter;
+
+        // coarsest levels always resident: all levels up to min_size
+        int levels = entry.file.getLevels();
+        entry.floor_level = 0;
+        while (entry.floor_level < levels - 1 && std::max(entry.file.getWidth(entry.floor_level), entry.file.getHeight(entry.floor_level)) > min_size)
+        {
+            ++entry.floor_level;
+        }
+        entry.wanted = entry.floor_level;
+        allocate(entry, entry.floor_level);
+        return entries.size() - 1;
+    }
+
+    /**
+     * @brief Returns the texture of a handle.
+     * @param handle Handle returned by add.
+     */
+    Texture& getTexture (int handle)
+    {
+        return entries[handle].texture;
+    }
+
+    /**
+     * @brief Reports the size a texture is displayed with this frame. The largest request of the frame is kept.
+     * @param handle Texture handle.
+     * @param screen_size Size on screen in pixels of the texture (of its whole [0,1] range), along its largest side.
+     */
+    void request (int handle, float screen_size)
+    {
+        entries[handle].requested = std::max(entries[handle].requested, screen_size);
+    }
+
+    /**
+     * @brief Reports the size of a texture from the screen projection of the bounding box of an object using it.
+     *
+     * Assumes the texture is mapped once over the object, scale the result with request otherwise.
+     * @param handle Texture handle.
+     * @param camera Camera the object is viewed with.
+     * @param box Object bounding box, in world coordinates.
+     * @param viewport Viewport [minX, minY, width, height].
+     */
+    void request (int handle, const Camera& camera, const BoundingBox3<float>& box, const Eigen::Vector4f& viewport)
+    {
+        request(handle, screenSize(camera, box, viewport));
+    }
+
+    /**
+     * @brief Streams levels in and out according to the requests of the frame, and clears the requests.
+     *
+     * Called once per frame, with the context current.
+     */
+    void update (void)
+    {
+        for (unsigned int i = 0; i < entries.size(); ++i)
+        {
+            Entry& entry = entries[i];
+            entry.wanted = wantedLevel(entry);
+            entry.requested = 0.0f;
+        }
+        size_t uploaded = 0;
+        evict(uploaded);
+        streamIn(uploaded);
+    }
+
+    /**
+     * @brief Returns the finest level of a texture holding data, as a level of its file.
+     * @param handle Texture handle.
+     */
+    int getResidentLevel (int handle) const
+    {
+        return entries[handle].resident;
+    }
+
+    /**
+     * @brief Returns the finest level of a texture needed by the last requests, as a level of its file.
+     * @param handle Texture handle.
+     */
+    int getWantedLevel (int handle) const
+    {
+        return entries[handle].wanted;
+    }
+
+    /**
+     * @brief Returns the GPU memory allocated by all textures in bytes.
+     */
+    size_t getAllocatedBytes (void) const
+    {
+        return allocated_bytes;
+    }
+
+    /**
+     * @brief Sets the GPU memory budget.
+     * @param bytes Budget in bytes.
+     */
+    void setBudget (size_t bytes)
+    {
+        memory_budget = bytes;
+    }
+
+    /**
+     * @brief Sets the maximum bytes uploaded per frame. Levels are uploaded whole, so a larger level takes a frame alone.
+     * @param bytes Upload budget in bytes.
+     */
+    void setUploadBudget (size_t bytes)
+    {
+        frame_upload_budget = bytes;
+    }
+
+    /**
+     * @brief Sets the level of detail bias, positive values use coarser levels.
+     * @param bias Bias in levels (default 0).
+     */
+    void setLodBias (float bias)
+    {
+        lod_bias = bias;
+    }
+
+    /**
+     * @brief Sets the size of the coarsest levels kept resident, applied to the textures added afterwards.
+     * @param size Largest side in texels (default 64).
+     */
+    void setMinResidentSize (int size)
+    {
+        min_size = std::max(size, 1);
+    }
+
+    /**
+     * @brief Returns the size in pixels, along its largest side, of the screen projection of a bounding box.
+     * @param camera Camera.
+     * @param box Bounding box, in world coordinates.
+     * @param viewport Viewport [minX, minY, width, height].
+     * @return Size in pixels, the largest viewport side if the box crosses the camera plane.
+     */
+    static float screenSize (const Camera& camera, const BoundingBox3<float>& box, const Eigen::Vector4f& viewport)
+    {
+        const Eigen::Matrix4f& view_projection = camera.getViewProjectionMatrix();
+        Eigen::Vector2f lo (std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+        Eigen::Vector2f hi = -lo;
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            Eigen::Vector4f point ((corner & 1) ? box.Max()[0] : box.Min()[0],
+                                   (corner & 2) ? box.Max()[1] : box.Min()[1],
+                                   (corner & 4) ? box.Max()[2] : box.Min()[2], 1.0f);
+            Eigen::Vector4f clip = view_projection * point;
+            if (clip[3] <= 0.0f)
+            {
+                return std::max(viewport[2], viewport[3]);
+            }
+            Eigen::Vector2f screen (viewport[2] * (clip[0] / clip[3] * 0.5f + 0.5f), viewport[3] * (clip[1] / clip[3] * 0.5f + 0.5f));
+            lo = lo.cwiseMin(screen);
+            hi = hi.cwiseMax(screen);
+        }
+        Eigen::Vector2f extent = hi - lo;
+        return std::min(std::max(extent[0], extent[1]), 4.0f * std::max(viewport[2], viewport[3]));
+    }
+
+private:
+
+    /// One streamed texture.
+    struct Entry
+    {
+        /// Mapped file with all levels.
+        TextureFile file;
+        /// GL texture, its level 0 is file level allocated.
+        Texture texture;
+        /// Finest file level with storage.
+        int allocated;
+        /// Finest file level holding data.
+        int resident;
+        /// Finest file level needed.
+        int wanted;
+        /// Coarsest file level needed, always resident.
+        int floor_level;
+        /// Largest screen size requested this frame.
+        float requested;
+        /// Sampling parameters.
+        GLenum wrap, magfilter, minfilter;
+        Entry (void) : allocated(0), resident(0), wanted(0), floor_level(0), requested(0.0f),
+                       wrap(GL_REPEAT), magfilter(GL_LINEAR), minfilter(GL_LINEAR_MIPMAP_LINEAR) {}
+    };
+
+    ///Copy Constructor
+    TextureResidency (TextureResidency const&);
+
+    ///Assignment Operation
+    TextureResidency& operator= (TextureResidency const&);
+
+    /**
+     * @brief Returns the finest level needed for the requested screen size.
+     */
+    int wantedLevel (const Entry& entry) const
+    {
+        if (entry.requested <= 0.0f)
+        {
+            return entry.floor_level;
+        }
+        float texels = std::max(entry.file.getWidth(), entry.file.getHeight());
+        int level = (int)std::floor(std::log2(texels / entry.requested) + lod_bias);
+        return std::max(0, std::min(level, entry.floor_level));
+    }
+
+    /**
+     * @brief Returns the GPU memory of the file levels from first_level to the coarsest.
+     */
+    static size_t levelsSize (const Entry& entry, int first_level)
+    {
+        size_t bytes = 0;
+        for (int level = first_level; level < entry.file.getLevels(); ++level)
+        {
+            bytes += entry.file.getLevelSize(level);
+        }
+        return bytes;
+    }
+
+    /**
+     * @brief Recreates the storage of a texture from a file level, and uploads the levels already resident.
+     * @return Uploaded bytes.
+     */
+    size_t allocate (Entry& entry, int first_level)
+    {
+        bool created = entry.texture.texID() != 0;
+        if (created)
+        {
+            allocated_bytes -= levelsSize(entry, entry.allocated);
+        }
+        // levels holding data: the resident ones that fit in the new storage, or the coarsest ones on creation
+        int resident = created ? std::max(entry.resident, first_level) : entry.floor_level;
+        const TextureFile& file = entry.file;
+        entry.texture.createCompressed(file.getTarget(), file.getInternalFormat(), file.getWidth(first_level), file.getHeight(first_level),
+                                       file.getLevels() - first_level, file.getLayers());
+        entry.allocated = first_level;
+        allocated_bytes += levelsSize(entry, first_level);
+
+        // data of the old storage comes again from the mapped file, the coarse levels are a fraction of the finest one
+        size_t uploaded = 0;
+        for (int level = resident; level < file.getLevels(); ++level)
+        {
+            file.uploadLevel(entry.texture, level, level - first_level);
+            uploaded += file.getLevelSize(level);
+        }
+        entry.resident = resident;
+        if (!entry.texture.isDSASupported())
+        {
+            glState.bindTexture(entry.texture.getTextureType(), entry.texture.texID());
+        }
+        entry.texture.setTexParametersMipMap(file.getLevels() - 1 - first_level, resident - first_level, entry.wrap, entry.wrap,
+                                             entry.magfilter, entry.minfilter, false);
+        if (!entry.texture.isDSASupported())
+        {
+            glState.bindTexture(entry.texture.getTextureType(), 0);
+        }
+        return uploaded;
+    }
+
+    /**
+     * @brief Frees the levels not needed by the textures with most surplus until the allocation fits the budget.
+     */
+    void evict (size_t& uploaded)
+    {
+        while (allocated_bytes > memory_budget && uploaded < frame_upload_budget)
+        {
+            Entry* victim = NULL;
+            int surplus = 0;
+            for (unsigned int i = 0; i < entries.size(); ++i)
+            {
+                int levels = entries[i].wanted - entries[i].allocated;
+                if (levels > surplus)
+                {
+                    surplus = levels;
+                    victim = &entries[i];
+                }
+            }
+            if (!victim)
+            {
+                break;
+            }
+            uploaded += allocate(*victim, victim->wanted);
+        }
+    }
+
+    /**
+     * @brief Uploads missing levels, one level per texture per pass and the largest deficits first, within the upload budget.
+     */
+    void streamIn (size_t& uploaded)
+    {
+        std::vector< std::pair<int, Entry*> > missing;
+        for (unsigned int i = 0; i < entries.size(); ++i)
+        {
+            if (entries[i].wanted < entries[i].resident)
+            {
+                missing.push_back(std::make_pair(entries[i].resident - entries[i].wanted, &entries[i]));
+            }
+        }
+        std::sort(missing.begin(), missing.end(),
+                  [] (const std::pair<int, Entry*>& a, const std::pair<int, Entry*>& b) { return a.first > b.first; });
+
+        bool progress = true;
+        while (progress && uploaded < frame_upload_budget)
+        {
+            progress = false;
+            for (unsigned int i = 0; i < missing.size() && uploaded < frame_upload_budget; ++i)
+            {
+                Entry& entry = *missing[i].second;
+                if (entry.wanted >= entry.resident)
+                {
+                    continue;
+                }
+                int level = entry.resident - 1;
+                // growing the storage first uploads again all the resident levels
+                bool grow = level < entry.allocated;
+                size_t cost = entry.file.getLevelSize(level) + (grow ? levelsSize(entry, entry.resident) : 0);
+                if (uploaded > 0 && uploaded + cost > frame_upload_budget)
+                {
+                    continue;
+                }
+                if (grow)
+                {
+                    // grow the storage down to the wanted level at once, if it fits the budget
+                    size_t growth = levelsSize(entry, entry.wanted) - levelsSize(entry, entry.allocated);
+                    if (allocated_bytes + growth > memory_budget)
+                    {
+                        continue;
+                    }
+                    uploaded += allocate(entry, entry.wanted);
+                }
+                entry.file.uploadLevel(entry.texture, level, level - entry.allocated);
+                uploaded += entry.file.getLevelSize(level);
+                entry.resident = level;
+                entry.texture.setLevelRange(entry.resident - entry.allocated);
+                if (level - 1 >= entry.wanted)
+                {
+                    entry.file.prefetchLevel(level - 1);
+                }
+                progress = true;
+            }
+        }
+    }
+
+    /// Streamed textures, a deque so references stay valid when adding.
+    std::deque<Entry> entries;
+
+    /// GPU memory budget in bytes.
+    size_t memory_budget;
+
+    /// Maximum bytes uploaded per frame.
+    size_t frame_upload_budget;
+
+    /// Largest side of the levels always resident.
+    int min_size;
+
+    /// Level of detail bias.
+    float lod_bias;
+
+    /// GPU memory allocated by all textures.
+    size_t allocated_bytes;
+};
+
+}
+
+#endif
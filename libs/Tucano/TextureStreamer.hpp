@@ -0,0 +1,362 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TEXTURESTREAMER__
+#define __TEXTURESTREAMER__
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <GL/glew.h>
+
+#include "GLTexture.hpp"
+
+namespace Tucano
+{
+
+/**
+ * @brief Asynchronous texture uploads through a persistently mapped pixel unpack buffer ring.
+ *
+ * The buffer is split in slots. A worker thread (without a GL context) acquires a free slot, decodes
+ * texels directly into the mapped memory and submits it with the destination texture region.
+ * The GL thread calls processUploads once per frame, which issues the glTextureSubImage calls sourcing
+ * from the buffer offsets and protects each slot with a fence, so a slot is only reused after the GPU
+ * has consumed it. The GL thread never copies texel data nor waits for the upload.
+ *
+ * Large volumes should be split by the worker in slabs (ranges of z) that fit in one slot.
+ * Requires OpenGL 4.5 (buffer storage and direct state access).
+ */
+class TextureStreamer {
+
+public:
+
+    /**
+     * @brief Destination region of an upload, in texels.
+     *
+     * For 2D textures z is ignored and d must be 1, for 1D textures y and z are ignored.
+     */
+    struct Region
+    {
+        int x, y, z;
+        int w, h, d;
+        Region (int px = 0, int py = 0, int pz = 0, int pw = 0, int ph = 0, int pd = 1) :
+            x(px), y(py), z(pz), w(pw), h(ph), d(pd) {}
+    };
+
+    /**
+     * @brief Default constructor.
+     */
+    TextureStreamer (void) : pbo(0), mapped(NULL), slot_size(0) {}
+
+    /**
+     * @brief Default destructor, waits for pending uploads and releases the buffer.
+     */
+    ~TextureStreamer (void)
+    {
+        destroy();
+    }
+
+    /**
+     * @brief Creates and maps the pixel unpack buffer ring.
+     * @param slot_bytes Size of each slot in bytes (the largest region that can be uploaded at once).
+     * @param num_slots Number of slots, usually two or three times the number of uploads per frame.
+     * @return True if the buffer was created, false if buffer storage is not supported.
+     */
+    bool initialize (GLsizeiptr slot_bytes, int num_slots = 3)
+    {
+        if (!Texture::isDSASupported())
+        {
+            cerr << "Warning: TextureStreamer requires OpenGL 4.5!" << endl;
+            return false;
+        }
+
+        destroy();
+
+        // keep slot offsets aligned for any pixel type
+        slot_size = ((slot_bytes + 255) / 256) * 256;
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &pbo);
+        glNamedBufferStorage(pbo, slot_size * num_slots, NULL, flags);
+        mapped = (GLubyte*)glMapNamedBufferRange(pbo, 0, slot_size * num_slots, flags);
+        if (!mapped)
+        {
+            cerr << "Error: could not map texture streamer buffer" << endl;
+            DeletionQueue::Instance().retire(DeletionQueue::BUFFER, pbo);
+            pbo = 0;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock (slots_mutex);
+        slots.assign(num_slots, Slot());
+        ready.clear();
+        return true;
+    }
+
+    /**
+     * @brief Waits for all uploads in flight and releases the buffer.
+     *
+     * Must be called from the GL thread, and no worker may hold a slot.
+     */
+    void destroy (void)
+    {
+        if (pbo == 0)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock (slots_mutex);
+        for (unsigned int i = 0; i < slots.size(); ++i)
+        {
+            if (slots[i].fence)
+            {
+                glClientWaitSync(slots[i].fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(slots[i].fence);
+            }
+        }
+        slots.clear();
+        ready.clear();
+
+        glUnmapNamedBuffer(pbo);
+        DeletionQueue::Instance().retire(DeletionQueue::BUFFER, pbo);
+        pbo = 0;
+        mapped = NULL;
+    }
+
+    /**
+     * @brief Acquires a free slot for writing. Can be called from any thread.
+     * @param wait If true blocks until a slot is free, otherwise returns immediately.
+     * @return Slot index, or -1 if no slot is free and wait is false.
+     */
+    int acquireSlot (bool wait = true)
+    {
+        std::unique_lock<std::mutex> lock (slots_mutex);
+        while (true)
+        {
+            for (unsigned int i = 0; i < slots.size(); ++i)
+            {
+                if (slots[i].state == SLOT_FREE)
+                {
+                    slots[i].state = SLOT_WRITING;
+                    return i;
+                }
+            }
+            if (!wait || slots.empty())
+            {
+                return -1;
+            }
+            slot_freed.wait(lock);
+        }
+    }
+
+    /**
+     * @brief Returns the mapped memory of an acquired slot, where texels should be written.
+     * @param slot Slot index returned by acquireSlot.
+     * @return Pointer to the slot memory (getSlotSize bytes).
+     */
+    GLvoid* getSlotPointer (int slot)
+    {
+        return mapped + slot * slot_size;
+    }
+
+    /**
+     * @brief Returns the size of each slot in bytes.
+     */
+    GLsizeiptr getSlotSize (void) const
+    {
+        return slot_size;
+    }
+
+    /**
+     * @brief Submits a written slot to be uploaded to a texture region. Can be called from any thread.
+     *
+     * The texture must outlive the upload, and the texels in the slot must be tightly packed
+     * with the texture format and pixel type.
+     * @param slot Slot index returned by acquireSlot.
+     * @param texture Destination texture.
+     * @param region Destination region in texels.
+     */
+    void submit (int slot, Texture* texture, const Region& region)
+    {
+        std::lock_guard<std::mutex> lock (slots_mutex);
+        slots[slot].state = SLOT_READY;
+        slots[slot].texture = texture;
+        slots[slot].region = region;
+        ready.push_back(slot);
+    }
+
+    /**
+     * @brief Returns an acquired slot without uploading it.
+     * @param slot Slot index returned by acquireSlot.
+     */
+    void cancel (int slot)
+    {
+        {
+            std::lock_guard<std::mutex> lock (slots_mutex);
+            slots[slot].state = SLOT_FREE;
+        }
+        slot_freed.notify_one();
+    }
+
+    /**
+     * @brief Issues the submitted uploads and recycles the slots the GPU is done with.
+     *
+     * Must be called from the GL thread, usually once per frame. Never waits for the GPU.
+     * @param max_uploads Maximum number of uploads to issue in this call, -1 for all submitted ones.
+     * @return Number of uploads issued.
+     */
+    int processUploads (int max_uploads = -1)
+    {
+        retireSlots();
+
+        std::vector<int> to_upload;
+        {
+            std::lock_guard<std::mutex> lock (slots_mutex);
+            while (!ready.empty() && (max_uploads < 0 || (int)to_upload.size() < max_uploads))
+            {
+                to_upload.push_back(ready.front());
+                ready.pop_front();
+            }
+        }
+        if (to_upload.empty())
+        {
+            return 0;
+        }
+
+        GLint alignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (unsigned int i = 0; i < to_upload.size(); ++i)
+        {
+            Slot& slot = slots[to_upload[i]];
+            const GLvoid* offset = (const GLvoid*)(to_upload[i] * slot_size);
+            const Region& r = slot.region;
+            GLenum type = slot.texture->getTextureType();
+            if (type == GL_TEXTURE_3D || type == GL_TEXTURE_2D_ARRAY)
+            {
+                slot.texture->update(r.x, r.y, r.z, r.w, r.h, r.d, offset);
+            }
+            else if (type == GL_TEXTURE_1D)
+            {
+                slot.texture->update(r.x, r.w, offset);
+            }
+            else
+            {
+                slot.texture->update(r.x, r.y, r.w, r.h, offset);
+            }
+            slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        // the fences are polled without flushing, they must reach the GPU to ever signal
+        glFlush();
+
+        std::lock_guard<std::mutex> lock (slots_mutex);
+        for (unsigned int i = 0; i < to_upload.size(); ++i)
+        {
+            slots[to_upload[i]].state = SLOT_IN_FLIGHT;
+        }
+        return to_upload.size();
+    }
+
+    /**
+     * @brief Returns the number of submitted uploads not yet issued.
+     */
+    int getNumPending (void)
+    {
+        std::lock_guard<std::mutex> lock (slots_mutex);
+        return ready.size();
+    }
+
+private:
+
+    /// Life cycle of one slot.
+    enum SlotState { SLOT_FREE, SLOT_WRITING, SLOT_READY, SLOT_IN_FLIGHT };
+
+    /// One region of the ring buffer.
+    struct Slot
+    {
+        SlotState state;
+        GLsync fence;
+        Texture* texture;
+        Region region;
+        Slot (void) : state(SLOT_FREE), fence(0), texture(NULL) {}
+    };
+
+    /**
+     * @brief Frees the in flight slots whose fence has been signaled, without waiting.
+     */
+    void retireSlots (void)
+    {
+        bool freed = false;
+        {
+            std::lock_guard<std::mutex> lock (slots_mutex);
+            for (unsigned int i = 0; i < slots.size(); ++i)
+            {
+                if (slots[i].state != SLOT_IN_FLIGHT)
+                {
+                    continue;
+                }
+                GLenum status = glClientWaitSync(slots[i].fence, 0, 0);
+                if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+                {
+                    glDeleteSync(slots[i].fence);
+                    slots[i].fence = 0;
+                    slots[i].state = SLOT_FREE;
+                    freed = true;
+                }
+            }
+        }
+        if (freed)
+        {
+            slot_freed.notify_all();
+        }
+    }
+
+    /// Pixel unpack buffer handle.
+    GLuint pbo;
+
+    /// Persistently mapped buffer memory.
+    GLubyte* mapped;
+
+    /// Size of each slot in bytes.
+    GLsizeiptr slot_size;
+
+    /// Slots of the ring.
+    std::vector<Slot> slots;
+
+    /// Slots submitted and waiting to be uploaded, in submission order.
+    std::deque<int> ready;
+
+    /// Guards slot states and the ready queue.
+    std::mutex slots_mutex;
+
+    /// Signaled when a slot becomes free.
+    std::condition_variable slot_freed;
+};
+
+}
+
+#endif
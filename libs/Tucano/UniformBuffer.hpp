@@ -0,0 +1,428 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __UNIFORMBUFFER__
+#define __UNIFORMBUFFER__
+
+#include <vector>
+#include <cstring>
+#include <utility>
+#include <Eigen/Dense>
+#include <GL/glew.h>
+
+#include "DeletionQueue.hpp"
+
+namespace Tucano
+{
+
+/// Uniform buffer binding point reserved for the shared camera block (see CameraBlock).
+#define TUCANO_CAMERA_BLOCK_BINDING 0
+
+/**
+ * @brief Writes values in a CPU buffer following the std140 layout rules.
+ *
+ * Values must be added in the same order as they are declared in the GLSL block, the writer inserts
+ * the padding: vec2 are aligned to 8 bytes, vec3 and vec4 to 16, matrices are stored as arrays of
+ * vec4 columns, and array elements are padded to 16 bytes.
+ */
+class Std140Writer {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    Std140Writer (void) {}
+
+    /**
+     * @brief Clears the buffer, to start writing the block again.
+     */
+    void clear (void)
+    {
+        buffer.clear();
+    }
+
+    /**
+     * @brief Returns the written data.
+     */
+    const unsigned char* data (void) const
+    {
+        return buffer.empty() ? NULL : &buffer[0];
+    }
+
+    /**
+     * @brief Returns the number of bytes written, including the padding.
+     */
+    size_t size (void) const
+    {
+        return buffer.size();
+    }
+
+    /**
+     * @brief Pads the buffer to a given alignment, for example before a struct (16 bytes).
+     * @param alignment Alignment in bytes.
+     */
+    Std140Writer& align (size_t alignment)
+    {
+        buffer.resize(((buffer.size() + alignment - 1) / alignment) * alignment, 0);
+        return *this;
+    }
+
+    /// Adds a float.
+    Std140Writer& add (float value)
+    {
+        return write(&value, sizeof(float), 4);
+    }
+
+    /// Adds an int.
+    Std140Writer& add (int value)
+    {
+        return write(&value, sizeof(int), 4);
+    }
+
+    /// Adds an unsigned int.
+    Std140Writer& add (unsigned int value)
+    {
+        return write(&value, sizeof(unsigned int), 4);
+    }
+
+    /// Adds a bool, stored as an int.
+    Std140Writer& add (bool value)
+    {
+        return add((int)value);
+    }
+
+    /// Adds a vec2.
+    Std140Writer& add (const Eigen::Vector2f& vec)
+    {
+        return write(vec.data(), 2*sizeof(float), 8);
+    }
+
+    /// Adds a vec3.
+    Std140Writer& add (const Eigen::Vector3f& vec)
+    {
+        return write(vec.data(), 3*sizeof(float), 16);
+    }
+
+    /// Adds a vec4.
+    Std140Writer& add (const Eigen::Vector4f& vec)
+    {
+        return write(vec.data(), 4*sizeof(float), 16);
+    }
+
+    /// Adds an ivec2.
+    Std140Writer& add (const Eigen::Vector2i& vec)
+    {
+        return write(vec.data(), 2*sizeof(int), 8);
+    }
+
+    /// Adds an ivec3.
+    Std140Writer& add (const Eigen::Vector3i& vec)
+    {
+        return write(vec.data(), 3*sizeof(int), 16);
+    }
+
+    /// Adds an ivec4.
+    Std140Writer& add (const Eigen::Vector4i& vec)
+    {
+        return write(vec.data(), 4*sizeof(int), 16);
+    }
+
+    /// Adds a mat3, each column padded to a vec4.
+    Std140Writer& add (const Eigen::Matrix3f& mat)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            write(mat.col(c).data(), 3*sizeof(float), 16);
+        }
+        return align(16);
+    }
+
+    /// Adds a mat4.
+    Std140Writer& add (const Eigen::Matrix4f& mat)
+    {
+        return write(mat.data(), 16*sizeof(float), 16);
+    }
+
+    /// Adds an affine transformation as a mat4.
+    Std140Writer& add (const Eigen::Affine3f& mat)
+    {
+        return add(mat.matrix());
+    }
+
+    /**
+     * @brief Adds an array of floats, each element padded to 16 bytes.
+     * @param values Array values.
+     * @param count Number of elements.
+     */
+    Std140Writer& addArray (const float* values, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            write(&values[i], sizeof(float), 16);
+        }
+        return align(16);
+    }
+
+    /**
+     * @brief Adds an array of ints, each element padded to 16 bytes.
+     * @param values Array values.
+     * @param count Number of elements.
+     */
+    Std140Writer& addArray (const int* values, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            write(&values[i], sizeof(int), 16);
+        }
+        return align(16);
+    }
+
+    /**
+     * @brief Adds an array of vec4.
+     * @param values Array values.
+     * @param count Number of elements.
+     */
+    Std140Writer& addArray (const Eigen::Vector4f* values, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            add(values[i]);
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Adds an array of mat4.
+     * @param values Array values.
+     * @param count Number of elements.
+     */
+    Std140Writer& addArray (const Eigen::Matrix4f* values, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            add(values[i]);
+        }
+        return *this;
+    }
+
+private:
+
+    /**
+     * @brief Aligns the buffer and appends bytes.
+     * @param value Pointer to the value.
+     * @param bytes Number of bytes to append.
+     * @param alignment Base alignment of the type.
+     */
+    Std140Writer& write (const void* value, size_t bytes, size_t alignment)
+    {
+        align(alignment);
+        size_t offset = buffer.size();
+        buffer.resize(offset + bytes);
+        memcpy(&buffer[offset], value, bytes);
+        return *this;
+    }
+
+    /// Written bytes.
+    std::vector<unsigned char> buffer;
+};
+
+/**
+ * @brief A uniform buffer object, holding the values of a GLSL uniform block.
+ *
+ * The buffer is filled (usually once per frame) with update, bound to an indexed binding point with bindBase,
+ * and every program whose block is assigned to the same binding point reads from it.
+ */
+class UniformBuffer {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     */
+    UniformBuffer (void) : buffer_id(0), buffer_size(0), binding(-1) {}
+
+    /**
+     * @brief Default destructor.
+     */
+    ~UniformBuffer (void)
+    {
+        destroy();
+    }
+
+    /**
+     * @brief Move constructor, takes the buffer of another uniform buffer, leaving it empty.
+     * @param other Uniform buffer to move from.
+     */
+    UniformBuffer (UniformBuffer&& other) noexcept : buffer_id(other.buffer_id), buffer_size(other.buffer_size), binding(other.binding)
+    {
+        other.buffer_id = 0;
+        other.buffer_size = 0;
+        other.binding = -1;
+    }
+
+    /**
+     * @brief Move assignment, deletes the current buffer and takes the one of another uniform buffer.
+     * @param other Uniform buffer to move from.
+     * @return Reference to this uniform buffer.
+     */
+    UniformBuffer& operator= (UniformBuffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            std::swap(buffer_id, other.buffer_id);
+            std::swap(buffer_size, other.buffer_size);
+            std::swap(binding, other.binding);
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Creates the buffer.
+     * @param size Size in bytes, rounded up to 16.
+     * @param data Initial data, or NULL.
+     */
+    void create (GLsizeiptr size, const GLvoid* data = NULL)
+    {
+        destroy();
+        buffer_size = ((size + 15) / 16) * 16;
+        glGenBuffers(1, &buffer_id);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer_id);
+        glBufferData(GL_UNIFORM_BUFFER, buffer_size, NULL, GL_DYNAMIC_DRAW);
+        if (data)
+        {
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    /**
+     * @brief Deletes the buffer.
+     */
+    void destroy (void)
+    {
+        if (buffer_id != 0)
+        {
+            DeletionQueue::Instance().retire(DeletionQueue::BUFFER, buffer_id);
+        }
+        buffer_id = 0;
+        buffer_size = 0;
+        binding = -1;
+    }
+
+    /**
+     * @brief Updates the buffer contents, creating or growing it if necessary.
+     * @param data Pointer to the data.
+     * @param size Number of bytes.
+     * @param offset Offset in bytes inside the buffer.
+     */
+    void update (const GLvoid* data, GLsizeiptr size, GLintptr offset = 0)
+    {
+        if (offset + size > buffer_size)
+        {
+            GLint old_binding = binding;
+            create(offset + size);
+            if (old_binding >= 0)
+            {
+                bindBase(old_binding);
+            }
+        }
+        if (GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access)
+        {
+            glNamedBufferSubData(buffer_id, offset, size, data);
+        }
+        else
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, buffer_id);
+            glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+    }
+
+    /**
+     * @brief Updates the buffer with the contents of a std140 writer.
+     * @param writer Writer holding the block values.
+     */
+    void update (const Std140Writer& writer)
+    {
+        if (writer.size() > 0)
+        {
+            update(writer.data(), writer.size());
+        }
+    }
+
+    /**
+     * @brief Binds the buffer to an indexed uniform buffer binding point.
+     * @param index Binding point.
+     */
+    void bindBase (GLuint index)
+    {
+        glBindBufferBase(GL_UNIFORM_BUFFER, index, buffer_id);
+        binding = index;
+    }
+
+    /**
+     * @brief Returns the buffer handle.
+     */
+    GLuint bufferID (void) const
+    {
+        return buffer_id;
+    }
+
+    /**
+     * @brief Returns the buffer size in bytes.
+     */
+    GLsizeiptr getSize (void) const
+    {
+        return buffer_size;
+    }
+
+    /**
+     * @brief Returns the last binding point the buffer was bound to, or -1.
+     */
+    GLint getBinding (void) const
+    {
+        return binding;
+    }
+
+private:
+
+    ///Copy Constructor
+    UniformBuffer (UniformBuffer const&);
+
+    ///Assignment Operation
+    UniformBuffer& operator= (UniformBuffer const&);
+
+    /// Buffer handle.
+    GLuint buffer_id;
+
+    /// Buffer size in bytes.
+    GLsizeiptr buffer_size;
+
+    /// Last binding point.
+    GLint binding;
+};
+
+}
+
+#endif
@@ -0,0 +1,231 @@
+/**
+ * Tucano - A library for rapid prototyping with Modern OpenGL and GLSL
+ * Copyright (C) 2014
+ * LCG - Laboratório de Computação Gráfica (Computer Graphics Lab) - COPPE
+ * UFRJ - Federal University of Rio de Janeiro
+ *
+ * This file is part of Tucano Library.
+ *
+ * Tucano Library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Tucano Library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Tucano Library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WINDOWCONTEXT__
+#define __WINDOWCONTEXT__
+
+#include "Context.hpp"
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+#include <atomic>
+
+namespace Tucano
+{
+
+/**
+ * @brief OpenGL context with a GLFW window.
+ *
+ * The viewport follows the window framebuffer size (see updateViewport). Requires linking GLFW.
+ * GLFW is terminated when the last WindowContext, including the shared ones, is destroyed.
+ */
+class WindowContext : public Context {
+
+public:
+
+    /**
+     * @brief Default constructor.
+     * @param visible If false the window is created hidden (rendering to Framebuffers only).
+     */
+    WindowContext (bool visible = true) : window(NULL), window_visible(visible), resized(false), pending_width(0), pending_height(0) {}
+
+    /**
+     * @brief Default destructor.
+     */
+    virtual ~WindowContext (void)
+    {
+        destroy();
+    }
+
+    virtual bool create (int width, int height, const std::string& title = "Tucano", int major = 4, int minor = 5, bool debug = false)
+    {
+        destroy();
+        if (!glfwInit())
+        {
+            std::cerr << "Error: could not initialize GLFW" << std::endl;
+            return false;
+        }
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, debug ? GLFW_TRUE : GLFW_FALSE);
+        glfwWindowHint(GLFW_VISIBLE, window_visible ? GLFW_TRUE : GLFW_FALSE);
+
+        window = glfwCreateWindow(width, height, title.c_str(), NULL, NULL);
+        if (window == NULL)
+        {
+            std::cerr << "Error: could not create GLFW window" << std::endl;
+            if (numWindows() == 0)
+            {
+                glfwTerminate();
+            }
+            return false;
+        }
+        ++numWindows();
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+        glfwGetFramebufferSize(window, &size[0], &size[1]);
+        close_requested = false;
+        return true;
+    }
+
+    virtual void destroy (void)
+    {
+        if (window)
+        {
+            glfwDestroyWindow(window);
+            if (--numWindows() == 0)
+            {
+                glfwTerminate();
+            }
+        }
+        window = NULL;
+    }
+
+    virtual void makeCurrent (void)
+    {
+        glfwMakeContextCurrent(window);
+    }
+
+    virtual void doneCurrent (void)
+    {
+        if (glfwGetCurrentContext() == window)
+        {
+            glfwMakeContextCurrent(NULL);
+        }
+    }
+
+    /**
+     * @brief Creates a hidden 1x1 window whose context shares objects with this one.
+     *
+     * Must be called from the main thread, as all GLFW window functions, the new context can be made current in any thread.
+     */
+    virtual Context* createShared (void)
+    {
+        if (!window)
+        {
+            return NULL;
+        }
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        GLFWwindow* shared_window = glfwCreateWindow(1, 1, "", NULL, window);
+        glfwWindowHint(GLFW_VISIBLE, window_visible ? GLFW_TRUE : GLFW_FALSE);
+        if (!shared_window)
+        {
+            std::cerr << "Error: could not create shared GLFW context" << std::endl;
+            return NULL;
+        }
+        ++numWindows();
+        WindowContext* shared = new WindowContext(false);
+        shared->window = shared_window;
+        shared->size << 1, 1;
+        return shared;
+    }
+
+    virtual void swapBuffers (void)
+    {
+        glfwSwapBuffers(window);
+    }
+
+    virtual void updateViewport (void)
+    {
+        if (resized.exchange(false))
+        {
+            glViewport(0, 0, pending_width, pending_height);
+        }
+    }
+
+    virtual void pollEvents (void)
+    {
+        glfwPollEvents();
+    }
+
+    virtual void setSwapInterval (int interval)
+    {
+        glfwSwapInterval(interval);
+    }
+
+    virtual bool shouldClose (void)
+    {
+        return close_requested || window == NULL || glfwWindowShouldClose(window);
+    }
+
+    virtual bool isHeadless (void) const
+    {
+        return false;
+    }
+
+    virtual bool hasDefaultFramebuffer (void) const
+    {
+        return true;
+    }
+
+    /**
+     * @brief Returns the GLFW window, for input handling.
+     */
+    GLFWwindow* getWindow (void)
+    {
+        return window;
+    }
+
+private:
+
+    /**
+     * @brief Number of GLFW windows alive, GLFW is terminated when the last one is destroyed.
+     *
+     * Only changed from the main thread, as all GLFW window functions.
+     */
+    static int& numWindows (void)
+    {
+        static int count = 0;
+        return count;
+    }
+
+    /**
+     * @brief Keeps the size in sync with the window framebuffer, the viewport is set later by updateViewport.
+     *
+     * Called by the thread polling events, where the context may not be current.
+     */
+    static void framebufferSizeCallback (GLFWwindow* w, int width, int height)
+    {
+        WindowContext* context = static_cast<WindowContext*>(glfwGetWindowUserPointer(w));
+        context->size << width, height;
+        context->pending_width = width;
+        context->pending_height = height;
+        context->resized = true;
+    }
+
+    /// GLFW window.
+    GLFWwindow* window;
+
+    /// Flag to create the window visible.
+    bool window_visible;
+
+    /// Flag set when the framebuffer was resized and the viewport not updated yet.
+    std::atomic<bool> resized;
+
+    /// Framebuffer size to apply to the viewport.
+    std::atomic<int> pending_width, pending_height;
+};
+
+}
+
+#endif
@@ -1,82 +1,115 @@
-
-
-#include "Tucano/Misc.hpp"
-#include <GL/glew.h>
-#include <GLFW/glfw3.h>
+#include "Tucano/WindowContext.hpp"
+#include "Tucano/Application.hpp"
+#ifdef TUCANO_HAS_EGL
+#include "Tucano/HeadlessContext.hpp"
+#include "Tucano/FrameBuffer.hpp"
+#endif
 
 #include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
 
-void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow *window);
+int runHeadless(int num_frames);
 
 // settings
 const unsigned int SCR_WIDTH = 1000;
 const unsigned int SCR_HEIGHT = 800;
 
-int main()
+// render loop: input once per frame, fixed 60 Hz updates, vsync and at most two frames queued to the GPU
+// -------------------------------------------------------------------------------------------------------
+class CreateContextApp : public Tucano::Application
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    // glfw window creation
-    // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-    if (window == NULL)
+public:
+    CreateContextApp(Tucano::WindowContext& window_context) : Tucano::Application(window_context), window(window_context.getWindow()) {}
+
+    // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+    void processInput()
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
+        if(glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+            glfwSetWindowShouldClose(window, true);
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
-
-    Tucano::Misc::initializeGLEW();
-    Tucano::Misc::OpenGLInformation();
-
-    // render loop
-    // -----------
-    while (!glfwWindowShouldClose(window))
+    // camera and animation updates go here, dt is always the same
+    void update(double dt)
     {
-        // input
-        // -----
-        processInput(window);
+        (void)dt;
+    }
 
-        // render
-        // ------
+    void render(double alpha)
+    {
+        (void)alpha;
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
     }
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
-    return 0;
-}
+private:
+    GLFWwindow* window;
+};
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
-// ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window)
+// usage: createcontext [--headless [num_frames]] [--novsync]
+int main(int argc, char** argv)
 {
-    if(glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+    if (argc > 1 && std::string(argv[1]) == "--headless")
+    {
+        return runHeadless(argc > 2 ? atoi(argv[2]) : 1000);
+    }
+
+    // window context: glfw window, core profile 4.5, GLEW
+    // ---------------------------------------------------
+    Tucano::WindowContext context;
+    if (!context.initialize(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", 4, 5))
+    {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        return -1;
+    }
+    Tucano::Misc::OpenGLInformation();
+
+    CreateContextApp app(context);
+    if (argc > 1 && std::string(argv[1]) == "--novsync")
+    {
+        app.setSwapInterval(0);
+    }
+    app.run();
+    app.printStats();
+
+    // the context destructor destroys the window and terminates glfw
+    return 0;
 }
 
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+// headless: render frames into a framebuffer as fast as the GPU allows, no window and no vsync
 // ---------------------------------------------------------------------------------------------
-void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+int runHeadless(int num_frames)
 {
-    // make sure the viewport matches the new window dimensions; note that width and 
-    // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
-}
+#ifdef TUCANO_HAS_EGL
+    Tucano::HeadlessContext context;
+    if (!context.initialize(SCR_WIDTH, SCR_HEIGHT, "", 4, 5))
+    {
+        std::cout << "Failed to create headless context" << std::endl;
+        return -1;
+    }
+    Tucano::Misc::OpenGLInformation();
+
+    Tucano::Framebuffer fbo (SCR_WIDTH, SCR_HEIGHT, 1, GL_TEXTURE_2D, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
 
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_frames; ++i)
+    {
+        fbo.bind();
+        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        fbo.unbindFBO();
+    }
+    glFinish();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << num_frames << " frames in " << seconds << " s (" << num_frames / seconds << " fps)" << std::endl;
+
+    fbo.saveAsPPM("headless.ppm");
+    return 0;
+#else
+    (void)num_frames;
+    std::cout << "Built without EGL, headless mode is not available" << std::endl;
+    return -1;
+#endif
+}
@@ -0,0 +1,505 @@
+#include "Tucano/Camera.hpp"
+#include "Tucano/BoundingBox3.hpp"
+#include "Tucano/Frustum.hpp"
+#include "Tucano/BVH.hpp"
+#ifdef TUCANO_HAS_EGL
+#include "Tucano/HeadlessContext.hpp"
+#include "Tucano/Shader.hpp"
+#include "Tucano/GLTexture.hpp"
+#include "Tucano/TextureManager.hpp"
+#include "Tucano/TextureStreamer.hpp"
+#include "Tucano/FrameBuffer.hpp"
+#include "Tucano/UniformBuffer.hpp"
+#include "Tucano/ImageWriter.hpp"
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+// usage: tucano_bench [--out results.json] [--filter name] [--cpu-only] [--min-time seconds]
+//                     [--baseline previous.json] [--tolerance 0.15]
+//
+// Runs each benchmark in batches until min-time is spent, and reports per operation times
+// (median and min over the batches) as JSON, to be compared between builds. With a baseline
+// (the output of a previous run) it exits with 1 if any median got slower than the tolerance.
+
+struct Result
+{
+    std::string name;
+    std::string group;
+    double median_ns;
+    double min_ns;
+    long long ops;
+    int batches;
+};
+
+struct Options
+{
+    std::string out;
+    std::string filter;
+    std::string baseline;
+    bool cpu_only;
+    double min_time;
+    double tolerance;
+    Options() : cpu_only(false), min_time(0.25), tolerance(0.15) {}
+};
+
+static Options options;
+static std::vector<Result> results;
+
+// keeps the compiler from removing the benchmarked work
+static volatile float sink = 0.0f;
+
+static bool selected(const std::string& name)
+{
+    return options.filter.empty() || name.find(options.filter) != std::string::npos;
+}
+
+// runs f (which performs ops_per_call operations) in batches and records the time per operation
+template <class Function>
+void bench(const std::string& group, const std::string& name, long long ops_per_call, Function f)
+{
+    if (!selected(name))
+    {
+        return;
+    }
+    typedef std::chrono::steady_clock Clock;
+
+    // warm up, and size the batches to about 10 ms
+    Clock::time_point start = Clock::now();
+    f();
+    double once = std::chrono::duration<double>(Clock::now() - start).count();
+    int calls_per_batch = std::max(1, (int)(0.01 / std::max(once, 1e-9)));
+
+    std::vector<double> samples;
+    double total = 0.0;
+    long long ops = 0;
+    while (total < options.min_time || samples.size() < 5)
+    {
+        start = Clock::now();
+        for (int i = 0; i < calls_per_batch; ++i)
+        {
+            f();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        total += seconds;
+        ops += ops_per_call * calls_per_batch;
+        samples.push_back(1e9 * seconds / (ops_per_call * calls_per_batch));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    Result result;
+    result.group = group;
+    result.name = name;
+    result.median_ns = samples[samples.size() / 2];
+    result.min_ns = samples.front();
+    result.ops = ops;
+    result.batches = samples.size();
+    results.push_back(result);
+    std::cerr << name << ": " << result.median_ns << " ns/op" << std::endl;
+}
+
+static void writeJSON(std::ostream& out, const std::string& renderer)
+{
+    out << "{\n  \"renderer\": \"" << renderer << "\",\n  \"benchmarks\": [\n";
+    for (unsigned int i = 0; i < results.size(); ++i)
+    {
+        const Result& r = results[i];
+        out << "    {\"group\": \"" << r.group << "\", \"name\": \"" << r.name << "\", \"median_ns\": " << r.median_ns
+            << ", \"min_ns\": " << r.min_ns << ", \"ops\": " << r.ops << ", \"batches\": " << r.batches << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// reads the medians of a previous output, one benchmark per line as written by writeJSON
+static bool readBaseline(const std::string& filename, std::vector< std::pair<std::string, double> >& medians)
+{
+    std::ifstream file(filename.c_str());
+    if (!file.is_open())
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        size_t name = line.find("\"name\": \"");
+        size_t median = line.find("\"median_ns\": ");
+        if (name == std::string::npos || median == std::string::npos)
+        {
+            continue;
+        }
+        name += 9;
+        medians.push_back(std::make_pair(line.substr(name, line.find('"', name) - name), atof(line.c_str() + median + 13)));
+    }
+    return true;
+}
+
+// compares the results with a baseline, returns the number of regressions
+static int compareBaseline(const std::string& filename)
+{
+    std::vector< std::pair<std::string, double> > medians;
+    if (!readBaseline(filename, medians))
+    {
+        std::cerr << "Warning: could not read baseline " << filename << std::endl;
+        return 0;
+    }
+    int regressions = 0;
+    for (unsigned int i = 0; i < results.size(); ++i)
+    {
+        for (unsigned int j = 0; j < medians.size(); ++j)
+        {
+            if (medians[j].first == results[i].name && medians[j].second > 0.0)
+            {
+                double ratio = results[i].median_ns / medians[j].second;
+                if (ratio > 1.0 + options.tolerance)
+                {
+                    std::cerr << "regression: " << results[i].name << " " << medians[j].second << " -> "
+                              << results[i].median_ns << " ns/op (" << ratio << "x)" << std::endl;
+                    ++regressions;
+                }
+            }
+        }
+    }
+    return regressions;
+}
+
+static float randomFloat()
+{
+    return rand() / (float)RAND_MAX;
+}
+
+// CPU benchmarks
+// --------------
+
+static void benchBounds()
+{
+    const size_t count = 1 << 20;
+    std::vector<float> points(3 * count);
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        points[i] = randomFloat() * 100.0f;
+    }
+    bench("cpu", "bbox_fromPointCloud_1M", count, [&] () {
+        Tucano::BoundingBox3<float> box;
+        box.fromPointCloud(&points[0], count);
+        sink += box.Max()[0];
+    });
+    bench("cpu", "bbox_fromPointCloud_1M_single_thread", count, [&] () {
+        Tucano::BoundingBox3<float> box;
+        box.fromPointCloud(&points[0], count, 3, 1);
+        sink += box.Max()[0];
+    });
+}
+
+static void benchProjection()
+{
+    const int count = 4096;
+    Tucano::Camera camera;
+    camera.setPerspectiveMatrix(60.0, 1.0, 0.1, 100.0);
+    Eigen::Vector4f viewport(0, 0, 1024, 1024);
+    std::vector<Eigen::Vector4f> points(count);
+    std::vector<float> x(count), y(count), z(count), sx(count), sy(count), sz(count);
+    for (int i = 0; i < count; ++i)
+    {
+        points[i] = Eigen::Vector4f(randomFloat() - 0.5f, randomFloat() - 0.5f, -randomFloat() * 10.0f, 1.0f);
+        x[i] = points[i][0];
+        y[i] = points[i][1];
+        z[i] = points[i][2];
+    }
+    bench("cpu", "camera_projectPoint", count, [&] () {
+        for (int i = 0; i < count; ++i)
+        {
+            sink += camera.projectPoint(points[i], viewport)[0];
+        }
+    });
+    bench("cpu", "camera_projectPoints_batch", count, [&] () {
+        camera.projectPoints(&x[0], &y[0], &z[0], count, viewport, &sx[0], &sy[0], &sz[0]);
+        sink += sx[count - 1];
+    });
+}
+
+static void benchCulling()
+{
+    const int count = 100000;
+    std::vector< Tucano::BoundingBox3<float> > boxes;
+    for (int i = 0; i < count; ++i)
+    {
+        float px = randomFloat() * 200.0f - 100.0f, py = randomFloat() * 200.0f - 100.0f, pz = randomFloat() * 200.0f - 100.0f;
+        float s = randomFloat();
+        boxes.push_back(Tucano::BoundingBox3<float>(px, py, pz, px + s, py + s, pz + s));
+    }
+    Tucano::Camera camera;
+    camera.setPerspectiveMatrix(60.0, 1.0, 0.1, 100.0);
+    Tucano::Frustum frustum = camera.getFrustum();
+    std::vector<unsigned char> visible;
+    bench("cpu", "frustum_cullBoxes_100k", count, [&] () {
+        sink += frustum.cullBoxes(boxes, visible);
+    });
+
+    Tucano::BVH bvh;
+    bench("cpu", "bvh_build_100k", count, [&] () {
+        bvh.build(boxes);
+        sink += bvh.getNumNodes();
+    });
+    const int rays = 1000;
+    bench("cpu", "bvh_raycast_100k", rays, [&] () {
+        for (int i = 0; i < rays; ++i)
+        {
+            Eigen::Vector3f origin, direction;
+            camera.getRay(Eigen::Vector2f(randomFloat() * 2.0f - 1.0f, randomFloat() * 2.0f - 1.0f), origin, direction);
+            sink += bvh.raycast(origin, direction).t;
+        }
+    });
+    std::vector<int> objects;
+    bench("cpu", "bvh_query_frustum_100k", 1, [&] () {
+        bvh.query(frustum, objects);
+        sink += objects.size();
+    });
+}
+
+#ifdef TUCANO_HAS_EGL
+
+// GPU benchmarks, on a headless context
+// -------------------------------------
+
+static const char* vertex_code =
+    "#version 430\n"
+    "layout(location = 0) in vec4 in_Position;\n"
+    "uniform mat4 matrices[16];\n"
+    "uniform float value;\n"
+    "layout(std140, binding = 5) uniform Matrices { mat4 block_matrices[16]; };\n"
+    "void main() { gl_Position = matrices[gl_VertexID % 16] * block_matrices[gl_VertexID % 16] * in_Position * value; }\n";
+
+static const char* fragment_code =
+    "#version 430\n"
+    "out vec4 color;\n"
+    "void main() { color = vec4(1.0); }\n";
+
+static void benchUniforms()
+{
+    Tucano::Shader shader("bench");
+    shader.initializeFromStrings(vertex_code, fragment_code);
+    shader.bind();
+    GLint location = shader.getUniformLocation("value");
+    const int count = 1000;
+    bench("gpu", "uniform_set_by_name", count, [&] () {
+        for (int i = 0; i < count; ++i)
+        {
+            shader.setUniform("value", (GLfloat)i);
+        }
+    });
+    bench("gpu", "uniform_set_by_location", count, [&] () {
+        for (int i = 0; i < count; ++i)
+        {
+            shader.setUniform(location, (GLfloat)i);
+        }
+    });
+
+    // sixteen matrices per draw, as individual uniforms or as one uniform block update
+    std::vector<Eigen::Matrix4f> matrices(16, Eigen::Matrix4f::Identity());
+    Tucano::UniformBuffer ubo;
+    ubo.create(16 * sizeof(Eigen::Matrix4f));
+    shader.setUniformBlock("Matrices", ubo, 5);
+    Tucano::Std140Writer writer;
+    // locations are looked up once, as the block binding, so only the uploads are timed
+    std::vector<GLint> matrix_locations(16);
+    for (int m = 0; m < 16; ++m)
+    {
+        std::ostringstream name;
+        name << "matrices[" << m << "]";
+        matrix_locations[m] = shader.getUniformLocation(name.str().c_str());
+    }
+    const int draws = 100;
+    bench("gpu", "matrices_as_uniforms", draws, [&] () {
+        for (int d = 0; d < draws; ++d)
+        {
+            for (int m = 0; m < 16; ++m)
+            {
+                shader.setUniform(matrix_locations[m], matrices[m]);
+            }
+        }
+        glFinish();
+    });
+    bench("gpu", "matrices_as_ubo", draws, [&] () {
+        for (int d = 0; d < draws; ++d)
+        {
+            writer.clear();
+            writer.addArray(&matrices[0], 16);
+            ubo.update(writer);
+        }
+        glFinish();
+    });
+    shader.unbind();
+}
+
+static void benchTextureManager()
+{
+    std::vector<GLuint> textures(8);
+    glGenTextures(textures.size(), &textures[0]);
+    const int count = 1000;
+    bench("gpu", "texmanager_bind_unbind", count, [&] () {
+        for (int i = 0; i < count; ++i)
+        {
+            GLuint tex = textures[i % textures.size()];
+            int unit = Tucano::TextureManager::Instance().bindTexture(GL_TEXTURE_2D, tex);
+            Tucano::TextureManager::Instance().unbindTexture(GL_TEXTURE_2D, unit, tex);
+        }
+    });
+    glDeleteTextures(textures.size(), &textures[0]);
+}
+
+static void benchTextureUpload()
+{
+    const int size = 1024;
+    std::vector<unsigned char> texels(size * size * 4, 128);
+    Tucano::Texture texture;
+    texture.create(GL_TEXTURE_2D, GL_RGBA8, size, size, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    bench("gpu", "texture_upload_sync_1024", 1, [&] () {
+        texture.update(&texels[0]);
+        glFinish();
+    });
+
+    Tucano::TextureStreamer streamer;
+    if (streamer.initialize(texels.size(), 3))
+    {
+        bench("gpu", "texture_upload_pbo_1024", 1, [&] () {
+            int slot;
+            while ((slot = streamer.acquireSlot(false)) == -1)
+            {
+                streamer.processUploads();
+            }
+            memcpy(streamer.getSlotPointer(slot), &texels[0], texels.size());
+            streamer.submit(slot, &texture, Tucano::TextureStreamer::Region(0, 0, 0, size, size, 1));
+            streamer.processUploads();
+            glFinish();
+        });
+    }
+}
+
+static void benchReadback()
+{
+    const int width = 1024, height = 1024;
+    Tucano::Framebuffer fbo(width, height, 1, GL_TEXTURE_2D, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+    std::vector<unsigned char> pixels;
+
+    bench("gpu", "framebuffer_readBuffer_sync", 1, [&] () {
+        fbo.clearAttachments();
+        fbo.readBuffer(0, pixels);
+        sink += pixels[0];
+    });
+
+    // pipelined: the read of the previous frame is fetched while the current one is in flight
+    int previous = -1;
+    bench("gpu", "framebuffer_readBuffer_async", 1, [&] () {
+        fbo.clearAttachments();
+        int ticket = fbo.readBufferAsync(0);
+        if (previous != -1)
+        {
+            const unsigned char* data = (const unsigned char*)fbo.getReadbackData(previous, true);
+            sink += data ? data[0] : 0;
+            fbo.releaseReadback(previous);
+        }
+        previous = ticket;
+    });
+    if (previous != -1)
+    {
+        fbo.releaseReadback(previous);
+    }
+
+    bench("gpu", "framebuffer_saveAsPPM", 1, [&] () {
+        fbo.saveAsPPM("tucano_bench.ppm");
+    });
+    bench("gpu", "framebuffer_saveAsRaw", 1, [&] () {
+        fbo.saveAsRaw("tucano_bench.raw");
+    });
+    Tucano::ImageWriter writer;
+    bench("gpu", "framebuffer_saveAsPPM_writer_thread", 1, [&] () {
+        fbo.saveAsPPM("tucano_bench.ppm", 0, &writer);
+    });
+    writer.wait();
+    remove("tucano_bench.ppm");
+    remove("tucano_bench.raw");
+}
+
+#endif
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc)
+            options.out = argv[++i];
+        else if (arg == "--filter" && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (arg == "--min-time" && i + 1 < argc)
+            options.min_time = atof(argv[++i]);
+        else if (arg == "--baseline" && i + 1 < argc)
+            options.baseline = argv[++i];
+        else if (arg == "--tolerance" && i + 1 < argc)
+            options.tolerance = atof(argv[++i]);
+        else if (arg == "--cpu-only")
+            options.cpu_only = true;
+        else
+        {
+            std::cerr << "usage: tucano_bench [--out results.json] [--filter name] [--cpu-only] [--min-time seconds]"
+                      << " [--baseline previous.json] [--tolerance 0.15]" << std::endl;
+            return -1;
+        }
+    }
+    srand(1);
+
+    benchBounds();
+    benchProjection();
+    benchCulling();
+
+    std::string renderer = "none";
+#ifdef TUCANO_HAS_EGL
+    Tucano::HeadlessContext context;
+    if (!options.cpu_only)
+    {
+        if (context.initialize(64, 64, "", 4, 5))
+        {
+            renderer = (const char*)glGetString(GL_RENDERER);
+            benchUniforms();
+            benchTextureManager();
+            benchTextureUpload();
+            benchReadback();
+        }
+        else
+        {
+            std::cerr << "Warning: no headless context, GPU benchmarks skipped" << std::endl;
+        }
+    }
+#else
+    if (!options.cpu_only)
+    {
+        std::cerr << "Warning: built without EGL, GPU benchmarks skipped" << std::endl;
+    }
+#endif
+
+    if (options.out.empty())
+    {
+        writeJSON(std::cout, renderer);
+    }
+    else
+    {
+        std::ofstream file(options.out.c_str());
+        writeJSON(file, renderer);
+    }
+    if (!options.baseline.empty() && compareBaseline(options.baseline) > 0)
+    {
+        return 1;
+    }
+    return 0;
+}